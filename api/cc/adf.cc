@@ -54,6 +54,13 @@ namespace adf {
 		if (res != ADF_OK) throwAdfError(res);
 	}
 
+	Adf::Adf(const std::string& path)
+	{
+		uint16_t res = adf_open_file(&this->adf, path.c_str(),
+									 ADF_FILE_SEQUENTIAL | ADF_FILE_WILLNEED);
+		if (res != ADF_OK) throwAdfError(res);
+	}
+
 	Adf::~Adf()
 	{
 		adf_free(&this->adf);
@@ -111,6 +118,12 @@ namespace adf {
 		return result;
 	}
 
+	void Adf::save(const std::string& path)
+	{
+		uint16_t res = adf_save_file(&this->adf, path.c_str());
+		if (res != ADF_OK) throwAdfError(res);
+	}
+
 	size_t Adf::size(void) { return size_adf_t(&this->adf); }
 
 } /* namespace adf */
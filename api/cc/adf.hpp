@@ -311,6 +311,7 @@ namespace adf {
 	public:
 		Adf(Header header, uint32_t periodSec);
 		Adf(std::vector<std::byte> bytes);
+		Adf(const std::string& path);
 		~Adf();
 		std::string versionString(void);
 		Version version(void);
@@ -319,5 +320,6 @@ namespace adf {
 		void removeSeries(void);
 		void updateSeries(Series &series, uint64_t time);
 		std::vector<std::byte> marshal(void);
+		void save(const std::string& path);
 	};
 } /* namespace adf */
@@ -25,7 +25,7 @@ package adflib
 /*
 #cgo CFLAGS: -std=c2x
 #cgo CFLAGS: -I/usr/local/include
-#cgo LDFLAGS: -L/usr/local/lib -ladf
+#cgo LDFLAGS: -L/usr/local/lib -ladf -pthread
 #include <adf.h>
 */
 import "C"
@@ -33,6 +33,7 @@ import (
 	"encoding/json"
 	"fmt"
 	"runtime"
+	"unsafe"
 )
 
 var seriesPinner runtime.Pinner = runtime.Pinner{}
@@ -394,6 +395,27 @@ func Unmarshal(bytes []byte) (Adf, *AdfError) {
 	return adf, nil
 }
 
+func OpenFile(path string) (Adf, *AdfError) {
+	var adf Adf
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+	res := C.adf_open_file(&adf.cAdf, cPath, C.ADF_FILE_SEQUENTIAL|C.ADF_FILE_WILLNEED)
+	if res != C.ADF_OK {
+		return Adf{}, getAdfError(uint16(res))
+	}
+	return adf, nil
+}
+
+func (adf *Adf) SaveFile(path string) *AdfError {
+	cPath := C.CString(path)
+	defer C.free(unsafe.Pointer(cPath))
+	res := C.adf_save_file(&adf.cAdf, cPath)
+	if res != C.ADF_OK {
+		return getAdfError(uint16(res))
+	}
+	return nil
+}
+
 func (adf *Adf) SizeBytes() uint32 {
 	return uint32(C.size_adf_t(&adf.cAdf))
 }
@@ -91,6 +91,7 @@ const adflib = Object.freeze({
 	get_UINT_TINY_T_SIZE: exports.get_UINT_TINY_T_SIZE as () => number,
 	get_REAL_T_SIZE: exports.get_REAL_T_SIZE as () => number,
 	get_ADD_T_SIZE: exports.get_ADD_T_SIZE as () => number,
+	get_SERIES_T_SIZE: exports.get_SERIES_T_SIZE as () => number,
 	new_additive: exports.new_additive as (code: number, concentration: number) => pointer,
 	malloc: exports.malloc as (size: number) => pointer,
 	free: exports.free as (obj: pointer) => void,
@@ -131,6 +132,7 @@ export const AdfDatatype = Object.freeze({
 	TINY_INT: adflib.get_UINT_TINY_T_SIZE(),
 	FLOAT: adflib.get_REAL_T_SIZE(),
 	ADDITIVE_T: adflib.get_ADD_T_SIZE(),
+	SERIES_T: adflib.get_SERIES_T_SIZE(),
 });
 
 class AdflibConverter {
@@ -595,7 +597,7 @@ export class Adf {
 		const nSeries = this.getMetadata().sizeSeries;
 		const cSeries = adflib.get_series_list(this.cAdf);
 		for (let i = 0; i < nSeries; i++) {
-			this.series.push(AdflibConverter.fromCSeries(cSeries + (i * 41), this.getHeader(), view));
+			this.series.push(AdflibConverter.fromCSeries(cSeries + (i * AdfDatatype.SERIES_T), this.getHeader(), view));
 		}
 		return this.series;
 	}
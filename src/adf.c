@@ -21,18 +21,29 @@
  */
 
 #include "adf.h"
+#include "alloc.h"
+#include "bswap.h"
+#include "codec.h"
+#include "compare.h"
 #include "crc.h"
 #include "lookup_table.h"
+#include "parallel.h"
+#include "shuffle.h"
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SHIFT1(byte_counter) (byte_counter++)
 #define SHIFT2(byte_counter) (byte_counter += 2)
 #define SHIFT4(byte_counter) (byte_counter += 4)
 #define SHIFT8(byte_counter) (byte_counter += 8)
 
+/* The alignment of the slab, and of each series within it */
+#define ADF_CACHE_LINE 64
+
 #ifdef __ADF_DEBUG__
 #define DEBUG_STR "*** DEBUG *** "
 #define DEBUG_LOG(...) (printf(DEBUG_STR __VA_ARGS__))
@@ -46,6 +57,18 @@ typedef void (*number_bytes_copy)(uint8_t *, const uint8_t *);
 static number_bytes_copy cpy_8_bytes_fn;
 static number_bytes_copy cpy_4_bytes_fn;
 static number_bytes_copy cpy_2_bytes_fn;
+static array_bytes_copy cpy_4_bytes_array_fn;
+static array_shuffle shuffle_4_bytes_array_fn;
+static array_shuffle unshuffle_4_bytes_array_fn;
+
+/* The state of the selection of the functions above, made only once */
+enum {
+	COPY_FNS_UNKNOWN,
+	COPY_FNS_SELECTING,
+	COPY_FNS_SELECTED
+};
+
+static _Atomic int copy_fns_state = COPY_FNS_UNKNOWN;
 
 static bool is_big_endian(void)
 {
@@ -109,6 +132,61 @@ static void from_to_little_endian_2_bytes(uint8_t *dest, const uint8_t *source)
 	*(dest + 1) = *source;
 }
 
+static void select_bytes_copy_fns(void)
+{
+	bool big_endian = is_big_endian();
+	cpy_8_bytes_fn = big_endian
+					 ? &from_to_big_endian_8_bytes
+					 : &from_to_little_endian_8_bytes;
+	cpy_4_bytes_fn = big_endian
+					 ? &from_to_big_endian_4_bytes
+					 : &from_to_little_endian_4_bytes;
+	cpy_2_bytes_fn = big_endian
+					 ? &from_to_big_endian_2_bytes
+					 : &from_to_little_endian_2_bytes;
+	cpy_4_bytes_array_fn = get_4_bytes_array_fn();
+	shuffle_4_bytes_array_fn = get_shuffle_4_bytes_fn();
+	unshuffle_4_bytes_array_fn = get_unshuffle_4_bytes_fn();
+	/* the other kernels are selected too, before any thread is started */
+	get_crc16_fn();
+	get_reals_within_fn();
+}
+
+/*
+ * Every public entry point calls this, so the functions are selected by the
+ * first one only, like the cpu features: the winner publishes them with a
+ * release store, and the acquire load makes them visible to the others.
+ */
+static void init_bytes_copy_fns(void)
+{
+	int expected = COPY_FNS_UNKNOWN;
+
+	if (atomic_load_explicit(&copy_fns_state, memory_order_acquire)
+		== COPY_FNS_SELECTED)
+		return;
+
+	if (atomic_compare_exchange_strong(&copy_fns_state, &expected,
+									   COPY_FNS_SELECTING)) {
+		select_bytes_copy_fns();
+		atomic_store_explicit(&copy_fns_state, COPY_FNS_SELECTED,
+							  memory_order_release);
+	}
+	while (atomic_load_explicit(&copy_fns_state, memory_order_acquire)
+		   != COPY_FNS_SELECTED)
+		;
+}
+
+/*
+ * Converts a whole array of `n` 4-byte numbers (real_t or uint_t) in one
+ * call, and returns the number of bytes that have been copied.
+ */
+static inline size_t cpy_4_bytes_array(uint8_t *dest, const uint8_t *source,
+									   size_t n)
+{
+	cpy_4_bytes_array_fn(dest, source, n);
+	return n * 4;
+}
+
 uint16_t get_hex_version(void) {
 	return __ADF_VERSION__;
 }
@@ -122,13 +200,16 @@ version_t get_adf_version(void)
 	};
 }
 
-size_t size_series_t(adf_t *adf, series_t *series)
+/*
+ * The size of a serialized series depends only on the header and on the
+ * number of its additives.
+ */
+static size_t size_series_bytes(const adf_header_t *header,
+								uint16_t n_soil_add, uint16_t n_atm_add)
 {
-	uint32_t n_chunks = adf->header.n_chunks.val;
-	uint32_t n_wave = adf->header.wave_info.n_wavelength.val;
-	uint32_t n_depth = adf->header.soil_info.n_depth.val;
-	uint16_t n_soil_add = series->n_soil_adds.val;
-	uint16_t n_atm_add = series->n_atm_adds.val;
+	size_t n_chunks = header->n_chunks.val;
+	size_t n_wave = header->wave_info.n_wavelength.val;
+	size_t n_depth = header->soil_info.n_depth.val;
 	return (n_wave * n_chunks * REAL_T_SIZE)    /* light_exposure */
 		   + (n_depth * n_chunks * REAL_T_SIZE)	/* soil_temp_c */
 		   + (n_chunks * REAL_T_SIZE)           /* env_temp_c */
@@ -144,6 +225,505 @@ size_t size_series_t(adf_t *adf, series_t *series)
 		   + UINT_SMALL_T_SIZE;                 /* crc */
 }
 
+/* The fields of a series between its arrays and its additives */
+#define SERIES_FIELDS_SIZE (UINT_TINY_T_SIZE + 2 * REAL_T_SIZE \
+							+ 2 * UINT_SMALL_T_SIZE)
+
+static inline bool are_arrays_encoded(const adf_header_t *header)
+{
+	return header->flags & (ADF_FLAG_XOR_ARRAYS | ADF_FLAG_QUANTIZED_ARRAYS
+							| ADF_FLAG_LZ_ARRAYS | ADF_FLAG_SHUFFLE_ARRAYS);
+}
+
+static inline bool are_arrays_quantized(const adf_header_t *header)
+{
+	return header->flags & ADF_FLAG_QUANTIZED_ARRAYS;
+}
+
+/*
+ * The LZ codec can't be combined with the ones that work on floats, and
+ * unknown flags may stand for codecs of a later version: such a header is
+ * rejected, so the codecs never see it.
+ */
+static inline bool are_codec_flags_valid(const adf_header_t *header)
+{
+	if (header->flags & ~ADF_FLAGS_KNOWN) { return false; }
+	return !(header->flags & ADF_FLAG_LZ_ARRAYS)
+		   || !(header->flags & (ADF_FLAG_XOR_ARRAYS
+								 | ADF_FLAG_QUANTIZED_ARRAYS));
+}
+
+static inline bool are_arrays_lz_compressed(const adf_header_t *header)
+{
+	return header->flags & ADF_FLAG_LZ_ARRAYS;
+}
+
+/* Only the codecs that work on bytes shuffle them first */
+static inline bool are_arrays_shuffled(const adf_header_t *header)
+{
+	return (header->flags & (ADF_FLAG_XOR_ARRAYS | ADF_FLAG_QUANTIZED_ARRAYS
+							 | ADF_FLAG_SHUFFLE_ARRAYS))
+		   == ADF_FLAG_SHUFFLE_ARRAYS;
+}
+
+/* The number of values in the arrays of each series */
+static inline size_t n_array_values(const adf_header_t *header)
+{
+	return (size_t)header->n_chunks.val
+		   * (header->wave_info.n_wavelength.val
+			  + header->soil_info.n_depth.val + 2);
+}
+
+/* A precision of 0 means that the default tolerance is used */
+static inline float real_tolerance(float precision)
+{
+	return precision > 0 ? precision : EPSILON;
+}
+
+/*
+ * The size of a serialized series whose arrays are encoded in `arrays_size`
+ * bytes. The size of the arrays is written before the other fields.
+ */
+static size_t size_encoded_series_bytes(uint16_t n_soil_add,
+										uint16_t n_atm_add, size_t arrays_size)
+{
+	return UINT_T_SIZE                          /* arrays size */
+		   + SERIES_FIELDS_SIZE                 /* pH ... n_atm_adds */
+		   + (ADD_T_SIZE * n_soil_add)          /* soil_additives */
+		   + (ADD_T_SIZE * n_atm_add)           /* atm_additives */
+		   + arrays_size                        /* encoded arrays */
+		   + UINT_T_SIZE                        /* repeated */
+		   + UINT_SMALL_T_SIZE;                 /* crc */
+}
+
+/* The smallest serialized series, i.e. one without additives */
+static size_t min_series_size(const adf_header_t *header)
+{
+	if (are_arrays_encoded(header))
+		return size_encoded_series_bytes(0, 0, 0);
+	return size_series_bytes(header, 0, 0);
+}
+
+/* Like `encode_series_arrays`, with each array quantized by its precision */
+static size_t quantize_series_arrays(uint8_t *dest, const series_t *series,
+									 const adf_header_t *header)
+{
+	const precision_info_t *prec = &header->precision_info;
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	float light_step = real_tolerance(prec->light_exposure_prec.val),
+		  soil_step = real_tolerance(prec->soil_temp_prec.val);
+	quantized_encoder_t encoder;
+
+	quantized_encoder_init(&encoder, dest);
+	for (uint16_t j = 0; j < n_wave; j++)
+		quantized_encode_column(&encoder,
+								(const uint8_t *)(series->light_exposure + j),
+								n_chunks, n_wave, light_step);
+	for (uint16_t j = 0; j < n_depth; j++)
+		quantized_encode_column(&encoder,
+								(const uint8_t *)(series->soil_temp_c + j),
+								n_chunks, n_depth, soil_step);
+	quantized_encode_column(&encoder, (const uint8_t *)series->env_temp_c,
+							n_chunks, 1,
+							real_tolerance(prec->env_temp_prec.val));
+	quantized_encode_column(&encoder, (const uint8_t *)series->water_use_ml,
+							n_chunks, 1,
+							real_tolerance(prec->water_use_prec.val));
+	return quantized_encoder_finish(&encoder);
+}
+
+/* The inverse of `quantize_series_arrays`, into arrays already allocated */
+static bool dequantize_series_arrays(series_t *series,
+									 const adf_header_t *header,
+									 const uint8_t *bytes, size_t size)
+{
+	const precision_info_t *prec = &header->precision_info;
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	float light_step = real_tolerance(prec->light_exposure_prec.val),
+		  soil_step = real_tolerance(prec->soil_temp_prec.val);
+	quantized_decoder_t decoder;
+
+	quantized_decoder_init(&decoder, bytes, size);
+	for (uint16_t j = 0; j < n_wave; j++)
+		quantized_decode_column(&decoder,
+								(uint8_t *)(series->light_exposure + j),
+								n_chunks, n_wave, light_step);
+	for (uint16_t j = 0; j < n_depth; j++)
+		quantized_decode_column(&decoder,
+								(uint8_t *)(series->soil_temp_c + j),
+								n_chunks, n_depth, soil_step);
+	quantized_decode_column(&decoder, (uint8_t *)series->env_temp_c,
+							n_chunks, 1,
+							real_tolerance(prec->env_temp_prec.val));
+	quantized_decode_column(&decoder, (uint8_t *)series->water_use_ml,
+							n_chunks, 1,
+							real_tolerance(prec->water_use_prec.val));
+	return quantized_decoder_finish(&decoder);
+}
+
+#define BLOCK_VALUES (ADF_ARRAYS_BLOCK_SIZE / REAL_T_SIZE)
+
+/* The four arrays of a series, in the order they are marshalled */
+static void get_series_arrays(const series_t *series,
+							  const adf_header_t *header, real_t *arrays[4],
+							  size_t sizes[4])
+{
+	uint32_t n_chunks = header->n_chunks.val;
+
+	arrays[0] = series->light_exposure;
+	sizes[0] = (size_t)n_chunks * header->wave_info.n_wavelength.val;
+	arrays[1] = series->soil_temp_c;
+	sizes[1] = (size_t)n_chunks * header->soil_info.n_depth.val;
+	arrays[2] = series->env_temp_c;
+	sizes[2] = n_chunks;
+	arrays[3] = series->water_use_ml;
+	sizes[3] = n_chunks;
+}
+
+/*
+ * Copies `n` values, starting from the value `first` of the arrays of a
+ * series taken one after the other, into `dest` in ADF byte order.
+ */
+static void gather_arrays(uint8_t *dest, const series_t *series,
+						  const adf_header_t *header, size_t first, size_t n)
+{
+	real_t *arrays[4];
+	size_t sizes[4], length;
+
+	get_series_arrays(series, header, arrays, sizes);
+	for (int k = 0; k < 4 && n > 0; k++) {
+		if (first >= sizes[k]) {
+			first -= sizes[k];
+			continue;
+		}
+		length = sizes[k] - first < n ? sizes[k] - first : n;
+		dest += cpy_4_bytes_array(dest, (const uint8_t *)(arrays[k] + first),
+								  length);
+		n -= length;
+		first = 0;
+	}
+}
+
+/* The inverse of `gather_arrays` */
+static void scatter_arrays(series_t *series, const adf_header_t *header,
+						   const uint8_t *source, size_t first, size_t n)
+{
+	real_t *arrays[4];
+	size_t sizes[4], length;
+
+	get_series_arrays(series, header, arrays, sizes);
+	for (int k = 0; k < 4 && n > 0; k++) {
+		if (first >= sizes[k]) {
+			first -= sizes[k];
+			continue;
+		}
+		length = sizes[k] - first < n ? sizes[k] - first : n;
+		source += cpy_4_bytes_array((uint8_t *)(arrays[k] + first), source,
+									length);
+		n -= length;
+		first = 0;
+	}
+}
+
+/* The number of values of the block that starts from the value `first` */
+static inline size_t block_values(size_t n_values, size_t first)
+{
+	return n_values - first < BLOCK_VALUES ? n_values - first : BLOCK_VALUES;
+}
+
+/*
+ * The buffers of the codecs that work on blocks. They are too large for the
+ * stack of a worker thread, so they are allocated once per series.
+ */
+typedef struct {
+	uint8_t block[ADF_ARRAYS_BLOCK_SIZE];
+	uint8_t shuffled[ADF_ARRAYS_BLOCK_SIZE];
+	uint8_t compressed[LZ_COMPRESS_BOUND(ADF_ARRAYS_BLOCK_SIZE)];
+	uint32_t lz_table[LZ_HASH_SIZE];
+} block_scratch_t;
+
+/*
+ * Like `encode_series_arrays`, with the arrays shuffled in blocks of
+ * ADF_ARRAYS_BLOCK_SIZE bytes, which keep their size.
+ */
+static uint16_t shuffle_series_arrays(uint8_t *dest, const series_t *series,
+									  const adf_header_t *header, size_t *size)
+{
+	size_t n_values = n_array_values(header), n;
+	uint8_t *block;
+
+	*size = n_values * REAL_T_SIZE;
+	if (!dest || n_values == 0) { return ADF_OK; }
+	block = adf_malloc(NULL, ADF_ARRAYS_BLOCK_SIZE);
+	if (!block) { return ADF_RUNTIME_ERROR; }
+	for (size_t first = 0; first < n_values; first += n) {
+		n = block_values(n_values, first);
+		gather_arrays(block, series, header, first, n);
+		shuffle_4_bytes_array_fn(dest + first * REAL_T_SIZE, block, n);
+	}
+	adf_dealloc(NULL, block);
+	return ADF_OK;
+}
+
+/* The inverse of `shuffle_series_arrays`, into arrays already allocated */
+static uint16_t unshuffle_series_arrays(series_t *series,
+										const adf_header_t *header,
+										const uint8_t *bytes, size_t size)
+{
+	size_t n_values = n_array_values(header), n;
+	uint8_t *block;
+
+	if (size != n_values * REAL_T_SIZE) { return ADF_SERIES_CORRUPTED; }
+	if (n_values == 0) { return ADF_OK; }
+	block = adf_malloc(NULL, ADF_ARRAYS_BLOCK_SIZE);
+	if (!block) { return ADF_RUNTIME_ERROR; }
+	for (size_t first = 0; first < n_values; first += n) {
+		n = block_values(n_values, first);
+		unshuffle_4_bytes_array_fn(block, bytes + first * REAL_T_SIZE, n);
+		scatter_arrays(series, header, block, first, n);
+	}
+	adf_dealloc(NULL, block);
+	return ADF_OK;
+}
+
+/*
+ * Like `encode_series_arrays`, with the arrays compressed by the LZ codec
+ * in blocks of ADF_ARRAYS_BLOCK_SIZE bytes, each of them shuffled first if
+ * the header says so.
+ */
+static uint16_t compress_series_arrays(uint8_t *dest, const series_t *series,
+									   const adf_header_t *header,
+									   size_t *size)
+{
+	const uint8_t *stored, *input;
+	const bool shuffle = are_arrays_shuffled(header);
+	size_t n_values = n_array_values(header), byte_c = 0, n, block_size;
+	block_scratch_t *scratch;
+
+	*size = 0;
+	if (n_values == 0) { return ADF_OK; }
+	scratch = adf_malloc(NULL, sizeof(block_scratch_t));
+	if (!scratch) { return ADF_RUNTIME_ERROR; }
+	input = scratch->block;
+	for (size_t first = 0; first < n_values; first += n) {
+		n = block_values(n_values, first);
+		gather_arrays(scratch->block, series, header, first, n);
+		if (shuffle) {
+			shuffle_4_bytes_array_fn(scratch->shuffled, scratch->block, n);
+			input = scratch->shuffled;
+		}
+		block_size = lz_compress(scratch->compressed, input, n * REAL_T_SIZE,
+								 scratch->lz_table);
+		stored = scratch->compressed;
+		if (block_size >= n * REAL_T_SIZE) {
+			block_size = n * REAL_T_SIZE;
+			stored = input;
+		}
+		if (dest) {
+			dest[byte_c] = (uint8_t)(block_size >> 8);
+			dest[byte_c + 1] = (uint8_t)block_size;
+			memcpy(dest + byte_c + UINT_SMALL_T_SIZE, stored, block_size);
+		}
+		byte_c += UINT_SMALL_T_SIZE + block_size;
+	}
+	adf_dealloc(NULL, scratch);
+	*size = byte_c;
+	return ADF_OK;
+}
+
+/* The inverse of `compress_series_arrays`, into arrays already allocated */
+static uint16_t decompress_series_arrays(series_t *series,
+										 const adf_header_t *header,
+										 const uint8_t *bytes, size_t size)
+{
+	const uint8_t *output;
+	const bool shuffle = are_arrays_shuffled(header);
+	size_t n_values = n_array_values(header), byte_c = 0, n, block_size;
+	block_scratch_t *scratch;
+	uint16_t res = ADF_SERIES_CORRUPTED;
+
+	if (n_values == 0) { return size == 0 ? ADF_OK : ADF_SERIES_CORRUPTED; }
+	scratch = adf_malloc(NULL, sizeof(block_scratch_t));
+	if (!scratch) { return ADF_RUNTIME_ERROR; }
+	for (size_t first = 0; first < n_values; first += n) {
+		n = block_values(n_values, first);
+		if (size - byte_c < UINT_SMALL_T_SIZE) { goto free_scratch; }
+		block_size = ((size_t)bytes[byte_c] << 8) | bytes[byte_c + 1];
+		byte_c += UINT_SMALL_T_SIZE;
+		if (block_size > size - byte_c || block_size > n * REAL_T_SIZE)
+			goto free_scratch;
+
+		output = bytes + byte_c;
+		if (block_size < n * REAL_T_SIZE) {
+			if (!lz_decompress(scratch->block, n * REAL_T_SIZE, output,
+							   block_size))
+				goto free_scratch;
+			output = scratch->block;
+		}
+		if (shuffle) {
+			unshuffle_4_bytes_array_fn(scratch->shuffled, output, n);
+			output = scratch->shuffled;
+		}
+		scatter_arrays(series, header, output, first, n);
+		byte_c += block_size;
+	}
+	if (byte_c == size) { res = ADF_OK; }
+
+free_scratch:
+	adf_dealloc(NULL, scratch);
+	return res;
+}
+
+/*
+ * Encodes the arrays of a series by the codec of the header, which is the
+ * XOR one, one column at a time (i.e. along the chunk axis), unless another
+ * takes precedence. The number of bytes written is returned in `size`. If
+ * `dest` is NULL, the size is computed without writing anything. It returns
+ * ADF_RUNTIME_ERROR if the buffers of a block codec can't be allocated.
+ */
+static uint16_t encode_series_arrays(uint8_t *dest, const series_t *series,
+									 const adf_header_t *header, size_t *size)
+{
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	xor_encoder_t encoder;
+
+	if (are_arrays_quantized(header)) {
+		*size = quantize_series_arrays(dest, series, header);
+		return ADF_OK;
+	}
+	if (are_arrays_lz_compressed(header))
+		return compress_series_arrays(dest, series, header, size);
+	if (are_arrays_shuffled(header))
+		return shuffle_series_arrays(dest, series, header, size);
+	xor_encoder_init(&encoder, dest);
+	for (uint16_t j = 0; j < n_wave; j++)
+		xor_encode_column(&encoder,
+						  (const uint8_t *)(series->light_exposure + j),
+						  n_chunks, n_wave);
+	for (uint16_t j = 0; j < n_depth; j++)
+		xor_encode_column(&encoder, (const uint8_t *)(series->soil_temp_c + j),
+						  n_chunks, n_depth);
+	xor_encode_column(&encoder, (const uint8_t *)series->env_temp_c,
+					  n_chunks, 1);
+	xor_encode_column(&encoder, (const uint8_t *)series->water_use_ml,
+					  n_chunks, 1);
+	*size = xor_encoder_finish(&encoder);
+	return ADF_OK;
+}
+
+/*
+ * The inverse of `encode_series_arrays`, into arrays already allocated. It
+ * returns ADF_SERIES_CORRUPTED if the bytes are malformed.
+ */
+static uint16_t decode_series_arrays(series_t *series,
+									 const adf_header_t *header,
+									 const uint8_t *bytes, size_t size)
+{
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	xor_decoder_t decoder;
+
+	if (are_arrays_quantized(header))
+		return dequantize_series_arrays(series, header, bytes, size)
+			   ? ADF_OK : ADF_SERIES_CORRUPTED;
+	if (are_arrays_lz_compressed(header))
+		return decompress_series_arrays(series, header, bytes, size);
+	if (are_arrays_shuffled(header))
+		return unshuffle_series_arrays(series, header, bytes, size);
+	xor_decoder_init(&decoder, bytes, size);
+	for (uint16_t j = 0; j < n_wave; j++)
+		xor_decode_column(&decoder, (uint8_t *)(series->light_exposure + j),
+						  n_chunks, n_wave);
+	for (uint16_t j = 0; j < n_depth; j++)
+		xor_decode_column(&decoder, (uint8_t *)(series->soil_temp_c + j),
+						  n_chunks, n_depth);
+	xor_decode_column(&decoder, (uint8_t *)series->env_temp_c, n_chunks, 1);
+	xor_decode_column(&decoder, (uint8_t *)series->water_use_ml, n_chunks, 1);
+	return xor_decoder_finish(&decoder) ? ADF_OK : ADF_SERIES_CORRUPTED;
+}
+
+/* An upper bound of the size of the encoded arrays of any series */
+static size_t encoded_arrays_bound(const adf_header_t *header)
+{
+	size_t n_values = n_array_values(header);
+
+	if (are_arrays_quantized(header))
+		return quantized_encoded_bound(n_values);
+	if (are_arrays_lz_compressed(header))
+		return n_values * REAL_T_SIZE
+			   + (n_values / BLOCK_VALUES + 1) * UINT_SMALL_T_SIZE;
+	if (are_arrays_shuffled(header))
+		return n_values * REAL_T_SIZE;
+	return xor_encoded_bound(n_values);
+}
+
+static size_t serialized_series_size(const adf_header_t *header,
+									 const series_t *series)
+{
+	size_t arrays_size = 0;
+
+	if (!are_arrays_encoded(header))
+		return size_series_bytes(header, series->n_soil_adds.val,
+								 series->n_atm_adds.val);
+	/*
+	 * A series without arrays can't be marshalled anyway. If they can't be
+	 * measured, the bound keeps the byte array large enough for them.
+	 */
+	if (series->light_exposure && series->soil_temp_c && series->env_temp_c
+		&& series->water_use_ml
+		&& encode_series_arrays(NULL, series, header, &arrays_size) != ADF_OK)
+		arrays_size = encoded_arrays_bound(header);
+	return size_encoded_series_bytes(series->n_soil_adds.val,
+									 series->n_atm_adds.val, arrays_size);
+}
+
+size_t size_series_t(adf_t *adf, series_t *series)
+{
+	/* the LZ codec needs the arrays in ADF byte order */
+	init_bytes_copy_fns();
+	return serialized_series_size(&adf->header, series);
+}
+
+/*
+ * Returns the size of the serialized series starting at `bytes`, which
+ * depends on its additive counters. Those counters are returned too.
+ */
+/* The offset of the additive counters from the beginning of a series */
+static size_t series_counters_offset(const adf_header_t *header)
+{
+	/* encoded arrays are moved after the additives, their size comes first */
+	if (are_arrays_encoded(header))
+		return UINT_T_SIZE + SERIES_FIELDS_SIZE - 2 * UINT_SMALL_T_SIZE;
+	/* the counters are followed by the additives, `repeated` and the crc */
+	return size_series_bytes(header, 0, 0) - UINT_SMALL_T_SIZE - UINT_T_SIZE
+		   - 2 * UINT_SMALL_T_SIZE;
+}
+
+static size_t peek_series_size(const adf_header_t *header,
+							   const uint8_t *bytes, uint_small_t *n_soil_adds,
+							   uint_small_t *n_atm_adds)
+{
+	size_t adds_offset = series_counters_offset(header);
+	uint_t arrays_size;
+
+	cpy_2_bytes_fn(n_soil_adds->bytes, (bytes + adds_offset));
+	cpy_2_bytes_fn(n_atm_adds->bytes,
+				   (bytes + adds_offset + UINT_SMALL_T_SIZE));
+	if (!are_arrays_encoded(header))
+		return size_series_bytes(header, n_soil_adds->val, n_atm_adds->val);
+
+	cpy_4_bytes_fn(arrays_size.bytes, bytes);
+	return size_encoded_series_bytes(n_soil_adds->val, n_atm_adds->val,
+									 arrays_size.val);
+}
+
 size_t size_medatata_t(adf_meta_t *metadata)
 {
 	uint16_t add_codes_size = metadata->n_additives.val;
@@ -182,9 +762,47 @@ size_t size_header(void)
 		   + REAL_T_SIZE           /* env_temp_prec  */
 		   + REAL_T_SIZE           /* additive_prec  */
 		   + UINT_T_SIZE           /* n_chunks */
+		   + UINT_TINY_T_SIZE      /* flags */
 		   + UINT_SMALL_T_SIZE;    /* crc */
 }
 
+/* The size of the header written by the given version */
+static size_t header_size_of(uint16_t version)
+{
+	if (version < ADF_HEADER_FLAGS_VERSION)
+		return size_header() - UINT_TINY_T_SIZE;
+	return size_header();
+}
+
+/*
+ * The size of the serialized header at `bytes`, which depends on its
+ * version, or 0 if it doesn't fit in `size` bytes.
+ */
+static size_t peek_header_size(const uint8_t *bytes, size_t size)
+{
+	uint_small_t version;
+	size_t header_size;
+
+	if (size < UINT_T_SIZE + UINT_SMALL_T_SIZE) { return 0; }
+	cpy_2_bytes_fn(version.bytes, (bytes + UINT_T_SIZE));
+	header_size = header_size_of(version.val);
+	return size < header_size ? 0 : header_size;
+}
+
+/* Each entry of the series index holds the offset and the start of a series */
+#define SERIES_INDEX_ENTRY_SIZE (2 * UINT_BIG_T_SIZE)
+
+/*
+ * The size of the series index, crc included, or 0 if the header doesn't ask
+ * for it.
+ */
+static size_t size_series_index(const adf_header_t *header,
+								uint32_t size_series)
+{
+	if (!(header->flags & ADF_FLAG_SERIES_INDEX)) { return 0; }
+	return (size_t)size_series * SERIES_INDEX_ENTRY_SIZE + UINT_SMALL_T_SIZE;
+}
+
 size_t size_adf_t(adf_t *data)
 {
 	const size_t head_metadata_size = size_header()
@@ -193,51 +811,38 @@ size_t size_adf_t(adf_t *data)
 	for (uint32_t i = 0, l = data->metadata.size_series.val; i < l; i++) {
 		series_size += size_series_t(data, data->series + i);
 	}
-	return head_metadata_size + series_size;
+	return head_metadata_size + series_size
+		   + size_series_index(&data->header, data->metadata.size_series.val);
 }
 
 uint8_t *adf_bytes_alloc(adf_t *data) {
-	return (uint8_t *)malloc(size_adf_t(data));
+	return (uint8_t *)adf_malloc(NULL, size_adf_t(data));
 }
 
 void adf_bytes_free(uint8_t *bytes) {
-	free(bytes);
+	adf_dealloc(NULL, bytes);
 	bytes = NULL;
 }
 
-uint16_t marshal(uint8_t *bytes, adf_t *data)
+/* Writes the header, crc included. It's always `size_header()` bytes. */
+static size_t marshal_header(uint8_t *bytes, const adf_header_t *header)
 {
+	/* the layout is always the one of this version */
+	const uint_small_t version = { __ADF_VERSION__ };
 	size_t byte_c = 0;
 	uint_small_t crc_16bits;
-	adf_header_t *header;
-	wavelength_info_t *wave_info;
-	soil_depth_info_t *soil_info;
-	reduction_info_t *red_info;
-	precision_info_t *prec_info;
-	adf_meta_t *metadata;
-	series_t *current;
-	cpy_8_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_8_bytes
-					 : &from_to_little_endian_8_bytes;
-	cpy_4_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_4_bytes
-					 : &from_to_little_endian_4_bytes;
-	cpy_2_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_2_bytes
-					 : &from_to_little_endian_2_bytes;
-
-	DEBUG_LOG("------- marshal -------\n");
-
-	if (!bytes || !data) { return ADF_RUNTIME_ERROR; }
+	const wavelength_info_t *wave_info;
+	const soil_depth_info_t *soil_info;
+	const reduction_info_t *red_info;
+	const precision_info_t *prec_info;
 
-	header = &data->header;
 	wave_info = &header->wave_info;
 	soil_info = &header->soil_info;
 	red_info = &header->reduction_info;
 	prec_info = &header->precision_info;
 	cpy_4_bytes_fn((bytes + byte_c), header->signature.bytes);
 	SHIFT4(byte_c);
-	cpy_2_bytes_fn(bytes + byte_c, header->version.bytes);
+	cpy_2_bytes_fn(bytes + byte_c, version.bytes);
 	SHIFT2(byte_c);
 	*(bytes + byte_c) = header->farming_tec;
 	SHIFT1(byte_c);
@@ -283,13 +888,20 @@ uint16_t marshal(uint8_t *bytes, adf_t *data)
 	SHIFT4(byte_c);
 	cpy_4_bytes_fn((bytes + byte_c), header->n_chunks.bytes);
 	SHIFT4(byte_c);
+	*(bytes + byte_c) = header->flags;
+	SHIFT1(byte_c);
 	crc_16bits.val = crc16(bytes, byte_c);
 	cpy_2_bytes_fn((bytes + byte_c), crc_16bits.bytes);
 	SHIFT2(byte_c);
+	return byte_c;
+}
 
-	DEBUG_LOG("Marshal header done\n");
+/* Writes the fixed-size fields of the metadata, i.e. all but the codes */
+static size_t marshal_metadata_fields(uint8_t *bytes,
+									  const adf_meta_t *metadata)
+{
+	size_t byte_c = 0;
 
-	metadata = &data->metadata;
 	cpy_4_bytes_fn((bytes + byte_c), metadata->size_series.bytes);
 	SHIFT4(byte_c);
 	cpy_4_bytes_fn((bytes + byte_c), metadata->period_sec.bytes);
@@ -300,112 +912,593 @@ uint16_t marshal(uint8_t *bytes, adf_t *data)
 	SHIFT8(byte_c);
 	cpy_2_bytes_fn((bytes + byte_c), metadata->n_additives.bytes);
 	SHIFT2(byte_c);
+	return byte_c;
+}
 
-	for (uint16_t i = 0, l = metadata->n_additives.val; i < l;
-		 i++, byte_c += 4) {
-		cpy_4_bytes_fn((bytes + byte_c), metadata->additive_codes[i].bytes);
-	}
+/*
+ * Writes the header and the metadata, and returns the number of bytes
+ * written.
+ */
+static size_t marshal_head(uint8_t *bytes, const adf_t *data)
+{
+	const adf_meta_t *metadata = &data->metadata;
+	uint_small_t crc_16bits;
+	size_t byte_c;
+
+	byte_c = marshal_header(bytes, &data->header);
+
+	DEBUG_LOG("Marshal header done\n");
+
+	byte_c += marshal_metadata_fields((bytes + byte_c), metadata);
+	byte_c += cpy_4_bytes_array((bytes + byte_c),
+								(const uint8_t *)metadata->additive_codes,
+								metadata->n_additives.val);
 
 	crc_16bits.val = crc16((bytes + size_header()), byte_c - size_header());
 	cpy_2_bytes_fn((bytes + byte_c), crc_16bits.bytes);
 	SHIFT2(byte_c);
 
 	DEBUG_LOG("Marshal metadata done\n");
+	return byte_c;
+}
+
+/* Writes the fields of a series between its arrays and its additives */
+static size_t marshal_series_fields(uint8_t *bytes, const series_t *series)
+{
+	size_t byte_c = 0;
+
+	*(bytes + byte_c) = series->pH;
+	SHIFT1(byte_c);
+	cpy_4_bytes_fn((bytes + byte_c), series->p_bar.bytes);
+	SHIFT4(byte_c);
+	cpy_4_bytes_fn((bytes + byte_c), series->soil_density_kg_m3.bytes);
+	SHIFT4(byte_c);
+	cpy_2_bytes_fn((bytes + byte_c), series->n_soil_adds.bytes);
+	SHIFT2(byte_c);
+	cpy_2_bytes_fn((bytes + byte_c), series->n_atm_adds.bytes);
+	SHIFT2(byte_c);
+	return byte_c;
+}
+
+static size_t marshal_additive(uint8_t *bytes, const additive_t *additive)
+{
+	size_t byte_c = 0;
+
+	cpy_2_bytes_fn((bytes + byte_c), additive->code_idx.bytes);
+	SHIFT2(byte_c);
+	cpy_4_bytes_fn((bytes + byte_c), additive->concentration.bytes);
+	SHIFT4(byte_c);
+	return byte_c;
+}
 
-	uint32_t n_iter = metadata->size_series.val;
+/*
+ * Writes a series of the adf structure starting at `bytes`, and returns the
+ * number of bytes written in `series_size`. If the arrays are encoded and
+ * `arrays` is not NULL, they have already been encoded there, in
+ * `arrays_size` bytes; otherwise they are encoded in place.
+ */
+static uint16_t marshal_series(uint8_t *bytes, const series_t *current,
+							   const adf_header_t *header,
+							   const uint8_t *arrays, size_t arrays_size,
+							   size_t *series_size)
+{
 	uint32_t n_chunks = header->n_chunks.val;
 	uint16_t n_wave = header->wave_info.n_wavelength.val;
 	uint16_t n_depth = header->soil_info.n_depth.val;
-	for (uint32_t i = 0; i < n_iter; i++) {
-		current = data->series + i;
-		size_t starting_byte = byte_c;
-		if (!current->light_exposure) { return ADF_RUNTIME_ERROR; }
-		for (uint32_t w = 0; w < n_chunks * n_wave; w++, byte_c += 4) {
-			cpy_4_bytes_fn((bytes + byte_c), current->light_exposure[w].bytes);
-		}
-		if (!current->soil_temp_c) { return ADF_RUNTIME_ERROR; }
-		for (uint32_t t = 0; t < n_chunks * n_depth; t++, byte_c += 4) {
-			cpy_4_bytes_fn((bytes + byte_c), current->soil_temp_c[t].bytes);
-		}
-		if (!current->env_temp_c) { return ADF_RUNTIME_ERROR; }
-		for (uint32_t temp_i = 0; temp_i < n_chunks;
-			 temp_i++, byte_c += 4) {
-			cpy_4_bytes_fn((bytes + byte_c),
-						   current->env_temp_c[temp_i].bytes);
-		}
-		if (!current->water_use_ml) { return ADF_RUNTIME_ERROR; }
-		for (uint32_t w_i = 0; w_i < n_chunks;
-			 w_i++, byte_c += 4) {
-			cpy_4_bytes_fn((bytes + byte_c), current->water_use_ml[w_i].bytes);
-		}
-		*(bytes + byte_c) = current->pH;
-		SHIFT1(byte_c);
-		cpy_4_bytes_fn((bytes + byte_c), current->p_bar.bytes);
-		SHIFT4(byte_c);
-		cpy_4_bytes_fn((bytes + byte_c), current->soil_density_kg_m3.bytes);
+	uint_small_t crc_16bits;
+	uint_t encoded_size;
+	size_t byte_c = 0;
+	uint16_t res;
+
+	if (!current->light_exposure || !current->soil_temp_c
+		|| !current->env_temp_c || !current->water_use_ml)
+		return ADF_RUNTIME_ERROR;
+
+	if (are_arrays_encoded(header)) {
+		/* the size of the arrays is written once they are encoded */
 		SHIFT4(byte_c);
-		cpy_2_bytes_fn((bytes + byte_c), current->n_soil_adds.bytes);
-		SHIFT2(byte_c);
-		cpy_2_bytes_fn((bytes + byte_c), current->n_atm_adds.bytes);
-		SHIFT2(byte_c);
-		for (uint16_t j = 0, l = current->n_soil_adds.val; j < l; j++) {
-			cpy_2_bytes_fn((bytes + byte_c),
-						   current->soil_additives[j].code_idx.bytes);
-			SHIFT2(byte_c);
-			cpy_4_bytes_fn((bytes + byte_c),
-						   current->soil_additives[j].concentration.bytes);
-			SHIFT4(byte_c);
+	}
+	else {
+		byte_c += cpy_4_bytes_array((bytes + byte_c),
+									(const uint8_t *)current->light_exposure,
+									n_chunks * n_wave);
+		byte_c += cpy_4_bytes_array((bytes + byte_c),
+									(const uint8_t *)current->soil_temp_c,
+									n_chunks * n_depth);
+		byte_c += cpy_4_bytes_array((bytes + byte_c),
+									(const uint8_t *)current->env_temp_c,
+									n_chunks);
+		byte_c += cpy_4_bytes_array((bytes + byte_c),
+									(const uint8_t *)current->water_use_ml,
+									n_chunks);
+	}
+	byte_c += marshal_series_fields((bytes + byte_c), current);
+	for (uint16_t j = 0, l = current->n_soil_adds.val; j < l; j++)
+		byte_c += marshal_additive((bytes + byte_c),
+								   current->soil_additives + j);
+	for (uint16_t j = 0, l = current->n_atm_adds.val; j < l; j++)
+		byte_c += marshal_additive((bytes + byte_c),
+								   current->atm_additives + j);
+	if (are_arrays_encoded(header)) {
+		if (arrays) {
+			memcpy((bytes + byte_c), arrays, arrays_size);
 		}
-		for (uint16_t j = 0, l = current->n_atm_adds.val; j < l; j++) {
-			cpy_2_bytes_fn((bytes + byte_c),
-						   current->atm_additives[j].code_idx.bytes);
-			SHIFT2(byte_c);
-			cpy_4_bytes_fn((bytes + byte_c),
-						   current->atm_additives[j].concentration.bytes);
-			SHIFT4(byte_c);
+		else {
+			res = encode_series_arrays((bytes + byte_c), current, header,
+									   &arrays_size);
+			if (res != ADF_OK) { return res; }
 		}
-		cpy_4_bytes_fn((bytes + byte_c), current->repeated.bytes);
-		SHIFT4(byte_c);
+		encoded_size.val = arrays_size;
+		cpy_4_bytes_fn(bytes, encoded_size.bytes);
+		byte_c += encoded_size.val;
+	}
+	cpy_4_bytes_fn((bytes + byte_c), current->repeated.bytes);
+	SHIFT4(byte_c);
 
-		crc_16bits.val = crc16((bytes + starting_byte), byte_c - starting_byte);
-		cpy_2_bytes_fn((bytes + byte_c), crc_16bits.bytes);
-		SHIFT2(byte_c);
+	crc_16bits.val = crc16(bytes, byte_c);
+	cpy_2_bytes_fn((bytes + byte_c), crc_16bits.bytes);
+	SHIFT2(byte_c);
 
-		DEBUG_LOG("Marshal series #%u done\n", i);
-	}
+	*series_size = byte_c;
 	return ADF_OK;
 }
 
-uint16_t unmarshal(adf_t *adf, const uint8_t *bytes)
+static size_t marshal_index_entry(uint8_t *bytes, uint64_t offset,
+								  uint64_t start)
+{
+	uint_big_t field = { offset };
+
+	cpy_8_bytes_fn(bytes, field.bytes);
+	field.val = start;
+	cpy_8_bytes_fn((bytes + UINT_BIG_T_SIZE), field.bytes);
+	return SERIES_INDEX_ENTRY_SIZE;
+}
+
+/*
+ * Writes the series index, if the header asks for it, at `bytes`, right
+ * after the series of the marshalled `object`. `offset` is where the first
+ * series starts.
+ */
+static void marshal_series_index(uint8_t *bytes, const uint8_t *object,
+								 const adf_t *data, size_t offset)
 {
-	adf_header_t *header;
-	wavelength_info_t *wave_info;
-	soil_depth_info_t *soil_info;
-	reduction_info_t *red_info;
-	precision_info_t *prec_info;
+	uint_small_t crc_16bits, n_soil_adds, n_atm_adds;
+	uint64_t start = 0;
 	size_t byte_c = 0;
-	uint_small_t expected_crc;
-	uint16_t header_crc, meta_crc, series_crc;
-	uint32_t n_series = 0, n_iter, n_chunks, n_waves, n_depth;
-	cpy_8_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_8_bytes
-					 : &from_to_little_endian_8_bytes;
-	cpy_4_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_4_bytes
-					 : &from_to_little_endian_4_bytes;
-	cpy_2_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_2_bytes
-					 : &from_to_little_endian_2_bytes;
 
-	DEBUG_LOG("------- unmarshal -------\n");
+	if (!(data->header.flags & ADF_FLAG_SERIES_INDEX)) { return; }
 
-	if (!bytes || !adf) { return ADF_RUNTIME_ERROR; }
+	/* the series are already written: their size is read back */
+	for (uint32_t i = 0, l = data->metadata.size_series.val; i < l; i++) {
+		byte_c += marshal_index_entry((bytes + byte_c), offset, start);
+		offset += peek_series_size(&data->header, (object + offset),
+								   &n_soil_adds, &n_atm_adds);
+		start += data->series[i].repeated.val;
+	}
+	crc_16bits.val = crc16(bytes, byte_c);
+	cpy_2_bytes_fn((bytes + byte_c), crc_16bits.bytes);
+}
+
+uint16_t marshal(uint8_t *bytes, adf_t *data)
+{
+	size_t byte_c, head_size, series_size;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- marshal -------\n");
+
+	if (!bytes || !data) { return ADF_RUNTIME_ERROR; }
+	if (!are_codec_flags_valid(&data->header)) { return ADF_RUNTIME_ERROR; }
+
+	byte_c = head_size = marshal_head(bytes, data);
+	for (uint32_t i = 0, l = data->metadata.size_series.val; i < l; i++) {
+		res = marshal_series((bytes + byte_c), data->series + i,
+							 &data->header, NULL, 0, &series_size);
+		if (res != ADF_OK) { return res; }
+		byte_c += series_size;
+
+		DEBUG_LOG("Marshal series #%u done\n", i);
+	}
+	marshal_series_index((bytes + byte_c), bytes, data, head_size);
+	return ADF_OK;
+}
+
+typedef struct {
+	uint8_t *bytes;
+	const adf_t *data;
+	const size_t *offsets;
+
+	/* The arrays of each series, if encoded, and their size */
+	uint8_t **arrays;
+	size_t *arrays_sizes;
+	first_error_t error;
+} marshal_job_t;
+
+/*
+ * Encodes the arrays of each series into a buffer of its own, so that they
+ * are encoded once: their size gives the offsets, then they are copied.
+ */
+static void encode_series_range(void *ctx, uint32_t begin, uint32_t end)
+{
+	marshal_job_t *job = ctx;
+	const adf_header_t *header = &job->data->header;
+	const size_t bound = encoded_arrays_bound(header);
+	const series_t *current;
+	uint8_t *arrays;
+	uint16_t res;
+	size_t size;
+
+	for (uint32_t i = begin; i < end; i++) {
+		if (first_error_before(&job->error, i)) { return; }
+		current = job->data->series + i;
+		if (!current->light_exposure || !current->soil_temp_c
+			|| !current->env_temp_c || !current->water_use_ml) {
+			first_error_set(&job->error, i, ADF_RUNTIME_ERROR);
+			return;
+		}
+		job->arrays[i] = adf_malloc(NULL, bound);
+		if (bound > 0 && !job->arrays[i]) {
+			first_error_set(&job->error, i, ADF_RUNTIME_ERROR);
+			return;
+		}
+		res = encode_series_arrays(job->arrays[i], current, header, &size);
+		if (res != ADF_OK) {
+			first_error_set(&job->error, i, res);
+			return;
+		}
+		job->arrays_sizes[i] = size;
+
+		/* only the bytes taken by the arrays are kept */
+		arrays = size > 0 ? adf_realloc(NULL, job->arrays[i], size) : NULL;
+		if (arrays) { job->arrays[i] = arrays; }
+	}
+}
+
+static void marshal_series_range(void *ctx, uint32_t begin, uint32_t end)
+{
+	marshal_job_t *job = ctx;
+	size_t series_size;
+	uint16_t res;
+
+	for (uint32_t i = begin; i < end; i++) {
+		res = marshal_series((job->bytes + job->offsets[i]),
+							 job->data->series + i, &job->data->header,
+							 job->arrays ? job->arrays[i] : NULL,
+							 job->arrays ? job->arrays_sizes[i] : 0,
+							 &series_size);
+		if (res != ADF_OK) {
+			first_error_set(&job->error, i, res);
+			return;
+		}
+	}
+}
+
+static void encoded_arrays_free(marshal_job_t *job, uint32_t n_iter)
+{
+	if (job->arrays) {
+		for (uint32_t i = 0; i < n_iter; i++)
+			adf_dealloc(NULL, job->arrays[i]);
+	}
+	adf_dealloc(NULL, job->arrays);
+	adf_dealloc(NULL, job->arrays_sizes);
+}
+
+uint16_t marshal_parallel(uint8_t *bytes, adf_t *data, uint32_t n_threads)
+{
+	marshal_job_t job = { .bytes = bytes, .data = data };
+	size_t byte_c, head_size, *offsets;
+	const series_t *current;
+	uint32_t n_iter, error_idx, grain;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- marshal_parallel -------\n");
+
+	if (!bytes || !data) { return ADF_RUNTIME_ERROR; }
+	if (!are_codec_flags_valid(&data->header)) { return ADF_RUNTIME_ERROR; }
+
+	n_iter = data->metadata.size_series.val;
+	n_threads = parallel_n_threads(n_threads);
+	grain = n_iter / (n_threads * 8) + 1;
+	first_error_init(&job.error);
+
+	/* encoded arrays are measured by encoding them, so it's done once */
+	if (are_arrays_encoded(&data->header) && n_iter > 0) {
+		job.arrays = adf_calloc(NULL, n_iter, sizeof(uint8_t *));
+		job.arrays_sizes = adf_malloc(NULL, n_iter * sizeof(size_t));
+		if (!job.arrays || !job.arrays_sizes) {
+			encoded_arrays_free(&job, n_iter);
+			return ADF_RUNTIME_ERROR;
+		}
+		parallel_for(n_iter, grain, n_threads, &encode_series_range, &job);
+		if (first_error_get(&job.error, &error_idx, &res)) {
+			encoded_arrays_free(&job, n_iter);
+			return res;
+		}
+	}
+
+	offsets = adf_malloc(NULL, n_iter * sizeof(size_t));
+	if (n_iter > 0 && !offsets) {
+		encoded_arrays_free(&job, n_iter);
+		return ADF_RUNTIME_ERROR;
+	}
+
+	/* the size of each series is known, so is the offset where it starts */
+	byte_c = head_size = marshal_head(bytes, data);
+	for (uint32_t i = 0; i < n_iter; i++) {
+		current = data->series + i;
+		offsets[i] = byte_c;
+		if (job.arrays)
+			byte_c += size_encoded_series_bytes(current->n_soil_adds.val,
+												current->n_atm_adds.val,
+												job.arrays_sizes[i]);
+		else
+			byte_c += size_series_bytes(&data->header,
+										current->n_soil_adds.val,
+										current->n_atm_adds.val);
+	}
+
+	job.offsets = offsets;
+	parallel_for(n_iter, grain, n_threads, &marshal_series_range, &job);
+	adf_dealloc(NULL, offsets);
+	encoded_arrays_free(&job, n_iter);
+
+	if (first_error_get(&job.error, &error_idx, &res)) { return res; }
+	/* the index is built from the series, once they are all written */
+	marshal_series_index((bytes + byte_c), bytes, data, head_size);
+	return ADF_OK;
+}
+
+/* Large enough for the biggest fixed-size section, i.e. the header */
+#define STREAM_SCRATCH_SIZE 128
+
+uint16_t adf_writer_init(adf_writer_t *writer, adf_write_fn write, void *ctx,
+						 size_t buffer_size)
+{
+	if (!writer || !write) { return ADF_RUNTIME_ERROR; }
+
+	if (buffer_size == 0) { buffer_size = ADF_WRITER_BUFFER_SIZE; }
+	if (buffer_size < ADF_CACHE_LINE) { buffer_size = ADF_CACHE_LINE; }
+	writer->write = write;
+	writer->ctx = ctx;
+	writer->buffer_size = buffer_size;
+	writer->used = 0;
+	writer->buffer = adf_malloc(NULL, buffer_size);
+	if (!writer->buffer) { return ADF_RUNTIME_ERROR; }
+	return ADF_OK;
+}
+
+void adf_writer_free(adf_writer_t *writer)
+{
+	adf_dealloc(NULL, writer->buffer);
+	writer->buffer = NULL;
+	writer->buffer_size = 0;
+	writer->used = 0;
+}
+
+static bool writer_flush(adf_writer_t *writer)
+{
+	if (writer->used > 0
+		&& !writer->write(writer->ctx, writer->buffer, writer->used))
+		return false;
+	writer->used = 0;
+	return true;
+}
+
+/* Appends bytes already in the ADF byte order, and extends the crc */
+static bool writer_put(adf_writer_t *writer, const uint8_t *bytes,
+					   size_t size, uint16_t *crc)
+{
+	size_t n;
+
+	*crc = crc16_update(*crc, bytes, size);
+	while (size > 0) {
+		if (writer->used == writer->buffer_size && !writer_flush(writer))
+			return false;
+		n = writer->buffer_size - writer->used;
+		if (n > size) { n = size; }
+		memcpy((writer->buffer + writer->used), bytes, n);
+		writer->used += n;
+		bytes += n;
+		size -= n;
+	}
+	return true;
+}
+
+/*
+ * Appends `n` 4-byte values, converting them to the ADF byte order straight
+ * into the buffer, and extends the crc.
+ */
+static bool writer_put_array(adf_writer_t *writer, const uint8_t *source,
+							 size_t n, uint16_t *crc)
+{
+	size_t n_fit;
+	uint8_t *dest;
+
+	while (n > 0) {
+		n_fit = (writer->buffer_size - writer->used) / 4;
+		if (n_fit == 0) {
+			if (!writer_flush(writer)) { return false; }
+			continue;
+		}
+		if (n_fit > n) { n_fit = n; }
+		dest = writer->buffer + writer->used;
+		writer->used += cpy_4_bytes_array(dest, source, n_fit);
+		*crc = crc16_update(*crc, dest, n_fit * 4);
+		source += n_fit * 4;
+		n -= n_fit;
+	}
+	return true;
+}
+
+static bool writer_put_crc(adf_writer_t *writer, uint16_t crc)
+{
+	uint_small_t crc_16bits = { crc };
+	uint8_t bytes[UINT_SMALL_T_SIZE];
+	uint16_t ignored = CRC16_INIT;
+
+	cpy_2_bytes_fn(bytes, crc_16bits.bytes);
+	return writer_put(writer, bytes, UINT_SMALL_T_SIZE, &ignored);
+}
+
+/*
+ * Streams a series. If its arrays are encoded, they are encoded into
+ * `arrays` first, which must be large enough for any series.
+ */
+static bool stream_series(adf_writer_t *writer, const series_t *series,
+						  const adf_header_t *header, uint8_t *arrays)
+{
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	uint8_t scratch[STREAM_SCRATCH_SIZE];
+	uint16_t crc = CRC16_INIT;
+	uint_t arrays_size;
+	size_t size;
+
+	if (are_arrays_encoded(header)) {
+		if (encode_series_arrays(arrays, series, header, &size) != ADF_OK)
+			return false;
+		arrays_size.val = size;
+		cpy_4_bytes_fn(scratch, arrays_size.bytes);
+		if (!writer_put(writer, scratch, UINT_T_SIZE, &crc)) { return false; }
+	}
+	else if (!writer_put_array(writer,
+							   (const uint8_t *)series->light_exposure,
+							   n_chunks * n_wave, &crc)
+			 || !writer_put_array(writer,
+								  (const uint8_t *)series->soil_temp_c,
+								  n_chunks * n_depth, &crc)
+			 || !writer_put_array(writer, (const uint8_t *)series->env_temp_c,
+								  n_chunks, &crc)
+			 || !writer_put_array(writer,
+								  (const uint8_t *)series->water_use_ml,
+								  n_chunks, &crc)) {
+		return false;
+	}
+
+	size = marshal_series_fields(scratch, series);
+	if (!writer_put(writer, scratch, size, &crc)) { return false; }
+	for (uint16_t j = 0, l = series->n_soil_adds.val; j < l; j++) {
+		size = marshal_additive(scratch, series->soil_additives + j);
+		if (!writer_put(writer, scratch, size, &crc)) { return false; }
+	}
+	for (uint16_t j = 0, l = series->n_atm_adds.val; j < l; j++) {
+		size = marshal_additive(scratch, series->atm_additives + j);
+		if (!writer_put(writer, scratch, size, &crc)) { return false; }
+	}
+	if (are_arrays_encoded(header)
+		&& !writer_put(writer, arrays, arrays_size.val, &crc))
+		return false;
+	cpy_4_bytes_fn(scratch, series->repeated.bytes);
+	if (!writer_put(writer, scratch, UINT_T_SIZE, &crc)) { return false; }
+	return writer_put_crc(writer, crc);
+}
+
+/*
+ * Streams the series index, if the header asks for it. The size of each
+ * series is computed again instead of being kept while streaming it, so
+ * that the memory used doesn't grow with the series: encoded series are
+ * encoded once more to be measured.
+ */
+static bool stream_series_index(adf_writer_t *writer, adf_t *data)
+{
+	uint8_t scratch[SERIES_INDEX_ENTRY_SIZE];
+	size_t offset = size_header() + size_medatata_t(&data->metadata);
+	uint16_t crc = CRC16_INIT;
+	uint64_t start = 0;
+
+	if (!(data->header.flags & ADF_FLAG_SERIES_INDEX)) { return true; }
+
+	for (uint32_t i = 0, l = data->metadata.size_series.val; i < l; i++) {
+		marshal_index_entry(scratch, offset, start);
+		if (!writer_put(writer, scratch, SERIES_INDEX_ENTRY_SIZE, &crc))
+			return false;
+		offset += serialized_series_size(&data->header, data->series + i);
+		start += data->series[i].repeated.val;
+	}
+	return writer_put_crc(writer, crc);
+}
+
+static bool stream_series_list(adf_writer_t *writer, adf_t *data,
+							   uint8_t *arrays)
+{
+	const series_t *current;
+
+	for (uint32_t i = 0, l = data->metadata.size_series.val; i < l; i++) {
+		current = data->series + i;
+		if (!current->light_exposure || !current->soil_temp_c
+			|| !current->env_temp_c || !current->water_use_ml)
+			return false;
+		if (!stream_series(writer, current, &data->header, arrays))
+			return false;
+
+		DEBUG_LOG("Stream series #%u done\n", i);
+	}
+	return true;
+}
+
+uint16_t marshal_stream(adf_t *data, adf_writer_t *writer)
+{
+	uint8_t scratch[STREAM_SCRATCH_SIZE], *arrays = NULL;
+	const adf_meta_t *metadata;
+	const adf_header_t *header;
+	uint16_t crc = CRC16_INIT;
+	size_t size;
+	bool done;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- marshal_stream -------\n");
+
+	if (!data || !writer || !writer->buffer) { return ADF_RUNTIME_ERROR; }
+	if (!are_codec_flags_valid(&data->header)) { return ADF_RUNTIME_ERROR; }
+
+	/* the crc of the header is computed by marshal_header itself */
+	size = marshal_header(scratch, &data->header);
+	if (!writer_put(writer, scratch, size, &crc)) { return ADF_RUNTIME_ERROR; }
+
+	DEBUG_LOG("Stream header done\n");
+
+	metadata = &data->metadata;
+	crc = CRC16_INIT;
+	size = marshal_metadata_fields(scratch, metadata);
+	if (!writer_put(writer, scratch, size, &crc)
+		|| !writer_put_array(writer, (const uint8_t *)metadata->additive_codes,
+							 metadata->n_additives.val, &crc)
+		|| !writer_put_crc(writer, crc))
+		return ADF_RUNTIME_ERROR;
+
+	DEBUG_LOG("Stream metadata done\n");
+
+	/* encoded arrays need to be measured before they are written */
+	header = &data->header;
+	if (are_arrays_encoded(header)) {
+		size = encoded_arrays_bound(header);
+		arrays = adf_malloc(NULL, size);
+		if (size > 0 && !arrays) { return ADF_RUNTIME_ERROR; }
+	}
+	done = stream_series_list(writer, data, arrays)
+		   && stream_series_index(writer, data);
+	adf_dealloc(NULL, arrays);
+
+	if (!done || !writer_flush(writer)) { return ADF_RUNTIME_ERROR; }
+	return ADF_OK;
+}
+
+/*
+ * Reads the header section starting at `bytes` and checks its crc. The
+ * number of bytes read is `header_size_of` its version.
+ */
+static uint16_t unmarshal_header(adf_header_t *header, const uint8_t *bytes)
+{
+	wavelength_info_t *wave_info = &header->wave_info;
+	soil_depth_info_t *soil_info = &header->soil_info;
+	reduction_info_t *red_info = &header->reduction_info;
+	precision_info_t *prec_info = &header->precision_info;
+	size_t byte_c = 0;
+	uint_small_t expected_crc;
+	uint16_t header_crc;
 
-	header = &adf->header;
-	wave_info = &header->wave_info;
-	soil_info = &header->soil_info;
-	red_info = &header->reduction_info;
-	prec_info = &header->precision_info;
 	cpy_4_bytes_fn(header->signature.bytes, (bytes + byte_c));
 	SHIFT4(byte_c);
 	cpy_2_bytes_fn(header->version.bytes, bytes + byte_c);
@@ -434,7 +1527,7 @@ uint16_t unmarshal(adf_t *adf, const uint8_t *bytes)
 	SHIFT1(byte_c);
 	red_info->soil_temp_red_mode = *(bytes + byte_c);
 	SHIFT1(byte_c);
-    red_info->env_temp_red_mode = *(bytes + byte_c);
+	red_info->env_temp_red_mode = *(bytes + byte_c);
 	SHIFT1(byte_c);
 	red_info->additive_red_mode = *(bytes + byte_c);
 	SHIFT1(byte_c);
@@ -454,169 +1547,1378 @@ uint16_t unmarshal(adf_t *adf, const uint8_t *bytes)
 	SHIFT4(byte_c);
 	cpy_4_bytes_fn(header->n_chunks.bytes, (bytes + byte_c));
 	SHIFT4(byte_c);
+	header->flags = 0;
+	if (header->version.val >= ADF_HEADER_FLAGS_VERSION) {
+		header->flags = *(bytes + byte_c);
+		SHIFT1(byte_c);
+	}
 	header_crc = crc16(bytes, byte_c);
 	cpy_2_bytes_fn(expected_crc.bytes, (bytes + byte_c));
-	SHIFT2(byte_c);
 
-	if (header_crc != expected_crc.val) { return ADF_HEADER_CORRUPTED; }
+	if (header_crc != expected_crc.val || !are_codec_flags_valid(header))
+		return ADF_HEADER_CORRUPTED;
+	return ADF_OK;
+}
 
-	DEBUG_LOG("Unmarshal header done\n");
+/*
+ * Reads the fixed-size fields of the metadata section (i.e. all of them,
+ * except the additive codes and the crc) and returns the number of bytes
+ * read.
+ */
+static size_t unmarshal_metadata_fields(adf_meta_t *metadata,
+										const uint8_t *bytes)
+{
+	size_t byte_c = 0;
 
-	cpy_4_bytes_fn(adf->metadata.size_series.bytes, (bytes + byte_c));
+	cpy_4_bytes_fn(metadata->size_series.bytes, (bytes + byte_c));
 	SHIFT4(byte_c);
-	n_series = adf->metadata.size_series.val;
-	cpy_4_bytes_fn(adf->metadata.period_sec.bytes, (bytes + byte_c));
+	cpy_4_bytes_fn(metadata->period_sec.bytes, (bytes + byte_c));
 	SHIFT4(byte_c);
-	cpy_8_bytes_fn(adf->metadata.seeded.bytes, (bytes + byte_c));
+	cpy_8_bytes_fn(metadata->seeded.bytes, (bytes + byte_c));
 	SHIFT8(byte_c);
-	cpy_8_bytes_fn(adf->metadata.harvested.bytes, (bytes + byte_c));
+	cpy_8_bytes_fn(metadata->harvested.bytes, (bytes + byte_c));
 	SHIFT8(byte_c);
-	cpy_2_bytes_fn(adf->metadata.n_additives.bytes, (bytes + byte_c));
+	cpy_2_bytes_fn(metadata->n_additives.bytes, (bytes + byte_c));
 	SHIFT2(byte_c);
+	return byte_c;
+}
 
-	adf->metadata.additive_codes = malloc(adf->metadata.n_additives.val 
-										  * sizeof(uint_t));
-	if (!adf->metadata.additive_codes) { return ADF_RUNTIME_ERROR; }
+/*
+ * Compares the crc of the first `size` bytes of a section with the one
+ * stored right after them.
+ */
+static bool is_section_crc_valid(const uint8_t *section, size_t size)
+{
+	uint_small_t expected_crc;
 
-	for (uint16_t i = 0, l = adf->metadata.n_additives.val; i < l;
-		 i++, byte_c += 4) {
-		cpy_4_bytes_fn(adf->metadata.additive_codes[i].bytes, (bytes + byte_c));
-	}
+	cpy_2_bytes_fn(expected_crc.bytes, (section + size));
+	return crc16(section, size) == expected_crc.val;
+}
 
-	meta_crc = crc16((bytes + size_header()), byte_c - size_header());
-	cpy_2_bytes_fn(expected_crc.bytes, (bytes + byte_c));
-	SHIFT2(byte_c);
-	if (meta_crc != expected_crc.val) { return ADF_METADATA_CORRUPTED; }
+/*
+ * The size of the arrays of a series in memory, rounded up to a cache line.
+ * It's the space that each series takes in the slab.
+ */
+static size_t slab_series_size(const adf_header_t *header,
+							   uint16_t n_soil_adds, uint16_t n_atm_adds)
+{
+	size_t n_chunks = header->n_chunks.val;
+	size_t n_waves = header->wave_info.n_wavelength.val;
+	size_t n_depth = header->soil_info.n_depth.val;
+	size_t size = (n_chunks * (n_waves + n_depth + 2)) * sizeof(real_t)
+				  + (n_soil_adds + n_atm_adds) * sizeof(additive_t);
+	return (size + ADF_CACHE_LINE - 1) & ~((size_t)ADF_CACHE_LINE - 1);
+}
 
-	DEBUG_LOG("Unmarshal metadata done\n");
+/* Takes `size` bytes from the slab, and moves the slab cursor forward. */
+static void *slab_take(uint8_t **slab, size_t size)
+{
+	void *ptr = *slab;
+	*slab += size;
+	return ptr;
+}
 
-	adf->series = malloc(adf->metadata.size_series.val * sizeof(series_t));
-	if (!adf->series) { return ADF_RUNTIME_ERROR; }
+static bool is_slab_owned(const adf_t *adf, const void *ptr)
+{
+	uintptr_t start = (uintptr_t)adf->slab, address = (uintptr_t)ptr;
+	return adf->slab && address >= start && address < start + adf->slab_size;
+}
 
-	n_iter = adf->metadata.size_series.val;
-	n_chunks = adf->header.n_chunks.val;
-	n_waves = adf->header.wave_info.n_wavelength.val;
-	n_depth = adf->header.soil_info.n_depth.val;
+static void series_dealloc(const adf_allocator_t *, series_t *);
+static void metadata_dealloc(const adf_allocator_t *, adf_meta_t *);
+static uint16_t cpy_series(series_t *, const series_t *, const adf_t *,
+						   const adf_allocator_t *);
+static series_digest_t digest_series(const series_t *, const adf_t *);
 
-	for (uint32_t i = 0; i < n_iter; i++) {
-		series_t current;
-		size_t starting_byte = byte_c;
-		current.light_exposure = malloc(n_chunks * n_waves* sizeof(real_t));
-		if (!current.light_exposure) { return ADF_RUNTIME_ERROR; }
+/*
+ * Frees the arrays of a series contained in the adf structure. The arrays of
+ * the series placed in the slab are released all together with the slab
+ * itself, so here their pointers are just set to NULL.
+ */
+static void release_series(const adf_t *adf, series_t *series)
+{
+	if (!is_slab_owned(adf, series->light_exposure)) {
+		series_dealloc(adf->allocator, series);
+		return;
+	}
+	series->light_exposure = NULL;
+	series->soil_temp_c = NULL;
+	series->env_temp_c = NULL;
+	series->water_use_ml = NULL;
+	series->soil_additives = NULL;
+	series->atm_additives = NULL;
+}
 
-		current.soil_temp_c = malloc(n_chunks * n_depth * sizeof(real_t));
-		if (!current.soil_temp_c) { return ADF_RUNTIME_ERROR; }
+/*
+ * Resolves the codes of the additives through the metadata. The indexes come
+ * from the byte array, so an index out of the additive codes means that it's
+ * corrupted, even if its crc is valid.
+ */
+static bool resolve_additive_codes(additive_t *additives, uint16_t n,
+								   const adf_meta_t *metadata)
+{
+	uint16_t code_idx;
 
-		current.env_temp_c = malloc(n_chunks * sizeof(real_t));
-		if (!current.env_temp_c) { return ADF_RUNTIME_ERROR; }
+	for (uint16_t j = 0; j < n; j++) {
+		code_idx = additives[j].code_idx.val;
+		if (code_idx >= metadata->n_additives.val) { return false; }
+		additives[j].code = metadata->additive_codes[code_idx];
+	}
+	return true;
+}
 
-		current.water_use_ml = malloc(n_chunks * sizeof(real_t));
-		if (!current.water_use_ml) { return ADF_RUNTIME_ERROR; }
+/*
+ * Reads the series starting at `bytes`. The arrays of the series are taken
+ * from the slab if `slab` is not NULL, or allocated one by one otherwise.
+ * The additive codes are resolved through the metadata of `adf`, that must
+ * already be unmarshalled, once the crc of the series has been checked. The number of bytes read is returned in
+ * `series_size`. If an error occurs, nothing is left allocated.
+ */
+static uint16_t unmarshal_series(series_t *series, const adf_t *adf,
+								 const uint8_t *bytes, size_t *series_size,
+								 uint8_t **slab)
+{
+	const uint32_t n_chunks = adf->header.n_chunks.val;
+	const uint16_t n_waves = adf->header.wave_info.n_wavelength.val;
+	const uint16_t n_depth = adf->header.soil_info.n_depth.val;
+	const adf_allocator_t *allocator = adf->allocator;
+	const bool encoded = are_arrays_encoded(&adf->header);
+	series_t current = { 0 };
+	uint8_t *slab_start = slab ? *slab : NULL;
+	size_t byte_c = 0, arrays_offset = 0;
+	uint_t arrays_size;
+	uint16_t res;
 
-		for (uint32_t w = 0; w < n_chunks * n_waves; w++, byte_c += 4) {
-			cpy_4_bytes_fn(current.light_exposure[w].bytes, bytes + byte_c);
-		}
-		for (uint32_t t = 0; t < n_chunks * n_depth; t++, byte_c += 4) {
-			cpy_4_bytes_fn(current.soil_temp_c[t].bytes, bytes + byte_c);
-		}
-		for (uint32_t temp_i = 0; temp_i < n_chunks; temp_i++, byte_c += 4) {
-			cpy_4_bytes_fn(current.env_temp_c[temp_i].bytes, (bytes + byte_c));
-		}
-		for (uint32_t w_i = 0; w_i < n_chunks; w_i++, byte_c += 4) {
-			cpy_4_bytes_fn(current.water_use_ml[w_i].bytes, (bytes + byte_c));
+	if (slab) {
+		current.light_exposure = slab_take(slab, n_chunks * n_waves
+												 * sizeof(real_t));
+		current.soil_temp_c = slab_take(slab, n_chunks * n_depth
+											  * sizeof(real_t));
+		current.env_temp_c = slab_take(slab, n_chunks * sizeof(real_t));
+		current.water_use_ml = slab_take(slab, n_chunks * sizeof(real_t));
+	}
+	else {
+		current.light_exposure = adf_malloc(allocator, n_chunks * n_waves
+															* sizeof(real_t));
+		current.soil_temp_c = adf_malloc(allocator, n_chunks * n_depth
+														* sizeof(real_t));
+		current.env_temp_c = adf_malloc(allocator, n_chunks * sizeof(real_t));
+		current.water_use_ml = adf_malloc(allocator,
+										  n_chunks * sizeof(real_t));
+		if (!current.light_exposure || !current.soil_temp_c
+			|| !current.env_temp_c || !current.water_use_ml) {
+			series_dealloc(allocator, &current);
+			return ADF_RUNTIME_ERROR;
 		}
+	}
 
-		current.pH = *(bytes + byte_c);
-		SHIFT1(byte_c);
-		cpy_4_bytes_fn(current.p_bar.bytes, (bytes + byte_c));
-		SHIFT4(byte_c);
-		cpy_4_bytes_fn(current.soil_density_kg_m3.bytes, (bytes + byte_c));
+	if (encoded) {
+		/* the arrays are decoded once the crc has been checked */
+		cpy_4_bytes_fn(arrays_size.bytes, bytes);
 		SHIFT4(byte_c);
-		cpy_2_bytes_fn(current.n_soil_adds.bytes, (bytes + byte_c));
-		SHIFT2(byte_c);
-		cpy_2_bytes_fn(current.n_atm_adds.bytes, (bytes + byte_c));
-		SHIFT2(byte_c);
+	}
+	else {
+		byte_c += cpy_4_bytes_array((uint8_t *)current.light_exposure,
+									(bytes + byte_c), n_chunks * n_waves);
+		byte_c += cpy_4_bytes_array((uint8_t *)current.soil_temp_c,
+									(bytes + byte_c), n_chunks * n_depth);
+		byte_c += cpy_4_bytes_array((uint8_t *)current.env_temp_c,
+									(bytes + byte_c), n_chunks);
+		byte_c += cpy_4_bytes_array((uint8_t *)current.water_use_ml,
+									(bytes + byte_c), n_chunks);
+	}
 
-		current.soil_additives = NULL;
-		current.atm_additives = NULL;
+	current.pH = *(bytes + byte_c);
+	SHIFT1(byte_c);
+	cpy_4_bytes_fn(current.p_bar.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
+	cpy_4_bytes_fn(current.soil_density_kg_m3.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
+	cpy_2_bytes_fn(current.n_soil_adds.bytes, (bytes + byte_c));
+	SHIFT2(byte_c);
+	cpy_2_bytes_fn(current.n_atm_adds.bytes, (bytes + byte_c));
+	SHIFT2(byte_c);
 
+	if (slab) {
+		if (current.n_soil_adds.val > 0)
+			current.soil_additives = slab_take(slab, current.n_soil_adds.val
+														* sizeof(additive_t));
+		if (current.n_atm_adds.val > 0)
+			current.atm_additives = slab_take(slab, current.n_atm_adds.val
+													   * sizeof(additive_t));
+		*slab = slab_start + slab_series_size(&adf->header,
+											  current.n_soil_adds.val,
+											  current.n_atm_adds.val);
+	}
+	else {
 		if (current.n_soil_adds.val > 0)
-			current.soil_additives = malloc(current.n_soil_adds.val
-								 			* sizeof(additive_t));
+			current.soil_additives = adf_malloc(allocator,
+												current.n_soil_adds.val
+												* sizeof(additive_t));
 
 		if (current.n_atm_adds.val > 0)
-			current.atm_additives = malloc(current.n_atm_adds.val
-										   * sizeof(additive_t));
-
-		uint16_t code_idx;
-		for (uint16_t j = 0, l = current.n_soil_adds.val; j < l; j++) {
-			cpy_2_bytes_fn(current.soil_additives[j].code_idx.bytes,
-						   (bytes + byte_c));
-			code_idx = current.soil_additives[j].code_idx.val;
-			current.soil_additives[j].code.val
-				= adf->metadata.additive_codes[code_idx].val;
-			SHIFT2(byte_c);
-			cpy_4_bytes_fn(current.soil_additives[j].concentration.bytes,
-						   (bytes + byte_c));
-			SHIFT4(byte_c);
+			current.atm_additives = adf_malloc(allocator,
+											   current.n_atm_adds.val
+											   * sizeof(additive_t));
+
+		if ((current.n_soil_adds.val > 0 && !current.soil_additives)
+			|| (current.n_atm_adds.val > 0 && !current.atm_additives)) {
+			series_dealloc(allocator, &current);
+			return ADF_RUNTIME_ERROR;
 		}
-		for (uint16_t j = 0, l = current.n_atm_adds.val; j < l; j++) {
-			cpy_2_bytes_fn(current.atm_additives[j].code_idx.bytes,
-						   (bytes + byte_c));
-			code_idx = current.atm_additives[j].code_idx.val;
-			current.atm_additives[j].code.val
-				= adf->metadata.additive_codes[code_idx].val;
-			SHIFT2(byte_c);
-			cpy_4_bytes_fn(current.atm_additives[j].concentration.bytes,
-						   (bytes + byte_c));
-			SHIFT4(byte_c);
-		}
-		cpy_4_bytes_fn(current.repeated.bytes, (bytes + byte_c));
-		SHIFT4(byte_c);
-
-		if (current.repeated.val == 0) { return ADF_ZERO_REPEATED_SERIES; }
+	}
 
-		series_crc = crc16((bytes + starting_byte), byte_c - starting_byte);
-		cpy_2_bytes_fn(expected_crc.bytes, (bytes + byte_c));
+	/* the codes are resolved once the crc has been checked */
+	for (uint16_t j = 0, l = current.n_soil_adds.val; j < l; j++) {
+		cpy_2_bytes_fn(current.soil_additives[j].code_idx.bytes,
+					   (bytes + byte_c));
 		SHIFT2(byte_c);
+		cpy_4_bytes_fn(current.soil_additives[j].concentration.bytes,
+					   (bytes + byte_c));
+		SHIFT4(byte_c);
+	}
+	for (uint16_t j = 0, l = current.n_atm_adds.val; j < l; j++) {
+		cpy_2_bytes_fn(current.atm_additives[j].code_idx.bytes,
+					   (bytes + byte_c));
+		SHIFT2(byte_c);
+		cpy_4_bytes_fn(current.atm_additives[j].concentration.bytes,
+					   (bytes + byte_c));
+		SHIFT4(byte_c);
+	}
+	if (encoded) {
+		arrays_offset = byte_c;
+		byte_c += arrays_size.val;
+	}
+	cpy_4_bytes_fn(current.repeated.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
 
-		if (series_crc != expected_crc.val) { return ADF_SERIES_CORRUPTED; }
-		n_series += current.repeated.val - 1;
-		adf->series[i] = current;
+	if (current.repeated.val == 0) {
+		if (!slab) { series_dealloc(allocator, &current); }
+		return ADF_ZERO_REPEATED_SERIES;
+	}
 
-		DEBUG_LOG("Unmarshal series #%u done\n", i);
+	if (!is_section_crc_valid(bytes, byte_c)
+		|| !resolve_additive_codes(current.soil_additives,
+								   current.n_soil_adds.val, &adf->metadata)
+		|| !resolve_additive_codes(current.atm_additives,
+								   current.n_atm_adds.val, &adf->metadata)) {
+		if (!slab) { series_dealloc(allocator, &current); }
+		return ADF_SERIES_CORRUPTED;
 	}
-	adf->metadata.n_series = n_series;
+	if (encoded) {
+		res = decode_series_arrays(&current, &adf->header,
+								   (bytes + arrays_offset), arrays_size.val);
+		if (res != ADF_OK) {
+			if (!slab) { series_dealloc(allocator, &current); }
+			return res;
+		}
+	}
+	SHIFT2(byte_c);
+
+	current.digest = digest_series(&current, adf);
+	*series = current;
+	*series_size = byte_c;
 	return ADF_OK;
 }
 
-static inline bool compare_reals(real_t x, real_t y, float tolerance)
-{
-	const float tol = tolerance > 0 ? tolerance : EPSILON;
-	return x.val < y.val
-		? (y.val - x.val) < tol
-		: (x.val - y.val) < tol;
-}
+/*
+ * Reads the metadata, additive codes included, starting at `bytes`. The
+ * number of bytes read is given by `size_medatata_t`.
+ */
+/* The number of slots of the smallest additive index */
+#define ADDITIVE_INDEX_MIN_CAPACITY 16
 
-bool are_additive_t_equal(additive_t x, additive_t y, float tolerance)
+/* Fibonacci hashing: the top bits of the product are the best mixed ones */
+static inline uint32_t hash_additive_code(uint32_t code, uint32_t capacity)
 {
-	return x.code.val == y.code.val
-		&& compare_reals(x.concentration, y.concentration, tolerance);
+	return (code * 0x9E3779B1u) >> (32 - __builtin_ctz(capacity));
 }
 
-bool are_series_equal(const series_t *first, const series_t *second,
-					  const adf_t *adf)
+/*
+ * The slot of the additive index that holds `code`, or the empty slot where
+ * it should be inserted. The index must not be full.
+ */
+static uint32_t probe_additive_index(const adf_meta_t *metadata,
+									 uint32_t code)
 {
-	uint32_t n_chunks = adf->header.n_chunks.val;
-	uint16_t n_waves = adf->header.wave_info.n_wavelength.val;
-	uint16_t n_depth = adf->header.soil_info.n_depth.val;
-	precision_info_t tol;
-	bool int_fields_eq, real_fields_eq;
+	const uint32_t mask = metadata->additive_index_capacity - 1;
+	uint32_t slot = hash_additive_code(code,
+									   metadata->additive_index_capacity),
+			 entry;
 
-	DEBUG_LOG("------- are_series_equal -------\n");
+	while ((entry = metadata->additive_index[slot]) != 0
+		   && metadata->additive_codes[entry - 1].val != code)
+		slot = (slot + 1) & mask;
+	return slot;
+}
 
-	int_fields_eq = first->pH == second->pH
-					&& first->n_atm_adds.val == second->n_atm_adds.val
+/*
+ * Brings the additive index up to date, and makes sure it can hold `size`
+ * codes keeping at least half of its slots empty. When it grows, or when
+ * some codes have been removed, it's rebuilt from scratch.
+ */
+static bool refresh_additive_index(adf_meta_t *metadata,
+								   const adf_allocator_t *allocator,
+								   uint32_t size)
+{
+	const uint32_t n_codes = metadata->n_additives.val;
+	uint32_t capacity = ADDITIVE_INDEX_MIN_CAPACITY, slot;
+	uint32_t *index;
+
+	if (size < n_codes) { size = n_codes; }
+	while (capacity < 2 * size) { capacity *= 2; }
+
+	if (capacity > metadata->additive_index_capacity) {
+		index = adf_malloc(allocator, capacity * sizeof(uint32_t));
+		if (!index) { return false; }
+		adf_dealloc(allocator, metadata->additive_index);
+		metadata->additive_index = index;
+		metadata->additive_index_capacity = capacity;
+		metadata->additive_index_size = 0;
+	}
+	else if (metadata->additive_index_size > n_codes) {
+		metadata->additive_index_size = 0;
+	}
+
+	if (metadata->additive_index_size == 0) {
+		memset(metadata->additive_index, 0,
+			   metadata->additive_index_capacity * sizeof(uint32_t));
+	}
+	for (uint32_t i = metadata->additive_index_size; i < n_codes; i++) {
+		slot = probe_additive_index(metadata,
+									metadata->additive_codes[i].val);
+		/* if a code appears twice, the first one is kept */
+		if (metadata->additive_index[slot] == 0)
+			metadata->additive_index[slot] = i + 1;
+	}
+	metadata->additive_index_size = n_codes;
+	return true;
+}
+
+static void reset_additive_index(adf_meta_t *metadata)
+{
+	metadata->additive_index = NULL;
+	metadata->additive_index_capacity = 0;
+	metadata->additive_index_size = 0;
+}
+
+static uint16_t unmarshal_metadata(adf_meta_t *metadata, const uint8_t *bytes,
+								   const adf_allocator_t *allocator)
+{
+	size_t byte_c = unmarshal_metadata_fields(metadata, bytes);
+
+	reset_additive_index(metadata);
+	metadata->additive_codes = adf_malloc(allocator, metadata->n_additives.val
+													 * sizeof(uint_t));
+	if (!metadata->additive_codes) { return ADF_RUNTIME_ERROR; }
+
+	byte_c += cpy_4_bytes_array((uint8_t *)metadata->additive_codes,
+								(bytes + byte_c), metadata->n_additives.val);
+
+	if (!is_section_crc_valid(bytes, byte_c)) { return ADF_METADATA_CORRUPTED; }
+	if (!refresh_additive_index(metadata, allocator, 0))
+		return ADF_RUNTIME_ERROR;
+	return ADF_OK;
+}
+
+/*
+ * Computes the size of the slab that contains the arrays of all the series
+ * serialized from `bytes` onwards.
+ */
+static size_t get_slab_size(const adf_header_t *header, const uint8_t *bytes,
+							uint32_t n_iter)
+{
+	uint_small_t n_soil_adds, n_atm_adds;
+	size_t size = 0;
+
+	for (uint32_t i = 0; i < n_iter; i++) {
+		bytes += peek_series_size(header, bytes, &n_soil_adds, &n_atm_adds);
+		size += slab_series_size(header, n_soil_adds.val, n_atm_adds.val);
+	}
+	return size;
+}
+
+static uint16_t unmarshal_adf(adf_t *adf, const uint8_t *bytes, bool use_slab,
+							  const adf_allocator_t *allocator)
+{
+	size_t byte_c = 0, series_size;
+	uint8_t *slab = NULL;
+	uintptr_t slab_start;
+	uint16_t res;
+	uint32_t n_iter;
+	uint64_t n_series;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- unmarshal -------\n");
+
+	if (!bytes || !adf) { return ADF_RUNTIME_ERROR; }
+
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf->allocator = allocator;
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
+
+	res = unmarshal_header(&adf->header, bytes);
+	if (res != ADF_OK) { return res; }
+	byte_c += header_size_of(adf->header.version.val);
+
+	DEBUG_LOG("Unmarshal header done\n");
+
+	res = unmarshal_metadata(&adf->metadata, (bytes + byte_c), allocator);
+	if (res != ADF_OK) { return res; }
+	byte_c += size_medatata_t(&adf->metadata);
+	n_series = adf->metadata.size_series.val;
+
+	DEBUG_LOG("Unmarshal metadata done\n");
+
+	adf->series = adf_malloc(allocator, adf->metadata.size_series.val
+										* sizeof(series_t));
+	if (!adf->series) { return ADF_RUNTIME_ERROR; }
+
+	n_iter = adf->metadata.size_series.val;
+	if (use_slab && n_iter > 0) {
+		/*
+		 * The allocator gives no alignment guarantee beyond the one of
+		 * malloc, so a cache line more is requested, and the series are
+		 * placed from the first aligned address onwards.
+		 */
+		adf->slab_size = get_slab_size(&adf->header, (bytes + byte_c),
+									   n_iter) + ADF_CACHE_LINE - 1;
+		adf->slab = adf_malloc(allocator, adf->slab_size);
+		if (!adf->slab) { return ADF_RUNTIME_ERROR; }
+		slab_start = ((uintptr_t)adf->slab + ADF_CACHE_LINE - 1)
+					 & ~((uintptr_t)ADF_CACHE_LINE - 1);
+		slab = (uint8_t *)adf->slab + (slab_start - (uintptr_t)adf->slab);
+
+		DEBUG_LOG("Slab of %zu bytes allocated\n", adf->slab_size);
+	}
+
+	for (uint32_t i = 0; i < n_iter; i++) {
+		res = unmarshal_series(adf->series + i, adf, (bytes + byte_c),
+							   &series_size, slab ? &slab : NULL);
+		if (res != ADF_OK) { return res; }
+		byte_c += series_size;
+		n_series += adf->series[i].repeated.val - 1;
+
+		DEBUG_LOG("Unmarshal series #%u done\n", i);
+	}
+	adf->metadata.n_series = n_series;
+	return ADF_OK;
+}
+
+uint16_t unmarshal(adf_t *adf, const uint8_t *bytes)
+{
+	return unmarshal_adf(adf, bytes, false, NULL);
+}
+
+uint16_t unmarshal_slab(adf_t *adf, const uint8_t *bytes)
+{
+	return unmarshal_adf(adf, bytes, true, NULL);
+}
+
+uint16_t unmarshal_with_allocator(adf_t *adf, const uint8_t *bytes,
+								  const adf_allocator_t *allocator)
+{
+	return unmarshal_adf(adf, bytes, false, allocator);
+}
+
+typedef struct {
+	adf_t *adf;
+	const uint8_t *bytes;
+	const size_t *offsets;
+	first_error_t error;
+} unmarshal_job_t;
+
+static void unmarshal_series_range(void *ctx, uint32_t begin, uint32_t end)
+{
+	unmarshal_job_t *job = ctx;
+	size_t series_size;
+	uint16_t res;
+
+	for (uint32_t i = begin; i < end; i++) {
+		/* the serial unmarshal would have stopped before this series */
+		if (first_error_before(&job->error, i)) { return; }
+		res = unmarshal_series(job->adf->series + i, job->adf,
+							   (job->bytes + job->offsets[i]), &series_size,
+							   NULL);
+		if (res != ADF_OK) {
+			first_error_set(&job->error, i, res);
+			return;
+		}
+	}
+}
+
+uint16_t unmarshal_parallel(adf_t *adf, const uint8_t *bytes, size_t size,
+							uint32_t n_threads)
+{
+	unmarshal_job_t job = { .adf = adf, .bytes = bytes };
+	size_t byte_c, meta_size, fixed_size, current_size, *offsets;
+	uint_small_t n_soil_adds, n_atm_adds;
+	uint32_t n_iter, n_alloc, n_bounded, error_idx, grain;
+	uint64_t n_series;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- unmarshal_parallel -------\n");
+
+	if (!bytes || !adf) { return ADF_RUNTIME_ERROR; }
+
+	/* the default allocator is the only one known to be thread-safe */
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf->allocator = NULL;
+	adf->series = NULL;
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
+
+	byte_c = peek_header_size(bytes, size);
+	if (byte_c == 0) { return ADF_HEADER_CORRUPTED; }
+	res = unmarshal_header(&adf->header, bytes);
+	if (res != ADF_OK) { return res; }
+
+	meta_size = size_medatata_t(&(adf_meta_t){ .n_additives = { 0 } });
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	unmarshal_metadata_fields(&adf->metadata, (bytes + byte_c));
+	meta_size = size_medatata_t(&adf->metadata);
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	res = unmarshal_metadata(&adf->metadata, (bytes + byte_c), NULL);
+	if (res != ADF_OK) { return res; }
+	byte_c += meta_size;
+
+	/*
+	 * The number of series comes from the byte array: no more of them than
+	 * the smallest series would fit in the bytes left are allocated. If
+	 * there are fewer, the truncation is reported after the first pass.
+	 */
+	n_iter = adf->metadata.size_series.val;
+	fixed_size = min_series_size(&adf->header);
+	n_alloc = n_iter;
+	if (n_alloc > (size - byte_c) / fixed_size)
+		n_alloc = (size - byte_c) / fixed_size;
+	adf->series = adf_calloc(NULL, n_alloc, sizeof(series_t));
+	offsets = adf_malloc(NULL, n_alloc * sizeof(size_t));
+	if (n_alloc > 0 && (!adf->series || !offsets)) {
+		adf_dealloc(NULL, adf->series);
+		adf_dealloc(NULL, offsets);
+		adf->series = NULL;
+		adf->metadata.size_series.val = 0;
+		metadata_dealloc(NULL, &adf->metadata);
+		return ADF_RUNTIME_ERROR;
+	}
+
+	/*
+	 * First pass: the size of a series depends only on its additive
+	 * counters, so the offset of every series can be found without
+	 * decoding it. The pass stops at the first series that doesn't fit.
+	 */
+	for (n_bounded = 0; n_bounded < n_alloc; n_bounded++) {
+		if (size - byte_c < fixed_size) { break; }
+		current_size = peek_series_size(&adf->header, (bytes + byte_c),
+										&n_soil_adds, &n_atm_adds);
+		if (size - byte_c < current_size) { break; }
+		offsets[n_bounded] = byte_c;
+		byte_c += current_size;
+	}
+
+	DEBUG_LOG("Offsets of %u series found\n", n_bounded);
+
+	/* a few batches per thread, to even out the load */
+	n_threads = parallel_n_threads(n_threads);
+	grain = n_bounded / (n_threads * 8) + 1;
+	job.offsets = offsets;
+	first_error_init(&job.error);
+	parallel_for(n_bounded, grain, n_threads, &unmarshal_series_range, &job);
+	adf_dealloc(NULL, offsets);
+
+	/* an error in a series is reported before the truncation that follows */
+	if (!first_error_get(&job.error, &error_idx, &res))
+		res = n_bounded < n_iter ? ADF_SERIES_CORRUPTED : ADF_OK;
+
+	if (res != ADF_OK) {
+		for (uint32_t i = 0; i < n_alloc; i++)
+			series_dealloc(NULL, adf->series + i);
+		adf_dealloc(NULL, adf->series);
+		adf->series = NULL;
+		adf->metadata.size_series.val = 0;
+		metadata_dealloc(NULL, &adf->metadata);
+		return res;
+	}
+
+	n_series = n_iter;
+	for (uint32_t i = 0; i < n_iter; i++)
+		n_series += adf->series[i].repeated.val - 1;
+	adf->metadata.n_series = n_series;
+	return ADF_OK;
+}
+
+/* The section an adf_decoder_t is waiting for */
+enum {
+	DECODER_HEADER,
+	DECODER_METADATA,
+	DECODER_SERIES,
+	DECODER_DONE,
+	DECODER_FAILED
+};
+
+uint16_t adf_decoder_init(adf_decoder_t *decoder, adf_t *adf,
+						  adf_series_fn on_series, void *ctx)
+{
+	init_bytes_copy_fns();
+
+	if (!decoder || !adf) { return ADF_RUNTIME_ERROR; }
+
+	*decoder = (adf_decoder_t) {
+		.adf = adf,
+		.on_series = on_series,
+		.ctx = ctx,
+		.state = DECODER_HEADER,
+		.error = ADF_OK
+	};
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf->allocator = NULL;
+	adf->series = NULL;
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
+	adf->metadata.additive_codes = NULL;
+	reset_additive_index(&adf->metadata);
+	adf->metadata.size_series.val = 0;
+	return ADF_OK;
+}
+
+/*
+ * Stops the decoder. The structure is left in a state that `adf_free` can
+ * release: before the series section, it holds no series at all.
+ */
+static uint16_t decoder_fail(adf_decoder_t *decoder, uint16_t error)
+{
+	if (decoder->state != DECODER_SERIES)
+		decoder->adf->metadata.size_series.val = 0;
+	decoder->state = DECODER_FAILED;
+	decoder->error = error;
+	return error;
+}
+
+/*
+ * Returns the first `need` bytes of the section being decoded. When nothing
+ * is buffered and the chunk holds all of them, they are read in place;
+ * otherwise the chunk is copied to the buffer, until `need` bytes are
+ * there. If there aren't enough bytes yet, NULL is returned.
+ */
+static const uint8_t *decoder_take(adf_decoder_t *decoder,
+								   const uint8_t **chunk, size_t *len,
+								   size_t need)
+{
+	size_t n_copy, capacity;
+	uint8_t *buffer;
+
+	if (decoder->used == 0 && *len >= need) { return *chunk; }
+	/* a previous chunk may have buffered more than a leading field */
+	if (decoder->used >= need) { return decoder->buffer; }
+
+	if (decoder->capacity < need) {
+		capacity = decoder->capacity * 2 > need ? decoder->capacity * 2
+												: need;
+		buffer = adf_realloc(NULL, decoder->buffer, capacity);
+		if (!buffer) {
+			decoder_fail(decoder, ADF_RUNTIME_ERROR);
+			return NULL;
+		}
+		decoder->buffer = buffer;
+		decoder->capacity = capacity;
+	}
+	n_copy = need - decoder->used < *len ? need - decoder->used : *len;
+	memcpy(decoder->buffer + decoder->used, *chunk, n_copy);
+	decoder->used += n_copy;
+	*chunk += n_copy;
+	*len -= n_copy;
+	return decoder->used == need ? decoder->buffer : NULL;
+}
+
+/* Moves past a section of `size` bytes, once it has been decoded. */
+static void decoder_consume(adf_decoder_t *decoder, const uint8_t **chunk,
+							size_t *len, size_t size)
+{
+	if (decoder->used > 0) {
+		/* the section was buffered, the chunk has already moved past it */
+		decoder->used = 0;
+		return;
+	}
+	*chunk += size;
+	*len -= size;
+}
+
+/*
+ * Hands a decoded series to the callback, and frees it, or stores it in the
+ * adf structure if there's no callback.
+ */
+static uint16_t decoder_emit(adf_decoder_t *decoder, series_t *series)
+{
+	adf_t *adf = decoder->adf;
+	uint16_t res;
+
+	adf->metadata.n_series += series->repeated.val - 1;
+	if (!decoder->on_series) {
+		adf->series[decoder->n_decoded++] = *series;
+		adf->metadata.size_series.val++;
+		return ADF_OK;
+	}
+	res = decoder->on_series(decoder->ctx, adf, series, decoder->n_decoded++);
+	series_dealloc(NULL, series);
+	return res;
+}
+
+uint16_t adf_decoder_feed(adf_decoder_t *decoder, const uint8_t *chunk,
+						  size_t len)
+{
+	const size_t meta_fixed_size =
+		size_medatata_t(&(adf_meta_t){ .n_additives = { 0 } });
+	uint_small_t n_soil_adds, n_atm_adds;
+	const uint8_t *section;
+	series_t series;
+	size_t size;
+	uint16_t res;
+	adf_t *adf;
+
+	if (!decoder || (!chunk && len > 0)) { return ADF_RUNTIME_ERROR; }
+	if (decoder->state == DECODER_FAILED) { return decoder->error; }
+	adf = decoder->adf;
+
+	while (decoder->state != DECODER_DONE) {
+		switch (decoder->state) {
+		case DECODER_HEADER:
+			/* the version tells how big the header is */
+			size = UINT_T_SIZE + UINT_SMALL_T_SIZE;
+			section = decoder_take(decoder, &chunk, &len, size);
+			if (!section) { break; }
+			size = peek_header_size(section, size_header());
+			section = decoder_take(decoder, &chunk, &len, size);
+			if (!section) { break; }
+			res = unmarshal_header(&adf->header, section);
+			if (res != ADF_OK) { return decoder_fail(decoder, res); }
+
+			DEBUG_LOG("Decode header done\n");
+			decoder->state = DECODER_METADATA;
+			break;
+		case DECODER_METADATA:
+			/* the fixed-size fields tell how many additive codes follow */
+			section = decoder_take(decoder, &chunk, &len, meta_fixed_size);
+			if (!section) { break; }
+			unmarshal_metadata_fields(&adf->metadata, section);
+			size = size_medatata_t(&adf->metadata);
+			section = decoder_take(decoder, &chunk, &len, size);
+			if (!section) { break; }
+			res = unmarshal_metadata(&adf->metadata, section, NULL);
+			if (res != ADF_OK) { return decoder_fail(decoder, res); }
+
+			/* from now on, `size_series` counts the stored series only */
+			decoder->size_series = adf->metadata.size_series.val;
+			adf->metadata.size_series.val = 0;
+			adf->metadata.n_series = decoder->size_series;
+			if (!decoder->on_series) {
+				adf->series = adf_malloc(NULL, decoder->size_series
+											   * sizeof(series_t));
+				if (!adf->series)
+					return decoder_fail(decoder, ADF_RUNTIME_ERROR);
+			}
+
+			DEBUG_LOG("Decode metadata done\n");
+			decoder->state = decoder->size_series > 0 ? DECODER_SERIES
+													  : DECODER_DONE;
+			break;
+		case DECODER_SERIES:
+			/* the additive counters tell how big the series is */
+			size = min_series_size(&adf->header);
+			section = decoder_take(decoder, &chunk, &len, size);
+			if (!section) { break; }
+			size = peek_series_size(&adf->header, section, &n_soil_adds,
+									&n_atm_adds);
+			section = decoder_take(decoder, &chunk, &len, size);
+			if (!section) { break; }
+			res = unmarshal_series(&series, adf, section, &size, NULL);
+			if (res == ADF_OK) { res = decoder_emit(decoder, &series); }
+			if (res != ADF_OK) { return decoder_fail(decoder, res); }
+
+			DEBUG_LOG("Decode series #%u done\n", decoder->n_decoded - 1);
+			if (decoder->n_decoded == decoder->size_series)
+				decoder->state = DECODER_DONE;
+			break;
+		}
+
+		/* waiting for the next chunk, or out of memory */
+		if (!section) {
+			return decoder->state == DECODER_FAILED ? decoder->error : ADF_OK;
+		}
+		decoder_consume(decoder, &chunk, &len, size);
+	}
+	return ADF_OK;
+}
+
+uint16_t adf_decoder_finish(adf_decoder_t *decoder)
+{
+	static const uint16_t truncated[] = {
+		[DECODER_HEADER] = ADF_HEADER_CORRUPTED,
+		[DECODER_METADATA] = ADF_METADATA_CORRUPTED,
+		[DECODER_SERIES] = ADF_SERIES_CORRUPTED
+	};
+
+	if (!decoder) { return ADF_RUNTIME_ERROR; }
+
+	adf_dealloc(NULL, decoder->buffer);
+	decoder->buffer = NULL;
+	decoder->used = 0;
+	decoder->capacity = 0;
+
+	if (decoder->state == DECODER_DONE) { return ADF_OK; }
+	if (decoder->state == DECODER_FAILED) { return decoder->error; }
+	return decoder_fail(decoder, truncated[decoder->state]);
+}
+
+static inline float read_real(const uint8_t *bytes)
+{
+	real_t value;
+	cpy_4_bytes_fn(value.bytes, bytes);
+	return value.val;
+}
+
+/*
+ * Whether each of the `n` serialized additives indexes one of the `n_codes`
+ * additive codes. The code index is the first field of an additive.
+ */
+static bool are_additive_indexes_valid(const uint8_t *additives, uint32_t n,
+									   uint16_t n_codes)
+{
+	uint_small_t code_idx;
+
+	for (uint32_t j = 0; j < n; j++) {
+		cpy_2_bytes_fn(code_idx.bytes, (additives + j * ADD_T_SIZE));
+		if (code_idx.val >= n_codes) { return false; }
+	}
+	return true;
+}
+
+static additive_t read_additive(const series_view_t *series,
+								const uint8_t *bytes)
+{
+	additive_t additive;
+	uint16_t code_idx;
+
+	cpy_2_bytes_fn(additive.code_idx.bytes, bytes);
+	cpy_4_bytes_fn(additive.concentration.bytes, (bytes + UINT_SMALL_T_SIZE));
+	code_idx = additive.code_idx.val;
+	cpy_4_bytes_fn(additive.code.bytes,
+				   (series->additive_codes + code_idx * UINT_T_SIZE));
+	return additive;
+}
+
+static void read_index_entry(const uint8_t *index, uint32_t i,
+							 uint64_t *offset, uint64_t *start)
+{
+	uint_big_t field;
+
+	index += (size_t)i * SERIES_INDEX_ENTRY_SIZE;
+	cpy_8_bytes_fn(field.bytes, index);
+	*offset = field.val;
+	cpy_8_bytes_fn(field.bytes, (index + UINT_BIG_T_SIZE));
+	*start = field.val;
+}
+
+/* The `repeated` field of the serialized series that ends at `end` */
+static uint32_t peek_repeated(const uint8_t *end)
+{
+	uint_t repeated;
+	cpy_4_bytes_fn(repeated.bytes, (end - UINT_SMALL_T_SIZE - UINT_T_SIZE));
+	return repeated.val;
+}
+
+/*
+ * Checks the crc of the series index that starts at `series_end`, and that
+ * each entry agrees with the offsets found by scanning the series.
+ */
+static bool is_series_index_valid(const uint8_t *bytes, const size_t *offsets,
+								  uint32_t n_iter, size_t series_end)
+{
+	const uint8_t *index = bytes + series_end;
+	uint64_t offset, start, expected_start = 0;
+	size_t end;
+
+	if (!is_section_crc_valid(index, (size_t)n_iter * SERIES_INDEX_ENTRY_SIZE))
+		return false;
+	for (uint32_t i = 0; i < n_iter; i++) {
+		read_index_entry(index, i, &offset, &start);
+		if (offset != offsets[i] || start != expected_start) { return false; }
+		end = i + 1 < n_iter ? offsets[i + 1] : series_end;
+		expected_start += peek_repeated(bytes + end);
+	}
+	return true;
+}
+
+uint16_t adf_view_init(adf_view_t *view, const uint8_t *bytes, size_t size)
+{
+	size_t byte_c, meta_size, current_size, fixed_size;
+	uint_small_t n_soil_adds, n_atm_adds;
+	const uint8_t *additives;
+	uint_t repeated;
+	uint32_t n_iter, n_adds;
+	uint64_t n_series;
+	size_t *offsets;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- adf_view_init -------\n");
+
+	if (!bytes || !view) { return ADF_RUNTIME_ERROR; }
+
+	view->bytes = bytes;
+	view->size = size;
+	view->additive_codes = NULL;
+	view->series_offsets = NULL;
+	view->metadata.additive_codes = NULL;
+
+	byte_c = peek_header_size(bytes, size);
+	if (byte_c == 0) { return ADF_HEADER_CORRUPTED; }
+	res = unmarshal_header(&view->header, bytes);
+	if (res != ADF_OK) { return res; }
+
+	meta_size = size_medatata_t(&(adf_meta_t){ .n_additives = { 0 } });
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	unmarshal_metadata_fields(&view->metadata, (bytes + byte_c));
+	meta_size = size_medatata_t(&view->metadata);
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	if (!is_section_crc_valid((bytes + byte_c),
+							  meta_size - UINT_SMALL_T_SIZE))
+		return ADF_METADATA_CORRUPTED;
+	view->additive_codes = bytes + byte_c + meta_size - UINT_SMALL_T_SIZE
+						   - view->metadata.n_additives.val * UINT_T_SIZE;
+	byte_c += meta_size;
+
+	DEBUG_LOG("View header and metadata done\n");
+
+	n_iter = view->metadata.size_series.val;
+	n_series = n_iter;
+	offsets = adf_malloc(NULL, n_iter * sizeof(size_t));
+	if (n_iter > 0 && !offsets) { return ADF_RUNTIME_ERROR; }
+
+	/*
+	 * Only the additive counters and the `repeated` field of each series
+	 * are read here: they are enough to find where the next series starts.
+	 * The additive indexes are checked too, since an index past the
+	 * additive codes would be read out of bounds.
+	 */
+	fixed_size = min_series_size(&view->header);
+	for (uint32_t i = 0; i < n_iter; i++) {
+		if (size - byte_c < fixed_size) {
+			adf_dealloc(NULL, offsets);
+			return ADF_SERIES_CORRUPTED;
+		}
+		current_size = peek_series_size(&view->header, (bytes + byte_c),
+										&n_soil_adds, &n_atm_adds);
+		if (size - byte_c < current_size) {
+			adf_dealloc(NULL, offsets);
+			return ADF_SERIES_CORRUPTED;
+		}
+		/* the atmosphere additives follow the soil ones */
+		additives = bytes + byte_c + series_counters_offset(&view->header)
+					+ 2 * UINT_SMALL_T_SIZE;
+		n_adds = (uint32_t)n_soil_adds.val + n_atm_adds.val;
+		if (!are_additive_indexes_valid(additives, n_adds,
+										view->metadata.n_additives.val)) {
+			adf_dealloc(NULL, offsets);
+			return ADF_SERIES_CORRUPTED;
+		}
+		cpy_4_bytes_fn(repeated.bytes, (bytes + byte_c + current_size
+										- UINT_SMALL_T_SIZE - UINT_T_SIZE));
+		if (repeated.val == 0) {
+			adf_dealloc(NULL, offsets);
+			return ADF_ZERO_REPEATED_SERIES;
+		}
+		n_series += repeated.val - 1;
+		offsets[i] = byte_c;
+		byte_c += current_size;
+	}
+	if (view->header.flags & ADF_FLAG_SERIES_INDEX
+		&& (size - byte_c < size_series_index(&view->header, n_iter)
+			|| !is_series_index_valid(bytes, offsets, n_iter, byte_c))) {
+		adf_dealloc(NULL, offsets);
+		return ADF_SERIES_CORRUPTED;
+	}
+	view->series_offsets = offsets;
+	view->metadata.n_series = n_series;
+	return ADF_OK;
+}
+
+uint16_t adf_view_get_series(const adf_view_t *view, series_view_t *series,
+							 uint32_t idx)
+{
+	const uint8_t *bytes;
+	size_t byte_c = 0;
+	uint32_t n_chunks;
+	uint16_t n_waves, n_depth;
+	uint_t arrays_size = { 0 };
+
+	if (!view || !series) { return ADF_RUNTIME_ERROR; }
+	if (idx >= view->metadata.size_series.val) { return ADF_RUNTIME_ERROR; }
+
+	bytes = view->bytes + view->series_offsets[idx];
+	n_chunks = view->header.n_chunks.val;
+	n_waves = view->header.wave_info.n_wavelength.val;
+	n_depth = view->header.soil_info.n_depth.val;
+
+	series->n_wavelength = n_waves;
+	series->n_depth = n_depth;
+	series->additive_codes = view->additive_codes;
+	if (are_arrays_encoded(&view->header)) {
+		/* encoded arrays can't be read in place */
+		cpy_4_bytes_fn(arrays_size.bytes, bytes);
+		SHIFT4(byte_c);
+		series->light_exposure = NULL;
+		series->soil_temp_c = NULL;
+		series->env_temp_c = NULL;
+		series->water_use_ml = NULL;
+	}
+	else {
+		series->light_exposure = bytes + byte_c;
+		byte_c += (size_t)n_chunks * n_waves * REAL_T_SIZE;
+		series->soil_temp_c = bytes + byte_c;
+		byte_c += (size_t)n_chunks * n_depth * REAL_T_SIZE;
+		series->env_temp_c = bytes + byte_c;
+		byte_c += (size_t)n_chunks * REAL_T_SIZE;
+		series->water_use_ml = bytes + byte_c;
+		byte_c += (size_t)n_chunks * REAL_T_SIZE;
+	}
+	series->pH = *(bytes + byte_c);
+	SHIFT1(byte_c);
+	cpy_4_bytes_fn(series->p_bar.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
+	cpy_4_bytes_fn(series->soil_density_kg_m3.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
+	cpy_2_bytes_fn(series->n_soil_adds.bytes, (bytes + byte_c));
+	SHIFT2(byte_c);
+	cpy_2_bytes_fn(series->n_atm_adds.bytes, (bytes + byte_c));
+	SHIFT2(byte_c);
+	series->soil_additives = bytes + byte_c;
+	byte_c += series->n_soil_adds.val * ADD_T_SIZE;
+	series->atm_additives = bytes + byte_c;
+	byte_c += series->n_atm_adds.val * ADD_T_SIZE;
+	if (are_arrays_encoded(&view->header)) { byte_c += arrays_size.val; }
+	cpy_4_bytes_fn(series->repeated.bytes, (bytes + byte_c));
+	SHIFT4(byte_c);
+
+	if (!is_section_crc_valid(bytes, byte_c)
+		|| !are_additive_indexes_valid(series->soil_additives,
+									   series->n_soil_adds.val,
+									   view->metadata.n_additives.val)
+		|| !are_additive_indexes_valid(series->atm_additives,
+									   series->n_atm_adds.val,
+									   view->metadata.n_additives.val))
+		return ADF_SERIES_CORRUPTED;
+	return ADF_OK;
+}
+
+float series_view_light_exposure(const series_view_t *series, uint32_t chunk,
+								 uint16_t wavelength)
+{
+	size_t idx = (size_t)chunk * series->n_wavelength + wavelength;
+	return read_real(series->light_exposure + idx * REAL_T_SIZE);
+}
+
+float series_view_soil_temp_c(const series_view_t *series, uint32_t chunk,
+							  uint16_t depth)
+{
+	size_t idx = (size_t)chunk * series->n_depth + depth;
+	return read_real(series->soil_temp_c + idx * REAL_T_SIZE);
+}
+
+float series_view_env_temp_c(const series_view_t *series, uint32_t chunk)
+{
+	return read_real(series->env_temp_c + (size_t)chunk * REAL_T_SIZE);
+}
+
+float series_view_water_use_ml(const series_view_t *series, uint32_t chunk)
+{
+	return read_real(series->water_use_ml + (size_t)chunk * REAL_T_SIZE);
+}
+
+additive_t series_view_soil_additive(const series_view_t *series,
+									 uint16_t idx)
+{
+	return read_additive(series, series->soil_additives + idx * ADD_T_SIZE);
+}
+
+additive_t series_view_atm_additive(const series_view_t *series,
+									uint16_t idx)
+{
+	return read_additive(series, series->atm_additives + idx * ADD_T_SIZE);
+}
+
+uint32_t adf_view_additive_code(const adf_view_t *view, uint16_t idx)
+{
+	uint_t code;
+	cpy_4_bytes_fn(code.bytes, (view->additive_codes + idx * UINT_T_SIZE));
+	return code.val;
+}
+
+void adf_view_free(adf_view_t *view)
+{
+	adf_dealloc(NULL, view->series_offsets);
+	view->series_offsets = NULL;
+	view->additive_codes = NULL;
+	view->bytes = NULL;
+}
+
+/* The number of periods needed to reach `time`, rounded up */
+static uint64_t periods_to_reach(uint64_t period, uint64_t time)
+{
+	if (period == 0) { return time > 0 ? UINT64_MAX : 0; }
+	return time / period + (time % period != 0);
+}
+
+/*
+ * Reads the header and the metadata of a serialized object of `size` bytes
+ * into `adf`. The series are found in [`series_begin`, `series_end`): the
+ * series index, if any, starts at `series_end`.
+ */
+static uint16_t read_head(adf_t *adf, const uint8_t *bytes, size_t size,
+						  size_t *series_begin, size_t *series_end)
+{
+	size_t byte_c, meta_size, index_size;
+	uint16_t res;
+
+	adf->allocator = NULL;
+	adf->metadata.additive_codes = NULL;
+	reset_additive_index(&adf->metadata);
+
+	byte_c = peek_header_size(bytes, size);
+	if (byte_c == 0) { return ADF_HEADER_CORRUPTED; }
+	res = unmarshal_header(&adf->header, bytes);
+	if (res != ADF_OK) { return res; }
+
+	meta_size = size_medatata_t(&(adf_meta_t){ .n_additives = { 0 } });
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	unmarshal_metadata_fields(&adf->metadata, (bytes + byte_c));
+	meta_size = size_medatata_t(&adf->metadata);
+	if (size - byte_c < meta_size) { return ADF_METADATA_CORRUPTED; }
+	res = unmarshal_metadata(&adf->metadata, (bytes + byte_c), NULL);
+	if (res != ADF_OK) { return res; }
+	byte_c += meta_size;
+
+	index_size = size_series_index(&adf->header,
+								   adf->metadata.size_series.val);
+	if (size - byte_c < index_size) { return ADF_SERIES_CORRUPTED; }
+	*series_begin = byte_c;
+	*series_end = size - index_size;
+	return ADF_OK;
+}
+
+/*
+ * The size of the series at `offset`, or 0 if it doesn't fit in
+ * [`series_begin`, `series_end`).
+ */
+static size_t fitting_series_size(const adf_header_t *header,
+								  const uint8_t *bytes, uint64_t offset,
+								  size_t series_begin, size_t series_end)
+{
+	uint_small_t n_soil_adds, n_atm_adds;
+	size_t series_size;
+
+	if (offset < series_begin || offset > series_end
+		|| series_end - offset < min_series_size(header))
+		return 0;
+	series_size = peek_series_size(header, (bytes + offset), &n_soil_adds,
+								   &n_atm_adds);
+	return series_end - offset < series_size ? 0 : series_size;
+}
+
+/*
+ * Without a series index, the series are skipped one by one until the one at
+ * position `idx` or the first one that ends after `n_periods` periods.
+ */
+static uint16_t scan_series(const adf_t *adf, const uint8_t *bytes,
+							size_t series_begin, size_t series_end,
+							uint32_t idx, uint64_t n_periods,
+							uint64_t *offset, uint64_t *start)
+{
+	size_t byte_c = series_begin, series_size;
+	uint64_t elapsed = 0;
+	uint32_t repeated;
+
+	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
+		series_size = fitting_series_size(&adf->header, bytes, byte_c,
+										  series_begin, series_end);
+		if (series_size == 0) { return ADF_SERIES_CORRUPTED; }
+		repeated = peek_repeated(bytes + byte_c + series_size);
+		if (i == idx || elapsed + repeated >= n_periods) {
+			*offset = byte_c;
+			*start = elapsed;
+			return ADF_OK;
+		}
+		elapsed += repeated;
+		byte_c += series_size;
+	}
+	return ADF_TIME_OUT_OF_BOUND;
+}
+
+/* Decodes the series at `offset`, checking that it's within bounds */
+static uint16_t read_series_at_offset(const adf_t *adf, const uint8_t *bytes,
+									  uint64_t offset, size_t series_begin,
+									  size_t series_end, series_t *series)
+{
+	size_t series_size;
+
+	series_size = fitting_series_size(&adf->header, bytes, offset,
+									  series_begin, series_end);
+	if (series_size == 0) { return ADF_SERIES_CORRUPTED; }
+	return unmarshal_series(series, adf, (bytes + offset), &series_size,
+							NULL);
+}
+
+uint16_t adf_read_series_at(const uint8_t *bytes, size_t size, uint32_t idx,
+							series_t *series, uint64_t *start)
+{
+	size_t series_begin, series_end;
+	uint64_t offset, elapsed;
+	adf_t adf;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	if (!bytes || !series) { return ADF_RUNTIME_ERROR; }
+
+	res = read_head(&adf, bytes, size, &series_begin, &series_end);
+	if (res != ADF_OK) { goto free_metadata; }
+	if (idx >= adf.metadata.size_series.val) {
+		res = ADF_RUNTIME_ERROR;
+		goto free_metadata;
+	}
+
+	if (adf.header.flags & ADF_FLAG_SERIES_INDEX) {
+		read_index_entry((bytes + series_end), idx, &offset, &elapsed);
+	} else {
+		res = scan_series(&adf, bytes, series_begin, series_end, idx,
+						  UINT64_MAX, &offset, &elapsed);
+		if (res != ADF_OK) { goto free_metadata; }
+	}
+
+	res = read_series_at_offset(&adf, bytes, offset, series_begin,
+								series_end, series);
+	if (res == ADF_OK && start) { *start = elapsed; }
+
+free_metadata:
+	metadata_free(&adf.metadata);
+	return res;
+}
+
+/*
+ * Through a binary search over the starts in the series index, the first
+ * series that ends after `n_periods` periods. The series `i` ends where the
+ * series `i + 1` starts, so the last one is the only candidate left if none
+ * of the others is.
+ */
+static uint32_t search_series_index(const uint8_t *index, uint32_t n_iter,
+									uint64_t n_periods)
+{
+	uint32_t low = 1, high = n_iter, mid;
+	uint64_t offset, start;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		read_index_entry(index, mid, &offset, &start);
+		if (start < n_periods)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low - 1;
+}
+
+uint16_t adf_read_series_at_time(const uint8_t *bytes, size_t size,
+								 uint64_t time, series_t *series,
+								 uint64_t *start)
+{
+	size_t series_begin, series_end;
+	uint64_t n_periods, offset, elapsed;
+	uint32_t pos;
+	adf_t adf;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	if (!bytes || !series) { return ADF_RUNTIME_ERROR; }
+
+	res = read_head(&adf, bytes, size, &series_begin, &series_end);
+	if (res != ADF_OK) { goto free_metadata; }
+	if (adf.metadata.size_series.val == 0) {
+		res = ADF_TIME_OUT_OF_BOUND;
+		goto free_metadata;
+	}
+	n_periods = periods_to_reach(adf.metadata.period_sec.val, time);
+
+	if (adf.header.flags & ADF_FLAG_SERIES_INDEX) {
+		pos = search_series_index((bytes + series_end),
+								  adf.metadata.size_series.val, n_periods);
+		read_index_entry((bytes + series_end), pos, &offset, &elapsed);
+	} else {
+		res = scan_series(&adf, bytes, series_begin, series_end, UINT32_MAX,
+						  n_periods, &offset, &elapsed);
+		if (res != ADF_OK) { goto free_metadata; }
+	}
+
+	res = read_series_at_offset(&adf, bytes, offset, series_begin,
+								series_end, series);
+	if (res != ADF_OK) { goto free_metadata; }
+	/* only the last series may not reach that far */
+	if (elapsed + series->repeated.val < n_periods) {
+		series_free(series);
+		res = ADF_TIME_OUT_OF_BOUND;
+		goto free_metadata;
+	}
+	if (start) { *start = elapsed; }
+
+free_metadata:
+	metadata_free(&adf.metadata);
+	return res;
+}
+
+static inline bool compare_reals(real_t x, real_t y, float tolerance)
+{
+	const float tol = real_tolerance(tolerance);
+	return x.val < y.val
+		? (y.val - x.val) < tol
+		: (x.val - y.val) < tol;
+}
+
+/* Compares two arrays of `n` reals with the SIMD kernel of the host */
+static inline bool compare_real_arrays(const real_t *x, const real_t *y,
+									   size_t n, float tolerance)
+{
+	return get_reals_within_fn()((const float *)x, (const float *)y, n,
+								 real_tolerance(tolerance));
+}
+
+bool are_additive_t_equal(additive_t x, additive_t y, float tolerance)
+{
+	return x.code.val == y.code.val
+		&& compare_reals(x.concentration, y.concentration, tolerance);
+}
+
+bool are_series_equal(const series_t *first, const series_t *second,
+					  const adf_t *adf)
+{
+	uint32_t n_chunks = adf->header.n_chunks.val;
+	uint16_t n_waves = adf->header.wave_info.n_wavelength.val;
+	uint16_t n_depth = adf->header.soil_info.n_depth.val;
+	precision_info_t tol;
+	bool int_fields_eq, real_fields_eq;
+
+	DEBUG_LOG("------- are_series_equal -------\n");
+
+	int_fields_eq = first->pH == second->pH
+					&& first->n_atm_adds.val == second->n_atm_adds.val
 					&& first->n_soil_adds.val == second->n_soil_adds.val;
 
 	DEBUG_LOG("are int fields equal? %d\n", int_fields_eq);
@@ -636,237 +2938,584 @@ bool are_series_equal(const series_t *first, const series_t *second,
 
 	if (!real_fields_eq) return false;
 
-	/* lastly, we need to check the arrays :( */
-	for (uint32_t i = 0; i < n_chunks; i++) {
-		bool env_temp_equals = compare_reals(first->env_temp_c[i],
-											 second->env_temp_c[i],
-											 tol.env_temp_prec.val);
-		bool water_use_equals = compare_reals(first->water_use_ml[i],
-											  second->water_use_ml[i],
-											  tol.water_use_prec.val);
-		if (!(env_temp_equals && water_use_equals)) {
-			DEBUG_LOG("chunk: %d, first->env_temp_c = %f, "
-					  "second->env_temp_c = %f | "
-					  "first->water_use_ml = %f, "
-					  "second->water_use_ml = %f\n",
-					  i, first->env_temp_c[i].val, second->env_temp_c[i].val,
-					  first->water_use_ml[i].val, second->water_use_ml[i].val);
+	/* lastly, we need to check the arrays, a whole block at a time */
+	if (!compare_real_arrays(first->env_temp_c, second->env_temp_c,
+							 n_chunks, tol.env_temp_prec.val)
+		|| !compare_real_arrays(first->water_use_ml, second->water_use_ml,
+								n_chunks, tol.water_use_prec.val)) {
+		DEBUG_LOG("env_temp_c or water_use_ml are different\n");
+		return false;
+	}
+
+	DEBUG_LOG("env_temp_c & water_use_ml are equal\n");
+
+	if (!compare_real_arrays(first->light_exposure, second->light_exposure,
+							 (size_t)n_chunks * n_waves,
+							 tol.light_exposure_prec.val)) {
+		DEBUG_LOG("light_exposure are different\n");
+		return false;
+	}
+
+	DEBUG_LOG("light_exposure are equal\n");
+
+	if (!compare_real_arrays(first->soil_temp_c, second->soil_temp_c,
+							 (size_t)n_chunks * n_depth,
+							 tol.soil_temp_prec.val)) {
+		DEBUG_LOG("soil_temp_c are different\n");
+		return false;
+	}
+
+	DEBUG_LOG("soil_temp_c are equal\n");
+
+	for (uint16_t i = 0, l = first->n_soil_adds.val; i < l; i++) {
+		bool soil_additive_equals = are_additive_t_equal(first->soil_additives[i],
+												  second->soil_additives[i],
+												  tol.additive_prec.val);
+		if (!soil_additive_equals) {
+			DEBUG_LOG("#soil_add: %d, first->soil_additives.code = %d, "
+					  "second->soil_additives.code = %d | "
+					  "first->soil_additives.conc = %f, "
+					  "second->soil_additives.conc = %f\n",
+					  i, first->soil_additives[i].code.val,
+					  second->soil_additives[i].code.val,
+					  first->soil_additives[i].concentration.val,
+					  second->soil_additives[i].concentration.val);
 			return false;
 		}
 	}
 
-	DEBUG_LOG("env_temp_c & water_use_ml are equal\n");
+	DEBUG_LOG("soil_additives are equal\n");
+
+	for (uint16_t i = 0, l = first->n_atm_adds.val; i < l; i++) {
+		bool atm_additive_equals = are_additive_t_equal(first->atm_additives[i],
+														 second->atm_additives[i],
+														 tol.additive_prec.val);
+		if (!atm_additive_equals) {
+			DEBUG_LOG("#atm_add: %d, first->atm_additives.code = %d, "
+					  "second->atm_additives.code = %d | "
+					  "first->atm_additives.conc = %f, "
+					  "second->atm_additives.conc = %f\n",
+					  i, first->atm_additives[i].code.val,
+					  second->atm_additives[i].code.val,
+					  first->atm_additives[i].concentration.val,
+					  second->atm_additives[i].concentration.val);
+			return false;
+		}
+	}
+
+	DEBUG_LOG("The two series are equal\n");
+
+	return true;
+}
+
+/* The multiplier of the fingerprint: 2^64 divided by the golden ratio */
+#define FINGERPRINT_MULTIPLIER 0x9E3779B97F4A7C15ull
+
+static inline uint64_t mix_fingerprint(uint64_t hash, uint64_t value)
+{
+	hash = (hash ^ value) * FINGERPRINT_MULTIPLIER;
+	return hash ^ (hash >> 32);
+}
+
+/*
+ * Rounds x / tolerance to the closest integer (`inverse` is 1 / tolerance).
+ * NaN, and the values too big to be represented, have buckets of their own.
+ */
+static inline uint64_t quantize_real(float x, double inverse)
+{
+	const double q = x * inverse;
+
+	if (q != q) { return 0x7FF8000000000000ull; }
+	if (q >= 0x1p62) { return (uint64_t)INT64_MAX; }
+	if (q <= -0x1p62) { return (uint64_t)INT64_MIN; }
+	return (uint64_t)(int64_t)(q < 0 ? q - 0.5 : q + 0.5);
+}
+
+/*
+ * Adds the `n` values of `x` to the fingerprint, and returns their sum in
+ * `sum` and the sum of their absolute values in `magnitude`.
+ */
+static uint64_t digest_reals(uint64_t hash, const real_t *x, size_t n,
+							 float tolerance, double *sum, double *magnitude)
+{
+	const double inverse = 1.0 / real_tolerance(tolerance);
+	double s = 0, m = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		s += x[i].val;
+		m += __builtin_fabs(x[i].val);
+		hash = mix_fingerprint(hash, quantize_real(x[i].val, inverse));
+	}
+	*sum = s;
+	*magnitude = m;
+	return hash;
+}
+
+static uint64_t digest_additives(uint64_t hash, const additive_t *additives,
+								 uint16_t n, float tolerance)
+{
+	const double inverse = 1.0 / real_tolerance(tolerance);
+
+	for (uint16_t i = 0; i < n; i++) {
+		hash = mix_fingerprint(hash, additives[i].code.val);
+		hash = mix_fingerprint(hash,
+							   quantize_real(additives[i].concentration.val,
+											 inverse));
+	}
+	return hash;
+}
+
+static series_digest_t digest_series(const series_t *series,
+									 const adf_t *adf)
+{
+	const uint32_t n_chunks = adf->header.n_chunks.val;
+	const size_t n_light = (size_t)n_chunks
+						   * adf->header.wave_info.n_wavelength.val;
+	const size_t n_soil = (size_t)n_chunks * adf->header.soil_info.n_depth.val;
+	const precision_info_t *tol = &adf->header.precision_info;
+	double sums[4], magnitudes[4];
+	uint64_t hash = series->pH;
+
+	hash = mix_fingerprint(hash, series->n_soil_adds.val
+								 | (uint64_t)series->n_atm_adds.val << 16);
+	hash = mix_fingerprint(hash, quantize_real(series->p_bar.val,
+		1.0 / real_tolerance(tol->pressure_prec.val)));
+	hash = mix_fingerprint(hash, quantize_real(series->soil_density_kg_m3.val,
+		1.0 / real_tolerance(tol->soil_density_prec.val)));
+	hash = digest_reals(hash, series->env_temp_c, n_chunks,
+						tol->env_temp_prec.val, sums, magnitudes);
+	hash = digest_reals(hash, series->water_use_ml, n_chunks,
+						tol->water_use_prec.val, sums + 1, magnitudes + 1);
+	hash = digest_reals(hash, series->light_exposure, n_light,
+						tol->light_exposure_prec.val, sums + 2,
+						magnitudes + 2);
+	hash = digest_reals(hash, series->soil_temp_c, n_soil,
+						tol->soil_temp_prec.val, sums + 3, magnitudes + 3);
+	hash = digest_additives(hash, series->soil_additives,
+							series->n_soil_adds.val, tol->additive_prec.val);
+	hash = digest_additives(hash, series->atm_additives,
+							series->n_atm_adds.val, tol->additive_prec.val);
+
+	/* 0 is reserved for the digests that haven't been computed */
+	return (series_digest_t) {
+		.fingerprint = hash ? hash : 1,
+		.sums = { sums[0], sums[1], sums[2], sums[3] },
+		.magnitude = magnitudes[0] + magnitudes[1] + magnitudes[2]
+					 + magnitudes[3]
+	};
+}
+
+/* The digest of a series stored in the adf structure, computed if missing */
+static const series_digest_t *stored_digest(const adf_t *adf,
+											series_t *series)
+{
+	if (series->digest.fingerprint == 0)
+		series->digest = digest_series(series, adf);
+	return &series->digest;
+}
+
+/*
+ * Returns true if two series can't be equal, judging from their digests.
+ * If each element of an array of size n is less than tol apart from the
+ * other one, the sums of the two arrays are less than n * tol apart. The
+ * rest of the bound covers the rounding errors, both of the comparison of
+ * the elements, and of the sums, which are at most n * 2^-53 times their
+ * magnitude. NaN and infinities never make two series apart.
+ */
+static bool are_digests_apart(const series_digest_t *x,
+							  const series_digest_t *y, const adf_t *adf)
+{
+	const uint32_t n_chunks = adf->header.n_chunks.val;
+	const precision_info_t *tol = &adf->header.precision_info;
+	const double n[4] = {
+		n_chunks, n_chunks,
+		(double)n_chunks * adf->header.wave_info.n_wavelength.val,
+		(double)n_chunks * adf->header.soil_info.n_depth.val
+	};
+	const double tolerances[4] = {
+		real_tolerance(tol->env_temp_prec.val),
+		real_tolerance(tol->water_use_prec.val),
+		real_tolerance(tol->light_exposure_prec.val),
+		real_tolerance(tol->soil_temp_prec.val)
+	};
+	double bound;
+
+	for (int i = 0; i < 4; i++) {
+		bound = n[i] * tolerances[i] * (1 + 0x1p-20)
+				+ n[i] * 0x1p-50 * (x->magnitude + y->magnitude);
+		if (__builtin_fabs(x->sums[i] - y->sums[i]) > bound) { return true; }
+	}
+	return false;
+}
+
+uint64_t series_fingerprint(const series_t *series, const adf_t *adf)
+{
+	return digest_series(series, adf).fingerprint;
+}
+
+uint64_t adf_series_fingerprint(adf_t *adf, uint32_t index)
+{
+	if (index >= adf->metadata.size_series.val) { return 0; }
+	return stored_digest(adf, adf->series + index)->fingerprint;
+}
+
+/*
+ * Makes room for `size` series in the `series` array, growing it
+ * geometrically. A capacity smaller than the number of series means that
+ * the array has exactly their size.
+ */
+static bool reserve_series_capacity(adf_t *adf, uint32_t size)
+{
+	uint32_t capacity = adf->series_capacity;
+	series_t *series;
+
+	if (capacity < adf->metadata.size_series.val)
+		capacity = adf->metadata.size_series.val;
+	if (capacity >= size) { return true; }
+	capacity = capacity <= UINT32_MAX / 2 && capacity * 2 > size
+			   ? capacity * 2
+			   : size;
+	series = adf_realloc(adf->allocator, adf->series,
+						 (size_t)capacity * sizeof(series_t));
+	if (!series) { return false; }
+	adf->series = series;
+	adf->series_capacity = capacity;
+	return true;
+}
+
+void adf_invalidate_time_index(adf_t *adf, uint32_t from)
+{
+	if (adf->time_index_size > from) { adf->time_index_size = from; }
+}
+
+/* Makes room for `size` entries in the time index, growing geometrically. */
+static bool reserve_time_index(adf_t *adf, uint32_t size)
+{
+	uint64_t *index;
+	uint32_t capacity = adf->time_index_capacity;
+
+	if (capacity >= size) { return true; }
+	capacity = capacity * 2 > size ? capacity * 2 : size;
+	index = adf_realloc(adf->allocator, adf->time_index,
+						capacity * sizeof(uint64_t));
+	if (!index) { return false; }
+	adf->time_index = index;
+	adf->time_index_capacity = capacity;
+	return true;
+}
+
+/*
+ * Recomputes the entry of the last series, once it has been added or its
+ * `repeated` field has changed, if all the entries before it are up to
+ * date. If the index can't grow, it's just left stale.
+ */
+static void time_index_set_last(adf_t *adf)
+{
+	uint32_t last = adf->metadata.size_series.val - 1;
+	uint64_t start;
+
+	if (adf->time_index_size < last) { return; }
+	if (!reserve_time_index(adf, last + 1)) {
+		adf->time_index_size = last;
+		return;
+	}
+	start = last > 0 ? adf->time_index[last - 1] : 0;
+	adf->time_index[last] = start + adf->series[last].repeated.val;
+	adf->time_index_size = last + 1;
+}
+
+/* Brings the stale entries of the time index up to date. */
+static uint16_t refresh_time_index(adf_t *adf)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	uint64_t end;
+
+	if (adf->time_index_size >= size) { return ADF_OK; }
+	if (!reserve_time_index(adf, size)) { return ADF_RUNTIME_ERROR; }
+
+	end = adf->time_index_size > 0
+		  ? adf->time_index[adf->time_index_size - 1]
+		  : 0;
+	for (uint32_t i = adf->time_index_size; i < size; i++) {
+		end += adf->series[i].repeated.val;
+		adf->time_index[i] = end;
+	}
+	adf->time_index_size = size;
+	return ADF_OK;
+}
+
+/*
+ * The first series in [low, high) that ends after `n_periods` periods or
+ * later, or `high` if there's none. The time index must be up to date.
+ */
+static uint32_t search_time_index(const adf_t *adf, uint32_t low,
+								  uint32_t high, uint64_t n_periods)
+{
+	uint32_t mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (adf->time_index[mid] < n_periods)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/*
+ * Finds, through a binary search in the time index, the series that covers
+ * `time`: the first one that ends at or after it. Its position and the
+ * number of periods elapsed before it starts are returned.
+ */
+static uint16_t find_series_at(adf_t *adf, uint64_t time, uint32_t *pos,
+							   uint64_t *start)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	uint32_t low;
+	uint16_t res;
 
-	for (uint32_t i = 0; i < n_chunks * n_waves; i++) {
-		bool light_exposure_equals = compare_reals(first->light_exposure[i],
-												   second->light_exposure[i],
-												   tol.light_exposure_prec.val);
-		if (!light_exposure_equals) {
-			DEBUG_LOG("index: %d, first->light_exposure = %f, "
-					  "second->light_exposure = %f\n",
-					  i, first->light_exposure[i].val,
-					  second->light_exposure[i].val);
-			return false;
-		}
-	}
+	res = refresh_time_index(adf);
+	if (res != ADF_OK) { return res; }
 
-	DEBUG_LOG("light_exposure are equal\n");
+	low = search_time_index(adf, 0, size,
+							periods_to_reach(adf->metadata.period_sec.val,
+											 time));
+	if (low == size) { return ADF_TIME_OUT_OF_BOUND; }
 
-	for (uint32_t i = 0; i < n_chunks * n_depth; i++) {
-		bool soil_temp_equal = compare_reals(first->soil_temp_c[i],
-											 second->soil_temp_c[i],
-											 tol.soil_temp_prec.val);
-		if (!soil_temp_equal) {
-			DEBUG_LOG("index: %d, first->light_exposure = %f, "
-					  "second->light_exposure = %f\n",
-					  i, first->soil_temp_c[i].val, 
-					  second->soil_temp_c[i].val);
-			return false;
-		}
-	}
+	*pos = low;
+	*start = adf->time_index[low] - adf->series[low].repeated.val;
+	return ADF_OK;
+}
 
-	DEBUG_LOG("soil_temp_c are equal\n");
+uint16_t reserve_series(adf_t *adf, uint32_t size)
+{
+	return reserve_series_capacity(adf, size) ? ADF_OK : ADF_RUNTIME_ERROR;
+}
 
-	for (uint16_t i = 0, l = first->n_soil_adds.val; i < l; i++) {
-		bool soil_additive_equals = are_additive_t_equal(first->soil_additives[i],
-												  second->soil_additives[i],
-												  tol.additive_prec.val);
-		if (!soil_additive_equals) {
-			DEBUG_LOG("#soil_add: %d, first->soil_additives.code = %d, "
-					  "second->soil_additives.code = %d | "
-					  "first->soil_additives.conc = %f, "
-					  "second->soil_additives.conc = %f\n",
-					  i, first->soil_additives[i].code.val,
-					  second->soil_additives[i].code.val,
-					  first->soil_additives[i].concentration.val,
-					  second->soil_additives[i].concentration.val);
-			return false;
-		}
-	}
+/*
+ * Looks up the code of every additive of a series in the additive index,
+ * appending the ones that are not there yet to the additive codes, and sets
+ * their `code_idx`. Codes that are new are committed to the metadata only
+ * if all of them fit.
+ */
+static uint16_t register_additives(adf_t *adf, series_t *series)
+{
+	adf_meta_t *metadata = &adf->metadata;
+	const uint32_t n_soil = series->n_soil_adds.val,
+				   n_total = n_soil + series->n_atm_adds.val;
+	uint32_t n_codes = metadata->n_additives.val, slot, idx;
+	uint_t *codes;
+	additive_t *additive;
+	bool reserved = false;
+
+	if (n_total == 0) { return ADF_OK; }
+	if (!refresh_additive_index(metadata, adf->allocator,
+								n_codes + n_total < 0xFFFF
+								? n_codes + n_total
+								: 0xFFFF))
+		return ADF_RUNTIME_ERROR;
 
-	DEBUG_LOG("soil_additives are equal\n");
+	for (uint32_t i = 0; i < n_total; i++) {
+		additive = i < n_soil
+				   ? series->soil_additives + i
+				   : series->atm_additives + (i - n_soil);
+		slot = probe_additive_index(metadata, additive->code.val);
 
-	for (uint16_t i = 0, l = first->n_atm_adds.val; i < l; i++) {
-		bool atm_additive_equals = are_additive_t_equal(first->atm_additives[i],
-														 second->atm_additives[i],
-														 tol.additive_prec.val);
-		if (!atm_additive_equals) {
-			DEBUG_LOG("#atm_add: %d, first->atm_additives.code = %d, "
-					  "second->atm_additives.code = %d | "
-					  "first->atm_additives.conc = %f, "
-					  "second->atm_additives.conc = %f\n",
-					  i, first->atm_additives[i].code.val,
-					  second->atm_additives[i].code.val,
-					  first->atm_additives[i].concentration.val,
-					  second->atm_additives[i].concentration.val);
-			return false;
+		if (metadata->additive_index[slot] == 0) {
+			if (n_codes == 0xFFFF) {
+				/* the codes indexed so far are not committed */
+				metadata->additive_index_size = 0;
+				return ADF_ADDITIVE_OVERFLOW;
+			}
+			/* room for all the additives left, at most */
+			if (!reserved) {
+				codes = adf_realloc(adf->allocator, metadata->additive_codes,
+									(n_codes + n_total - i) * sizeof(uint_t));
+				if (!codes) {
+					metadata->additive_index_size = 0;
+					return ADF_RUNTIME_ERROR;
+				}
+				metadata->additive_codes = codes;
+				reserved = true;
+			}
+			metadata->additive_codes[n_codes] = additive->code;
+			metadata->additive_index[slot] = ++n_codes;
 		}
+		idx = metadata->additive_index[slot] - 1;
+		additive->code_idx.val = idx;
 	}
-
-	DEBUG_LOG("The two series are equal\n");
-
-	return true;
+	metadata->n_additives.val = n_codes;
+	metadata->additive_index_size = n_codes;
+	return ADF_OK;
 }
 
-static bool is_additive_new(uint_t *additives, uint16_t n_additives,
-							 additive_t target)
+/*
+ * If the series is equal to the last one, adds its repetitions to the last
+ * one and returns true.
+ */
+static bool merge_into_last(adf_t *adf, const series_t *series,
+							const series_digest_t *digest)
 {
-	for (uint16_t i = 0; i < n_additives; i++) {
-		if (target.code.val == additives[i].val) return false;
-	}
+	const uint32_t size = adf->metadata.size_series.val;
+	series_t *last;
+
+	DEBUG_LOG("Series is repeated: %u\n", series->repeated.val);
+
+	if (size == 0) { return false; }
+	last = adf->series + (size - 1);
+	DEBUG_LOG("--- comparing last series (position %d) ...\n", size - 1);
+	if (are_digests_apart(stored_digest(adf, last), digest, adf)
+		|| !are_series_equal(last, series, adf)) { return false; }
+
+	last->repeated.val += series->repeated.val;
+	adf->metadata.n_series += series->repeated.val;
+	time_index_set_last(adf);
 	return true;
 }
 
-uint16_t add_series(adf_t *adf, const series_t *series_to_add)
+/*
+ * Appends the series that has just been placed right after the last one in
+ * the `series` array, registering its additives.
+ */
+static uint16_t append_next_series(adf_t *adf)
 {
-	series_t *last;
-	size_t new_size_series;
-	additive_t *soil_add, *atm_add;
-	uint16_t n_soil_add, n_atm_add, soil_addtocopy_idx, atm_addtocopy_idx,
-			 res;
-	uint32_t total_additives;
-	cpy_2_bytes_fn = is_big_endian()
-					 ? &from_to_big_endian_2_bytes
-					 : &from_to_little_endian_2_bytes;
+	series_t *next = adf->series + adf->metadata.size_series.val;
+	uint16_t res;
 
-	DEBUG_LOG("------- add_series -------\n");
+	res = register_additives(adf, next);
+	if (res != ADF_OK) { return res; }
 
-	if (series_to_add->repeated.val == 0) { return ADF_ZERO_REPEATED_SERIES; }
+	adf->metadata.size_series.val++;
+	adf->metadata.n_series += next->repeated.val;
+	time_index_set_last(adf);
+	return ADF_OK;
+}
 
-	DEBUG_LOG("Series is repeated: %u\n", series_to_add->repeated.val);
+/*
+ * Adds a non zero-repeated series: it's either merged into the last one,
+ * or copied at the end of the `series` array, which grows geometrically.
+ */
+static uint16_t push_series(adf_t *adf, const series_t *series_to_add)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	const series_digest_t digest = digest_series(series_to_add, adf);
+	series_t *next;
+	uint16_t res;
 
 	/* Happy path, the series is repeated, just increment the counter */
-	if (adf->metadata.size_series.val > 0) {
-		last = adf->series + (adf->metadata.size_series.val - 1);
-		DEBUG_LOG("--- comparing last series (position %d) ...\n",
-				  adf->metadata.size_series.val - 1);
-		if (are_series_equal(last, series_to_add, adf)) {
-			last->repeated.val += series_to_add->repeated.val;
-			adf->metadata.n_series += series_to_add->repeated.val;
-			return ADF_OK;
-		}
-	}
+	if (merge_into_last(adf, series_to_add, &digest)) { return ADF_OK; }
 
 	DEBUG_LOG("Series to add is not repeated\n");
 
 	/* If it's not equal to the last one, and if it's not zero-repeated, 
 	   then we have to add it to the series array */
-	new_size_series = (adf->metadata.size_series.val + 1) * sizeof(series_t);
-	adf->series = realloc(adf->series, new_size_series);
-	if (!adf->series) { return ADF_RUNTIME_ERROR; }
+	if (!reserve_series_capacity(adf, size + 1)) { return ADF_RUNTIME_ERROR; }
 
-	last = adf->series + adf->metadata.size_series.val;
-	res = cpy_adf_series(last, series_to_add, adf);
+	next = adf->series + size;
+	res = cpy_series(next, series_to_add, adf, adf->allocator);
 	if (res != ADF_OK) { return res; }
+	next->digest = digest;
 
 	DEBUG_LOG("New series has been copied into series array\n");
 
-	/* At this point, we don't know how many additives should be added to the 
-	   additive_codes array in the metadata, so we allocate  */
-	n_soil_add = last->n_soil_adds.val;
-	n_atm_add = last->n_atm_adds.val;
-	soil_addtocopy_idx = 0;
-	atm_addtocopy_idx = 0;
-
-	if (n_soil_add > 0) {
-		soil_add = malloc(n_soil_add * sizeof(additive_t));
-		for (uint16_t n_soil = 0; n_soil < n_soil_add; n_soil++) {
-			if (is_additive_new(adf->metadata.additive_codes,
-								adf->metadata.n_additives.val,
-								last->soil_additives[n_soil])) {
-				cpy_additive(soil_add + soil_addtocopy_idx, 
-							 last->soil_additives + n_soil);
-				soil_addtocopy_idx++;
-			}
-		}
-	}
+	res = append_next_series(adf);
+	if (res != ADF_OK) { release_series(adf, next); }
+	return res;
+}
 
-	if (n_atm_add > 0) {
-		atm_add = malloc(n_atm_add * sizeof(additive_t));
-		for (uint16_t n_atm = 0; n_atm < n_atm_add; n_atm++) {
-			if (is_additive_new(adf->metadata.additive_codes,
-								adf->metadata.n_additives.val,
-								last->atm_additives[n_atm])) {
-				cpy_additive(atm_add + atm_addtocopy_idx,
-							 last->atm_additives + n_atm);
-				atm_addtocopy_idx++;
-			}
-		}
-	}
+uint16_t add_series(adf_t *adf, const series_t *series_to_add)
+{
+	init_bytes_copy_fns();
 
-	uint32_t items_to_add = soil_addtocopy_idx + atm_addtocopy_idx;
-	total_additives = adf->metadata.n_additives.val + items_to_add;
-	if (total_additives > 0xFFFF) {
-		series_free(last);
-		if (n_soil_add > 0) { free(soil_add); }
-		if (n_atm_add > 0) { free(atm_add); }
-		return ADF_ADDITIVE_OVERFLOW;
-	}
-	size_t new_size_additives = (adf->metadata.n_additives.val + items_to_add)
-								* sizeof(uint_t);
-	adf->metadata.additive_codes = realloc(adf->metadata.additive_codes,
-										   new_size_additives);
+	DEBUG_LOG("------- add_series -------\n");
 
-	if (!adf->metadata.additive_codes) {
-		series_free(last);
-		if (n_soil_add > 0) { free(soil_add); }
-		if (n_atm_add > 0) { free(atm_add); }
-		return ADF_RUNTIME_ERROR;
+	if (series_to_add->repeated.val == 0) { return ADF_ZERO_REPEATED_SERIES; }
+
+	return push_series(adf, series_to_add);
+}
+
+uint16_t add_series_many(adf_t *adf, const series_t *series, size_t n)
+{
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- add_series_many -------\n");
+
+	for (size_t i = 0; i < n; i++)
+		if (series[i].repeated.val == 0) { return ADF_ZERO_REPEATED_SERIES; }
+
+	for (size_t i = 0; i < n; i++) {
+		res = push_series(adf, series + i);
+		if (res != ADF_OK) { return res; }
 	}
 
-	for (uint16_t i = adf->metadata.n_additives.val, j = 0;
-		 i < adf->metadata.n_additives.val + soil_addtocopy_idx; i++, j++) {
-		adf->metadata.additive_codes[i] = soil_add[j].code;
-		soil_add[j].code_idx.val = i;
+	return ADF_OK;
+}
+
+uint16_t add_series_take(adf_t *adf, series_t *series)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	const bool same_allocator = get_allocator(adf->allocator)
+								== get_allocator(NULL);
+	series_digest_t digest;
+	series_t *next;
+	uint16_t res;
+	init_bytes_copy_fns();
+
+	DEBUG_LOG("------- add_series_take -------\n");
+
+	if (series->repeated.val == 0) { return ADF_ZERO_REPEATED_SERIES; }
+
+	/* empty additive arrays (e.g. from `init_empty_series`) are dropped */
+	if (series->n_soil_adds.val == 0) {
+		adf_dealloc(NULL, series->soil_additives);
+		series->soil_additives = NULL;
 	}
-	for (uint16_t i = adf->metadata.n_additives.val + soil_addtocopy_idx, j = 0;
-		 i < adf->metadata.n_additives.val + atm_addtocopy_idx; i++, j++) {
-		adf->metadata.additive_codes[i] = atm_add[j].code;
-		atm_add[j].code_idx.val = i;
+	if (series->n_atm_adds.val == 0) {
+		adf_dealloc(NULL, series->atm_additives);
+		series->atm_additives = NULL;
 	}
-	adf->metadata.n_additives.val += items_to_add;
 
-	/* Update soil_add and atm_add of the new series to keep track of the
-	   index of the just inserted additive_code */
-	for (uint16_t i = 0, l = last->n_soil_adds.val; i < l; i++)
-		last->soil_additives[i] = soil_add[i];
+	digest = digest_series(series, adf);
+	if (merge_into_last(adf, series, &digest)) {
+		series_dealloc(NULL, series);
+		*series = (series_t) { 0 };
+		return ADF_OK;
+	}
 
-	for (uint16_t i = 0, l = last->n_atm_adds.val; i < l; i++)
-		last->atm_additives[i] = atm_add[i];
+	if (!reserve_series_capacity(adf, size + 1)) { return ADF_RUNTIME_ERROR; }
 
-	adf->metadata.size_series.val++;
-	adf->metadata.n_series += last->repeated.val;
+	/*
+	 * The arrays come from the default allocator: they can be adopted only
+	 * if the adf structure uses it too, otherwise they are copied.
+	 */
+	next = adf->series + size;
+	if (same_allocator) {
+		*next = *series;
+	}
+	else {
+		res = cpy_series(next, series, adf, adf->allocator);
+		if (res != ADF_OK) { return res; }
+	}
+	next->digest = digest;
 
-	if (n_soil_add > 0) { free(soil_add); }
-	if (n_atm_add > 0) { free(atm_add); }
+	res = append_next_series(adf);
+	if (res != ADF_OK) {
+		/* the caller still owns its arrays */
+		if (!same_allocator) { release_series(adf, next); }
+		return res;
+	}
 
+	if (!same_allocator) { series_dealloc(NULL, series); }
+	*series = (series_t) { 0 };
 	return ADF_OK;
 }
 
 uint16_t remove_series(adf_t *adf)
 {
-	uint32_t new_size;
-	series_t *last;
+	uint32_t new_size, capacity;
+	series_t *last, *series;
 
 	if (adf->metadata.size_series.val == 0) {
 		/* nothing to do here, just return an error code */
@@ -879,46 +3528,130 @@ uint16_t remove_series(adf_t *adf)
 	if (last->repeated.val > 1) {
 		adf->metadata.n_series--;
 		last->repeated.val--;
+		time_index_set_last(adf);
 		return ADF_OK;
 	}
 
 	adf->metadata.n_series--;
 	adf->metadata.size_series.val--;
 	new_size = adf->metadata.size_series.val;
+	adf_invalidate_time_index(adf, new_size);
 
-	series_free(last);
+	release_series(adf, last);
 
 	/* just one series, not repeated */
 	if (new_size == 0) {
-		free(adf->series);
+		adf_dealloc(adf->allocator, adf->series);
 		adf->series = NULL;
+		adf->series_capacity = 0;
 		return ADF_OK;
 	}
 
-	adf->series = realloc(adf->series, new_size * sizeof(series_t));
-	if (!adf->series) { return ADF_RUNTIME_ERROR; }
+	/*
+	 * The array is shrunk only when it's a quarter full, so that adding
+	 * and removing a series over and over doesn't realloc every time.
+	 */
+	capacity = adf->series_capacity > new_size + 1
+			   ? adf->series_capacity
+			   : new_size + 1;
+	if (new_size > capacity / 4) { return ADF_OK; }
+
+	capacity /= 2;
+	series = adf_realloc(adf->allocator, adf->series,
+						 capacity * sizeof(series_t));
+	/* a failed shrink leaves the bigger array in place */
+	if (series) {
+		adf->series = series;
+		adf->series_capacity = capacity;
+	}
 
 	return ADF_OK;
 }
 
 uint16_t get_series_at(adf_t *adf, series_t *series, uint64_t time)
 {
-	series_t *current;
-	uint16_t series_period = adf->metadata.period_sec.val;
-	uint64_t l_bound_nth_series = 0, u_bound_nth_series = 0;
+	uint32_t pos;
+	uint64_t start;
+	uint16_t res = find_series_at(adf, time, &pos, &start);
 
-	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
-		current = adf->series + i;
-		l_bound_nth_series = u_bound_nth_series;
-		u_bound_nth_series = l_bound_nth_series
-							 + (current->repeated.val * series_period);
+	if (res != ADF_OK) { return res; }
+	*series = adf->series[pos];
+	return ADF_OK;
+}
 
-		if (time > u_bound_nth_series) { continue; }
-		*series = *current;
-		return ADF_OK;
+/*
+ * Like `search_time_index`, but starting from `low` and doubling the step
+ * until the series is passed: a sequence of increasing times is looked up
+ * in a single pass, and far apart times skip the series in between.
+ */
+static uint32_t gallop_time_index(const adf_t *adf, uint32_t low,
+								  uint64_t n_periods)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	uint32_t step = 1;
+
+	if (low >= size || adf->time_index[low] >= n_periods) { return low; }
+	while (step < size - low && adf->time_index[low + step] < n_periods) {
+		low += step;
+		step *= 2;
 	}
+	return search_time_index(adf, low + 1,
+							 step < size - low ? low + step + 1 : size,
+							 n_periods);
+}
 
-	return ADF_TIME_OUT_OF_BOUND;
+typedef struct {
+	uint64_t time;
+	size_t idx;
+} timed_query_t;
+
+static int compare_queries(const void *x, const void *y)
+{
+	const timed_query_t *a = x, *b = y;
+	if (a->time != b->time) { return a->time < b->time ? -1 : 1; }
+	return 0;
+}
+
+uint16_t get_series_at_many(adf_t *adf, const uint64_t *times, size_t n,
+							series_t **out)
+{
+	const uint64_t period = adf->metadata.period_sec.val;
+	const uint32_t size = adf->metadata.size_series.val;
+	timed_query_t *queries;
+	bool sorted = true;
+	uint32_t pos = 0;
+	uint16_t res = refresh_time_index(adf), status = ADF_OK;
+
+	if (res != ADF_OK) { return res; }
+
+	for (size_t k = 1; k < n && sorted; k++)
+		sorted = times[k - 1] <= times[k];
+
+	if (sorted) {
+		for (size_t k = 0; k < n; k++) {
+			pos = gallop_time_index(adf, pos,
+									periods_to_reach(period, times[k]));
+			out[k] = pos < size ? adf->series + pos : NULL;
+			if (pos == size) { status = ADF_TIME_OUT_OF_BOUND; }
+		}
+		return status;
+	}
+
+	/* the same pass, over the times in increasing order */
+	queries = adf_malloc(NULL, n * sizeof(timed_query_t));
+	if (!queries) { return ADF_RUNTIME_ERROR; }
+	for (size_t k = 0; k < n; k++)
+		queries[k] = (timed_query_t){ .time = times[k], .idx = k };
+	qsort(queries, n, sizeof(timed_query_t), &compare_queries);
+
+	for (size_t k = 0; k < n; k++) {
+		pos = gallop_time_index(adf, pos,
+								periods_to_reach(period, queries[k].time));
+		out[queries[k].idx] = pos < size ? adf->series + pos : NULL;
+		if (pos == size) { status = ADF_TIME_OUT_OF_BOUND; }
+	}
+	adf_dealloc(NULL, queries);
+	return status;
 }
 
 uint16_t cpy_series_starting_at(series_t *series, const adf_t *adf,
@@ -936,96 +3669,138 @@ uint16_t cpy_series_starting_at(series_t *series, const adf_t *adf,
 
 uint16_t update_series(adf_t *adf, const series_t *series, uint64_t time)
 {
-	series_t *current, *tmp;
-	uint16_t res, series_period = adf->metadata.period_sec.val;
-	uint32_t new_series_size, size_series_increment;
-	uint64_t l_bound_nth_series = 0, u_bound_nth_series = 0;
+	series_t *current, inserted, suffix;
+	const uint64_t series_period = adf->metadata.period_sec.val;
+	series_digest_t digest;
+	uint16_t res;
+	uint32_t i, j = 0, len = 0, size, n_before, n_after, increment;
+	uint64_t start, n_periods;
 
-	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
-		current = adf->series + i;
-		l_bound_nth_series = u_bound_nth_series;
-		u_bound_nth_series = l_bound_nth_series
-							 + (current->repeated.val * series_period);
+	res = find_series_at(adf, time, &i, &start);
+	if (res != ADF_OK) { return res; }
+	size = adf->metadata.size_series.val;
+
+	/* from this series onwards, the time index has to be recomputed */
+	adf_invalidate_time_index(adf, i);
 
-		if (time > u_bound_nth_series) { continue; }
+	digest = digest_series(series, adf);
+	n_periods = series_period > 0 ? time / series_period : 0;
+	for (;;) {
+		current = adf->series + i;
 
 		/* if the two series are eual, nothing to do */
 		DEBUG_LOG("--- comparing series in position %d ...\n", i);
-		if (are_series_equal(current, series, adf)) {
-			adf->metadata.n_series += (series->repeated.val 
+		if (!are_digests_apart(stored_digest(adf, current), &digest, adf)
+			&& are_series_equal(current, series, adf)) {
+			adf->metadata.n_series += (series->repeated.val
 									  - current->repeated.val);
 			current->repeated = series->repeated;
 			return ADF_OK;
 		}
+		if (current->repeated.val == 1) { break; }
+
+		/* the repetition that contains `time` */
+		len = current->repeated.val;
+		j = n_periods - start;
+		if (j < len) { break; }
+
+		/*
+		 * A time at the very end of a repeated series belongs to the first
+		 * repetition of the following one: past the last series, it's out
+		 * of bound.
+		 */
+		if (++i == size) { return ADF_TIME_OUT_OF_BOUND; }
+		start += len;
+		n_periods = start;
+	}
 
-		DEBUG_LOG("Series to update is not equal to the previous one\n");
-
-		if (current->repeated.val == 1) {
-			DEBUG_LOG("Repeated just one time, nothing to split\n");
-
-			adf->metadata.n_series += (series->repeated.val
-									  - current->repeated.val);
-			series_free(current);
-			cpy_adf_series(current, series, adf);
-			return ADF_OK;
-		}
+	DEBUG_LOG("Series to update is not equal to the previous one\n");
 
-		for (uint32_t j = 0, len = current->repeated.val; j < len; j++) {
-			u_bound_nth_series = l_bound_nth_series + series_period;
-			if (time < l_bound_nth_series || time >= u_bound_nth_series) {
-				l_bound_nth_series += series_period; 
-				u_bound_nth_series += series_period;
-				continue;
-			}
+	res = cpy_series(&inserted, series, adf, adf->allocator);
+	if (res != ADF_OK) { return res; }
+	inserted.digest = digest;
+	res = register_additives(adf, &inserted);
+	if (res != ADF_OK) {
+		release_series(adf, &inserted);
+		return res;
+	}
 
-			tmp = malloc((adf->metadata.size_series.val - i - 1) 
-						  * sizeof(series_t));
-			res = cpy_series_starting_at(tmp, adf, i + 1);
-			if (res != ADF_OK) { return res; }
+	if (current->repeated.val == 1) {
+		DEBUG_LOG("Repeated just one time, nothing to split\n");
 
-			size_series_increment = (j == len - 1) ? 1 : 2;
-			new_series_size = adf->metadata.size_series.val
-							  + size_series_increment;
-			adf->metadata.size_series.val = new_series_size;
-			adf->series = realloc(adf->series, new_series_size
-								  * sizeof(series_t));
-			if (!adf->series) { return ADF_RUNTIME_ERROR; }
+		adf->metadata.n_series += (series->repeated.val
+								  - current->repeated.val);
+		release_series(adf, current);
+		*current = inserted;
+		return ADF_OK;
+	}
 
-			res = cpy_adf_series(adf->series + (i+1), series, adf);
-			if (res != ADF_OK) { return res; }
-			adf->series[i].repeated.val = j;
-			if (size_series_increment == 2) {
-				res = cpy_adf_series(adf->series + (i+2), adf->series + i, adf);
-				if (res != ADF_OK) { return res; }
-				adf->series[i+2].repeated.val = 1;
-			}
-			for (uint32_t k1 = i + size_series_increment + 1, k2 = 0; k1 < l; k1++, k2++) {
-				res = cpy_adf_series(adf->series + k1, tmp + k2, adf);
-				if (res != ADF_OK) { return res; }
-			}
-			free(tmp);
-			return ADF_OK;
+	/*
+	 * The repetition that contains `time` is replaced, and the series is
+	 * split into the repetitions before and after it.
+	 */
+	n_before = j;
+	n_after = len - j - 1;
+	increment = (n_before > 0) + (n_after > 0);
+
+	/* the repetitions before and after can't share the same arrays */
+	if (n_before > 0 && n_after > 0) {
+		res = cpy_series(&suffix, current, adf, adf->allocator);
+		if (res != ADF_OK) {
+			release_series(adf, &inserted);
+			return res;
 		}
 	}
+	else {
+		suffix = *current;
+	}
 
-	return ADF_TIME_OUT_OF_BOUND;
+	if (!reserve_series_capacity(adf, size + increment)) {
+		if (n_before > 0 && n_after > 0) { release_series(adf, &suffix); }
+		release_series(adf, &inserted);
+		return ADF_RUNTIME_ERROR;
+	}
+	current = adf->series + i;
+
+	/* only the descriptors of the following series are moved */
+	memmove(adf->series + i + 1 + increment, adf->series + i + 1,
+			(size - i - 1) * sizeof(series_t));
+	if (n_before > 0) {
+		current->repeated.val = n_before;
+		current++;
+	}
+	*current = inserted;
+	if (n_after > 0) {
+		suffix.repeated.val = n_after;
+		current[1] = suffix;
+	}
+
+	adf->metadata.size_series.val = size + increment;
+	adf->metadata.n_series += series->repeated.val - 1;
+	return ADF_OK;
 }
 
 uint16_t set_series(adf_t *adf, const series_t *series, uint32_t size)
 {
 	uint16_t res;
 	for (uint32_t i = 0; i < adf->metadata.size_series.val; i++) {
-		series_free(adf->series + i);
+		release_series(adf, adf->series + i);
 	}
-	if (adf->metadata.size_series.val > 0)
-		free(adf->series);
+	/* reserved series leave an array even when there are none */
+	if (adf->series) adf_dealloc(adf->allocator, adf->series);
+	adf_dealloc(adf->allocator, adf->slab);
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf_invalidate_time_index(adf, 0);
+	adf->series_capacity = 0;
 
 	adf->metadata.size_series.val = size;
-	adf->series = malloc(size * sizeof(series_t));
+	adf->series = adf_malloc(adf->allocator, size * sizeof(series_t));
 	if (!adf->series) { return ADF_RUNTIME_ERROR; }
 	for (uint32_t i = 0; i < adf->metadata.size_series.val; i++) {
-		res = cpy_adf_series(adf->series + i, series + i, adf);
+		res = cpy_series(adf->series + i, series + i, adf, adf->allocator);
 		if (res != ADF_OK) { return res; }
+		adf->series[i].digest = digest_series(adf->series + i, adf);
 	}
 
 	return ADF_OK;
@@ -1047,98 +3822,183 @@ uint16_t set_harvest_time(adf_t *adf, uint64_t time_sec)
 	return ADF_OK;
 }
 
-static uint_t *get_additive_codes(pair_t *pairs, size_t size)
+static uint32_t id(void *key)
 {
-	uint_t *additives = malloc(size * sizeof(uint_t));
-	for (size_t i = 0; i < size; i++) {
-		additives[i].val = pairs[i].key;
-		pairs[i].value = i;
-	}
-	return additives;
+	return *((uint32_t *) key);
 }
 
-static uint32_t id(void *key)
+/*
+ * The series are split into this many chunks per thread, each collecting
+ * its own codes: chunks are balanced among the threads by `parallel_for`.
+ */
+#define REINDEX_CHUNKS_PER_THREAD 4
+
+typedef struct {
+	adf_t *adf;
+
+	/* the chunks of series, and the codes found in each of them */
+	uint32_t chunk_size;
+	table_t *chunk_codes;
+	uint16_t *chunk_res;
+
+	/* all the codes, mapped to their position */
+	const table_t *codes;
+} reindex_job_t;
+
+static uint16_t put_series_codes(table_t *codes, const series_t *series)
 {
-	return *((uint32_t *) key);
+	const uint32_t n_soil = series->n_soil_adds.val,
+				   n_total = n_soil + series->n_atm_adds.val;
+	uint16_t res;
+
+	for (uint32_t i = 0; i < n_total; i++) {
+		res = table_put(codes, i < n_soil
+							   ? series->soil_additives[i].code.val
+							   : series->atm_additives[i - n_soil].code.val,
+						0);
+		if (res == LM_MAP_SIZE_OVERFLOW) { return ADF_ADDITIVE_OVERFLOW; }
+		if (res != LM_OK) { return ADF_RUNTIME_ERROR; }
+	}
+	return ADF_OK;
 }
 
-uint16_t reindex_additives(adf_t *adf)
+/* Collects the codes of each chunk, in order of appearance */
+static void collect_codes_range(void *ctx, uint32_t begin, uint32_t end)
 {
-	table_t lookup_table;
-	uint16_t table_code, add_idx, n_soil, n_atm;
-	pair_t *additives_keys;
+	reindex_job_t *job = ctx;
+	const uint32_t size = job->adf->metadata.size_series.val;
+	uint32_t first, last;
+	uint16_t res;
 
-	if (adf->metadata.n_series == 0) {
-		adf->metadata.additive_codes = NULL;
-		adf->metadata.n_additives.val = 0;
-		return ADF_OK;
+	for (uint32_t chunk = begin; chunk < end; chunk++) {
+		first = chunk * job->chunk_size < size
+				? chunk * job->chunk_size
+				: size;
+		last = size - first > job->chunk_size
+			   ? first + job->chunk_size
+			   : size;
+		res = table_init(job->chunk_codes + chunk, 16, 16, &id) == LM_OK
+			  ? ADF_OK
+			  : ADF_RUNTIME_ERROR;
+		for (uint32_t i = first; i < last && res == ADF_OK; i++)
+			res = put_series_codes(job->chunk_codes + chunk,
+								   job->adf->series + i);
+		job->chunk_res[chunk] = res;
 	}
+}
 
-	/*
-	 * Since the additive code is a unique integer id we do not need an hash 
-	 * function. Hence, the `id` function just return the 4-byte additive code
-	 */
-	if ((table_code = table_init(&lookup_table, 1024, 1024, &id)) != LM_OK)
-		return ADF_RUNTIME_ERROR;
+static void assign_codes_range(void *ctx, uint32_t begin, uint32_t end)
+{
+	reindex_job_t *job = ctx;
+	series_t *series;
+	additive_t *additive;
+	uint32_t n_soil, n_total;
 
-	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
-		n_soil = adf->series[i].n_soil_adds.val;
-		n_atm = adf->series[i].n_atm_adds.val;
-		for (uint16_t j = 0; j < n_soil; j++) {
-			table_code = table_put(&lookup_table,
-								   adf->series[i].soil_additives[j].code.val,
-								   j);
-			if (table_code == LM_MAP_SIZE_OVERFLOW)
-				return ADF_ADDITIVE_OVERFLOW;
-			if (table_code != LM_OK)
-				return ADF_RUNTIME_ERROR;
+	for (uint32_t i = begin; i < end; i++) {
+		series = job->adf->series + i;
+		n_soil = series->n_soil_adds.val;
+		n_total = n_soil + series->n_atm_adds.val;
+		for (uint32_t j = 0; j < n_total; j++) {
+			additive = j < n_soil
+					   ? series->soil_additives + j
+					   : series->atm_additives + (j - n_soil);
+			additive->code_idx.val = table_get(job->codes,
+											   additive->code.val);
 		}
+	}
+}
 
-		for (uint16_t j = 0; j < n_atm; j++) {
-			table_code = table_put(&lookup_table,
-								   adf->series[i].atm_additives[j].code.val,
-								   j);
-			if (table_code == LM_MAP_SIZE_OVERFLOW)
-				return ADF_ADDITIVE_OVERFLOW;
-			if (table_code != LM_OK)
-				return ADF_RUNTIME_ERROR;
+/*
+ * Merges the codes of the chunks, keeping the order of their first
+ * appearance, so that the result doesn't depend on the number of threads.
+ */
+static uint16_t merge_chunk_codes(table_t *codes, const reindex_job_t *job,
+								  uint32_t n_chunks)
+{
+	const table_t *chunk;
+	uint32_t key, pos;
+	uint16_t res;
+
+	for (uint32_t c = 0; c < n_chunks; c++) {
+		if (job->chunk_res[c] != ADF_OK) { return job->chunk_res[c]; }
+		chunk = job->chunk_codes + c;
+		for (size_t i = 0; i < chunk->size; i++) {
+			key = chunk->pairs[i].key;
+			if (table_find(codes, key, &pos) == LM_OK) { continue; }
+			if (codes->size == 0xFFFF) { return ADF_ADDITIVE_OVERFLOW; }
+			res = table_put(codes, key, codes->size);
+			if (res != LM_OK) { return ADF_RUNTIME_ERROR; }
 		}
 	}
+	return ADF_OK;
+}
+
+uint16_t reindex_additives_parallel(adf_t *adf, uint32_t n_threads)
+{
+	const uint32_t size = adf->metadata.size_series.val;
+	reindex_job_t job = { .adf = adf };
+	uint32_t n_chunks;
+	table_t codes;
+	uint_t *additive_codes = NULL;
+	uint16_t res;
 
-	additives_keys = malloc(lookup_table.size * sizeof(pair_t));
-	if (table_get_pairs(&lookup_table, additives_keys) != LM_OK) {
+	DEBUG_LOG("------- reindex_additives -------\n");
+
+	n_threads = parallel_n_threads(n_threads);
+	n_chunks = n_threads * REINDEX_CHUNKS_PER_THREAD;
+	if (n_chunks > size) { n_chunks = size > 0 ? size : 1; }
+	job.chunk_size = (size + n_chunks - 1) / n_chunks;
+	job.chunk_codes = adf_calloc(NULL, n_chunks, sizeof(table_t));
+	job.chunk_res = adf_malloc(NULL, n_chunks * sizeof(uint16_t));
+	if (!job.chunk_codes || !job.chunk_res
+		|| table_init(&codes, 16, 16, &id) != LM_OK) {
+		adf_dealloc(NULL, job.chunk_codes);
+		adf_dealloc(NULL, job.chunk_res);
 		return ADF_RUNTIME_ERROR;
 	}
 
-	adf->metadata.additive_codes = get_additive_codes(additives_keys,
-													  lookup_table.size);
-	adf->metadata.n_additives.val = (uint16_t)lookup_table.size;
-
-	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
-		n_soil = adf->series[i].n_soil_adds.val;
-		n_atm = adf->series[i].n_atm_adds.val;
-		additive_t *current;
-		for (uint16_t j = 0; j < n_soil; j++) {
-			current = (adf->series[i].soil_additives + j);
-			add_idx = (uint16_t) table_get(&lookup_table,
-
-										   current->code.val);
-			current->code_idx.val = add_idx;
-		}
-		for (uint16_t j = 0; j < n_atm; j++) {
-			current = (adf->series[i].atm_additives + j);
-			add_idx = (uint16_t) table_get(&lookup_table,
-										   current->code.val);
-			current->code_idx.val = add_idx;
-		}
+	parallel_for(n_chunks, 1, n_threads, &collect_codes_range, &job);
+	res = merge_chunk_codes(&codes, &job, n_chunks);
+	for (uint32_t c = 0; c < n_chunks; c++)
+		if (job.chunk_codes[c].pairs) { table_free(job.chunk_codes + c); }
+	adf_dealloc(NULL, job.chunk_codes);
+	adf_dealloc(NULL, job.chunk_res);
+
+	if (res == ADF_OK && codes.size > 0) {
+		additive_codes = adf_malloc(adf->allocator,
+									codes.size * sizeof(uint_t));
+		if (!additive_codes) { res = ADF_RUNTIME_ERROR; }
+	}
+	if (res != ADF_OK) {
+		table_free(&codes);
+		return res;
 	}
 
-	table_free(&lookup_table);
-	free(additives_keys);
+	/* every code has its position: the series can be updated in parallel */
+	for (size_t i = 0; i < codes.size; i++)
+		additive_codes[i].val = codes.pairs[i].key;
+	job.codes = &codes;
+	parallel_for(size, size / (n_threads * 8) + 1, n_threads,
+				 &assign_codes_range, &job);
+
+	adf_dealloc(adf->allocator, adf->metadata.additive_codes);
+	adf->metadata.additive_codes = additive_codes;
+	adf->metadata.n_additives.val = codes.size;
+	table_free(&codes);
+
+	/* the codes have a new order: the index is rebuilt */
+	adf->metadata.additive_index_size = 0;
+	if (!refresh_additive_index(&adf->metadata, adf->allocator, 0))
+		return ADF_RUNTIME_ERROR;
 
 	return ADF_OK;
 }
 
+uint16_t reindex_additives(adf_t *adf)
+{
+	return reindex_additives_parallel(adf, 1);
+}
+
 wavelength_info_t create_wavelength_info(uint16_t min_w_len_nm,
 										 uint16_t max_w_len_nm,
 										 uint16_t n_wavelength)
@@ -1247,8 +4107,11 @@ void  metadata_init(adf_meta_t *metadata, uint32_t period_sec)
 {
 	metadata->additive_codes = NULL;
 	metadata->n_additives.val = 0;
+	reset_additive_index(metadata);
 	metadata->size_series.val = 0;
 	metadata->period_sec.val = period_sec;
+	metadata->seeded.val = 0;
+	metadata->harvested.val = 0;
 	metadata->n_series = 0;
 }
 
@@ -1259,6 +4122,13 @@ void adf_init(adf_t *adf, adf_header_t header, uint32_t period_sec)
 	adf->header = header;
 	adf->metadata = metadata;
 	adf->series = NULL;
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf->allocator = NULL;
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
 }
 
 uint16_t init_empty_series(series_t *series, uint32_t n_chunks,
@@ -1267,14 +4137,17 @@ uint16_t init_empty_series(series_t *series, uint32_t n_chunks,
 {
 	series->n_soil_adds.val = n_soil_additives;
 	series->n_atm_adds.val = n_atm_additives;
-	series->env_temp_c = calloc(n_chunks, sizeof(real_t));
-	series->water_use_ml = calloc(n_chunks, sizeof(real_t));
-	series->soil_additives = calloc(n_soil_additives,
-									sizeof(additive_t));
-	series->atm_additives = calloc(n_atm_additives,
-								   sizeof(additive_t));
-	series->light_exposure = calloc(n_chunks * n_waves, sizeof(real_t));
-	series->soil_temp_c = calloc(n_chunks * n_depth, sizeof(real_t));
+	series->digest = (series_digest_t) { 0 };
+	series->env_temp_c = adf_calloc(NULL, n_chunks, sizeof(real_t));
+	series->water_use_ml = adf_calloc(NULL, n_chunks, sizeof(real_t));
+	series->soil_additives = adf_calloc(NULL, n_soil_additives,
+										sizeof(additive_t));
+	series->atm_additives = adf_calloc(NULL, n_atm_additives,
+									   sizeof(additive_t));
+	series->light_exposure = adf_calloc(NULL, n_chunks * n_waves,
+										sizeof(real_t));
+	series->soil_temp_c = adf_calloc(NULL, n_chunks * n_depth,
+									 sizeof(real_t));
 
 	if (!series->env_temp_c
 		|| !series->water_use_ml
@@ -1439,44 +4312,79 @@ adf_t *new_empty_adf(void)
 {
 	adf_t *adf = malloc(sizeof(adf_t));
 	adf->series = NULL;
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf->allocator = NULL;
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
 	return adf;
 }
 
-void metadata_free(adf_meta_t *metadata)
+static void metadata_dealloc(const adf_allocator_t *allocator,
+							 adf_meta_t *metadata)
 {
-	free(metadata->additive_codes);
+	adf_dealloc(allocator, metadata->additive_codes);
+	adf_dealloc(allocator, metadata->additive_index);
 	metadata->additive_codes = NULL;
+	reset_additive_index(metadata);
 }
 
-void series_free(series_t *series)
+void metadata_free(adf_meta_t *metadata)
 {
-	free(series->light_exposure);
-	free(series->soil_temp_c);
-	free(series->env_temp_c);
-	free(series->water_use_ml);
-	if (series->n_soil_adds.val > 0) { free(series->soil_additives); }
-	if (series->n_atm_adds.val > 0) { free(series->atm_additives); }
+	metadata_dealloc(NULL, metadata);
+}
+
+static void series_dealloc(const adf_allocator_t *allocator, series_t *series)
+{
+	adf_dealloc(allocator, series->light_exposure);
+	adf_dealloc(allocator, series->soil_temp_c);
+	adf_dealloc(allocator, series->env_temp_c);
+	adf_dealloc(allocator, series->water_use_ml);
+	if (series->n_soil_adds.val > 0)
+		adf_dealloc(allocator, series->soil_additives);
+	if (series->n_atm_adds.val > 0)
+		adf_dealloc(allocator, series->atm_additives);
 
 	series->light_exposure = NULL;
+	series->soil_temp_c = NULL;
 	series->env_temp_c = NULL;
 	series->water_use_ml = NULL;
 	series->soil_additives = NULL;
 	series->atm_additives = NULL;
 }
 
+void series_free(series_t *series)
+{
+	series_dealloc(NULL, series);
+}
+
 void adf_free(adf_t *adf)
 {
 	DEBUG_LOG("------- adf_free -------\n");
 	adf_meta_t *metadata = (adf_meta_t *) &(adf->metadata);
-	metadata_free(metadata);
+	metadata_dealloc(adf->allocator, metadata);
 	DEBUG_LOG("metadata has been freed\n");
 	for (uint32_t i = 0, l = adf->metadata.size_series.val; i < l; i++) {
-		series_free(adf->series + i);
+		release_series(adf, adf->series + i);
 		DEBUG_LOG("series #%u has been freed\n", i);
 	}
-	if (adf->series) free(adf->series);
+	if (adf->series) adf_dealloc(adf->allocator, adf->series);
 	DEBUG_LOG("Series array has been freed\n");
 	adf->series = NULL;
+	adf_dealloc(adf->allocator, adf->slab);
+	adf->slab = NULL;
+	adf->slab_size = 0;
+	adf_dealloc(adf->allocator, adf->time_index);
+	adf->time_index = NULL;
+	adf->time_index_size = 0;
+	adf->time_index_capacity = 0;
+	adf->series_capacity = 0;
+
+	/* everything has been given back, the allocator can start over */
+	if (adf->allocator && adf->allocator->reset)
+		adf->allocator->reset(adf->allocator->ctx);
 }
 
 void metadata_delete(adf_meta_t *metadata)
@@ -1509,8 +4417,8 @@ uint16_t cpy_additive(additive_t *target, const additive_t *source)
 	return ADF_OK;
 }
 
-uint16_t cpy_adf_series(series_t *target, const series_t *source,
-						const adf_t *adf)
+static uint16_t cpy_series(series_t *target, const series_t *source,
+						   const adf_t *adf, const adf_allocator_t *allocator)
 {
 	uint32_t n_chunks;
 	uint16_t res, n_waves, n_depth;
@@ -1527,10 +4435,13 @@ uint16_t cpy_adf_series(series_t *target, const series_t *source,
 	target->pH = source->pH;
 	target->repeated = source->repeated;
 	target->soil_density_kg_m3 = source->soil_density_kg_m3;
-	target->water_use_ml = malloc(n_chunks * sizeof(real_t));
-	target->env_temp_c = malloc(n_chunks * sizeof(real_t));
-	target->light_exposure = malloc(n_chunks * n_waves * sizeof(real_t));
-	target->soil_temp_c = malloc(n_chunks * n_depth * sizeof(real_t));
+	target->digest = source->digest;
+	target->water_use_ml = adf_malloc(allocator, n_chunks * sizeof(real_t));
+	target->env_temp_c = adf_malloc(allocator, n_chunks * sizeof(real_t));
+	target->light_exposure = adf_malloc(allocator, n_chunks * n_waves
+												   * sizeof(real_t));
+	target->soil_temp_c = adf_malloc(allocator, n_chunks * n_depth
+												* sizeof(real_t));
 	target->soil_additives = NULL;
 	target->atm_additives = NULL;
 
@@ -1546,8 +4457,8 @@ uint16_t cpy_adf_series(series_t *target, const series_t *source,
 	}
 
 	if (source->n_soil_adds.val > 0) {
-		target->soil_additives = malloc(target->n_soil_adds.val
-										* sizeof(additive_t));
+		target->soil_additives = adf_malloc(allocator, target->n_soil_adds.val
+														* sizeof(additive_t));
 		for (uint16_t i = 0, l = target->n_soil_adds.val; i < l; i++) {
 			res = cpy_additive(target->soil_additives + i,
 							   source->soil_additives + i);
@@ -1556,8 +4467,8 @@ uint16_t cpy_adf_series(series_t *target, const series_t *source,
 	}
 
 	if (source->n_atm_adds.val > 0) {
-		target->atm_additives = malloc(target->n_atm_adds.val
-									   * sizeof(additive_t));
+		target->atm_additives = adf_malloc(allocator, target->n_atm_adds.val
+													   * sizeof(additive_t));
 		for (uint16_t i = 0, l = target->n_atm_adds.val; i < l; i++) {
 			res = cpy_additive(target->atm_additives + i,
 							   source->atm_additives + i);
@@ -1568,13 +4479,21 @@ uint16_t cpy_adf_series(series_t *target, const series_t *source,
 	return ADF_OK;
 }
 
+uint16_t cpy_adf_series(series_t *target, const series_t *source,
+						const adf_t *adf)
+{
+	return cpy_series(target, source, adf, NULL);
+}
+
 uint16_t cpy_adf_metadata(adf_meta_t *target, const adf_meta_t *source)
 {
 	if (!source) { return ADF_NULL_META_SOURCE; }
 	if (!target) { return ADF_NULL_META_TARGET; }
 
 	*target = *source;
-	target->additive_codes = malloc(target->n_additives.val * sizeof(uint_t));
+	reset_additive_index(target);
+	target->additive_codes = adf_malloc(NULL, target->n_additives.val
+											  * sizeof(uint_t));
 
 	for (uint16_t i = 0, l = target->n_additives.val; i < l; i++)
 		target->additive_codes[i] = source->additive_codes[i];
@@ -1599,6 +4518,15 @@ uint16_t cpy_adf(adf_t *target, const adf_t *source)
 	if (!source) { return ADF_NULL_SOURCE; }
 	if (!target) { return ADF_NULL_TARGET; }
 
+	/* the copied series are always allocated one by one */
+	target->slab = NULL;
+	target->slab_size = 0;
+	target->allocator = NULL;
+	target->time_index = NULL;
+	target->time_index_size = 0;
+	target->time_index_capacity = 0;
+	target->series_capacity = 0;
+
 	res = cpy_adf_header(&target->header, &source->header);
 	if (res != ADF_OK) { return res; }
 
@@ -1607,7 +4535,7 @@ uint16_t cpy_adf(adf_t *target, const adf_t *source)
 
 	size_series = source->metadata.size_series.val;
 	if (size_series > 0) {
-		target->series = malloc(size_series * sizeof(series_t));
+		target->series = adf_malloc(NULL, size_series * sizeof(series_t));
 		for (uint32_t i = 0, l = target->metadata.size_series.val; i < l; i++) {
 			res = cpy_adf_series(target->series + i, source->series + i,
 								source);
@@ -1901,6 +4829,11 @@ uint8_t get_ADD_T_SIZE(void)
 	return ADD_T_SIZE;
 }
 
+uint16_t get_SERIES_T_SIZE(void)
+{
+	return sizeof(series_t);
+}
+
 uint32_t get_ADF_DAY(void)
 {
 	return ADF_DAY;
@@ -30,6 +30,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 /* The (hex) bytes of `@ADF` */
@@ -50,11 +51,67 @@ extern "C" {
  *     Patch version -> 0x1
  * So, this ADF version is 1.10.1
  */
-#define __ADF_VERSION__ 0x0092u
+#define __ADF_VERSION__ 0x00A0u
 #define MAJOR_VERSION_MASK 0xFF00u
 #define MINOR_VERSION_MASK 0x00F0u
 #define PATCH_VERSION_MASK 0x000Fu
 
+/*
+ * The first version whose header contains the field `flags`: the header of
+ * the previous versions is one byte shorter, and it has no flags set.
+ */
+#define ADF_HEADER_FLAGS_VERSION 0x00A0u
+
+/*
+ * The flags of the header, each of them telling that an optional section
+ * is present.
+ *     ADF_FLAG_SERIES_INDEX: the series are followed by the series index,
+ *     i.e. a table with the offset (in bytes, from the beginning of the
+ *     object) and the start (in periods) of each series, which can be
+ *     reached without reading the ones before it.
+ *     ADF_FLAG_XOR_ARRAYS: the arrays of each series are compressed, along
+ *     the chunk axis, by the lossless XOR codec of codec.h. Such a series
+ *     starts with the size of its encoded arrays, which are moved right
+ *     before the field `repeated`.
+ *     ADF_FLAG_QUANTIZED_ARRAYS: the arrays of each series are stored, in
+ *     the same layout, by the quantized codec of codec.h: each value is a
+ *     multiple of the precision of its quantity (see precision_info_t, with
+ *     EPSILON for a precision of 0), and it's decoded within that precision.
+ *     ADF_FLAG_LZ_ARRAYS: the arrays of each series, in the order and byte
+ *     order of an uncompressed series, are cut in blocks of
+ *     ADF_ARRAYS_BLOCK_SIZE bytes (the last one may be shorter), and each
+ *     block is compressed by the LZ codec of codec.h, in the same layout. A
+ *     block starts with its size in 2 bytes: if it's the size of the block,
+ *     the bytes are stored as they are, because they didn't compress.
+ *     The arrays are encoded by one codec only: ADF_FLAG_LZ_ARRAYS can't
+ *     be set along with either of the others, and such a header is
+ *     rejected, while with both ADF_FLAG_QUANTIZED_ARRAYS and
+ *     ADF_FLAG_XOR_ARRAYS the quantized codec is used.
+ *     ADF_FLAG_SHUFFLE_ARRAYS: the arrays of each series are cut in the same
+ *     blocks, and the bytes of each block are shuffled (see shuffle.h), so
+ *     that the first bytes of all its values come first, then the second
+ *     ones, and so on. The blocks are stored in the same layout, and with
+ *     ADF_FLAG_LZ_ARRAYS they are shuffled before they are compressed. The
+ *     flag is ignored when the arrays are encoded by the quantized or the
+ *     XOR codec, which don't work on bytes.
+ */
+#define ADF_FLAG_SERIES_INDEX     0x01u
+#define ADF_FLAG_XOR_ARRAYS       0x02u
+#define ADF_FLAG_QUANTIZED_ARRAYS 0x04u
+#define ADF_FLAG_LZ_ARRAYS        0x08u
+#define ADF_FLAG_SHUFFLE_ARRAYS   0x10u
+
+/*
+ * All the flags above. A header with any other bit set was written by a
+ * later version, and it's rejected instead of being misread.
+ */
+#define ADF_FLAGS_KNOWN (ADF_FLAG_SERIES_INDEX | ADF_FLAG_XOR_ARRAYS \
+						 | ADF_FLAG_QUANTIZED_ARRAYS | ADF_FLAG_LZ_ARRAYS \
+						 | ADF_FLAG_SHUFFLE_ARRAYS)
+
+/* The number of bytes of the arrays shuffled or compressed at a time */
+#define ADF_ARRAYS_BLOCK_SIZE 16384
+
 /*
  * Used for the comparison of floating point numbers: numbers that have the
  * first three decimals equal, are considered equals.
@@ -131,6 +188,23 @@ typedef enum {
 	ADF_RM_MAVG = 0x02u
 } reduction_code_t;
 
+/*
+ * Access hints that can be combined and passed to `adf_open_file`. They are
+ * forwarded to the kernel (madvise) when the file is memory-mapped, and
+ * ignored otherwise.
+ */
+typedef enum {
+
+	/* No hint */
+	ADF_FILE_DEFAULT    = 0x00u,
+
+	/* The file is read from the beginning to the end, just once */
+	ADF_FILE_SEQUENTIAL = 0x01u,
+
+	/* The whole file is going to be read soon: start reading ahead */
+	ADF_FILE_WILLNEED   = 0x02u
+} file_flag_t;
+
 /*
  * It contains the exit code of the functions that handle the adf_t structure.
  */
@@ -293,6 +367,29 @@ typedef struct {
 	real_t concentration;
 } __attribute__(( packed )) additive_t;
 
+/*
+ * A summary of the content of a series, kept by the adf structure for each
+ * of its series. It's never marshalled.
+ */
+typedef struct {
+
+	/*
+	 * The fingerprint of the series (see `series_fingerprint`). The value 0
+	 * means that the digest hasn't been computed yet.
+	 */
+	uint64_t fingerprint;
+
+	/*
+	 * The sums of the elements of env_temp_c, water_use_ml, light_exposure
+	 * and soil_temp_c, and the sum of the absolute values of all of them.
+	 * They bound the distance between two series: when the sums of two
+	 * series are too far apart, the series can't be equal, and their arrays
+	 * don't need to be compared.
+	 */
+	double sums[4];
+	double magnitude;
+} __attribute__(( packed )) series_digest_t;
+
 /*
  * The structure that contains the data series.
  */
@@ -364,6 +461,15 @@ typedef struct {
 	 * be returned.
 	 */
 	uint_t repeated;
+
+	/*
+	 * This field won't be serialized into the binary file. It's computed by
+	 * the adf structure when the series is stored, and it's ignored in the
+	 * series passed to it. If the content of a stored series is changed
+	 * directly, or if a series is placed directly in the `series` array,
+	 * this field must be set to zero.
+	 */
+	series_digest_t digest;
 } __attribute__(( packed )) series_t;
 
 /*
@@ -419,6 +525,18 @@ typedef struct {
 	 * additive should appear just once.
 	 */
 	uint_t *additive_codes;
+
+	/*
+	 * A hash index over `additive_codes`, used to find the position of a
+	 * code when a series is added. It's an open addressing table of
+	 * `additive_index_capacity` slots (a power of two), each of them holding
+	 * the position of a code plus one, or zero if it's empty. Only the first
+	 * `additive_index_size` codes are indexed: the others are indexed the
+	 * next time the index is needed. This field won't be marshalled.
+	 */
+	uint32_t *additive_index;
+	uint32_t additive_index_capacity;
+	uint32_t additive_index_size;
 } __attribute__(( packed )) adf_meta_t;
 
 typedef struct {
@@ -558,8 +676,35 @@ typedef struct {
 	 * The number of chunks in which each data series is (equally) divided.
 	 */
 	uint_t n_chunks;
+
+	/*
+	 * A combination of the ADF_FLAG_* flags. It's set by the user before the
+	 * object is marshalled, to ask for the optional sections.
+	 */
+	uint8_t flags;
 } __attribute__(( packed )) adf_header_t;
 
+/*
+ * A set of hooks that replace malloc, realloc and free. The context `ctx` is
+ * passed as the first parameter to each of them. The hook `reset` can be
+ * NULL; otherwise it's called by `adf_free` once all the memory of the adf
+ * structure has been freed (e.g. to rewind an arena).
+ */
+typedef struct {
+	void *(*alloc)(void *ctx, size_t size);
+	void *(*realloc)(void *ctx, void *ptr, size_t size);
+	void (*free)(void *ctx, void *ptr);
+	void (*reset)(void *ctx);
+	void *ctx;
+} adf_allocator_t;
+
+/*
+ * A bump allocator: each allocation just moves a cursor forward, and all of
+ * them are given back at once when the arena is reset. The structure is
+ * opaque; see the `adf_arena_*` functions.
+ */
+typedef struct adf_arena adf_arena_t;
+
 /*
  * The structure that contains all the ADF data.
  */
@@ -573,8 +718,159 @@ typedef struct {
 	 * If size_series == 0, then this array is set to NULL.
 	 */
 	series_t *series;
+
+	/*
+	 * If the object has been unmarshalled with `unmarshal_slab`, this is the
+	 * single chunk of memory of `slab_size` bytes that contains the arrays
+	 * of all the unmarshalled series, each of them starting on a cache line.
+	 * Otherwise it's NULL. It's owned by the adf structure, and released by
+	 * `adf_free`.
+	 */
+	void *slab;
+	size_t slab_size;
+
+	/*
+	 * The allocator used for the content of this structure. If it's NULL,
+	 * the default one is used (see `adf_set_default_allocator`).
+	 */
+	const adf_allocator_t *allocator;
+
+	/*
+	 * The time index: `time_index[i]` is the number of periods that have
+	 * elapsed at the end of the series `i` (i.e. the sum of the `repeated`
+	 * fields up to `i`). Only the first `time_index_size` entries are up to
+	 * date: the others are computed the next time the index is needed. It's
+	 * kept up to date by the functions that change the series; if they are
+	 * changed directly, `adf_invalidate_time_index` must be called.
+	 */
+	uint64_t *time_index;
+	uint32_t time_index_size;
+	uint32_t time_index_capacity;
+
+	/*
+	 * The number of series the `series` array has room for. It grows
+	 * geometrically as series are added, and it's halved when the array is
+	 * a quarter full. If it's less than `size_series`, the array has
+	 * exactly the size of the series.
+	 */
+	uint32_t series_capacity;
 } __attribute__(( packed )) adf_t;
 
+/*
+ * A read-only view over a serialized ADF object. Nothing is copied out of
+ * the byte array: header and metadata are decoded (and their crc checked)
+ * when the view is created, while the series are decoded on access.
+ * The byte array must outlive the view.
+ */
+typedef struct {
+
+	/* The serialized object, and its size in bytes. */
+	const uint8_t *bytes;
+	size_t size;
+
+	adf_header_t header;
+
+	/*
+	 * The field `additive_codes` is always NULL: the codes are read from
+	 * the byte array through `adf_view_additive_code`.
+	 */
+	adf_meta_t metadata;
+
+	/* The first (serialized) additive code. */
+	const uint8_t *additive_codes;
+
+	/*
+	 * The offset, from the beginning of `bytes`, of each series. This is the
+	 * only allocation performed by the view, and it has `size_series`
+	 * elements.
+	 */
+	size_t *series_offsets;
+} adf_view_t;
+
+/*
+ * A series of an adf_view_t. The arrays point directly to the serialized
+ * data, so they must be read through the `series_view_*` accessors, which
+ * convert each value to the host byte order.
+ */
+typedef struct {
+	const uint8_t *light_exposure;
+	const uint8_t *soil_temp_c;
+	const uint8_t *env_temp_c;
+	const uint8_t *water_use_ml;
+	uint8_t pH;
+	real_t p_bar;
+	real_t soil_density_kg_m3;
+	uint_small_t n_soil_adds;
+	uint_small_t n_atm_adds;
+	const uint8_t *soil_additives;
+	const uint8_t *atm_additives;
+	uint_t repeated;
+
+	/* Copied from the header, to index the matrices. */
+	uint16_t n_wavelength;
+	uint16_t n_depth;
+
+	/* Copied from the view, to resolve the additive codes. */
+	const uint8_t *additive_codes;
+} series_view_t;
+
+/* The default size of the buffer of an adf_writer_t: 256 KiB */
+#define ADF_WRITER_BUFFER_SIZE (256u * 1024u)
+
+/*
+ * Receives the bytes produced by `marshal_stream`, in order, and returns
+ * false if they cannot be written.
+ */
+typedef bool (*adf_write_fn)(void *ctx, const uint8_t *bytes, size_t size);
+
+/*
+ * The destination of `marshal_stream`. The bytes are collected in a buffer
+ * of fixed size, which is handed to `write` every time it's full: that's
+ * all the memory needed to marshal an object, however big it is. A writer
+ * can be reused for more objects. See the `adf_writer_*` functions.
+ */
+typedef struct {
+	adf_write_fn write;
+	void *ctx;
+	uint8_t *buffer;
+	size_t buffer_size;
+	size_t used;
+} adf_writer_t;
+
+/*
+ * Called by an adf_decoder_t for each series as soon as it's decoded, with
+ * its index. The series belongs to the decoder, and it's freed as soon as
+ * the callback returns: it must be copied to be kept. Returning anything
+ * but ADF_OK stops the decoder, which then reports that code.
+ */
+typedef uint16_t (*adf_series_fn)(void *ctx, const adf_t *adf,
+								  const series_t *series, uint32_t index);
+
+/*
+ * A decoder that is fed the serialized bytes a chunk at a time, as they
+ * arrive (e.g. from a pipe, a socket or a decompressor). Only the section
+ * being decoded is buffered: with a callback, memory doesn't grow with the
+ * number of series. See the `adf_decoder_*` functions.
+ */
+typedef struct {
+	adf_t *adf;
+	adf_series_fn on_series;
+	void *ctx;
+
+	/* The section being decoded, and the error that stopped the decoder */
+	uint8_t state;
+	uint16_t error;
+
+	/* The bytes of the section being decoded, when split among chunks */
+	uint8_t *buffer;
+	size_t used;
+	size_t capacity;
+
+	/* The number of series decoded so far, and of those in the file */
+	uint32_t n_decoded;
+	uint32_t size_series;
+} adf_decoder_t;
+
 /*
  * Returns the constant __ADF_VERSION__.
  */
@@ -586,7 +882,8 @@ uint16_t get_hex_version(void);
 version_t get_adf_version(void);
 
 /*
- * The size (bytes) of the adf header, including its crc field.
+ * The size (bytes) of the adf header, including its crc field, as it's
+ * written by this version of the library (see ADF_HEADER_FLAGS_VERSION).
  * IMPORTANT: This is *not* the size of the struct adf_header_t; this is the
  * size of the serialized header data. The actual size in memory of the
  * adf_header_t structure may be bigger, due to some redundant fields that
@@ -607,9 +904,10 @@ size_t size_medatata_t(adf_meta_t *);
  * The size (bytes) of *one* adf series, including the crc field. It takes the
  * number of chunks (i.e. the number of iterations in which some measures are
  * taken in the series) as the first parameter, and a series as the second.
- * Since all the series have the same size, we can get the size of all the
- * series block by multiplying this value with the field `size_series` in
- * metadata.
+ * Series with the same number of additives have the same size, unless
+ * their arrays are encoded (ADF_FLAG_XOR_ARRAYS, ADF_FLAG_QUANTIZED_ARRAYS or
+ * ADF_FLAG_LZ_ARRAYS): then the size depends on their values, and computing
+ * it takes as long as encoding them. Shuffled arrays keep their size.
  * IMPORTANT: This is *not* the size of the struct series_t; this is the
  * size of each serialized series. The actual size in memory of the series_t
  * structure may be bigger, due to some redundant fields that speed up the
@@ -618,11 +916,15 @@ size_t size_medatata_t(adf_meta_t *);
 size_t size_series_t(adf_t *, series_t *);
 
 /*
- * The size (bytes) of the adf object, including all the crc fields.
+ * The size (bytes) of the adf object, including all the crc fields and the
+ * optional sections asked by the flags of the header.
  * IMPORTANT: This is *not* the size of the struct adf_t; this is the size of
  * the serialized object as a whole. The actual size in memory of the adf_t
  * structure is bigger, due to some redundant fields contained in it to help
  * speeding up the mashalling and unmarshalling process.
+ * If the arrays are encoded, each series is encoded to be measured: to
+ * encode them once, use `marshal_stream` instead, without
+ * ADF_FLAG_SERIES_INDEX.
  */
 size_t size_adf_t(adf_t *);
 
@@ -643,32 +945,271 @@ void adf_bytes_free(uint8_t *);
  */
 uint16_t add_series(adf_t *, const series_t *);
 
+/*
+ * Adds `n` series in order, as many calls to `add_series` would do: each
+ * of them is merged into the last one if they are equal. If one of them
+ * is zero-repeated, nothing is added. On any other error, the series
+ * before the failing one are kept.
+ */
+uint16_t add_series_many(adf_t *, const series_t *, size_t);
+
+/*
+ * Like `add_series`, but the arrays of the series are moved into the adf
+ * structure instead of being copied, and the series is zeroed. If it's
+ * merged into the last one, its arrays are freed. The arrays must come from
+ * the default allocator (e.g. from `init_empty_series`): if the adf
+ * structure has an allocator of its own, they are copied into it and then
+ * freed. On error, the arrays are still owned by the caller.
+ */
+uint16_t add_series_take(adf_t *, series_t *);
+
+/*
+ * Makes room for the given number of series in the `series` array, so that
+ * adding them doesn't realloc it. The array grows geometrically anyway:
+ * this just saves the intermediate reallocs when the size is known.
+ */
+uint16_t reserve_series(adf_t *, uint32_t);
+
 /*
  * 
  */
 uint16_t remove_series(adf_t *);
 
 /*
- * 
+ * Rebuilds the additive codes of the metadata from the additives of the
+ * series, in order of first appearance (soil additives before atmospheric
+ * ones), and updates the `code_idx` of every additive. The old codes are
+ * released. It takes linear time in the number of additives.
  */
 uint16_t reindex_additives(adf_t *);
 
 /*
- *
+ * Like `reindex_additives`, but the series are scanned by `n_threads`
+ * threads (0 means one per core). The codes are in the same order
+ * whatever the number of threads.
+ */
+uint16_t reindex_additives_parallel(adf_t *, uint32_t);
+
+/*
+ * Copies into the second parameter the series that covers the given time
+ * (in seconds), i.e. the first one that ends at or after that time. The
+ * arrays are shared with the adf structure, not copied. It takes
+ * logarithmic time, through the time index.
  */
 uint16_t get_series_at(adf_t *, series_t *, uint64_t);
 
+/*
+ * Looks up many times at once: `out[i]` is set to the series that covers
+ * `times[i]`, as `get_series_at` would find it. The pointers refer to the
+ * `series` array of the adf structure, so they're valid until the series
+ * change. Sorted times are looked up in a single pass over the series;
+ * the others are sorted first. If some time is out of bound, its pointer
+ * is NULL and ADF_TIME_OUT_OF_BOUND is returned, but all the others are
+ * still looked up.
+ */
+uint16_t get_series_at_many(adf_t *, const uint64_t *, size_t, series_t **);
+
+/*
+ * Marks the time index as stale from the series at the given position
+ * onwards. It's needed only after changing the `series` array or the
+ * `repeated` fields directly.
+ */
+void adf_invalidate_time_index(adf_t *, uint32_t);
+
 /*
  * Assumes the byte array `uint8_t *` to be allocated. You can get the exact
  * byte size to be allocated by the function `size_adf_t`. Alternatively, you
  * can allocate it directly with `bytes_alloc`.
+ * It returns ADF_RUNTIME_ERROR if the flags of the header ask for codecs
+ * that can't be combined (see ADF_FLAG_LZ_ARRAYS), or if a series has no
+ * arrays. Unmarshalling such a header returns ADF_HEADER_CORRUPTED.
  */
 uint16_t marshal(uint8_t *, adf_t *);
 
+/*
+ * Same as `marshal`, and produces the same bytes, but the series are encoded
+ * by `n_threads` threads (if it's 0, one per core), each of them writing to
+ * its own slice of the byte array. Encoded arrays are kept aside until
+ * all of them are measured, so that each series is encoded once.
+ */
+uint16_t marshal_parallel(uint8_t *, adf_t *, uint32_t);
+
 /* Assumes the adf_t structure not to be NULL. */
 uint16_t unmarshal(adf_t *, const uint8_t *);
 
-/* It updates the series at a certain time. */
+/*
+ * Same as `unmarshal`, but the arrays of all the series are placed in a
+ * single slab (see the `slab` field of adf_t), instead of being allocated
+ * one by one. The series added later are allocated as usual.
+ */
+uint16_t unmarshal_slab(adf_t *, const uint8_t *);
+
+/*
+ * Same as `unmarshal`, but all the content of the adf structure is allocated
+ * through the given allocator, which is then used for the whole lifetime
+ * of the structure.
+ */
+uint16_t unmarshal_with_allocator(adf_t *, const uint8_t *,
+								  const adf_allocator_t *);
+
+/*
+ * Same as `unmarshal`, but the series are decoded by `n_threads` threads (if
+ * it's 0, one per core). The size of the byte array is passed as the third
+ * parameter; a byte array too short to contain all the series is reported
+ * as ADF_SERIES_CORRUPTED (or as corrupted header or metadata). Otherwise,
+ * the returned code is the same `unmarshal` would return. On error, the
+ * series are released, so that the structure can be passed to `adf_free`.
+ * The content of the structure is allocated by the default allocator.
+ */
+uint16_t unmarshal_parallel(adf_t *, const uint8_t *, size_t, uint32_t);
+
+/*
+ * Creates a view over the byte array, whose size is passed as the third
+ * parameter. It checks the crc of the header and of the metadata, and
+ * records where each series starts, checking that the additives of each
+ * series index one of the additive codes. The crc of each series is checked
+ * by `adf_view_get_series`.
+ * If the object has a series index, its crc is checked, and so is each of
+ * its entries against the series it found; a mismatch is reported as
+ * ADF_SERIES_CORRUPTED.
+ * The errors returned are the same of `unmarshal`; a byte array that is
+ * shorter than expected is reported as a corruption of the section that is
+ * truncated.
+ */
+uint16_t adf_view_init(adf_view_t *, const uint8_t *, size_t);
+
+/*
+ * Fills the series view with the series at the given index (*not* time) and
+ * checks its crc, and that its additives index one of the additive codes.
+ * It returns ADF_RUNTIME_ERROR if the index is out of bound.
+ * If the arrays are encoded (ADF_FLAG_XOR_ARRAYS, ADF_FLAG_QUANTIZED_ARRAYS,
+ * ADF_FLAG_LZ_ARRAYS or ADF_FLAG_SHUFFLE_ARRAYS), they can't be read in
+ * place: their pointers are NULL, and the series has to be read by
+ * `adf_read_series_at` instead.
+ */
+uint16_t adf_view_get_series(const adf_view_t *, series_view_t *, uint32_t);
+
+/*
+ * Accessors of the series view. They take the chunk as the second parameter,
+ * and, for the matrices, the wavelength/depth index as the third one.
+ * The indexes are not checked against the bounds set in the header.
+ */
+float series_view_light_exposure(const series_view_t *, uint32_t, uint16_t);
+float series_view_soil_temp_c(const series_view_t *, uint32_t, uint16_t);
+float series_view_env_temp_c(const series_view_t *, uint32_t);
+float series_view_water_use_ml(const series_view_t *, uint32_t);
+additive_t series_view_soil_additive(const series_view_t *, uint16_t);
+additive_t series_view_atm_additive(const series_view_t *, uint16_t);
+
+/* Returns the additive code at the given index of the metadata section. */
+uint32_t adf_view_additive_code(const adf_view_t *, uint16_t);
+
+/* It frees the offsets of the view. The byte array is left untouched. */
+void adf_view_free(adf_view_t *);
+
+/*
+ * Reads the series at the given index (*not* time) of a serialized object,
+ * whose size is passed as the second parameter: it must be the exact size of
+ * the object, since the series index is found at its end. Only the header,
+ * the metadata and the series itself are read, thanks to the series index;
+ * if the object has none, the series before it are skipped one by one.
+ * The series is allocated with the default allocator, so it has to be freed
+ * with `series_free`. The number of periods elapsed before the series is
+ * returned in the last parameter, if it's not NULL.
+ * An entry of the index is trusted as long as the series it points to is
+ * within bounds and its crc is valid: the crc of the whole index is checked
+ * by `adf_view_init`. It returns ADF_RUNTIME_ERROR if the index is out of
+ * bound, or the same errors of `adf_view_init`.
+ */
+uint16_t adf_read_series_at(const uint8_t *, size_t, uint32_t, series_t *,
+							uint64_t *);
+
+/*
+ * Same as `adf_read_series_at`, but the series is the one that covers the
+ * given time (in seconds), as in `get_series_at`. With the series index,
+ * the series is found by a binary search over the starts.
+ * It returns ADF_TIME_OUT_OF_BOUND if no series covers that time.
+ */
+uint16_t adf_read_series_at_time(const uint8_t *, size_t, uint64_t,
+								 series_t *, uint64_t *);
+
+/*
+ * Unmarshals the file at the given path. On POSIX systems the file is
+ * memory-mapped and decoded directly from the mapping, using the hints
+ * contained in the flags (see file_flag_t). Besides the errors returned by
+ * `unmarshal`, it returns ADF_RUNTIME_ERROR if the file cannot be read.
+ */
+uint16_t adf_open_file(adf_t *, const char *, uint8_t);
+
+/*
+ * Marshals the adf structure into the file at the given path, overwriting
+ * it. On POSIX systems the file is resized to `size_adf_t` bytes and the
+ * data is written directly into a writable mapping of it. If it fails, the
+ * file is removed.
+ */
+uint16_t adf_save_file(adf_t *, const char *);
+
+/*
+ * Initializes a writer that passes the bytes to the given callback, along
+ * with the context. If the buffer size is 0, ADF_WRITER_BUFFER_SIZE is
+ * used; it's never smaller than 64 bytes.
+ */
+uint16_t adf_writer_init(adf_writer_t *, adf_write_fn, void *, size_t);
+
+/* Initializes a writer to an open file. The file is not closed. */
+uint16_t adf_writer_init_file(adf_writer_t *, FILE *, size_t);
+
+/*
+ * Initializes a writer to an open file descriptor (e.g. a pipe or a
+ * socket), which is not closed. It's available on POSIX systems only:
+ * elsewhere it returns ADF_RUNTIME_ERROR.
+ */
+uint16_t adf_writer_init_fd(adf_writer_t *, int, size_t);
+
+/* It frees the buffer of the writer. */
+void adf_writer_free(adf_writer_t *);
+
+/*
+ * Same as `marshal`, but the bytes are passed to the writer as they are
+ * produced, instead of being stored in an array of `size_adf_t` bytes. The
+ * crc of each section is computed along the way. All the bytes are handed
+ * to the writer before returning. It returns ADF_RUNTIME_ERROR if the
+ * writer fails. The memory it uses doesn't depend on the number of series:
+ * with ADF_FLAG_SERIES_INDEX, the series are measured again to write the
+ * index, so encoded arrays are encoded twice.
+ */
+uint16_t marshal_stream(adf_t *, adf_writer_t *);
+
+/*
+ * Initializes a decoder that fills the given adf structure. If the callback
+ * is NULL the series are stored in the structure, as `unmarshal` does.
+ * Otherwise they are passed to the callback, along with the context, and
+ * the structure is left with no series (`size_series` is 0), while its
+ * `n_series` still counts all of them.
+ */
+uint16_t adf_decoder_init(adf_decoder_t *, adf_t *, adf_series_fn, void *);
+
+/*
+ * Decodes the given chunk of bytes, picking up where the previous chunk
+ * left. It returns the same errors `unmarshal` would, as soon as they are
+ * found; after an error, every call returns it. The bytes after the end of
+ * the object are ignored.
+ */
+uint16_t adf_decoder_feed(adf_decoder_t *, const uint8_t *, size_t);
+
+/*
+ * Releases the decoder. If the object has not been decoded entirely, the
+ * section it stopped at is reported as corrupted. On error, the adf
+ * structure holds the series decoded so far, and it can be passed to
+ * `adf_free`.
+ */
+uint16_t adf_decoder_finish(adf_decoder_t *);
+
+/*
+ * It updates the series at a certain time. A time at the very end of a
+ * series repeated more than once updates the first repetition of the
+ * following series, and it's out of bound after the last one.
+ */
 uint16_t update_series(adf_t *, const series_t *, uint64_t);
 
 /* */
@@ -693,6 +1234,57 @@ bool are_additive_t_equal(additive_t, additive_t, float);
  */
 bool are_series_equal(const series_t *, const series_t *, const adf_t*);
 
+/*
+ * Returns a 64-bit hash of the content of the series, in which each real
+ * value is first rounded to a multiple of the precision of its field (the
+ * default tolerance is used when the precision is 0). The field `repeated`,
+ * the additive indexes and the digest are not taken into account.
+ * Two series with the same fingerprint are equal according to
+ * `are_series_equal`, barring a hash collision; two equal series almost
+ * always have the same fingerprint, unless some of their values are
+ * rounded to different multiples. That makes it a key to find duplicate
+ * series, even across different files, that should be confirmed with
+ * `are_series_equal`.
+ */
+uint64_t series_fingerprint(const series_t *, const adf_t *);
+
+/*
+ * Returns the fingerprint of the series in position `index`, which is
+ * computed once and cached in its digest. If the index is out of bounds,
+ * 0 is returned.
+ */
+uint64_t adf_series_fingerprint(adf_t *, uint32_t index);
+
+/*
+ * Sets the allocator used by every structure that has no allocator of its
+ * own, and by the helper functions that allocate memory for the caller
+ * (e.g. `init_empty_series`, `adf_bytes_alloc`, `cpy_adf_series`). Passing
+ * NULL restores malloc, realloc and free. It should be called before any
+ * allocation takes place, since memory must be freed by the allocator that
+ * allocated it.
+ */
+void adf_set_default_allocator(const adf_allocator_t *);
+
+/*
+ * Sets the allocator of an (initialized) adf structure. It must be called
+ * before any series is added to it. The adf structure does not own the
+ * allocator, which must outlive it.
+ */
+void adf_set_allocator(adf_t *, const adf_allocator_t *);
+
+/*
+ * Creates an arena that allocates blocks of (at least) the given size; if
+ * the size is 0, blocks of 1 MiB are used. If `huge_pages` is true, the
+ * blocks are backed by huge pages where the system supports them.
+ * The allocator returned by `adf_arena_allocator` is meant to be used by a
+ * single adf structure at a time: `adf_free` resets the arena, so that its
+ * blocks are reused by the next structure.
+ */
+adf_arena_t *adf_arena_new(size_t, bool);
+const adf_allocator_t *adf_arena_allocator(adf_arena_t *);
+void adf_arena_reset(adf_arena_t *);
+void adf_arena_delete(adf_arena_t *);
+
 /*
  * Helper functions to create adf structures.
  */
@@ -787,6 +1379,9 @@ uint16_t init_empty_series(series_t *series, uint32_t n_chunks,
  * They just free the *content* of the structure. If the structure itself has
  * been dynamically allocated, use the delete functions below instead.
  * All the internarls pointers will be set to NULL.
+ * !!! series_free must not be called on the series contained in an adf
+ * structure, since their arrays may belong to its slab: they are freed by
+ * adf_free (or by the functions that remove them) !!!
  */
 void metadata_free(adf_meta_t *);
 void series_free(series_t *);
@@ -877,6 +1472,8 @@ uint8_t get_UINT_SMALL_T_SIZE(void);
 uint8_t get_UINT_TINY_T_SIZE(void);
 uint8_t get_REAL_T_SIZE(void);
 uint8_t get_ADD_T_SIZE(void);
+/* The size in memory of series_t, to walk an array of them in the bindings */
+uint16_t get_SERIES_T_SIZE(void);
 /* Useful time constants */
 uint32_t get_ADF_DAY(void);
 uint32_t get_ADF_WEEK(void);
@@ -0,0 +1,280 @@
+/* alloc.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* MAP_ANONYMOUS and madvise are not part of ISO C */
+#define _DEFAULT_SOURCE
+
+#include "alloc.h"
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define __ADF_MMAP__
+#include <sys/mman.h>
+#endif
+
+/* Every arena allocation is aligned to (and preceded by) this many bytes */
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_BLOCK_SIZE (1u << 20)
+#define HUGE_PAGE_SIZE (1u << 21)
+
+static void *std_alloc(void *ctx, size_t size)
+{
+	(void)ctx;
+	return malloc(size);
+}
+
+static void *std_realloc(void *ctx, void *ptr, size_t size)
+{
+	(void)ctx;
+	return realloc(ptr, size);
+}
+
+static void std_free(void *ctx, void *ptr)
+{
+	(void)ctx;
+	free(ptr);
+}
+
+static const adf_allocator_t std_allocator = {
+	.alloc = &std_alloc,
+	.realloc = &std_realloc,
+	.free = &std_free,
+	.reset = NULL,
+	.ctx = NULL
+};
+
+static const adf_allocator_t *default_allocator = &std_allocator;
+
+void adf_set_default_allocator(const adf_allocator_t *allocator)
+{
+	default_allocator = allocator ? allocator : &std_allocator;
+}
+
+const adf_allocator_t *get_allocator(const adf_allocator_t *allocator)
+{
+	return allocator ? allocator : default_allocator;
+}
+
+void adf_set_allocator(adf_t *adf, const adf_allocator_t *allocator)
+{
+	adf->allocator = allocator;
+}
+
+/*
+ * The arena is a list of blocks. Allocations bump a cursor in the current
+ * block, and move to the next block (allocating it if needed) when the
+ * current one is full. Resetting the arena just rewinds the cursors, so the
+ * blocks are reused by the next adf structure.
+ */
+typedef struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	bool mapped;
+	alignas(ARENA_ALIGNMENT) uint8_t data[];
+} arena_block_t;
+
+struct adf_arena {
+	arena_block_t *first;
+	arena_block_t *current;
+	size_t block_size;
+	bool huge_pages;
+	adf_allocator_t allocator;
+};
+
+static inline size_t align_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static arena_block_t *arena_block_new(const adf_arena_t *arena,
+									  size_t min_size)
+{
+	size_t size = sizeof(arena_block_t)
+				  + (min_size > arena->block_size ? min_size
+												  : arena->block_size);
+	arena_block_t *block = NULL;
+	bool mapped = false;
+
+#ifdef __ADF_MMAP__
+	if (arena->huge_pages) {
+		size = align_up(size, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+		block = mmap(NULL, size, PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (block == MAP_FAILED) { block = NULL; }
+#endif
+		/* no reserved huge pages: ask for transparent ones instead */
+		if (!block) {
+			block = mmap(NULL, size, PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (block == MAP_FAILED) { return NULL; }
+#ifdef MADV_HUGEPAGE
+			madvise(block, size, MADV_HUGEPAGE);
+#endif
+		}
+		mapped = true;
+	}
+#endif
+	if (!block) {
+		block = malloc(size);
+		if (!block) { return NULL; }
+	}
+
+	block->next = NULL;
+	block->size = size - sizeof(arena_block_t);
+	block->used = 0;
+	block->mapped = mapped;
+	return block;
+}
+
+static void arena_block_delete(arena_block_t *block)
+{
+#ifdef __ADF_MMAP__
+	if (block->mapped) {
+		munmap(block, block->size + sizeof(arena_block_t));
+		return;
+	}
+#endif
+	free(block);
+}
+
+static void *arena_alloc(void *ctx, size_t size)
+{
+	adf_arena_t *arena = ctx;
+	arena_block_t *block = arena->current, *new_block;
+	size_t needed = ARENA_ALIGNMENT + align_up(size, ARENA_ALIGNMENT);
+	uint8_t *ptr;
+
+	/* the blocks left by a reset are reused before allocating new ones */
+	while (block && block->size - block->used < needed && block->next) {
+		block = block->next;
+		block->used = 0;
+	}
+	if (!block || block->size - block->used < needed) {
+		new_block = arena_block_new(arena, needed);
+		if (!new_block) { return NULL; }
+		if (block) {
+			new_block->next = block->next;
+			block->next = new_block;
+		}
+		else {
+			arena->first = new_block;
+		}
+		block = new_block;
+	}
+	arena->current = block;
+
+	/* the size of each allocation is stored right before it, for realloc */
+	ptr = block->data + block->used;
+	*(size_t *)ptr = size;
+	block->used += needed;
+	return ptr + ARENA_ALIGNMENT;
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size)
+{
+	adf_arena_t *arena = ctx;
+	arena_block_t *block = arena->current;
+	uintptr_t address = (uintptr_t)ptr, data;
+	size_t old_size, offset;
+	void *new_ptr;
+
+	if (!ptr) { return arena_alloc(ctx, size); }
+
+	old_size = *(size_t *)((uint8_t *)ptr - ARENA_ALIGNMENT);
+
+	/* the last allocation of the current block can grow in place */
+	data = (uintptr_t)block->data;
+	if (address > data && address <= data + block->used) {
+		offset = address - data;
+		if (offset + align_up(old_size, ARENA_ALIGNMENT) == block->used
+			&& offset + align_up(size, ARENA_ALIGNMENT) <= block->size) {
+			*(size_t *)((uint8_t *)ptr - ARENA_ALIGNMENT) = size;
+			block->used = offset + align_up(size, ARENA_ALIGNMENT);
+			return ptr;
+		}
+	}
+
+	new_ptr = arena_alloc(ctx, size);
+	if (!new_ptr) { return NULL; }
+	memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+	return new_ptr;
+}
+
+static void arena_free(void *ctx, void *ptr)
+{
+	/* the memory is given back all together, by adf_arena_reset */
+	(void)ctx;
+	(void)ptr;
+}
+
+static void arena_reset(void *ctx)
+{
+	adf_arena_reset(ctx);
+}
+
+adf_arena_t *adf_arena_new(size_t block_size, bool huge_pages)
+{
+	adf_arena_t *arena = malloc(sizeof(adf_arena_t));
+	if (!arena) { return NULL; }
+
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->block_size = block_size > 0 ? block_size
+										: ARENA_DEFAULT_BLOCK_SIZE;
+	arena->huge_pages = huge_pages;
+	arena->allocator = (adf_allocator_t) {
+		.alloc = &arena_alloc,
+		.realloc = &arena_realloc,
+		.free = &arena_free,
+		.reset = &arena_reset,
+		.ctx = arena
+	};
+	return arena;
+}
+
+const adf_allocator_t *adf_arena_allocator(adf_arena_t *arena)
+{
+	return &arena->allocator;
+}
+
+void adf_arena_reset(adf_arena_t *arena)
+{
+	arena->current = arena->first;
+	if (arena->first) { arena->first->used = 0; }
+}
+
+void adf_arena_delete(adf_arena_t *arena)
+{
+	arena_block_t *block = arena->first, *next;
+
+	while (block) {
+		next = block->next;
+		arena_block_delete(block);
+		block = next;
+	}
+	free(arena);
+}
@@ -0,0 +1,74 @@
+/* alloc.h - Allocation helpers that dispatch to the configured allocator
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ALLOC_H__
+#define __ALLOC_H__
+
+#include "adf.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns the allocator passed as parameter or, if it's NULL, the default
+ * one (see `adf_set_default_allocator`).
+ */
+const adf_allocator_t *get_allocator(const adf_allocator_t *);
+
+/*
+ * The counterparts of malloc, realloc and free. If the allocator is NULL,
+ * the default one is used.
+ */
+static inline void *adf_malloc(const adf_allocator_t *allocator, size_t size)
+{
+	allocator = get_allocator(allocator);
+	return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *adf_realloc(const adf_allocator_t *allocator, void *ptr,
+								size_t size)
+{
+	allocator = get_allocator(allocator);
+	return allocator->realloc(allocator->ctx, ptr, size);
+}
+
+/*
+ * Like calloc: the returned memory is set to zero, and NULL is returned if
+ * `n * size` overflows.
+ */
+static inline void *adf_calloc(const adf_allocator_t *allocator, size_t n,
+							   size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && n > SIZE_MAX / size) { return NULL; }
+	ptr = adf_malloc(allocator, n * size);
+	if (ptr) { memset(ptr, 0, n * size); }
+	return ptr;
+}
+
+static inline void adf_dealloc(const adf_allocator_t *allocator, void *ptr)
+{
+	allocator = get_allocator(allocator);
+	allocator->free(allocator->ctx, ptr);
+}
+
+#endif /* __ALLOC_H__ */
@@ -0,0 +1,157 @@
+/* bswap.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "bswap.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __ADF_X86__
+#include <immintrin.h>
+#endif
+
+#ifdef __ADF_NEON__
+#include <arm_neon.h>
+#endif
+
+static _Atomic(array_bytes_copy) cpy_4_bytes_array_fn = NULL;
+
+static bool is_host_big_endian(void)
+{
+	union {
+		uint16_t val;
+		uint8_t bytes[2];
+	} endianess = { 0x0100 };
+
+	return endianess.bytes[0];
+}
+
+void copy_4_bytes_array(uint8_t *dest, const uint8_t *source, size_t n)
+{
+	if (dest != source) { memmove(dest, source, n * 4); }
+}
+
+void swap_4_bytes_array_scalar(uint8_t *dest, const uint8_t *source,
+							   size_t n)
+{
+	uint32_t word;
+
+	for (size_t i = 0; i < n; i++, dest += 4, source += 4) {
+		memcpy(&word, source, 4);
+		word = __builtin_bswap32(word);
+		memcpy(dest, &word, 4);
+	}
+}
+
+#ifdef __ADF_X86__
+__attribute__((target("ssse3")))
+void swap_4_bytes_array_ssse3(uint8_t *dest, const uint8_t *source, size_t n)
+{
+	const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+									  4, 5, 6, 7, 0, 1, 2, 3);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(source + i * 4));
+		_mm_storeu_si128((__m128i *)(dest + i * 4), _mm_shuffle_epi8(v, mask));
+	}
+	swap_4_bytes_array_scalar(dest + i * 4, source + i * 4, n - i);
+}
+
+__attribute__((target("avx2")))
+void swap_4_bytes_array_avx2(uint8_t *dest, const uint8_t *source, size_t n)
+{
+	const __m256i mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+										 4, 5, 6, 7, 0, 1, 2, 3,
+										 12, 13, 14, 15, 8, 9, 10, 11,
+										 4, 5, 6, 7, 0, 1, 2, 3);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(source + i * 4));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(source + i * 4
+														  + 32));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4),
+							_mm256_shuffle_epi8(v0, mask));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4 + 32),
+							_mm256_shuffle_epi8(v1, mask));
+	}
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(source + i * 4));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4),
+							_mm256_shuffle_epi8(v, mask));
+	}
+	swap_4_bytes_array_scalar(dest + i * 4, source + i * 4, n - i);
+}
+#endif /* __ADF_X86__ */
+
+#ifdef __ADF_NEON__
+void swap_4_bytes_array_neon(uint8_t *dest, const uint8_t *source, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		uint8x16_t v0 = vld1q_u8(source + i * 4);
+		uint8x16_t v1 = vld1q_u8(source + i * 4 + 16);
+		vst1q_u8(dest + i * 4, vrev32q_u8(v0));
+		vst1q_u8(dest + i * 4 + 16, vrev32q_u8(v1));
+	}
+	for (; i + 4 <= n; i += 4) {
+		vst1q_u8(dest + i * 4, vrev32q_u8(vld1q_u8(source + i * 4)));
+	}
+	swap_4_bytes_array_scalar(dest + i * 4, source + i * 4, n - i);
+}
+#endif /* __ADF_NEON__ */
+
+static array_bytes_copy select_4_bytes_array_fn(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+
+	/* ADF is big-endian: nothing to convert */
+	if (is_host_big_endian()) { return &copy_4_bytes_array; }
+
+#ifdef __ADF_X86__
+	if (cpu->avx2) { return &swap_4_bytes_array_avx2; }
+	if (cpu->ssse3) { return &swap_4_bytes_array_ssse3; }
+#endif
+#ifdef __ADF_NEON__
+	if (cpu->neon) { return &swap_4_bytes_array_neon; }
+#endif
+	(void)cpu;
+	return &swap_4_bytes_array_scalar;
+}
+
+/*
+ * The selection is deterministic, so two threads that get here at the same
+ * time publish the same function.
+ */
+array_bytes_copy get_4_bytes_array_fn(void)
+{
+	array_bytes_copy fn = atomic_load_explicit(&cpy_4_bytes_array_fn,
+											   memory_order_acquire);
+
+	if (!fn) {
+		fn = select_4_bytes_array_fn();
+		atomic_store_explicit(&cpy_4_bytes_array_fn, fn, memory_order_release);
+	}
+	return fn;
+}
@@ -0,0 +1,62 @@
+/* bswap.h - Bulk conversion of 4-byte arrays between host and ADF byte order
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __BSWAP_H__
+#define __BSWAP_H__
+
+#include "cpu.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Copies `n` 4-byte elements from the source (second parameter) to the
+ * destination (first parameter), converting each of them between the host
+ * byte order and the big-endian order used by the ADF format. The same
+ * function is used in both directions, since the conversion is symmetric.
+ * Source and destination may be the same pointer, but they must not
+ * partially overlap.
+ */
+typedef void (*array_bytes_copy)(uint8_t *, const uint8_t *, size_t);
+
+/* Plain copy, used when the host is big-endian. */
+void copy_4_bytes_array(uint8_t *, const uint8_t *, size_t);
+
+/* Portable byte swap, used when no SIMD extension is available. */
+void swap_4_bytes_array_scalar(uint8_t *, const uint8_t *, size_t);
+
+#ifdef __ADF_X86__
+void swap_4_bytes_array_ssse3(uint8_t *, const uint8_t *, size_t);
+void swap_4_bytes_array_avx2(uint8_t *, const uint8_t *, size_t);
+#endif
+
+#ifdef __ADF_NEON__
+void swap_4_bytes_array_neon(uint8_t *, const uint8_t *, size_t);
+#endif
+
+/*
+ * Returns the fastest kernel that converts an array of 4-byte elements
+ * between the host byte order and the ADF one. The choice is made once at
+ * runtime, according to the host byte order and the available extensions.
+ */
+array_bytes_copy get_4_bytes_array_fn(void);
+
+#endif /* __BSWAP_H__ */
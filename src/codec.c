@@ -0,0 +1,484 @@
+/* codec.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "codec.h"
+#include <string.h>
+
+#define XOR_NEW_WINDOW_BITS 12
+
+void xor_encoder_init(xor_encoder_t *encoder, uint8_t *dest)
+{
+	encoder->dest = dest;
+	encoder->byte_c = 0;
+	encoder->bits = 0;
+	encoder->n_bits = 0;
+}
+
+/*
+ * Appends the `n` (at most 32) lowest bits of `value`, whose other bits must
+ * be zero. Whole words are written as soon as they are complete, so fewer
+ * than 32 bits are left pending.
+ */
+static inline void put_bits(xor_encoder_t *encoder, uint32_t value,
+							uint32_t n)
+{
+	uint32_t word;
+
+	encoder->bits = (encoder->bits << n) | value;
+	encoder->n_bits += n;
+	if (encoder->n_bits < 32) { return; }
+
+	encoder->n_bits -= 32;
+	if (encoder->dest) {
+		word = (uint32_t)(encoder->bits >> encoder->n_bits);
+		encoder->dest[encoder->byte_c] = word >> 24;
+		encoder->dest[encoder->byte_c + 1] = word >> 16;
+		encoder->dest[encoder->byte_c + 2] = word >> 8;
+		encoder->dest[encoder->byte_c + 3] = word;
+	}
+	encoder->byte_c += 4;
+}
+
+void xor_encode_column(xor_encoder_t *encoder, const uint8_t *source,
+					   size_t n, size_t stride)
+{
+	uint32_t value, xored, prev = 0, lead, trail, len;
+	uint32_t lead_w = 0, trail_w = 0, len_w = 0;
+
+	for (size_t i = 0; i < n; i++, source += stride * 4) {
+		memcpy(&value, source, 4);
+		xored = value ^ prev;
+		prev = value;
+		if (xored == 0) {
+			put_bits(encoder, 0, 1);
+			continue;
+		}
+
+		lead = __builtin_clz(xored);
+		trail = __builtin_ctz(xored);
+		if (len_w > 0 && lead >= lead_w && trail >= trail_w) {
+			put_bits(encoder, 2, 2);
+			put_bits(encoder, xored >> trail_w, len_w);
+			continue;
+		}
+
+		len = 32 - lead - trail;
+		put_bits(encoder, (3u << 10) | (lead << 5) | (len - 1),
+				 XOR_NEW_WINDOW_BITS);
+		put_bits(encoder, xored >> trail, len);
+		lead_w = lead;
+		trail_w = trail;
+		len_w = len;
+	}
+}
+
+size_t xor_encoder_finish(xor_encoder_t *encoder)
+{
+	uint32_t pad = (8 - encoder->n_bits % 8) % 8;
+	uint64_t bits = encoder->bits << pad;
+	uint32_t n_bits = encoder->n_bits + pad;
+
+	while (n_bits > 0) {
+		n_bits -= 8;
+		if (encoder->dest)
+			encoder->dest[encoder->byte_c] = (uint8_t)(bits >> n_bits);
+		encoder->byte_c++;
+	}
+	encoder->bits = 0;
+	encoder->n_bits = 0;
+	return encoder->byte_c;
+}
+
+void xor_decoder_init(xor_decoder_t *decoder, const uint8_t *source,
+					  size_t size)
+{
+	decoder->source = source;
+	decoder->size = size;
+	decoder->byte_c = 0;
+	decoder->bits = 0;
+	decoder->n_bits = 0;
+	decoder->corrupted = false;
+}
+
+/* Loads a whole word if possible, or the bytes that are left otherwise */
+static void refill(xor_decoder_t *decoder)
+{
+	const uint8_t *bytes = decoder->source + decoder->byte_c;
+
+	if (decoder->n_bits <= 32 && decoder->size - decoder->byte_c >= 4) {
+		decoder->bits = (decoder->bits << 32) | ((uint64_t)bytes[0] << 24)
+						| ((uint64_t)bytes[1] << 16)
+						| ((uint64_t)bytes[2] << 8) | bytes[3];
+		decoder->n_bits += 32;
+		decoder->byte_c += 4;
+		return;
+	}
+	while (decoder->n_bits <= 56 && decoder->byte_c < decoder->size) {
+		decoder->bits = (decoder->bits << 8)
+						| decoder->source[decoder->byte_c++];
+		decoder->n_bits += 8;
+	}
+}
+
+/* Takes the next `n` (at least 1, at most 32) bits */
+static inline uint32_t get_bits(xor_decoder_t *decoder, uint32_t n)
+{
+	if (decoder->n_bits < n) { refill(decoder); }
+	if (decoder->n_bits < n) {
+		decoder->corrupted = true;
+		decoder->n_bits = 0;
+		return 0;
+	}
+	decoder->n_bits -= n;
+	return (uint32_t)(decoder->bits >> decoder->n_bits)
+		   & (uint32_t)((UINT64_C(1) << n) - 1);
+}
+
+void xor_decode_column(xor_decoder_t *decoder, uint8_t *dest, size_t n,
+					   size_t stride)
+{
+	uint32_t value, xored, prev = 0, header, lead, len;
+	uint32_t trail_w = 0, len_w = 0;
+
+	for (size_t i = 0; i < n && !decoder->corrupted; i++, dest += stride * 4) {
+		if (get_bits(decoder, 1) == 0) {
+			xored = 0;
+		}
+		else if (get_bits(decoder, 1) == 0) {
+			if (len_w == 0) {
+				decoder->corrupted = true;
+				return;
+			}
+			xored = get_bits(decoder, len_w) << trail_w;
+		}
+		else {
+			header = get_bits(decoder, XOR_NEW_WINDOW_BITS - 2);
+			lead = header >> 5;
+			len = (header & 0x1F) + 1;
+			if (lead + len > 32) {
+				decoder->corrupted = true;
+				return;
+			}
+			trail_w = 32 - lead - len;
+			len_w = len;
+			xored = get_bits(decoder, len) << trail_w;
+		}
+		value = prev ^ xored;
+		prev = value;
+		memcpy(dest, &value, 4);
+	}
+}
+
+bool xor_decoder_finish(const xor_decoder_t *decoder)
+{
+	/* only the padding of the last byte may be left, and it's all zeros */
+	return !decoder->corrupted && decoder->byte_c == decoder->size
+		   && decoder->n_bits < 8
+		   && (decoder->bits & ((UINT64_C(1) << decoder->n_bits) - 1)) == 0;
+}
+
+void quantized_encoder_init(quantized_encoder_t *encoder, uint8_t *dest)
+{
+	encoder->dest = dest;
+	encoder->byte_c = 0;
+}
+
+static inline void put_byte(quantized_encoder_t *encoder, uint8_t byte)
+{
+	if (encoder->dest) { encoder->dest[encoder->byte_c] = byte; }
+	encoder->byte_c++;
+}
+
+static inline void put_varint(quantized_encoder_t *encoder, uint64_t value)
+{
+	while (value >= 0x80) {
+		put_byte(encoder, (uint8_t)value | 0x80);
+		value >>= 7;
+	}
+	put_byte(encoder, (uint8_t)value);
+}
+
+static inline uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* The same expression on both sides, so that the check below holds */
+static inline float dequantize(int64_t quantized, float step)
+{
+	return (float)((double)quantized * step);
+}
+
+/*
+ * Maps `value` to the closest multiple of `step`, if that is within the
+ * step (in the same sense of the comparisons of the library).
+ */
+static inline bool quantize(float value, float step, int64_t *quantized)
+{
+	double scaled = (double)value / step;
+
+	/* NaN fails the comparison too */
+	if (!(scaled > -QUANTIZED_MAX_INT && scaled < QUANTIZED_MAX_INT))
+		return false;
+	*quantized = (int64_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+	return __builtin_fabsf(dequantize(*quantized, step) - value) < step;
+}
+
+void quantized_encode_column(quantized_encoder_t *encoder,
+							 const uint8_t *source, size_t n, size_t stride,
+							 float step)
+{
+	int64_t quantized, prev = 0;
+	uint32_t bits;
+	float value;
+
+	for (size_t i = 0; i < n; i++, source += stride * 4) {
+		memcpy(&value, source, 4);
+		if (quantize(value, step, &quantized)) {
+			put_varint(encoder, zigzag(quantized - prev) + 1);
+			prev = quantized;
+			continue;
+		}
+		memcpy(&bits, &value, 4);
+		put_byte(encoder, 0);
+		put_byte(encoder, bits >> 24);
+		put_byte(encoder, bits >> 16);
+		put_byte(encoder, bits >> 8);
+		put_byte(encoder, bits);
+	}
+}
+
+size_t quantized_encoder_finish(const quantized_encoder_t *encoder)
+{
+	return encoder->byte_c;
+}
+
+void quantized_decoder_init(quantized_decoder_t *decoder,
+							const uint8_t *source, size_t size)
+{
+	decoder->source = source;
+	decoder->size = size;
+	decoder->byte_c = 0;
+	decoder->corrupted = false;
+}
+
+/* A varint that doesn't fit in 64 bits is corrupted */
+static inline uint64_t get_varint(quantized_decoder_t *decoder)
+{
+	uint64_t value = 0;
+	uint8_t byte;
+
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		if (decoder->byte_c == decoder->size) { break; }
+		byte = decoder->source[decoder->byte_c++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) { return value; }
+	}
+	decoder->corrupted = true;
+	return 0;
+}
+
+void quantized_decode_column(quantized_decoder_t *decoder, uint8_t *dest,
+							 size_t n, size_t stride, float step)
+{
+	const uint8_t *bytes;
+	uint64_t token, prev = 0;
+	uint32_t bits;
+	float value;
+
+	for (size_t i = 0; i < n; i++, dest += stride * 4) {
+		token = get_varint(decoder);
+		if (decoder->corrupted) { return; }
+		if (token > 0) {
+			/* unsigned, so that corrupted differences wrap around */
+			prev += (uint64_t)unzigzag(token - 1);
+			value = dequantize((int64_t)prev, step);
+			memcpy(dest, &value, 4);
+			continue;
+		}
+		if (decoder->size - decoder->byte_c < 4) {
+			decoder->corrupted = true;
+			return;
+		}
+		bytes = decoder->source + decoder->byte_c;
+		bits = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+			   | ((uint32_t)bytes[2] << 8) | bytes[3];
+		decoder->byte_c += 4;
+		memcpy(dest, &bits, 4);
+	}
+}
+
+bool quantized_decoder_finish(const quantized_decoder_t *decoder)
+{
+	return !decoder->corrupted && decoder->byte_c == decoder->size;
+}
+
+/* The hash of a word is an index of the table, of LZ_HASH_SIZE entries */
+#define LZ_HASH_BITS 12
+
+/* After this many misses in a row, the compressor starts skipping bytes */
+#define LZ_SKIP_TRIGGER 6
+
+static inline uint32_t read_32(const uint8_t *bytes)
+{
+	uint32_t word;
+	memcpy(&word, bytes, 4);
+	return word;
+}
+
+static inline uint32_t lz_hash(uint32_t word)
+{
+	return (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the bytes that continue a length of at least 15 */
+static inline size_t put_length(uint8_t *dest, size_t length)
+{
+	size_t byte_c = 0;
+
+	for (length -= 15; length >= 255; length -= 255)
+		dest[byte_c++] = 255;
+	dest[byte_c++] = (uint8_t)length;
+	return byte_c;
+}
+
+static inline size_t put_sequence(uint8_t *dest, const uint8_t *literals,
+								  size_t n_literals, size_t offset,
+								  size_t match_length)
+{
+	size_t byte_c = 1;
+
+	dest[0] = (uint8_t)((n_literals < 15 ? n_literals : 15) << 4);
+	if (n_literals >= 15)
+		byte_c += put_length(dest + byte_c, n_literals);
+	memcpy(dest + byte_c, literals, n_literals);
+	byte_c += n_literals;
+	if (!match_length) { return byte_c; }
+
+	dest[byte_c++] = (uint8_t)(offset >> 8);
+	dest[byte_c++] = (uint8_t)offset;
+	match_length -= LZ_MIN_MATCH;
+	dest[0] |= match_length < 15 ? match_length : 15;
+	if (match_length >= 15)
+		byte_c += put_length(dest + byte_c, match_length);
+	return byte_c;
+}
+
+size_t lz_compress(uint8_t *dest, const uint8_t *source, size_t n,
+				   uint32_t *table)
+{
+	size_t byte_c = 0, anchor = 0, i = 0, match, length, misses = 0;
+	uint32_t word, h;
+
+	memset(table, 0, LZ_HASH_SIZE * sizeof(uint32_t));
+
+	while (n >= LZ_MIN_MATCH && i <= n - LZ_MIN_MATCH) {
+		word = read_32(source + i);
+		h = lz_hash(word);
+		match = table[h];
+		table[h] = (uint32_t)i;
+		if (match >= i || i - match > LZ_MAX_OFFSET
+			|| read_32(source + match) != word) {
+			i += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+			continue;
+		}
+		misses = 0;
+
+		length = LZ_MIN_MATCH;
+		while (i + length < n && source[match + length] == source[i + length])
+			length++;
+		while (i > anchor && match > 0 && source[i - 1] == source[match - 1]) {
+			i--;
+			match--;
+			length++;
+		}
+		byte_c += put_sequence(dest + byte_c, source + anchor, i - anchor,
+							   i - match, length);
+		i += length;
+		anchor = i;
+	}
+	return byte_c + put_sequence(dest + byte_c, source + anchor, n - anchor,
+								 0, 0);
+}
+
+/* Adds the bytes that continue a length of 15, up to `max` */
+static inline bool get_length(const uint8_t *source, size_t size,
+							  size_t *byte_c, size_t *length, size_t max)
+{
+	uint8_t byte;
+
+	do {
+		if (*byte_c == size) { return false; }
+		byte = source[(*byte_c)++];
+		*length += byte;
+		if (*length > max) { return false; }
+	} while (byte == 255);
+	return true;
+}
+
+bool lz_decompress(uint8_t *dest, size_t n, const uint8_t *source,
+				   size_t size)
+{
+	size_t byte_c = 0, out = 0, length, offset;
+	uint8_t token;
+
+	for (;;) {
+		if (byte_c == size) { return false; }
+		token = source[byte_c++];
+
+		length = token >> 4;
+		if (length == 15
+			&& !get_length(source, size, &byte_c, &length, n - out))
+			return false;
+		if (length > size - byte_c || length > n - out) { return false; }
+		memcpy(dest + out, source + byte_c, length);
+		byte_c += length;
+		out += length;
+		/* only the last sequence ends the block */
+		if (out == n && byte_c == size) { return (token & 0x0F) == 0; }
+
+		if (size - byte_c < 2) { return false; }
+		offset = ((size_t)source[byte_c] << 8) | source[byte_c + 1];
+		byte_c += 2;
+		if (offset == 0 || offset > out) { return false; }
+
+		length = token & 0x0F;
+		if (length == 15
+			&& !get_length(source, size, &byte_c, &length, n - out))
+			return false;
+		length += LZ_MIN_MATCH;
+		if (length > n - out) { return false; }
+		if (offset >= length) {
+			memcpy(dest + out, dest + out - offset, length);
+		} else {
+			/* an overlapping copy repeats the last `offset` bytes */
+			for (size_t k = 0; k < length; k++)
+				dest[out + k] = dest[out + k - offset];
+		}
+		out += length;
+	}
+}
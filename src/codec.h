@@ -0,0 +1,223 @@
+/* codec.h - Lossless encodings of the arrays of the series
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * The XOR codec (as in Facebook's Gorilla) compresses a column of 4-byte
+ * floats, taken in host byte order, without losing a single bit. Each value
+ * is XORed with the previous one of the same column; the result, which is
+ * mostly zeros for values that change slowly, is written as:
+ *     '0'                     the value is equal to the previous one;
+ *     '10' + bits             the meaningful bits fit in the window of the
+ *                             previous value, and only those are written;
+ *     '11' + 5 + 5 + bits     a new window: the number of leading zeros, the
+ *                             number of meaningful bits minus one, and the
+ *                             meaningful bits themselves.
+ * Every column starts from a previous value of 0 and no window, so columns
+ * can be decoded independently as long as they are read in the same order.
+ * The bits are packed most significant first, and the last byte is padded
+ * with zeros.
+ */
+
+/* The worst case is a new window for each value: 2 + 5 + 5 + 32 bits */
+#define XOR_MAX_BITS_PER_VALUE 44
+
+/* An upper bound of the bytes needed to encode `n` values */
+static inline size_t xor_encoded_bound(size_t n)
+{
+	return (n * XOR_MAX_BITS_PER_VALUE + 7) / 8;
+}
+
+typedef struct {
+	/* where the bytes are written, or NULL to only count them */
+	uint8_t *dest;
+	size_t byte_c;
+	uint64_t bits;
+	uint32_t n_bits;
+} xor_encoder_t;
+
+typedef struct {
+	const uint8_t *source;
+	size_t size;
+	size_t byte_c;
+	uint64_t bits;
+	uint32_t n_bits;
+	/* set when the bits run out or don't make sense */
+	bool corrupted;
+} xor_decoder_t;
+
+/*
+ * Starts encoding into `dest`. If it's NULL nothing is written, but the
+ * size of the encoded bytes is still returned by `xor_encoder_finish`.
+ */
+void xor_encoder_init(xor_encoder_t *, uint8_t *);
+
+/*
+ * Encodes `n` values read from the source (second parameter) every `stride`
+ * values, i.e. a column of a row-major matrix with `stride` columns.
+ */
+void xor_encode_column(xor_encoder_t *, const uint8_t *, size_t, size_t);
+
+/* Writes the last, padded, byte and returns the number of bytes encoded. */
+size_t xor_encoder_finish(xor_encoder_t *);
+
+/* Starts decoding the given number of bytes. */
+void xor_decoder_init(xor_decoder_t *, const uint8_t *, size_t);
+
+/*
+ * Decodes `n` values into the destination (second parameter), every
+ * `stride` values. Columns must be decoded as they were encoded.
+ */
+void xor_decode_column(xor_decoder_t *, uint8_t *, size_t, size_t);
+
+/*
+ * Returns true if all the columns have been decoded from well-formed bits,
+ * and every byte has been consumed.
+ */
+bool xor_decoder_finish(const xor_decoder_t *);
+
+/*
+ * The quantized codec stores a column of 4-byte floats, taken in host byte
+ * order, as multiples of a step: each value becomes the integer closest to
+ * value / step, and the difference with the previous integer of the same
+ * column is zigzag-encoded (so that small negative differences stay small)
+ * and written as a varint, i.e. 7 bits per byte, least significant first,
+ * with the high bit set on every byte but the last. One is added to each
+ * difference, because 0 marks an escape: the value follows as it is, in 4
+ * big-endian bytes. A value is escaped whenever the decoded one would not
+ * be within the step, e.g. it's NaN or infinite, or the step is too small
+ * for its magnitude; so each decoded value y of an original x satisfies
+ * |x - y| < step, or is bit by bit equal to x.
+ * Every column starts from 0, and has to be decoded with the same step.
+ */
+
+/* The biggest integer a value is mapped to: its difference fits in 8 bytes */
+#define QUANTIZED_MAX_INT (INT64_C(1) << 52)
+
+/* The longest varint, that of the biggest difference; an escape takes 5 */
+#define QUANTIZED_MAX_BYTES_PER_VALUE 8
+
+/* An upper bound of the bytes needed to encode `n` values */
+static inline size_t quantized_encoded_bound(size_t n)
+{
+	return n * QUANTIZED_MAX_BYTES_PER_VALUE;
+}
+
+typedef struct {
+	/* where the bytes are written, or NULL to only count them */
+	uint8_t *dest;
+	size_t byte_c;
+} quantized_encoder_t;
+
+typedef struct {
+	const uint8_t *source;
+	size_t size;
+	size_t byte_c;
+	/* set when the bytes run out or don't make sense */
+	bool corrupted;
+} quantized_decoder_t;
+
+/*
+ * Starts encoding into `dest`. If it's NULL nothing is written, but the
+ * size of the encoded bytes is still returned by `quantized_encoder_finish`.
+ */
+void quantized_encoder_init(quantized_encoder_t *, uint8_t *);
+
+/*
+ * Encodes `n` values read from the source (second parameter) every `stride`
+ * values, as multiples of the step (last parameter), which must be
+ * positive.
+ */
+void quantized_encode_column(quantized_encoder_t *, const uint8_t *, size_t,
+							 size_t, float);
+
+/* Returns the number of bytes encoded. */
+size_t quantized_encoder_finish(const quantized_encoder_t *);
+
+/* Starts decoding the given number of bytes. */
+void quantized_decoder_init(quantized_decoder_t *, const uint8_t *, size_t);
+
+/*
+ * Decodes `n` values into the destination (second parameter), every
+ * `stride` values, with the step they were encoded with.
+ */
+void quantized_decode_column(quantized_decoder_t *, uint8_t *, size_t, size_t,
+							 float);
+
+/*
+ * Returns true if all the columns have been decoded from well-formed bytes,
+ * and every byte has been consumed.
+ */
+bool quantized_decoder_finish(const quantized_decoder_t *);
+
+/*
+ * The LZ codec compresses a block of bytes, in the way of LZ4: a sequence of
+ * literals is followed by a match, i.e. a copy of at least LZ_MIN_MATCH
+ * bytes that have already been decoded, at most LZ_MAX_OFFSET bytes back.
+ * Each sequence starts with a token, whose high 4 bits are the number of
+ * literals and whose low 4 bits are the length of the match minus
+ * LZ_MIN_MATCH; a value of 15 is continued by bytes that are added to it,
+ * as long as they are 255. The literals follow, then the offset of the
+ * match, in 2 big-endian bytes, and the rest of its length. The last
+ * sequence has only literals, so that the block always ends after them.
+ * Unlike the others, this codec doesn't know about floats: repeated values,
+ * such as zeros, or equal rows of a matrix, are what it compresses.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+/* The number of entries of the hash table of the compressor */
+#define LZ_HASH_SIZE (1u << 12)
+
+/* An upper bound of the compressed size of `n` bytes */
+#define LZ_COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+static inline size_t lz_compress_bound(size_t n)
+{
+	return LZ_COMPRESS_BOUND(n);
+}
+
+/*
+ * Compresses `n` bytes of the source (second parameter) into the
+ * destination, which must hold at least `lz_compress_bound(n)` bytes, and
+ * returns the number of bytes written. The last parameter is the hash table
+ * of the compressor, with LZ_HASH_SIZE entries: it's cleared first, so it
+ * can be reused from one call to the next.
+ */
+size_t lz_compress(uint8_t *, const uint8_t *, size_t, uint32_t *);
+
+/*
+ * Decompresses exactly the number of bytes passed as the second parameter
+ * into the destination, from the compressed bytes whose size is the last
+ * parameter. It returns false if they are malformed, or if they don't
+ * decompress to that size.
+ */
+bool lz_decompress(uint8_t *, size_t, const uint8_t *, size_t);
+
+#endif /* __CODEC_H__ */
@@ -0,0 +1,169 @@
+/* compare.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "compare.h"
+#include <stdatomic.h>
+
+#ifdef __ADF_X86__
+#include <immintrin.h>
+#endif
+
+#ifdef __ADF_NEON__
+#include <arm_neon.h>
+#endif
+
+static _Atomic(reals_within_fn) reals_within = NULL;
+
+/*
+ * |x - y| is computed once, with a single rounding, so that it's the same
+ * whether x < y or not: that's what the vector kernels do.
+ */
+bool reals_within_scalar(const float *x, const float *y, size_t n,
+						 float tolerance)
+{
+	for (size_t i = 0; i < n; i++)
+		if (!(__builtin_fabsf(x[i] - y[i]) < tolerance)) return false;
+	return true;
+}
+
+#ifdef __ADF_X86__
+__attribute__((target("sse2")))
+bool reals_within_sse2(const float *x, const float *y, size_t n,
+					   float tolerance)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 tol = _mm_set1_ps(tolerance);
+	__m128 within;
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		/* an ordered comparison: false if any of the two is a NaN */
+		within = _mm_and_ps(
+			_mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(x + i),
+											   _mm_loadu_ps(y + i)),
+									abs_mask), tol),
+			_mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(x + i + 4),
+											   _mm_loadu_ps(y + i + 4)),
+									abs_mask), tol));
+		if (_mm_movemask_ps(within) != 0xF) return false;
+	}
+	return reals_within_scalar(x + i, y + i, n - i, tolerance);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 within_avx2(const float *x, const float *y, __m256 tol)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps(
+		_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x), _mm256_loadu_ps(y));
+	return _mm256_cmp_ps(_mm256_and_ps(diff, abs_mask), tol, _CMP_LT_OQ);
+}
+
+__attribute__((target("avx2")))
+bool reals_within_avx2(const float *x, const float *y, size_t n,
+					   float tolerance)
+{
+	const __m256 tol = _mm256_set1_ps(tolerance);
+	__m256 within;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		within = _mm256_and_ps(
+			_mm256_and_ps(within_avx2(x + i, y + i, tol),
+						  within_avx2(x + i + 8, y + i + 8, tol)),
+			_mm256_and_ps(within_avx2(x + i + 16, y + i + 16, tol),
+						  within_avx2(x + i + 24, y + i + 24, tol)));
+		if (_mm256_movemask_ps(within) != 0xFF) return false;
+	}
+	for (; i + 8 <= n; i += 8) {
+		if (_mm256_movemask_ps(within_avx2(x + i, y + i, tol)) != 0xFF)
+			return false;
+	}
+	return reals_within_scalar(x + i, y + i, n - i, tolerance);
+}
+#endif /* __ADF_X86__ */
+
+#ifdef __ADF_NEON__
+static inline uint32x4_t within_neon(const float *x, const float *y,
+									 float32x4_t tol)
+{
+	return vcltq_f32(vabdq_f32(vld1q_f32(x), vld1q_f32(y)), tol);
+}
+
+static inline bool all_lanes_neon(uint32x4_t mask)
+{
+	uint32x2_t lanes = vand_u32(vget_low_u32(mask), vget_high_u32(mask));
+	return vget_lane_u32(vpmin_u32(lanes, lanes), 0) != 0;
+}
+
+bool reals_within_neon(const float *x, const float *y, size_t n,
+					   float tolerance)
+{
+	const float32x4_t tol = vdupq_n_f32(tolerance);
+	uint32x4_t within;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		within = vandq_u32(vandq_u32(within_neon(x + i, y + i, tol),
+									 within_neon(x + i + 4, y + i + 4, tol)),
+						   vandq_u32(within_neon(x + i + 8, y + i + 8, tol),
+									 within_neon(x + i + 12, y + i + 12,
+												 tol)));
+		if (!all_lanes_neon(within)) return false;
+	}
+	for (; i + 4 <= n; i += 4) {
+		if (!all_lanes_neon(within_neon(x + i, y + i, tol))) return false;
+	}
+	return reals_within_scalar(x + i, y + i, n - i, tolerance);
+}
+#endif /* __ADF_NEON__ */
+
+static reals_within_fn select_reals_within_fn(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+
+#ifdef __ADF_X86__
+	if (cpu->avx2) { return &reals_within_avx2; }
+	if (cpu->sse2) { return &reals_within_sse2; }
+#endif
+#ifdef __ADF_NEON__
+	if (cpu->neon) { return &reals_within_neon; }
+#endif
+	(void)cpu;
+	return &reals_within_scalar;
+}
+
+/*
+ * The selection is deterministic, so two threads that get here at the same
+ * time publish the same function.
+ */
+reals_within_fn get_reals_within_fn(void)
+{
+	reals_within_fn fn = atomic_load_explicit(&reals_within,
+											  memory_order_acquire);
+
+	if (!fn) {
+		fn = select_reals_within_fn();
+		atomic_store_explicit(&reals_within, fn, memory_order_release);
+	}
+	return fn;
+}
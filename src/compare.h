@@ -0,0 +1,57 @@
+/* compare.h - Tolerance comparison of arrays of floating point numbers
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __COMPARE_H__
+#define __COMPARE_H__
+
+#include "cpu.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * Returns true if every pair of elements of the two arrays of `n` floats
+ * differs by less than the tolerance, i.e. |x[i] - y[i]| < tolerance. A NaN
+ * is never equal to anything. The tolerance must be positive: the default
+ * one for a precision of 0 is chosen by the caller.
+ * The SIMD kernels stop at the first block of elements that differs.
+ */
+typedef bool (*reals_within_fn)(const float *, const float *, size_t, float);
+
+/* Portable comparison, used when no SIMD extension is available. */
+bool reals_within_scalar(const float *, const float *, size_t, float);
+
+#ifdef __ADF_X86__
+bool reals_within_sse2(const float *, const float *, size_t, float);
+bool reals_within_avx2(const float *, const float *, size_t, float);
+#endif
+
+#ifdef __ADF_NEON__
+bool reals_within_neon(const float *, const float *, size_t, float);
+#endif
+
+/*
+ * Returns the fastest kernel that compares two arrays of floats. The choice
+ * is made once at runtime, according to the available extensions.
+ */
+reals_within_fn get_reals_within_fn(void);
+
+#endif /* __COMPARE_H__ */
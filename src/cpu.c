@@ -0,0 +1,84 @@
+/* cpu.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "cpu.h"
+#include <stdatomic.h>
+
+#if defined(__ADF_PMULL__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+/* The state of the detection, which happens only once */
+enum {
+	FEATURES_UNKNOWN,
+	FEATURES_DETECTING,
+	FEATURES_DETECTED
+};
+
+static cpu_features_t features;
+static _Atomic int state = FEATURES_UNKNOWN;
+
+static void detect_features(void)
+{
+#ifdef __ADF_X86__
+	__builtin_cpu_init();
+	features.sse2 = __builtin_cpu_supports("sse2");
+	features.ssse3 = __builtin_cpu_supports("ssse3");
+	features.sse41 = __builtin_cpu_supports("sse4.1");
+	features.avx2 = __builtin_cpu_supports("avx2");
+	features.pclmul = __builtin_cpu_supports("pclmul");
+#endif
+#ifdef __ADF_NEON__
+	/* Advanced SIMD is mandatory on every ARMv8-A core */
+	features.neon = true;
+#endif
+#if defined(__ADF_PMULL__) && defined(__linux__)
+	features.pmull = (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#elif defined(__ADF_PMULL__) && defined(__APPLE__)
+	/* every Apple core has the cryptographic extension */
+	features.pmull = true;
+#endif
+}
+
+const cpu_features_t *get_cpu_features(void)
+{
+	int expected = FEATURES_UNKNOWN;
+
+	if (atomic_load_explicit(&state, memory_order_acquire) == FEATURES_DETECTED)
+		return &features;
+
+	/*
+	 * The first thread to get here detects the features and publishes them
+	 * by a release store, so that a thread that sees the state as detected
+	 * sees all of them too. The others wait for it, which takes as long as
+	 * a few cpuid instructions.
+	 */
+	if (atomic_compare_exchange_strong(&state, &expected, FEATURES_DETECTING)) {
+		detect_features();
+		atomic_store_explicit(&state, FEATURES_DETECTED, memory_order_release);
+	}
+	while (atomic_load_explicit(&state, memory_order_acquire)
+		   != FEATURES_DETECTED)
+		;
+	return &features;
+}
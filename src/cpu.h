@@ -0,0 +1,63 @@
+/* cpu.h - Runtime detection of the SIMD extensions available on the host
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define __ADF_X86__
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define __ADF_NEON__
+#endif
+
+/* The 64-bit polynomial multiplication of ARMv8 is available to AArch64 */
+#if defined(__aarch64__) && !defined(__AARCH64EB__)
+#define __ADF_PMULL__
+#endif
+
+/*
+ * Each field is true when the corresponding instruction set extension can
+ * be used on the host. The fields of the extensions that belong to another
+ * architecture are always false.
+ */
+typedef struct {
+	bool sse2;
+	bool ssse3;
+	bool sse41;
+	bool avx2;
+	bool pclmul;
+	bool neon;
+	bool pmull;
+} cpu_features_t;
+
+/*
+ * Returns the features of the host CPU. They are detected just once, the
+ * first time this function is called, and it's safe to call it from many
+ * threads at once.
+ */
+const cpu_features_t *get_cpu_features(void);
+
+#endif /* __CPU_H__ */
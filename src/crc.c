@@ -43,6 +43,22 @@
  */
 
 #include "crc.h"
+#include <stdatomic.h>
+
+#ifdef __ADF_X86__
+#include <immintrin.h>
+#endif
+
+#ifdef __ADF_PMULL__
+#include <arm_neon.h>
+#endif
+
+/* Below this size, folding doesn't pay off */
+#define FOLD_MIN_SIZE 64
+
+/* Generator polynomials, without the leading term */
+#define CRC16_POLY 0x8005
+#define CRC32_POLY 0x04c11db7
 
 /* pre-calculated table for 16-bit CRC */
 static uint16_t table16[] = { 
@@ -133,10 +149,43 @@ static uint32_t table32[] = {
 	0x2d02ef8d
 };
 
-uint16_t crc16(const uint8_t *buf, size_t size)
+/* slicing-by-8 tables: the first one is table16 (or table32) */
+static uint16_t slice16[8][256];
+static uint32_t slice32[8][256];
+
+/*
+ * Multipliers that fold a 128-bit block onto the one that comes `distance`
+ * bits later: they are x^(distance + 63) and x^(distance - 1) modulo the
+ * generator polynomial, bit-reflected into 64 bits.
+ */
+typedef struct {
+	uint64_t by_4[2];
+	uint64_t by_1[2];
+} fold_consts_t;
+
+static fold_consts_t fold16;
+static fold_consts_t fold32;
+
+/* The state of the selection, which happens only once */
+enum {
+	KERNELS_UNKNOWN,
+	KERNELS_SELECTING,
+	KERNELS_SELECTED
+};
+
+static crc16_fn crc16_kernel = NULL;
+static crc32_fn crc32_kernel = NULL;
+static _Atomic int kernels_state = KERNELS_UNKNOWN;
+
+static inline uint32_t load_32_le(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+		   | (uint32_t)p[3] << 24;
+}
+
+uint16_t crc16_update_table(uint16_t crc, const uint8_t *buf, size_t size)
 {
 	const uint8_t *p = buf;
-	uint16_t crc = 0xffff;
 
 	while (size--)
 		crc = table16[(crc ^ (*p++)) & 0xff] ^ (crc >> 8);
@@ -144,13 +193,326 @@ uint16_t crc16(const uint8_t *buf, size_t size)
 	return crc;
 }
 
-uint32_t crc32(const uint8_t *buf, size_t size)
+uint32_t crc32_update_table(uint32_t crc, const uint8_t *buf, size_t size)
 {
 	const uint8_t *p = buf;
-	uint32_t crc = 0xffffffff;
 
 	while (size--)
 		crc = table32[(crc ^ (*p++)) & 0xff] ^ (crc >> 8);
 
 	return crc;
 }
+
+uint16_t crc16_update_slice8(uint16_t crc, const uint8_t *buf, size_t size)
+{
+	uint32_t lo, hi;
+
+	for (; size >= 8; size -= 8, buf += 8) {
+		lo = crc ^ load_32_le(buf);
+		hi = load_32_le(buf + 4);
+		crc = slice16[7][lo & 0xff] ^ slice16[6][(lo >> 8) & 0xff]
+			  ^ slice16[5][(lo >> 16) & 0xff] ^ slice16[4][lo >> 24]
+			  ^ slice16[3][hi & 0xff] ^ slice16[2][(hi >> 8) & 0xff]
+			  ^ slice16[1][(hi >> 16) & 0xff] ^ slice16[0][hi >> 24];
+	}
+	return crc16_update_table(crc, buf, size);
+}
+
+uint32_t crc32_update_slice8(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	uint32_t lo, hi;
+
+	for (; size >= 8; size -= 8, buf += 8) {
+		lo = crc ^ load_32_le(buf);
+		hi = load_32_le(buf + 4);
+		crc = slice32[7][lo & 0xff] ^ slice32[6][(lo >> 8) & 0xff]
+			  ^ slice32[5][(lo >> 16) & 0xff] ^ slice32[4][lo >> 24]
+			  ^ slice32[3][hi & 0xff] ^ slice32[2][(hi >> 8) & 0xff]
+			  ^ slice32[1][(hi >> 16) & 0xff] ^ slice32[0][hi >> 24];
+	}
+	return crc32_update_table(crc, buf, size);
+}
+
+/*
+ * Folding works on the crc without its initial value: that is xored into
+ * the first bytes, and the crc of what's left once the blocks have been
+ * folded into a single one is computed from zero. Being both crcs
+ * reflected, the bit 0 of the first byte is the coefficient of the highest
+ * power of x, and the carry-less product of two 64-bit reflected values is
+ * the reflected product times x: that's why the multipliers lose a power.
+ */
+#ifdef __ADF_X86__
+__attribute__((target("pclmul,sse2")))
+static inline __m128i fold_pclmul(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+						 _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+/*
+ * Folds all the 16-byte blocks of the buffer (at least FOLD_MIN_SIZE bytes)
+ * into `folded`, and returns the number of bytes folded.
+ */
+__attribute__((target("pclmul,sse2")))
+static size_t fold_blocks_pclmul(uint8_t *folded, uint32_t crc,
+								 const uint8_t *buf, size_t size,
+								 const fold_consts_t *consts)
+{
+	const __m128i by_4 = _mm_set_epi64x((long long)consts->by_4[1],
+										(long long)consts->by_4[0]);
+	const __m128i by_1 = _mm_set_epi64x((long long)consts->by_1[1],
+										(long long)consts->by_1[0]);
+	__m128i x0, x1, x2, x3;
+	size_t n = 64;
+
+	x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf),
+					   _mm_cvtsi32_si128((int)crc));
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 16));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 32));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 48));
+
+	/* four independent chains, to hide the latency of the multiplier */
+	for (; n + 64 <= size; n += 64) {
+		x0 = _mm_xor_si128(fold_pclmul(x0, by_4),
+						   _mm_loadu_si128((const __m128i *)(buf + n)));
+		x1 = _mm_xor_si128(fold_pclmul(x1, by_4),
+						   _mm_loadu_si128((const __m128i *)(buf + n + 16)));
+		x2 = _mm_xor_si128(fold_pclmul(x2, by_4),
+						   _mm_loadu_si128((const __m128i *)(buf + n + 32)));
+		x3 = _mm_xor_si128(fold_pclmul(x3, by_4),
+						   _mm_loadu_si128((const __m128i *)(buf + n + 48)));
+	}
+
+	x1 = _mm_xor_si128(fold_pclmul(x0, by_1), x1);
+	x2 = _mm_xor_si128(fold_pclmul(x1, by_1), x2);
+	x0 = _mm_xor_si128(fold_pclmul(x2, by_1), x3);
+	for (; n + 16 <= size; n += 16) {
+		x0 = _mm_xor_si128(fold_pclmul(x0, by_1),
+						   _mm_loadu_si128((const __m128i *)(buf + n)));
+	}
+	_mm_storeu_si128((__m128i *)folded, x0);
+	return n;
+}
+
+uint16_t crc16_update_pclmul(uint16_t crc, const uint8_t *buf, size_t size)
+{
+	uint8_t folded[16];
+	size_t n;
+
+	if (size < FOLD_MIN_SIZE) { return crc16_update_slice8(crc, buf, size); }
+	n = fold_blocks_pclmul(folded, crc, buf, size, &fold16);
+	crc = crc16_update_slice8(0, folded, 16);
+	return crc16_update_slice8(crc, buf + n, size - n);
+}
+
+uint32_t crc32_update_pclmul(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	uint8_t folded[16];
+	size_t n;
+
+	if (size < FOLD_MIN_SIZE) { return crc32_update_slice8(crc, buf, size); }
+	n = fold_blocks_pclmul(folded, crc, buf, size, &fold32);
+	crc = crc32_update_slice8(0, folded, 16);
+	return crc32_update_slice8(crc, buf + n, size - n);
+}
+#endif /* __ADF_X86__ */
+
+#ifdef __ADF_PMULL__
+__attribute__((target("+crypto")))
+static inline uint64x2_t fold_pmull(uint64x2_t x, uint64x2_t k)
+{
+	poly128_t lo = vmull_p64((poly64_t)vgetq_lane_u64(x, 0),
+							 (poly64_t)vgetq_lane_u64(k, 0));
+	poly128_t hi = vmull_high_p64(vreinterpretq_p64_u64(x),
+								  vreinterpretq_p64_u64(k));
+	return veorq_u64(vreinterpretq_u64_p128(lo), vreinterpretq_u64_p128(hi));
+}
+
+static inline uint64x2_t load_block(const uint8_t *p)
+{
+	return vreinterpretq_u64_u8(vld1q_u8(p));
+}
+
+/* The same as fold_blocks_pclmul */
+__attribute__((target("+crypto")))
+static size_t fold_blocks_pmull(uint8_t *folded, uint32_t crc,
+								const uint8_t *buf, size_t size,
+								const fold_consts_t *consts)
+{
+	const uint64x2_t by_4 = vld1q_u64(consts->by_4);
+	const uint64x2_t by_1 = vld1q_u64(consts->by_1);
+	uint64x2_t x0, x1, x2, x3;
+	size_t n = 64;
+
+	x0 = veorq_u64(load_block(buf), vsetq_lane_u64(crc, vdupq_n_u64(0), 0));
+	x1 = load_block(buf + 16);
+	x2 = load_block(buf + 32);
+	x3 = load_block(buf + 48);
+
+	for (; n + 64 <= size; n += 64) {
+		x0 = veorq_u64(fold_pmull(x0, by_4), load_block(buf + n));
+		x1 = veorq_u64(fold_pmull(x1, by_4), load_block(buf + n + 16));
+		x2 = veorq_u64(fold_pmull(x2, by_4), load_block(buf + n + 32));
+		x3 = veorq_u64(fold_pmull(x3, by_4), load_block(buf + n + 48));
+	}
+
+	x1 = veorq_u64(fold_pmull(x0, by_1), x1);
+	x2 = veorq_u64(fold_pmull(x1, by_1), x2);
+	x0 = veorq_u64(fold_pmull(x2, by_1), x3);
+	for (; n + 16 <= size; n += 16)
+		x0 = veorq_u64(fold_pmull(x0, by_1), load_block(buf + n));
+	vst1q_u8(folded, vreinterpretq_u8_u64(x0));
+	return n;
+}
+
+uint16_t crc16_update_pmull(uint16_t crc, const uint8_t *buf, size_t size)
+{
+	uint8_t folded[16];
+	size_t n;
+
+	if (size < FOLD_MIN_SIZE) { return crc16_update_slice8(crc, buf, size); }
+	n = fold_blocks_pmull(folded, crc, buf, size, &fold16);
+	crc = crc16_update_slice8(0, folded, 16);
+	return crc16_update_slice8(crc, buf + n, size - n);
+}
+
+uint32_t crc32_update_pmull(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	uint8_t folded[16];
+	size_t n;
+
+	if (size < FOLD_MIN_SIZE) { return crc32_update_slice8(crc, buf, size); }
+	n = fold_blocks_pmull(folded, crc, buf, size, &fold32);
+	crc = crc32_update_slice8(0, folded, 16);
+	return crc32_update_slice8(crc, buf + n, size - n);
+}
+#endif /* __ADF_PMULL__ */
+
+/* x^n modulo the polynomial, bit-reflected into a 64-bit multiplier */
+static uint64_t reflected_x_pow_mod(unsigned n, unsigned width, uint32_t poly)
+{
+	const uint32_t top = 1u << (width - 1);
+	uint32_t rem = 1;
+	uint64_t reflected = 0;
+
+	for (unsigned i = 0; i < n; i++)
+		rem = (rem & top) ? (rem << 1) ^ poly : rem << 1;
+	for (unsigned d = 0; d < width; d++) {
+		if ((rem >> d) & 1) { reflected |= 1ull << (63 - d); }
+	}
+	return reflected;
+}
+
+static void init_fold_consts(fold_consts_t *consts, unsigned width,
+							 uint32_t poly)
+{
+	consts->by_4[0] = reflected_x_pow_mod(512 + 63, width, poly);
+	consts->by_4[1] = reflected_x_pow_mod(512 - 1, width, poly);
+	consts->by_1[0] = reflected_x_pow_mod(128 + 63, width, poly);
+	consts->by_1[1] = reflected_x_pow_mod(128 - 1, width, poly);
+}
+
+/*
+ * Entry k of each table is the crc of its index followed by k zero bytes,
+ * so that eight bytes can be looked up at once.
+ */
+static void init_slice_tables(void)
+{
+	for (unsigned i = 0; i < 256; i++) {
+		slice16[0][i] = table16[i];
+		slice32[0][i] = table32[i];
+	}
+	for (unsigned k = 1; k < 8; k++) {
+		for (unsigned i = 0; i < 256; i++) {
+			slice16[k][i] = (slice16[k - 1][i] >> 8)
+							^ slice16[0][slice16[k - 1][i] & 0xff];
+			slice32[k][i] = (slice32[k - 1][i] >> 8)
+							^ slice32[0][slice32[k - 1][i] & 0xff];
+		}
+	}
+}
+
+/* Builds the tables and picks the kernels */
+static void select_crc_fns(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+
+	init_slice_tables();
+	init_fold_consts(&fold16, 16, CRC16_POLY);
+	init_fold_consts(&fold32, 32, CRC32_POLY);
+	(void)cpu;
+
+#ifdef __ADF_X86__
+	if (cpu->pclmul) {
+		crc32_kernel = &crc32_update_pclmul;
+		crc16_kernel = &crc16_update_pclmul;
+		return;
+	}
+#endif
+#ifdef __ADF_PMULL__
+	if (cpu->pmull) {
+		crc32_kernel = &crc32_update_pmull;
+		crc16_kernel = &crc16_update_pmull;
+		return;
+	}
+#endif
+	crc32_kernel = &crc32_update_slice8;
+	crc16_kernel = &crc16_update_slice8;
+}
+
+/*
+ * The first thread to get here builds the tables and picks the kernels, then
+ * publishes them by a release store: a thread that sees the kernels as
+ * selected by an acquire load sees the tables they read as well. The others
+ * wait for it.
+ */
+static void ensure_crc_fns(void)
+{
+	int expected = KERNELS_UNKNOWN;
+
+	if (atomic_load_explicit(&kernels_state, memory_order_acquire)
+		== KERNELS_SELECTED)
+		return;
+
+	if (atomic_compare_exchange_strong(&kernels_state, &expected,
+									   KERNELS_SELECTING)) {
+		select_crc_fns();
+		atomic_store_explicit(&kernels_state, KERNELS_SELECTED,
+							  memory_order_release);
+	}
+	while (atomic_load_explicit(&kernels_state, memory_order_acquire)
+		   != KERNELS_SELECTED)
+		;
+}
+
+crc16_fn get_crc16_fn(void)
+{
+	ensure_crc_fns();
+	return crc16_kernel;
+}
+
+crc32_fn get_crc32_fn(void)
+{
+	ensure_crc_fns();
+	return crc32_kernel;
+}
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, size_t size)
+{
+	return get_crc16_fn()(crc, buf, size);
+}
+
+uint16_t crc16(const uint8_t *buf, size_t size)
+{
+	return crc16_update(CRC16_INIT, buf, size);
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	return get_crc32_fn()(crc, buf, size);
+}
+
+uint32_t crc32(const uint8_t *buf, size_t size)
+{
+	return crc32_update(CRC32_INIT, buf, size);
+}
@@ -23,10 +23,63 @@
 #ifndef __CRC_H__
 #define __CRC_H__
 
+#include "cpu.h"
 #include <stdint.h>
 #include <stdlib.h>
 
+#define CRC16_INIT 0xffff
+#define CRC32_INIT 0xffffffff
+
 uint16_t crc16(const uint8_t *, size_t);
+
+/*
+ * Extends a crc16 over more bytes: `crc16(buf, n)` is the same as
+ * `crc16_update(CRC16_INIT, buf, n)`, and the bytes can be split among as
+ * many calls as needed.
+ */
+uint16_t crc16_update(uint16_t, const uint8_t *, size_t);
 uint32_t crc32(const uint8_t *, size_t);
 
+/* Same as `crc16_update`, for crc32. */
+uint32_t crc32_update(uint32_t, const uint8_t *, size_t);
+
+/*
+ * Extends a crc over the bytes of the buffer, like `crc16_update` and
+ * `crc32_update` do. Every kernel gives the same result: they only differ
+ * in speed. They can be called directly once the kernels have been
+ * selected by `get_crc16_fn` or `get_crc32_fn`, that also build the tables
+ * the kernels rely on.
+ */
+typedef uint16_t (*crc16_fn)(uint16_t, const uint8_t *, size_t);
+typedef uint32_t (*crc32_fn)(uint32_t, const uint8_t *, size_t);
+
+/* A byte at a time, through a single table. */
+uint16_t crc16_update_table(uint16_t, const uint8_t *, size_t);
+uint32_t crc32_update_table(uint32_t, const uint8_t *, size_t);
+
+/* Eight bytes at a time, through eight tables (slicing-by-8). */
+uint16_t crc16_update_slice8(uint16_t, const uint8_t *, size_t);
+uint32_t crc32_update_slice8(uint32_t, const uint8_t *, size_t);
+
+/*
+ * Sixteen bytes at a time, folding the buffer with carry-less
+ * multiplications. Short buffers are left to slicing-by-8.
+ */
+#ifdef __ADF_X86__
+uint16_t crc16_update_pclmul(uint16_t, const uint8_t *, size_t);
+uint32_t crc32_update_pclmul(uint32_t, const uint8_t *, size_t);
+#endif
+
+#ifdef __ADF_PMULL__
+uint16_t crc16_update_pmull(uint16_t, const uint8_t *, size_t);
+uint32_t crc32_update_pmull(uint32_t, const uint8_t *, size_t);
+#endif
+
+/*
+ * Return the fastest crc kernels for the host. The choice is made once at
+ * runtime, according to the available extensions.
+ */
+crc16_fn get_crc16_fn(void);
+crc32_fn get_crc32_fn(void);
+
 #endif /* __CRC_H__ */
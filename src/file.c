@@ -0,0 +1,275 @@
+/* file.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* madvise, posix_fallocate and mkstemp are not part of ISO C */
+#define _DEFAULT_SOURCE
+
+#include "adf.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define __ADF_MMAP__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Before decoding, the byte array is checked against its actual size
+ * through a view: unmarshal trusts the sizes stored in the file, and
+ * reading past the end of a mapping is fatal. The view checks the additive
+ * indexes of each series as well.
+ */
+static uint16_t unmarshal_checked(adf_t *adf, const uint8_t *bytes,
+								  size_t size)
+{
+	adf_view_t view;
+	uint16_t res = adf_view_init(&view, bytes, size);
+
+	adf_view_free(&view);
+	if (res != ADF_OK) { return res; }
+	return unmarshal(adf, bytes);
+}
+
+/*
+ * A file is saved under a temporary name in the same directory and renamed
+ * over `path` only once it is complete, so that a failed save doesn't
+ * destroy the previous file. The returned path must be freed.
+ */
+static char *get_tmp_path(const char *path, const char *suffix)
+{
+	size_t path_len = strlen(path);
+	size_t suffix_len = strlen(suffix);
+	char *tmp_path = malloc(path_len + suffix_len + 1);
+
+	if (!tmp_path) { return NULL; }
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, suffix, suffix_len + 1);
+	return tmp_path;
+}
+
+static bool write_to_file(void *ctx, const uint8_t *bytes, size_t size)
+{
+	return fwrite(bytes, 1, size, (FILE *)ctx) == size;
+}
+
+uint16_t adf_writer_init_file(adf_writer_t *writer, FILE *file,
+							  size_t buffer_size)
+{
+	if (!file) { return ADF_RUNTIME_ERROR; }
+	return adf_writer_init(writer, &write_to_file, file, buffer_size);
+}
+
+#ifdef __ADF_MMAP__
+
+/* Pipes and sockets may accept fewer bytes than requested */
+static bool write_to_fd(void *ctx, const uint8_t *bytes, size_t size)
+{
+	int fd = (int)(intptr_t)ctx;
+	ssize_t written;
+
+	while (size > 0) {
+		written = write(fd, bytes, size);
+		if (written < 0 && errno == EINTR) { continue; }
+		if (written <= 0) { return false; }
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+uint16_t adf_writer_init_fd(adf_writer_t *writer, int fd, size_t buffer_size)
+{
+	if (fd < 0) { return ADF_RUNTIME_ERROR; }
+	return adf_writer_init(writer, &write_to_fd, (void *)(intptr_t)fd,
+						   buffer_size);
+}
+
+uint16_t adf_open_file(adf_t *adf, const char *path, uint8_t flags)
+{
+	struct stat file_stat;
+	uint8_t *bytes;
+	uint16_t res;
+	int fd;
+
+	if (!adf || !path) { return ADF_RUNTIME_ERROR; }
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) { return ADF_RUNTIME_ERROR; }
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+		close(fd);
+		return ADF_RUNTIME_ERROR;
+	}
+
+	bytes = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (bytes == MAP_FAILED) { return ADF_RUNTIME_ERROR; }
+
+	if (flags & ADF_FILE_SEQUENTIAL)
+		madvise(bytes, file_stat.st_size, MADV_SEQUENTIAL);
+	if (flags & ADF_FILE_WILLNEED)
+		madvise(bytes, file_stat.st_size, MADV_WILLNEED);
+
+	res = unmarshal_checked(adf, bytes, file_stat.st_size);
+	munmap(bytes, file_stat.st_size);
+	return res;
+}
+
+uint16_t adf_save_file(adf_t *adf, const char *path)
+{
+	uint16_t res = ADF_RUNTIME_ERROR;
+	uint8_t *bytes;
+	char *tmp_path;
+	size_t size;
+	int fd;
+
+	if (!adf || !path) { return ADF_RUNTIME_ERROR; }
+
+	size = size_adf_t(adf);
+	tmp_path = get_tmp_path(path, ".XXXXXX");
+	if (!tmp_path) { return ADF_RUNTIME_ERROR; }
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		free(tmp_path);
+		return ADF_RUNTIME_ERROR;
+	}
+
+	/*
+	 * The blocks are reserved up front where possible, so that running out
+	 * of space is reported here instead of raising SIGBUS while writing to
+	 * the mapping.
+	 */
+	if (fchmod(fd, 0644) != 0 || ftruncate(fd, size) != 0) {
+		close(fd);
+		goto remove_file;
+	}
+#ifdef __linux__
+	int err = posix_fallocate(fd, 0, size);
+	if (err != 0 && err != EINVAL && err != EOPNOTSUPP) {
+		close(fd);
+		goto remove_file;
+	}
+#endif
+
+	bytes = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (bytes == MAP_FAILED) { goto remove_file; }
+
+	madvise(bytes, size, MADV_SEQUENTIAL);
+	res = marshal(bytes, adf);
+	if (munmap(bytes, size) != 0 && res == ADF_OK) { res = ADF_RUNTIME_ERROR; }
+	if (res == ADF_OK && rename(tmp_path, path) != 0) {
+		res = ADF_RUNTIME_ERROR;
+	}
+	if (res == ADF_OK) {
+		free(tmp_path);
+		return res;
+	}
+
+remove_file:
+	/* the file at path, if any, is left as it was */
+	unlink(tmp_path);
+	free(tmp_path);
+	return res;
+}
+
+#else
+
+uint16_t adf_open_file(adf_t *adf, const char *path, uint8_t flags)
+{
+	uint8_t *bytes;
+	uint16_t res;
+	FILE *file;
+	long size;
+	(void)flags;
+
+	if (!adf || !path) { return ADF_RUNTIME_ERROR; }
+
+	file = fopen(path, "rb");
+	if (!file) { return ADF_RUNTIME_ERROR; }
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	if (size <= 0) {
+		fclose(file);
+		return ADF_RUNTIME_ERROR;
+	}
+
+	bytes = malloc(size);
+	if (!bytes || fread(bytes, size, 1, file) != 1) {
+		free(bytes);
+		fclose(file);
+		return ADF_RUNTIME_ERROR;
+	}
+	fclose(file);
+
+	res = unmarshal_checked(adf, bytes, size);
+	free(bytes);
+	return res;
+}
+
+uint16_t adf_writer_init_fd(adf_writer_t *writer, int fd, size_t buffer_size)
+{
+	(void)writer;
+	(void)fd;
+	(void)buffer_size;
+	return ADF_RUNTIME_ERROR;
+}
+
+uint16_t adf_save_file(adf_t *adf, const char *path)
+{
+	adf_writer_t writer;
+	char *tmp_path;
+	uint16_t res;
+	FILE *file;
+
+	if (!adf || !path) { return ADF_RUNTIME_ERROR; }
+
+	tmp_path = get_tmp_path(path, ".tmp");
+	if (!tmp_path) { return ADF_RUNTIME_ERROR; }
+	file = fopen(tmp_path, "wb");
+	if (!file) {
+		free(tmp_path);
+		return ADF_RUNTIME_ERROR;
+	}
+	res = adf_writer_init_file(&writer, file, 0);
+	if (res == ADF_OK) {
+		res = marshal_stream(adf, &writer);
+		adf_writer_free(&writer);
+	}
+	if (fclose(file) != 0 && res == ADF_OK) { res = ADF_RUNTIME_ERROR; }
+	/* rename doesn't replace an existing file everywhere */
+	if (res == ADF_OK && rename(tmp_path, path) != 0
+		&& (remove(path) != 0 || rename(tmp_path, path) != 0)) {
+		res = ADF_RUNTIME_ERROR;
+	}
+	/* the file at path, if any, is left as it was */
+	if (res != ADF_OK) { remove(tmp_path); }
+	free(tmp_path);
+	return res;
+}
+
+#endif /* __ADF_MMAP__ */
@@ -21,144 +21,340 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include <stdio.h>
 #include <stdbool.h>
+#include "alloc.h"
+#include "cpu.h"
 #include "lookup_table.h"
 
-static uint16_t increase_table_size(table_t *table)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ADF_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define GROUP_WIDTH 16
+#define MIN_CAPACITY GROUP_WIDTH
+
+/* Control bytes: a full slot holds the 7 low bits of the hash of its key */
+#define CTRL_EMPTY 0x80u
+#define CTRL_DELETED 0xFEu
+
+/*
+ * The result of matching the control bytes of a group: the bits of the
+ * byte `i` start at `i * MASK_STRIDE`, and they are all set if it matches.
+ */
+typedef uint64_t group_mask_t;
+
+#if defined(__SSE2__)
+#define MASK_STRIDE 1
+
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return (uint16_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+}
+
+/* empty and deleted slots are the ones with the high bit set */
+static inline group_mask_t match_free(const uint8_t *group)
+{
+	return (uint16_t)_mm_movemask_epi8(
+		_mm_loadu_si128((const __m128i *)group));
+}
+#elif defined(__ADF_NEON__)
+#define MASK_STRIDE 4
+
+/* NEON has no movemask: each byte is narrowed to a nibble instead */
+static inline group_mask_t neon_mask(uint8x16_t matches)
+{
+	uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+	return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+	return neon_mask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(byte)));
+}
+
+static inline group_mask_t match_free(const uint8_t *group)
+{
+	int8x16_t ctrl = vreinterpretq_s8_u8(vld1q_u8(group));
+	return neon_mask(vcltq_s8(ctrl, vdupq_n_s8(0)));
+}
+#else
+#define MASK_STRIDE 1
+
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+	group_mask_t mask = 0;
+	for (uint32_t i = 0; i < GROUP_WIDTH; i++)
+		mask |= (group_mask_t)(group[i] == byte) << i;
+	return mask;
+}
+
+static inline group_mask_t match_free(const uint8_t *group)
+{
+	group_mask_t mask = 0;
+	for (uint32_t i = 0; i < GROUP_WIDTH; i++)
+		mask |= (group_mask_t)(group[i] >> 7) << i;
+	return mask;
+}
+#endif
+
+/* The position in the group of the first match */
+static inline uint32_t first_match(group_mask_t mask)
+{
+	return __builtin_ctzll(mask) / MASK_STRIDE;
+}
+
+static inline group_mask_t next_match(group_mask_t mask)
+{
+	const group_mask_t lane = ((group_mask_t)1 << MASK_STRIDE) - 1;
+	return mask & ~(lane << (first_match(mask) * MASK_STRIDE));
+}
+
+/*
+ * The hash given by the user is mixed, so that keys that differ only in
+ * some bits are spread over the whole table: the top bits choose the
+ * group, and the low ones make the control byte.
+ */
+static inline uint64_t mix_hash(const table_t *table, uint32_t key)
+{
+	return (uint64_t)table->hash(&key) * 0x9E3779B97F4A7C15ull;
+}
+
+static inline uint8_t ctrl_of(uint64_t hash)
+{
+	return hash & 0x7F;
+}
+
+static inline size_t first_group(const table_t *table, uint64_t hash)
+{
+	return (hash >> 32) & (table->max_size / GROUP_WIDTH - 1);
+}
+
+/*
+ * Groups are probed in triangular steps (1, 2, 3, ...), which visit all of
+ * them when their number is a power of two.
+ */
+static inline size_t next_group(const table_t *table, size_t group,
+								size_t step)
+{
+	return (group + step) & (table->max_size / GROUP_WIDTH - 1);
+}
+
+/* The slot that holds `key`, or `max_size` if it's not in the table */
+static size_t find_slot(const table_t *table, uint32_t key)
 {
-	size_t old_size = table->max_size,
-		   new_size = old_size + table->increment;
+	const uint64_t hash = mix_hash(table, key);
+	const size_t n_groups = table->max_size / GROUP_WIDTH;
+	size_t group = first_group(table, hash), slot;
+	const uint8_t *ctrl;
+	group_mask_t matches;
+
+	for (size_t step = 1; step <= n_groups; step++) {
+		ctrl = table->ctrl + group * GROUP_WIDTH;
+		for (matches = match_byte(ctrl, ctrl_of(hash)); matches;
+			 matches = next_match(matches)) {
+			slot = group * GROUP_WIDTH + first_match(matches);
+			if (table->pairs[table->slots[slot]].key == key) { return slot; }
+		}
+		/* an empty slot ends the probing sequence */
+		if (match_byte(ctrl, CTRL_EMPTY)) { break; }
+		group = next_group(table, group, step);
+	}
+	return table->max_size;
+}
 
-    if (new_size <= old_size) { return LM_MAP_SIZE_OVERFLOW; }
-	
-	table->pairs = realloc(table->pairs, new_size * sizeof(pair_t));
-	if (!table->pairs) { return LM_FAILED_EXPANDING_MAP_SIZE; }
+/* The first empty or deleted slot where a key with `hash` can be placed */
+static size_t find_free_slot(const table_t *table, uint64_t hash)
+{
+	size_t group = first_group(table, hash);
+	group_mask_t matches;
 
-	for (size_t i = old_size; i < new_size; i++) {
-		table->pairs[i].key = 0;
-		table->pairs[i].value = 0;
+	/* the table is never full, so there's always a free slot */
+	for (size_t step = 1;; step++) {
+		matches = match_free(table->ctrl + group * GROUP_WIDTH);
+		if (matches) { return group * GROUP_WIDTH + first_match(matches); }
+		group = next_group(table, group, step);
 	}
+}
+
+/*
+ * Rebuilds the slots for a table of `capacity` slots. The pairs don't move,
+ * so their order is kept, and the deleted slots are dropped.
+ */
+static uint16_t rehash(table_t *table, size_t capacity)
+{
+	uint8_t *ctrl = adf_malloc(NULL, capacity);
+	uint32_t *slots = adf_malloc(NULL, capacity * sizeof(uint32_t));
+	pair_t *pairs = adf_realloc(NULL, table->pairs,
+								capacity / 2 * sizeof(pair_t));
+	uint64_t hash;
+	size_t slot;
 
-	table->max_size = new_size;
+	if (pairs) { table->pairs = pairs; }
+	if (!ctrl || !slots || !pairs) {
+		adf_dealloc(NULL, ctrl);
+		adf_dealloc(NULL, slots);
+		return LM_FAILED_EXPANDING_MAP_SIZE;
+	}
+
+	adf_dealloc(NULL, table->ctrl);
+	adf_dealloc(NULL, table->slots);
+	memset(ctrl, CTRL_EMPTY, capacity);
+	table->ctrl = ctrl;
+	table->slots = slots;
+	table->max_size = capacity;
+	table->n_deleted = 0;
+
+	for (size_t i = 0; i < table->size; i++) {
+		hash = mix_hash(table, table->pairs[i].key);
+		slot = find_free_slot(table, hash);
+		table->ctrl[slot] = ctrl_of(hash);
+		table->slots[slot] = i;
+	}
 	return LM_OK;
 }
 
-static bool should_be_resized(table_t *table)
+/*
+ * Makes room for one more pair, keeping the table at most half full
+ * (counting the deleted slots). If most of the used slots are deleted, the
+ * table is just rehashed in place, otherwise it doubles.
+ */
+static uint16_t reserve_one(table_t *table)
 {
-	return table->size >= table->max_size / 2;
+	size_t capacity = table->max_size;
+
+	if (table->size + table->n_deleted + 1 <= capacity / 2) { return LM_OK; }
+	if (table->size + 1 > capacity / 4) {
+		if (capacity > UINT32_MAX / 2) { return LM_MAP_SIZE_OVERFLOW; }
+		capacity *= 2;
+	}
+	return rehash(table, capacity);
 }
 
 uint16_t table_init(table_t *table, size_t capacity, size_t increment,
 					hash_fn_t hash)
 {
+	size_t max_size = MIN_CAPACITY;
+
 	if (!table) { return LM_CANNOT_INIT_TABLE; }
-	
+
+	while (max_size < capacity && max_size <= UINT32_MAX / 2)
+		max_size *= 2;
+
 	table->size = 0;
-    table->max_size = capacity;
+	table->max_size = max_size;
 	table->increment = increment;
-	table->pairs = calloc(capacity, sizeof(pair_t));
 	table->hash = hash;
-    if (table->pairs == NULL) { return LM_CANNOT_INIT_TABLE_PAIRS; }
+	table->n_deleted = 0;
+	table->pairs = adf_malloc(NULL, max_size / 2 * sizeof(pair_t));
+	table->ctrl = adf_malloc(NULL, max_size);
+	table->slots = adf_malloc(NULL, max_size * sizeof(uint32_t));
+	if (!table->pairs || !table->ctrl || !table->slots) {
+		table_free(table);
+		return LM_CANNOT_INIT_TABLE_PAIRS;
+	}
+	memset(table->ctrl, CTRL_EMPTY, max_size);
 	return LM_OK;
 }
 
 uint16_t table_put(table_t *table, uint32_t key, uint32_t val)
 {
-	uint32_t hash;
-    size_t idx;
+	size_t slot = find_slot(table, key);
+	uint64_t hash;
+	uint16_t res;
 
-	if (should_be_resized(table)) {
-		uint16_t res = increase_table_size(table);
-        if (res != LM_OK) { return res; }
-    }
+	if (slot < table->max_size) {
+		table->pairs[table->slots[slot]].value = val;
+		return LM_OK;
+	}
 
-	hash = table->hash(&key);
+	res = reserve_one(table);
+	if (res != LM_OK) { return res; }
 
-	for (size_t i = 0, max_size = table->max_size; i < max_size; i++) {
-		idx = (hash + i) % (max_size - 1);
-		if (!table->pairs[idx].value) {
-			table->pairs[idx] = (pair_t) {.key = idx, .value = val};
-			table->size++;
-			return LM_OK;
-		}
-	}
-    return LM_CANNOT_INSERT_VALUE;
+	hash = mix_hash(table, key);
+	slot = find_free_slot(table, hash);
+	if (table->ctrl[slot] == CTRL_DELETED) { table->n_deleted--; }
+	table->ctrl[slot] = ctrl_of(hash);
+	table->slots[slot] = table->size;
+	table->pairs[table->size] = (pair_t) { .key = key, .value = val };
+	table->size++;
+	return LM_OK;
 }
 
 uint16_t table_update(table_t *table, uint32_t key, uint32_t val)
 {
-	uint32_t hash;
-    size_t idx;
+	size_t slot = find_slot(table, key);
 
-	hash = table->hash(&key);
+	if (slot == table->max_size) { return LM_CANNOT_INSERT_VALUE; }
+	table->pairs[table->slots[slot]].value = val;
+	return LM_OK;
+}
 
-	for (size_t i = 0, max_size = table->max_size; i < max_size; i++) {
-		idx = (hash + i) % (max_size - 1);
-		if (table->pairs[idx].key == key) {
-			table->pairs[idx].value = val;
-			return LM_OK;
-		}
-	}
-    return LM_CANNOT_INSERT_VALUE;
+uint16_t table_find(const table_t *table, uint32_t key, uint32_t *val)
+{
+	size_t slot = find_slot(table, key);
+
+	if (slot == table->max_size) { return LM_VALUE_NOT_FOUND; }
+	*val = table->pairs[table->slots[slot]].value;
+	return LM_OK;
 }
 
 uint32_t table_get(const table_t * table, uint32_t key)
 {
-    uint16_t hash;
-    size_t idx;
+	uint32_t val = 0;
 
-	hash = table->hash(&key);
-	for (size_t i = 0, max_size = table->max_size; i < max_size; i++) {
-		idx = (hash + i) % (max_size - 1);
-		if (table->pairs[idx].key == key) {
-			return table->pairs[idx].value;
-		}
-	}
-	return 0;
+	table_find(table, key, &val);
+	return val;
 }
 
 uint16_t table_remove(table_t * table, uint32_t key)
 {
-	uint32_t hash;
-    size_t idx;
+	size_t slot = find_slot(table, key), last_slot;
+	uint32_t pos, last = table->size - 1;
 
-	hash = table->hash(&key);
+	if (slot == table->max_size) { return LM_CANNOT_REMOVE_NONEXISTENT_VALUE; }
 
-	for (size_t i = 0, max_size = table->max_size; i < max_size; i++) {
-		idx = (hash + i) % (max_size - 1);
-		if (table->pairs[idx].key == key) {
-			table->pairs[idx].value = 0;
-			table->pairs[idx].key = 0;
-			table->size--;
-			return LM_OK;
-		}
+	/* the slot stays in the probing sequences of the other keys */
+	pos = table->slots[slot];
+	table->ctrl[slot] = CTRL_DELETED;
+	table->n_deleted++;
+
+	/* the last pair fills the hole, so that the pairs stay dense */
+	if (pos != last) {
+		last_slot = find_slot(table, table->pairs[last].key);
+		table->pairs[pos] = table->pairs[last];
+		table->slots[last_slot] = pos;
 	}
-    return LM_CANNOT_REMOVE_NONEXISTENT_VALUE;
+	table->size--;
+	return LM_OK;
 }
 
 uint16_t table_get_pairs(const table_t *table, pair_t *keys)
 {
-	size_t counter = 0;
-
 	if (!keys) { return LM_NULL_KEY_ARRAY; }
 
-	for (size_t i = 0, max_size = table->max_size; i < max_size; i++) {
-		if (table->pairs[i].value) {
-			keys[counter].key = table->pairs[i].key;
-			keys[counter].value = table->pairs[i].value;
-			counter++;
-		}
-	}
-
+	memcpy(keys, table->pairs, table->size * sizeof(pair_t));
 	return LM_OK;
 }
 
+void pair_free(pair_t *pairs)
+{
+	adf_dealloc(NULL, pairs);
+}
+
 void table_free(table_t *table)
 {
-    free(table->pairs);
+	adf_dealloc(NULL, table->pairs);
+	adf_dealloc(NULL, table->ctrl);
+	adf_dealloc(NULL, table->slots);
 	table->increment = 0;
 	table->max_size = 0;
 	table->size = 0;
+	table->n_deleted = 0;
 	table->pairs = NULL;
+	table->ctrl = NULL;
+	table->slots = NULL;
 }
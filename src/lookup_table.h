@@ -48,19 +48,65 @@ typedef struct {
 	uint32_t value;
 } pair_t;
 
+/*
+ * A hash map from 4-byte keys to 4-byte values, in the style of a Swiss
+ * table. The slots are split into groups of 16, and each slot has a control
+ * byte: empty, deleted, or the 7 low bits of the hash of its key. A lookup
+ * compares the control bytes of a whole group at once (with SSE2 or NEON,
+ * where available), and looks at the keys only when they match.
+ * The pairs themselves are stored densely, in insertion order: the slots
+ * just hold their positions.
+ */
 typedef struct {
+	/* The `size` pairs in the map, in insertion order */
 	pair_t *pairs;
+
+	/* The number of slots, a power of two */
 	size_t max_size;
+
+	/* Unused: kept for compatibility, the map always grows geometrically */
 	size_t increment;
-    size_t size;
+
+	size_t size;
 	hash_fn_t hash;
+
+	/* The control byte, and the position in `pairs`, of each slot */
+	uint8_t *ctrl;
+	uint32_t *slots;
+
+	/* The number of slots marked as deleted */
+	size_t n_deleted;
 } table_t;
 
+/*
+ * Inits a map with room for at least the given number of slots (rounded up
+ * to a power of two). The map is kept at most half full, and it doubles
+ * its size when it's needed. The hash function is mixed by the map, so the
+ * identity is a fine choice for keys that are already unique ids.
+ */
 uint16_t table_init(table_t *, size_t, size_t, hash_fn_t);
+
+/* Inserts a pair, or replaces the value if the key is already there. */
 uint16_t table_put(table_t *, uint32_t, uint32_t);
+
+/* Replaces the value of a key, which must already be there. */
 uint16_t table_update(table_t *,uint32_t, uint32_t);
 uint16_t table_remove(table_t *, uint32_t);
+
+/* Returns the value of a key, or 0 if it's not in the map. */
 uint32_t table_get(const table_t *, uint32_t);
+
+/*
+ * Looks up a key, setting its value if it's found. Unlike `table_get`, it
+ * tells a missing key (LM_VALUE_NOT_FOUND) from a value equal to 0.
+ */
+uint16_t table_find(const table_t *, uint32_t, uint32_t *);
+
+/*
+ * Copies the `size` pairs of the map. They are in insertion order, unless
+ * some pairs have been removed: each removal moves the last pair in place
+ * of the removed one.
+ */
 uint16_t table_get_pairs(const table_t *, pair_t *);
 void pair_free(pair_t *);
 void table_free(table_t *);
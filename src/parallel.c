@@ -0,0 +1,137 @@
+/* parallel.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* sysconf is not part of ISO C */
+#define _DEFAULT_SOURCE
+
+#include "parallel.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(ADF_NO_THREADS)
+#define __ADF_THREADS__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define NO_ERROR UINT64_MAX
+
+typedef struct {
+	_Atomic uint64_t next;
+	uint32_t n;
+	uint32_t grain;
+	parallel_task task;
+	void *ctx;
+} parallel_job_t;
+
+/* Each thread keeps taking the next batch, until there are none left */
+static void *run_batches(void *arg)
+{
+	parallel_job_t *job = arg;
+	uint64_t begin, end;
+
+	for (;;) {
+		begin = atomic_fetch_add(&job->next, job->grain);
+		if (begin >= job->n) { break; }
+		end = (job->n - begin > job->grain) ? begin + job->grain : job->n;
+		job->task(job->ctx, (uint32_t)begin, (uint32_t)end);
+	}
+	return NULL;
+}
+
+uint32_t parallel_n_threads(uint32_t n_threads)
+{
+	long n_cores = 1;
+
+	if (n_threads > 0) { return n_threads; }
+#ifdef __ADF_THREADS__
+	n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return n_cores > 0 ? (uint32_t)n_cores : 1;
+}
+
+void parallel_for(uint32_t n, uint32_t grain, uint32_t n_threads,
+				  parallel_task task, void *ctx)
+{
+	parallel_job_t job = {
+		.n = n,
+		.grain = grain > 0 ? grain : 1,
+		.task = task,
+		.ctx = ctx
+	};
+	uint32_t n_batches = n / job.grain + (n % job.grain > 0);
+
+	atomic_init(&job.next, 0);
+	if (n_threads > n_batches) { n_threads = n_batches; }
+
+#ifdef __ADF_THREADS__
+	if (n_threads > 1) {
+		pthread_t *threads = malloc((n_threads - 1) * sizeof(pthread_t));
+		uint32_t n_started = 0;
+
+		/* if a thread cannot be created, the others take over its work */
+		if (threads) {
+			while (n_started < n_threads - 1
+				   && pthread_create(threads + n_started, NULL,
+									 &run_batches, &job) == 0)
+				n_started++;
+		}
+		run_batches(&job);
+		for (uint32_t i = 0; i < n_started; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		return;
+	}
+#endif
+	run_batches(&job);
+}
+
+void first_error_init(first_error_t *error)
+{
+	atomic_init(&error->packed, NO_ERROR);
+}
+
+void first_error_set(first_error_t *error, uint32_t index, uint16_t code)
+{
+	/* the index is in the high bits, so the lowest value wins */
+	uint64_t packed = ((uint64_t)index << 16) | code;
+	uint64_t current = atomic_load(&error->packed);
+
+	while (packed < current
+		   && !atomic_compare_exchange_weak(&error->packed, &current, packed))
+		;
+}
+
+bool first_error_before(first_error_t *error, uint32_t index)
+{
+	return atomic_load(&error->packed) < ((uint64_t)index << 16);
+}
+
+bool first_error_get(first_error_t *error, uint32_t *index, uint16_t *code)
+{
+	uint64_t packed = atomic_load(&error->packed);
+
+	if (packed == NO_ERROR) { return false; }
+	*index = (uint32_t)(packed >> 16);
+	*code = (uint16_t)(packed & 0xFFFF);
+	return true;
+}
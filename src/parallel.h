@@ -0,0 +1,71 @@
+/* parallel.h - A minimal parallel for loop over a range of indices
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Processes the indices in [begin, end). The context is the one passed to
+ * `parallel_for`.
+ */
+typedef void (*parallel_task)(void *ctx, uint32_t begin, uint32_t end);
+
+/*
+ * Returns the given number of threads or, if it's 0, the number of cores
+ * available on the host.
+ */
+uint32_t parallel_n_threads(uint32_t);
+
+/*
+ * Calls the task over all the indices in [0, n), splitting them in batches
+ * of `grain` indices that are handed out to up to `n_threads` threads (the
+ * calling one included). It returns when every index has been processed.
+ * If threads are not supported, or cannot be created, the calling thread
+ * processes all the indices by itself.
+ */
+void parallel_for(uint32_t n, uint32_t grain, uint32_t n_threads,
+				  parallel_task task, void *ctx);
+
+/*
+ * Keeps track of the first error (the one at the lowest index) reported by
+ * concurrent tasks, so that the outcome doesn't depend on scheduling.
+ */
+typedef struct {
+	_Atomic uint64_t packed;
+} first_error_t;
+
+void first_error_init(first_error_t *);
+void first_error_set(first_error_t *, uint32_t index, uint16_t code);
+
+/* Returns true if an error has been reported at an index lower than this. */
+bool first_error_before(first_error_t *, uint32_t index);
+
+/*
+ * Returns false if no error has been reported. Otherwise it returns true,
+ * with the index and the code of the first error in the last parameters.
+ */
+bool first_error_get(first_error_t *, uint32_t *, uint16_t *);
+
+#endif /* __PARALLEL_H__ */
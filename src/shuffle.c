@@ -0,0 +1,324 @@
+/* shuffle.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "shuffle.h"
+#include <stdatomic.h>
+
+#ifdef __ADF_X86__
+#include <immintrin.h>
+#endif
+
+#ifdef __ADF_NEON__
+#include <arm_neon.h>
+#endif
+
+static _Atomic(array_shuffle) shuffle_4_bytes_fn = NULL;
+static _Atomic(array_shuffle) unshuffle_4_bytes_fn = NULL;
+
+void shuffle_4_bytes_array_scalar(uint8_t *dest, const uint8_t *source,
+								  size_t n)
+{
+	for (size_t i = 0; i < n; i++, source += 4) {
+		dest[i] = source[0];
+		dest[n + i] = source[1];
+		dest[2 * n + i] = source[2];
+		dest[3 * n + i] = source[3];
+	}
+}
+
+void unshuffle_4_bytes_array_scalar(uint8_t *dest, const uint8_t *source,
+									size_t n)
+{
+	for (size_t i = 0; i < n; i++, dest += 4) {
+		dest[0] = source[i];
+		dest[1] = source[n + i];
+		dest[2] = source[2 * n + i];
+		dest[3] = source[3 * n + i];
+	}
+}
+
+/*
+ * The SIMD kernels shuffle 16 (or 32) elements at a time: the bytes of each
+ * vector of 4 elements are first grouped by plane, then the groups of the
+ * 4 vectors are transposed, so that each vector holds a single plane. The
+ * elements that are left are shuffled by the scalar kernel, whose planes
+ * are offset by the elements already done.
+ */
+static inline void shuffle_tail(uint8_t *dest, const uint8_t *source,
+								size_t n, size_t done)
+{
+	for (size_t i = done; i < n; i++) {
+		dest[i] = source[i * 4];
+		dest[n + i] = source[i * 4 + 1];
+		dest[2 * n + i] = source[i * 4 + 2];
+		dest[3 * n + i] = source[i * 4 + 3];
+	}
+}
+
+static inline void unshuffle_tail(uint8_t *dest, const uint8_t *source,
+								  size_t n, size_t done)
+{
+	for (size_t i = done; i < n; i++) {
+		dest[i * 4] = source[i];
+		dest[i * 4 + 1] = source[n + i];
+		dest[i * 4 + 2] = source[2 * n + i];
+		dest[i * 4 + 3] = source[3 * n + i];
+	}
+}
+
+#ifdef __ADF_X86__
+/* Transposes a 4x4 matrix of 32-bit groups, one row per vector */
+#define TRANSPOSE_4X4(unpacklo32, unpackhi32, unpacklo64, unpackhi64,      \
+					  v0, v1, v2, v3)                                      \
+	do {                                                                   \
+		__typeof__(v0) t0 = unpacklo32(v0, v1), t1 = unpackhi32(v0, v1),   \
+					   t2 = unpacklo32(v2, v3), t3 = unpackhi32(v2, v3);   \
+		v0 = unpacklo64(t0, t2);                                           \
+		v1 = unpackhi64(t0, t2);                                           \
+		v2 = unpacklo64(t1, t3);                                           \
+		v3 = unpackhi64(t1, t3);                                           \
+	} while (0)
+
+__attribute__((target("ssse3")))
+void shuffle_4_bytes_array_ssse3(uint8_t *dest, const uint8_t *source,
+								 size_t n)
+{
+	const __m128i group = _mm_set_epi8(15, 11, 7, 3, 14, 10, 6, 2,
+									   13, 9, 5, 1, 12, 8, 4, 0);
+	__m128i v0, v1, v2, v3;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)
+											  (source + i * 4)), group);
+		v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)
+											  (source + i * 4 + 16)), group);
+		v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)
+											  (source + i * 4 + 32)), group);
+		v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)
+											  (source + i * 4 + 48)), group);
+		TRANSPOSE_4X4(_mm_unpacklo_epi32, _mm_unpackhi_epi32,
+					  _mm_unpacklo_epi64, _mm_unpackhi_epi64, v0, v1, v2, v3);
+		_mm_storeu_si128((__m128i *)(dest + i), v0);
+		_mm_storeu_si128((__m128i *)(dest + n + i), v1);
+		_mm_storeu_si128((__m128i *)(dest + 2 * n + i), v2);
+		_mm_storeu_si128((__m128i *)(dest + 3 * n + i), v3);
+	}
+	shuffle_tail(dest, source, n, i);
+}
+
+__attribute__((target("ssse3")))
+void unshuffle_4_bytes_array_ssse3(uint8_t *dest, const uint8_t *source,
+								   size_t n)
+{
+	const __m128i ungroup = _mm_set_epi8(15, 11, 7, 3, 14, 10, 6, 2,
+										 13, 9, 5, 1, 12, 8, 4, 0);
+	__m128i v0, v1, v2, v3;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		v0 = _mm_loadu_si128((const __m128i *)(source + i));
+		v1 = _mm_loadu_si128((const __m128i *)(source + n + i));
+		v2 = _mm_loadu_si128((const __m128i *)(source + 2 * n + i));
+		v3 = _mm_loadu_si128((const __m128i *)(source + 3 * n + i));
+		TRANSPOSE_4X4(_mm_unpacklo_epi32, _mm_unpackhi_epi32,
+					  _mm_unpacklo_epi64, _mm_unpackhi_epi64, v0, v1, v2, v3);
+		_mm_storeu_si128((__m128i *)(dest + i * 4),
+						 _mm_shuffle_epi8(v0, ungroup));
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 16),
+						 _mm_shuffle_epi8(v1, ungroup));
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 32),
+						 _mm_shuffle_epi8(v2, ungroup));
+		_mm_storeu_si128((__m128i *)(dest + i * 4 + 48),
+						 _mm_shuffle_epi8(v3, ungroup));
+	}
+	unshuffle_tail(dest, source, n, i);
+}
+
+/*
+ * The AVX2 kernels work on two lanes of 16 elements at once: after the
+ * transposition, the groups of 4 elements of each plane are interleaved
+ * between the lanes, and a permutation puts them back in order.
+ */
+__attribute__((target("avx2")))
+void shuffle_4_bytes_array_avx2(uint8_t *dest, const uint8_t *source,
+								size_t n)
+{
+	const __m256i group = _mm256_set_epi8(15, 11, 7, 3, 14, 10, 6, 2,
+										  13, 9, 5, 1, 12, 8, 4, 0,
+										  15, 11, 7, 3, 14, 10, 6, 2,
+										  13, 9, 5, 1, 12, 8, 4, 0);
+	const __m256i order = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
+	__m256i v0, v1, v2, v3;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		v0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)
+													(source + i * 4)), group);
+		v1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)
+													(source + i * 4 + 32)),
+								 group);
+		v2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)
+													(source + i * 4 + 64)),
+								 group);
+		v3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)
+													(source + i * 4 + 96)),
+								 group);
+		TRANSPOSE_4X4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32,
+					  _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+					  v0, v1, v2, v3);
+		_mm256_storeu_si256((__m256i *)(dest + i),
+							_mm256_permutevar8x32_epi32(v0, order));
+		_mm256_storeu_si256((__m256i *)(dest + n + i),
+							_mm256_permutevar8x32_epi32(v1, order));
+		_mm256_storeu_si256((__m256i *)(dest + 2 * n + i),
+							_mm256_permutevar8x32_epi32(v2, order));
+		_mm256_storeu_si256((__m256i *)(dest + 3 * n + i),
+							_mm256_permutevar8x32_epi32(v3, order));
+	}
+	shuffle_tail(dest, source, n, i);
+}
+
+__attribute__((target("avx2")))
+void unshuffle_4_bytes_array_avx2(uint8_t *dest, const uint8_t *source,
+								  size_t n)
+{
+	const __m256i ungroup = _mm256_set_epi8(15, 11, 7, 3, 14, 10, 6, 2,
+											13, 9, 5, 1, 12, 8, 4, 0,
+											15, 11, 7, 3, 14, 10, 6, 2,
+											13, 9, 5, 1, 12, 8, 4, 0);
+	const __m256i order = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+	__m256i v0, v1, v2, v3;
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		v0 = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256((const __m256i *)(source + i)), order);
+		v1 = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256((const __m256i *)(source + n + i)), order);
+		v2 = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256((const __m256i *)(source + 2 * n + i)), order);
+		v3 = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256((const __m256i *)(source + 3 * n + i)), order);
+		TRANSPOSE_4X4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32,
+					  _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+					  v0, v1, v2, v3);
+		_mm256_storeu_si256((__m256i *)(dest + i * 4),
+							_mm256_shuffle_epi8(v0, ungroup));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4 + 32),
+							_mm256_shuffle_epi8(v1, ungroup));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4 + 64),
+							_mm256_shuffle_epi8(v2, ungroup));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4 + 96),
+							_mm256_shuffle_epi8(v3, ungroup));
+	}
+	unshuffle_tail(dest, source, n, i);
+}
+#endif /* __ADF_X86__ */
+
+#ifdef __ADF_NEON__
+void shuffle_4_bytes_array_neon(uint8_t *dest, const uint8_t *source,
+								size_t n)
+{
+	size_t i = 0;
+
+	/* the de-interleaving load splits the elements in their planes */
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t v = vld4q_u8(source + i * 4);
+		vst1q_u8(dest + i, v.val[0]);
+		vst1q_u8(dest + n + i, v.val[1]);
+		vst1q_u8(dest + 2 * n + i, v.val[2]);
+		vst1q_u8(dest + 3 * n + i, v.val[3]);
+	}
+	shuffle_tail(dest, source, n, i);
+}
+
+void unshuffle_4_bytes_array_neon(uint8_t *dest, const uint8_t *source,
+								  size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t v = { { vld1q_u8(source + i),
+							 vld1q_u8(source + n + i),
+							 vld1q_u8(source + 2 * n + i),
+							 vld1q_u8(source + 3 * n + i) } };
+		vst4q_u8(dest + i * 4, v);
+	}
+	unshuffle_tail(dest, source, n, i);
+}
+#endif /* __ADF_NEON__ */
+
+static void select_4_bytes_fns(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	array_shuffle shuffle = &shuffle_4_bytes_array_scalar;
+	array_shuffle unshuffle = &unshuffle_4_bytes_array_scalar;
+
+#ifdef __ADF_X86__
+	if (cpu->avx2) {
+		shuffle = &shuffle_4_bytes_array_avx2;
+		unshuffle = &unshuffle_4_bytes_array_avx2;
+	} else if (cpu->ssse3) {
+		shuffle = &shuffle_4_bytes_array_ssse3;
+		unshuffle = &unshuffle_4_bytes_array_ssse3;
+	}
+#endif
+#ifdef __ADF_NEON__
+	if (cpu->neon) {
+		shuffle = &shuffle_4_bytes_array_neon;
+		unshuffle = &unshuffle_4_bytes_array_neon;
+	}
+#endif
+	(void)cpu;
+	/*
+	 * Only the final choice is published. Two threads that get here at the
+	 * same time select the same functions, so storing them twice is fine.
+	 */
+	atomic_store_explicit(&shuffle_4_bytes_fn, shuffle, memory_order_release);
+	atomic_store_explicit(&unshuffle_4_bytes_fn, unshuffle,
+						  memory_order_release);
+}
+
+array_shuffle get_shuffle_4_bytes_fn(void)
+{
+	array_shuffle fn = atomic_load_explicit(&shuffle_4_bytes_fn,
+											memory_order_acquire);
+
+	if (!fn) {
+		select_4_bytes_fns();
+		fn = atomic_load_explicit(&shuffle_4_bytes_fn, memory_order_acquire);
+	}
+	return fn;
+}
+
+array_shuffle get_unshuffle_4_bytes_fn(void)
+{
+	array_shuffle fn = atomic_load_explicit(&unshuffle_4_bytes_fn,
+											memory_order_acquire);
+
+	if (!fn) {
+		select_4_bytes_fns();
+		fn = atomic_load_explicit(&unshuffle_4_bytes_fn, memory_order_acquire);
+	}
+	return fn;
+}
@@ -0,0 +1,66 @@
+/* shuffle.h - Byte shuffle of arrays of 4-byte elements
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SHUFFLE_H__
+#define __SHUFFLE_H__
+
+#include "cpu.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Shuffles `n` 4-byte elements from the source (second parameter) to the
+ * destination (first parameter): byte k of each element ends up in the
+ * plane k, i.e. the bytes from k * n to (k + 1) * n - 1 of the destination.
+ * In ADF byte order the first plane holds the signs and the exponents of
+ * the floats, which change slowly, and the last one their noisiest bits: a
+ * general-purpose compressor finds many more repetitions in the planes
+ * than in the elements. Unshuffling is the inverse. Source and destination
+ * must not overlap.
+ */
+typedef void (*array_shuffle)(uint8_t *, const uint8_t *, size_t);
+
+/* Portable kernels, used when no SIMD extension is available. */
+void shuffle_4_bytes_array_scalar(uint8_t *, const uint8_t *, size_t);
+void unshuffle_4_bytes_array_scalar(uint8_t *, const uint8_t *, size_t);
+
+#ifdef __ADF_X86__
+void shuffle_4_bytes_array_ssse3(uint8_t *, const uint8_t *, size_t);
+void unshuffle_4_bytes_array_ssse3(uint8_t *, const uint8_t *, size_t);
+void shuffle_4_bytes_array_avx2(uint8_t *, const uint8_t *, size_t);
+void unshuffle_4_bytes_array_avx2(uint8_t *, const uint8_t *, size_t);
+#endif
+
+#ifdef __ADF_NEON__
+void shuffle_4_bytes_array_neon(uint8_t *, const uint8_t *, size_t);
+void unshuffle_4_bytes_array_neon(uint8_t *, const uint8_t *, size_t);
+#endif
+
+/*
+ * Return the fastest kernels that shuffle and unshuffle an array of 4-byte
+ * elements. The choice is made once at runtime, according to the available
+ * extensions.
+ */
+array_shuffle get_shuffle_4_bytes_fn(void);
+array_shuffle get_unshuffle_4_bytes_fn(void);
+
+#endif /* __SHUFFLE_H__ */
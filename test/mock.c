@@ -22,6 +22,7 @@
 
 #include "mock.h"
 #include "../src/adf.h"
+#include "../src/crc.h"
 
 real_t *get_real_array(int n_chunks)
 {
@@ -175,7 +176,7 @@ series_t get_series_with_two_soil_additives(void)
 	additive_t add_1 = { .code = { 2345 }, .concentration = { 1.234 } };
 	additive_t add_2 = { .code = { 6789 }, .concentration = { 6.789 } };
 	*add_code = add_1;
-	*add_code = add_2;
+	*(add_code + 1) = add_2;
 	return (series_t) { 
 		.light_exposure = get_real_inline_matrix(10, 20),
 		.soil_temp_c = get_real_inline_matrix(10, 2),
@@ -342,3 +343,46 @@ adf_t get_object_with_precision_set(void)
 		.series = get_default_series()
 	};
 }
+
+/*
+ * Points the first soil additive of the first series of the byte array past
+ * the additive codes. The crc of the series is computed again, so the index
+ * is the only thing that makes the bytes corrupted.
+ */
+void put_additive_out_of_range(uint8_t *bytes, size_t size)
+{
+	adf_view_t view;
+	series_view_t series;
+	uint8_t *code_idx;
+	size_t end;
+	uint16_t crc;
+
+	adf_view_init(&view, bytes, size);
+	adf_view_get_series(&view, &series, 0);
+
+	code_idx = bytes + (series.soil_additives - view.bytes);
+	code_idx[0] = view.metadata.n_additives.val >> 8;
+	code_idx[1] = view.metadata.n_additives.val & 0xFF;
+
+	end = view.series_offsets[1];
+	crc = crc16(bytes + view.series_offsets[0],
+				end - view.series_offsets[0] - 2);
+	bytes[end - 2] = crc >> 8;
+	bytes[end - 1] = crc & 0xFF;
+
+	adf_view_free(&view);
+}
+
+/* The default object, marshalled with `put_additive_out_of_range` */
+uint8_t *get_bytes_with_additive_out_of_range(size_t *size)
+{
+	adf_t adf = get_default_object();
+	uint8_t *bytes;
+
+	*size = size_adf_t(&adf);
+	bytes = malloc(*size);
+	marshal(bytes, &adf);
+	put_additive_out_of_range(bytes, *size);
+	adf_free(&adf);
+	return bytes;
+}
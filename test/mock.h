@@ -38,5 +38,7 @@ adf_t get_object_with_precision_set(void);
 series_t get_series_with_two_soil_additives(void);
 series_t get_random_series(uint32_t n_chunks, uint16_t n_wavelength,
 						   uint16_t n_depth);
+void put_additive_out_of_range(uint8_t *, size_t);
+uint8_t *get_bytes_with_additive_out_of_range(size_t *);
 
 #endif /* __MOCK_H__ */
@@ -271,6 +271,7 @@ void assert_header_equal_verbose(adf_header_t target, adf_header_t expected)
 										expected.reduction_info);
 	assert_int_equal(target.n_chunks, expected.n_chunks,
 					 "are n_chunks equal");
+	assert_true(target.flags == expected.flags, "are flags equal");
 }
 
 void assert_header_equal(adf_header_t target, adf_header_t expected,
@@ -282,7 +283,8 @@ void assert_header_equal(adf_header_t target, adf_header_t expected,
 			 && are_wave_info_equal(target.wave_info, expected.wave_info)
 			 && are_soil_depth_info_equal(target.soil_info, expected.soil_info)
 			 && are_reduction_info_equal(target.reduction_info, expected.reduction_info)
-			 && are_ints_equal(target.n_chunks, expected.n_chunks);
+			 && are_ints_equal(target.n_chunks, expected.n_chunks)
+			 && target.flags == expected.flags;
 	assert_true(c, label);
 }
 
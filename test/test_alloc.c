@@ -0,0 +1,202 @@
+/* test_alloc.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/adf.h"
+#include "../src/alloc.h"
+#include "mock.h"
+#include "test.h"
+
+typedef struct {
+	long live;
+	long n_alloc;
+	long n_reset;
+} counter_t;
+
+static void *counting_alloc(void *ctx, size_t size)
+{
+	counter_t *counter = ctx;
+	counter->live++;
+	counter->n_alloc++;
+	return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size)
+{
+	counter_t *counter = ctx;
+	if (!ptr) {
+		counter->live++;
+		counter->n_alloc++;
+	}
+	return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+	counter_t *counter = ctx;
+	if (ptr) { counter->live--; }
+	free(ptr);
+}
+
+static void counting_reset(void *ctx)
+{
+	counter_t *counter = ctx;
+	counter->n_reset++;
+}
+
+static adf_allocator_t get_counting_allocator(counter_t *counter)
+{
+	return (adf_allocator_t) {
+		.alloc = &counting_alloc,
+		.realloc = &counting_realloc,
+		.free = &counting_free,
+		.reset = &counting_reset,
+		.ctx = counter
+	};
+}
+
+void object_allocator_is_used_for_its_lifetime(void)
+{
+	counter_t counter = { 0 };
+	adf_allocator_t allocator = get_counting_allocator(&counter);
+	adf_t expected = get_default_object(), adf;
+
+	adf_init(&adf, get_default_header(), 3600);
+	adf_set_allocator(&adf, &allocator);
+	for (uint32_t i = 0; i < expected.metadata.size_series.val; i++)
+		add_series(&adf, expected.series + i);
+
+	assert_true(counter.n_alloc > 0, "series are allocated by the allocator");
+	assert_series_equal(adf, adf.series[0], expected.series[0],
+						"series added through the allocator is correct");
+
+	remove_series(&adf);
+	adf_free(&adf);
+	assert_true(counter.live == 0, "adf_free gives back all the memory");
+	assert_true(counter.n_reset == 1, "adf_free resets the allocator");
+}
+
+void arena_unmarshal_equal_to_default_object(void)
+{
+	adf_arena_t *arena = adf_arena_new(0, false);
+	const adf_allocator_t *allocator = adf_arena_allocator(arena);
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+	real_t *first_array;
+
+	marshal(bytes, &expected);
+	assert_true(unmarshal_with_allocator(&new, bytes, allocator) == ADF_OK,
+				"unmarshal_with_allocator succeeds");
+	assert_metadata_equal(new.metadata, expected.metadata,
+						  "arena metadata is correct");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++)
+		assert_series_equal(new, new.series[i], expected.series[i],
+							"arena series is correct");
+	first_array = new.series[0].light_exposure;
+	adf_free(&new);
+
+	/* the arena has been reset: the same memory is handed out again */
+	assert_true(unmarshal_with_allocator(&new, bytes, allocator) == ADF_OK,
+				"unmarshal_with_allocator succeeds after a reset");
+	assert_true(new.series[0].light_exposure == first_array,
+				"arena memory is reused after adf_free");
+	assert_series_equal(new, new.series[0], expected.series[0],
+						"series unmarshalled in a reused arena is correct");
+	adf_free(&new);
+
+	adf_arena_delete(arena);
+	adf_bytes_free(bytes);
+}
+
+void arena_with_small_blocks_grows(void)
+{
+	/* blocks smaller than a single series force the arena to grow */
+	adf_arena_t *arena = adf_arena_new(64, false);
+	const adf_allocator_t *allocator = adf_arena_allocator(arena);
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+
+	marshal(bytes, &expected);
+	assert_true(unmarshal_with_allocator(&new, bytes, allocator) == ADF_OK,
+				"unmarshal_with_allocator succeeds with small blocks");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++)
+		assert_series_equal(new, new.series[i], expected.series[i],
+							"series in a growing arena is correct");
+	adf_free(&new);
+
+	adf_arena_delete(arena);
+	adf_bytes_free(bytes);
+}
+
+void default_allocator_is_replaceable(void)
+{
+	counter_t counter = { 0 };
+	adf_allocator_t allocator = get_counting_allocator(&counter);
+	adf_t expected = get_default_object();
+	uint8_t *bytes;
+
+	adf_set_default_allocator(&allocator);
+	bytes = adf_bytes_alloc(&expected);
+	assert_true(counter.live == 1, "default allocator is used");
+	adf_bytes_free(bytes);
+	assert_true(counter.live == 0, "default allocator frees the memory");
+	adf_set_default_allocator(NULL);
+}
+
+void taken_series_are_copied_into_the_allocator(void)
+{
+	counter_t counter = { 0 };
+	adf_allocator_t allocator = get_counting_allocator(&counter);
+	adf_t expected = get_default_object(), adf;
+	series_t series;
+
+	adf_init(&adf, get_default_header(), 3600);
+	adf_set_allocator(&adf, &allocator);
+	cpy_adf_series(&series, expected.series, &expected);
+
+	assert_true(add_series_take(&adf, &series) == ADF_OK,
+				"add_series_take succeeds with an allocator");
+	assert_true(!series.light_exposure, "the taken series is zeroed");
+	assert_true(counter.n_alloc > 0,
+				"the series is copied through the allocator");
+	assert_series_equal(adf, adf.series[0], expected.series[0],
+						"the copied series is correct");
+
+	adf_free(&adf);
+	assert_true(counter.live == 0, "adf_free gives back all the memory");
+	adf_free(&expected);
+}
+
+void overflowing_calloc_returns_null(void)
+{
+	assert_true(!adf_calloc(NULL, SIZE_MAX / 2 + 1, 2),
+				"adf_calloc returns NULL when the size overflows");
+}
+
+int main(void)
+{
+	object_allocator_is_used_for_its_lifetime();
+	arena_unmarshal_equal_to_default_object();
+	arena_with_small_blocks_grows();
+	default_allocator_is_replaceable();
+	taken_series_are_copied_into_the_allocator();
+	overflowing_calloc_returns_null();
+}
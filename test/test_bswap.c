@@ -0,0 +1,136 @@
+/* test_bswap.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/bswap.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_ELEMENTS 67
+
+static uint8_t *get_random_bytes(size_t size)
+{
+	uint8_t *bytes = malloc(size);
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = rand() % 0xFF;
+	return bytes;
+}
+
+static bool is_reversed(const uint8_t *x, const uint8_t *y, size_t n)
+{
+	for (size_t i = 0; i < n * 4; i += 4) {
+		if (x[i] != y[i + 3] || x[i + 1] != y[i + 2]
+			|| x[i + 2] != y[i + 1] || x[i + 3] != y[i])
+			return false;
+	}
+	return true;
+}
+
+static bool kernel_matches_scalar(array_bytes_copy kernel)
+{
+	uint8_t *source, *expected, *result;
+
+	/* every length up to MAX_ELEMENTS, so that all the tails are covered */
+	for (size_t n = 0; n <= MAX_ELEMENTS; n++) {
+		source = get_random_bytes(MAX_ELEMENTS * 4);
+		expected = malloc(MAX_ELEMENTS * 4);
+		result = malloc(MAX_ELEMENTS * 4);
+		swap_4_bytes_array_scalar(expected, source, n);
+		kernel(result, source, n);
+		bool equal = are_uint8_arrays_equal(expected, result, n * 4);
+		free(source);
+		free(expected);
+		free(result);
+		if (!equal) return false;
+	}
+	return true;
+}
+
+void scalar_kernel_reverses_each_element(void)
+{
+	uint8_t *source = get_random_bytes(MAX_ELEMENTS * 4),
+			*result = malloc(MAX_ELEMENTS * 4);
+
+	swap_4_bytes_array_scalar(result, source, MAX_ELEMENTS);
+	assert_true(is_reversed(source, result, MAX_ELEMENTS),
+				"scalar kernel reverses the bytes of each element");
+
+	free(source);
+	free(result);
+}
+
+void simd_kernels_match_scalar_kernel(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	(void)cpu;
+
+#ifdef __ADF_X86__
+	if (cpu->ssse3)
+		assert_true(kernel_matches_scalar(&swap_4_bytes_array_ssse3),
+					"SSSE3 kernel matches the scalar one");
+	if (cpu->avx2)
+		assert_true(kernel_matches_scalar(&swap_4_bytes_array_avx2),
+					"AVX2 kernel matches the scalar one");
+#endif
+#ifdef __ADF_NEON__
+	assert_true(kernel_matches_scalar(&swap_4_bytes_array_neon),
+				"NEON kernel matches the scalar one");
+#endif
+}
+
+void selected_kernel_round_trip(void)
+{
+	array_bytes_copy kernel = get_4_bytes_array_fn();
+	uint8_t *source = get_random_bytes(MAX_ELEMENTS * 4),
+			*copy = malloc(MAX_ELEMENTS * 4);
+
+	for (size_t i = 0; i < MAX_ELEMENTS * 4; i++) copy[i] = source[i];
+
+	/* converting twice in place gives back the original bytes */
+	kernel(copy, copy, MAX_ELEMENTS);
+	kernel(copy, copy, MAX_ELEMENTS);
+	assert_uint8_arrays_equal(source, copy, MAX_ELEMENTS * 4,
+							  "in-place conversion is symmetric");
+
+	free(source);
+	free(copy);
+}
+
+void selected_kernel_writes_big_endian(void)
+{
+	uint_t value = { 0x40414446u };
+	uint8_t expected[4] = { 0x40, 0x41, 0x44, 0x46 }, result[4];
+
+	get_4_bytes_array_fn()(result, value.bytes, 1);
+	assert_uint8_arrays_equal(expected, result, 4,
+							  "selected kernel produces big-endian bytes");
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	scalar_kernel_reverses_each_element();
+	simd_kernels_match_scalar_kernel();
+	selected_kernel_round_trip();
+	selected_kernel_writes_big_endian();
+}
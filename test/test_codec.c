@@ -0,0 +1,398 @@
+/* test_codec.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/codec.h"
+#include "test.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define N_ROWS 97
+#define N_COLUMNS 5
+
+static float get_random_real(void)
+{
+	return (float)rand() / RAND_MAX * 200.0f - 100.0f;
+}
+
+/*
+ * A matrix whose columns change slowly, by the resolution of a sensor, and
+ * often not at all between two chunks.
+ */
+static void fill_smooth(float *values, size_t n_rows, size_t n_columns)
+{
+	for (size_t j = 0; j < n_columns; j++) {
+		float value = (rand() % 400 - 200) / 4.0f;
+		for (size_t i = 0; i < n_rows; i++) {
+			if (rand() % 4 == 0) { value += 0.25f * (rand() % 3 - 1); }
+			values[i * n_columns + j] = value;
+		}
+	}
+}
+
+static size_t encode_matrix(uint8_t *dest, const float *values,
+							size_t n_rows, size_t n_columns)
+{
+	xor_encoder_t encoder;
+
+	xor_encoder_init(&encoder, dest);
+	for (size_t j = 0; j < n_columns; j++)
+		xor_encode_column(&encoder, (const uint8_t *)(values + j), n_rows,
+						  n_columns);
+	return xor_encoder_finish(&encoder);
+}
+
+static bool decode_matrix(float *values, const uint8_t *bytes, size_t size,
+						  size_t n_rows, size_t n_columns)
+{
+	xor_decoder_t decoder;
+
+	xor_decoder_init(&decoder, bytes, size);
+	for (size_t j = 0; j < n_columns; j++)
+		xor_decode_column(&decoder, (uint8_t *)(values + j), n_rows,
+						  n_columns);
+	return xor_decoder_finish(&decoder);
+}
+
+static bool round_trip(const float *values, size_t n_rows, size_t n_columns,
+					   size_t *size)
+{
+	size_t n = n_rows * n_columns;
+	uint8_t *bytes = malloc(xor_encoded_bound(n) + 1);
+	float *decoded = malloc(n * sizeof(float) + 1);
+	bool equal;
+
+	*size = encode_matrix(bytes, values, n_rows, n_columns);
+	equal = *size <= xor_encoded_bound(n)
+			&& *size == encode_matrix(NULL, values, n_rows, n_columns)
+			&& decode_matrix(decoded, bytes, *size, n_rows, n_columns)
+			/* bit by bit, so that NaNs and signed zeros count too */
+			&& memcmp(values, decoded, n * sizeof(float)) == 0;
+	free(bytes);
+	free(decoded);
+	return equal;
+}
+
+void random_values_round_trip(void)
+{
+	float values[N_ROWS * N_COLUMNS];
+	size_t size;
+	bool equal = true;
+
+	for (size_t n_rows = 0; n_rows <= N_ROWS; n_rows++) {
+		for (size_t i = 0; i < n_rows * N_COLUMNS; i++)
+			values[i] = get_random_real();
+		equal = equal && round_trip(values, n_rows, N_COLUMNS, &size);
+	}
+	assert_true(equal, "random values are decoded bit by bit");
+}
+
+void special_values_round_trip(void)
+{
+	uint32_t nan_payload = 0x7FC12345u;
+	float values[] = { 0.0f, -0.0f, INFINITY, -INFINITY, NAN, 1e-45f,
+					   -1e-45f, 3.4e38f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f };
+	size_t size;
+
+	memcpy(values + 8, &nan_payload, 4);
+	assert_true(round_trip(values, sizeof(values) / sizeof(float), 1, &size),
+				"special values are decoded bit by bit");
+}
+
+void smooth_values_are_compressed(void)
+{
+	float values[N_ROWS * N_COLUMNS];
+	size_t size;
+
+	fill_smooth(values, N_ROWS, N_COLUMNS);
+	assert_true(round_trip(values, N_ROWS, N_COLUMNS, &size),
+				"smooth values are decoded bit by bit");
+	assert_true(size * 2 < sizeof(values),
+				"smooth values take less than half of the space");
+
+	for (size_t i = 0; i < N_ROWS * N_COLUMNS; i++) values[i] = 21.5f;
+	assert_true(round_trip(values, N_ROWS, N_COLUMNS, &size)
+				&& size <= (N_ROWS * N_COLUMNS + 7) / 8 + 8 * N_COLUMNS,
+				"constant values take about a bit each");
+}
+
+void malformed_bytes_are_detected(void)
+{
+	float values[N_ROWS * N_COLUMNS], decoded[N_ROWS * N_COLUMNS];
+	uint8_t bytes[N_ROWS * N_COLUMNS * 8];
+	size_t size;
+
+	fill_smooth(values, N_ROWS, N_COLUMNS);
+	size = encode_matrix(bytes, values, N_ROWS, N_COLUMNS);
+
+	assert_true(!decode_matrix(decoded, bytes, size - 1, N_ROWS, N_COLUMNS),
+				"truncated bytes are detected");
+	bytes[size] = 0xFF;
+	assert_true(!decode_matrix(decoded, bytes, size + 1, N_ROWS, N_COLUMNS),
+				"trailing bytes are detected");
+	/* a window reused before any has been opened */
+	bytes[0] = 0x80;
+	assert_true(!decode_matrix(decoded, bytes, size, N_ROWS, N_COLUMNS),
+				"invalid bits are detected");
+}
+
+static size_t quantize_matrix(uint8_t *dest, const float *values,
+							  size_t n_rows, size_t n_columns, float step)
+{
+	quantized_encoder_t encoder;
+
+	quantized_encoder_init(&encoder, dest);
+	for (size_t j = 0; j < n_columns; j++)
+		quantized_encode_column(&encoder, (const uint8_t *)(values + j),
+								n_rows, n_columns, step);
+	return quantized_encoder_finish(&encoder);
+}
+
+static bool dequantize_matrix(float *values, const uint8_t *bytes,
+							  size_t size, size_t n_rows, size_t n_columns,
+							  float step)
+{
+	quantized_decoder_t decoder;
+
+	quantized_decoder_init(&decoder, bytes, size);
+	for (size_t j = 0; j < n_columns; j++)
+		quantized_decode_column(&decoder, (uint8_t *)(values + j), n_rows,
+								n_columns, step);
+	return quantized_decoder_finish(&decoder);
+}
+
+/* Each decoded value is within the step, or bit by bit equal */
+static bool are_within_step(const float *x, const float *y, size_t n,
+							float step)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (memcmp(x + i, y + i, sizeof(float)) != 0
+			&& !(fabsf(x[i] - y[i]) < step))
+			return false;
+	}
+	return true;
+}
+
+static bool quantized_round_trip(const float *values, size_t n_rows,
+								 size_t n_columns, float step, size_t *size)
+{
+	size_t n = n_rows * n_columns;
+	uint8_t *bytes = malloc(quantized_encoded_bound(n) + 1);
+	float *decoded = malloc(n * sizeof(float) + 1);
+	bool within;
+
+	*size = quantize_matrix(bytes, values, n_rows, n_columns, step);
+	within = *size <= quantized_encoded_bound(n)
+			 && *size == quantize_matrix(NULL, values, n_rows, n_columns,
+										 step)
+			 && dequantize_matrix(decoded, bytes, *size, n_rows, n_columns,
+								  step)
+			 && are_within_step(values, decoded, n, step);
+	free(bytes);
+	free(decoded);
+	return within;
+}
+
+void quantized_values_within_step(void)
+{
+	const float steps[] = { 1e-7f, 1e-4f, 0.01f, 0.5f, 10.0f };
+	float values[N_ROWS * N_COLUMNS];
+	size_t size;
+	bool within = true;
+
+	for (size_t s = 0; s < sizeof(steps) / sizeof(float); s++) {
+		for (size_t n_rows = 0; n_rows <= N_ROWS; n_rows++) {
+			for (size_t i = 0; i < n_rows * N_COLUMNS; i++)
+				values[i] = get_random_real();
+			within = within && quantized_round_trip(values, n_rows, N_COLUMNS,
+													steps[s], &size);
+		}
+	}
+	assert_true(within, "quantized values are decoded within the step");
+}
+
+void quantized_special_values_are_escaped(void)
+{
+	uint32_t nan_payload = 0x7FC12345u;
+	float values[] = { 0.0f, -0.0f, INFINITY, -INFINITY, NAN, 1e-45f,
+					   -1e-45f, 3.4e38f, 0.0f, -3.4e38f, 1.0f, 1.0f, 0.0f };
+	float decoded[sizeof(values) / sizeof(float)];
+	uint8_t bytes[sizeof(values) * 2];
+	size_t n = sizeof(values) / sizeof(float), size;
+
+	memcpy(values + 8, &nan_payload, 4);
+	assert_true(quantized_round_trip(values, n, 1, 0.01f, &size),
+				"special values are decoded within the step");
+	size = quantize_matrix(bytes, values, n, 1, 0.01f);
+	dequantize_matrix(decoded, bytes, size, n, 1, 0.01f);
+	assert_true(memcmp(values + 2, decoded + 2, 3 * sizeof(float)) == 0
+				&& memcmp(values + 7, decoded + 7, 3 * sizeof(float)) == 0,
+				"values that can't be quantized are decoded bit by bit");
+}
+
+void quantized_smooth_values_are_compressed(void)
+{
+	float values[N_ROWS * N_COLUMNS];
+	size_t size;
+
+	/* a step as big as the resolution of the values */
+	fill_smooth(values, N_ROWS, N_COLUMNS);
+	assert_true(quantized_round_trip(values, N_ROWS, N_COLUMNS, 0.25f, &size),
+				"smooth values are decoded within the step");
+	assert_true(size <= N_ROWS * N_COLUMNS + 2 * N_COLUMNS,
+				"smooth values take about a byte each");
+
+	for (size_t i = 0; i < N_ROWS * N_COLUMNS; i++) values[i] = 21.5f;
+	assert_true(quantized_round_trip(values, N_ROWS, N_COLUMNS, 0.01f, &size)
+				&& size <= N_ROWS * N_COLUMNS + 2 * N_COLUMNS,
+				"constant values take a byte each");
+}
+
+void quantized_malformed_bytes_are_detected(void)
+{
+	float values[N_ROWS * N_COLUMNS], decoded[N_ROWS * N_COLUMNS];
+	uint8_t bytes[N_ROWS * N_COLUMNS * 8];
+	size_t size;
+
+	fill_smooth(values, N_ROWS, N_COLUMNS);
+	size = quantize_matrix(bytes, values, N_ROWS, N_COLUMNS, 0.25f);
+
+	assert_true(!dequantize_matrix(decoded, bytes, size - 1, N_ROWS,
+								   N_COLUMNS, 0.25f),
+				"truncated quantized bytes are detected");
+	bytes[size] = 0x01;
+	assert_true(!dequantize_matrix(decoded, bytes, size + 1, N_ROWS,
+								   N_COLUMNS, 0.25f),
+				"trailing quantized bytes are detected");
+	/* a varint longer than 64 bits */
+	memset(bytes, 0xFF, 10);
+	assert_true(!dequantize_matrix(decoded, bytes, size, N_ROWS, N_COLUMNS,
+								   0.25f),
+				"overlong varints are detected");
+}
+
+#define LZ_SIZE 4096
+
+/* Reused by every compression, as the codec allows */
+static uint32_t lz_table[LZ_HASH_SIZE];
+
+static bool lz_round_trip(const uint8_t *bytes, size_t n, size_t *size)
+{
+	uint8_t *compressed = malloc(lz_compress_bound(n));
+	uint8_t *decompressed = malloc(n + 1);
+	bool equal;
+
+	*size = lz_compress(compressed, bytes, n, lz_table);
+	equal = *size <= lz_compress_bound(n)
+			&& lz_decompress(decompressed, n, compressed, *size)
+			&& memcmp(bytes, decompressed, n) == 0;
+	free(compressed);
+	free(decompressed);
+	return equal;
+}
+
+void lz_random_bytes_round_trip(void)
+{
+	uint8_t bytes[LZ_SIZE];
+	size_t size;
+	bool equal = true;
+
+	for (size_t i = 0; i < LZ_SIZE; i++) bytes[i] = rand();
+	for (size_t n = 0; n <= 300; n++)
+		equal = equal && lz_round_trip(bytes, n, &size);
+	assert_true(equal && lz_round_trip(bytes, LZ_SIZE, &size),
+				"random bytes are decompressed as they were");
+}
+
+void lz_repeated_bytes_are_compressed(void)
+{
+	uint8_t bytes[LZ_SIZE];
+	float values[LZ_SIZE / 4];
+	size_t size;
+
+	/* runs longer than what a token holds */
+	memset(bytes, 0, LZ_SIZE);
+	assert_true(lz_round_trip(bytes, LZ_SIZE, &size) && size < 32,
+				"zeros are compressed to a few bytes");
+
+	/* the rows of a matrix, some of them equal to the ones before */
+	for (size_t i = 0; i < LZ_SIZE / 4; i++)
+		values[i] = (i / 64) % 3 == 0 ? get_random_real() : values[i - 64];
+	assert_true(lz_round_trip((const uint8_t *)values, LZ_SIZE, &size)
+				&& size * 2 < LZ_SIZE,
+				"repeated rows take less than half of the space");
+
+	/* literals longer than what a token holds, between two matches */
+	for (size_t i = 0; i < LZ_SIZE; i++)
+		bytes[i] = i < 1024 || i >= 3072 ? 7 : rand();
+	assert_true(lz_round_trip(bytes, LZ_SIZE, &size)
+				&& size < LZ_SIZE / 2 + 64,
+				"long literals between matches are kept");
+}
+
+void lz_malformed_bytes_are_detected(void)
+{
+	uint8_t bytes[LZ_SIZE], compressed[LZ_SIZE * 2], decompressed[LZ_SIZE];
+	size_t size;
+
+	for (size_t i = 0; i < LZ_SIZE; i++) bytes[i] = (i / 256) % 2 ? rand() : 0;
+	size = lz_compress(compressed, bytes, LZ_SIZE, lz_table);
+
+	assert_true(!lz_decompress(decompressed, LZ_SIZE, compressed, size - 1),
+				"truncated compressed bytes are detected");
+	compressed[size] = 0;
+	assert_true(!lz_decompress(decompressed, LZ_SIZE, compressed, size + 1),
+				"trailing compressed bytes are detected");
+	assert_true(!lz_decompress(decompressed, LZ_SIZE - 1, compressed, size),
+				"a wrong decompressed size is detected");
+
+	/* four literals, then a match that starts before the block */
+	memcpy(compressed, (uint8_t[]){ 0x40, 1, 2, 3, 4, 0x00, 0x05, 0x00 }, 8);
+	assert_true(!lz_decompress(decompressed, 8, compressed, 8),
+				"offsets out of the block are detected");
+	compressed[6] = 0;
+	assert_true(!lz_decompress(decompressed, 8, compressed, 8),
+				"null offsets are detected");
+	compressed[6] = 4;
+	assert_true(lz_decompress(decompressed, 8, compressed, 8)
+				&& memcmp(decompressed, (uint8_t[]){ 1, 2, 3, 4, 1, 2, 3, 4 },
+						  8) == 0,
+				"a hand-written block is decompressed");
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	random_values_round_trip();
+	special_values_round_trip();
+	smooth_values_are_compressed();
+	malformed_bytes_are_detected();
+	quantized_values_within_step();
+	quantized_special_values_are_escaped();
+	quantized_smooth_values_are_compressed();
+	quantized_malformed_bytes_are_detected();
+	lz_random_bytes_round_trip();
+	lz_repeated_bytes_are_compressed();
+	lz_malformed_bytes_are_detected();
+}
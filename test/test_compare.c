@@ -0,0 +1,147 @@
+/* test_compare.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/compare.h"
+#include "test.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_ELEMENTS 75
+#define TOLERANCE 1e-3f
+
+/* the same comparison done by compare_reals in adf.c */
+static bool reference_within(const float *x, const float *y, size_t n,
+							 float tolerance)
+{
+	for (size_t i = 0; i < n; i++) {
+		bool within = x[i] < y[i]
+			? (y[i] - x[i]) < tolerance
+			: (x[i] - y[i]) < tolerance;
+		if (!within) return false;
+	}
+	return true;
+}
+
+static float get_random_real(void)
+{
+	return (float)rand() / RAND_MAX * 200.0f - 100.0f;
+}
+
+/* y is x plus a small noise, sometimes bigger than the tolerance */
+static void fill_arrays(float *x, float *y, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		x[i] = get_random_real();
+		y[i] = x[i] + ((float)rand() / RAND_MAX - 0.5f) * 2.1f * TOLERANCE
+			/ (rand() % 64 ? 1024 : 1);
+	}
+}
+
+static bool kernel_matches_reference(reals_within_fn kernel)
+{
+	const float special[] = { NAN, INFINITY, -INFINITY, 0.0f, -0.0f,
+							  TOLERANCE, -TOLERANCE, 1.0f };
+	const size_t n_special = sizeof(special) / sizeof(special[0]);
+	float x[MAX_ELEMENTS], y[MAX_ELEMENTS];
+
+	/* every length up to MAX_ELEMENTS, so that all the tails are covered */
+	for (size_t n = 0; n <= MAX_ELEMENTS; n++) {
+		for (int round = 0; round < 16; round++) {
+			fill_arrays(x, y, n);
+			if (kernel(x, y, n, TOLERANCE) != reference_within(x, y, n,
+															   TOLERANCE))
+				return false;
+		}
+		if (n == 0) continue;
+
+		/* a single different element, in every position */
+		for (size_t i = 0; i < n; i++) {
+			for (size_t j = 0; j < n; j++) x[j] = y[j] = (float)j;
+			y[i] += TOLERANCE;
+			if (kernel(x, y, n, TOLERANCE) != reference_within(x, y, n,
+															   TOLERANCE))
+				return false;
+		}
+
+		/* the special values, against each other, in the last position */
+		for (size_t a = 0; a < n_special; a++) {
+			for (size_t b = 0; b < n_special; b++) {
+				for (size_t j = 0; j < n; j++) x[j] = y[j] = 0.0f;
+				x[n - 1] = special[a];
+				y[n - 1] = special[b];
+				if (kernel(x, y, n, TOLERANCE)
+					!= reference_within(x, y, n, TOLERANCE))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+void scalar_kernel_matches_reference(void)
+{
+	assert_true(kernel_matches_reference(&reals_within_scalar),
+				"scalar kernel matches the branchy comparison");
+}
+
+void simd_kernels_match_reference(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	(void)cpu;
+
+#ifdef __ADF_X86__
+	if (cpu->sse2)
+		assert_true(kernel_matches_reference(&reals_within_sse2),
+					"SSE2 kernel matches the branchy comparison");
+	if (cpu->avx2)
+		assert_true(kernel_matches_reference(&reals_within_avx2),
+					"AVX2 kernel matches the branchy comparison");
+#endif
+#ifdef __ADF_NEON__
+	assert_true(kernel_matches_reference(&reals_within_neon),
+				"NEON kernel matches the branchy comparison");
+#endif
+}
+
+void selected_kernel_stops_at_the_difference(void)
+{
+	reals_within_fn kernel = get_reals_within_fn();
+	float x[MAX_ELEMENTS] = { 0 }, y[MAX_ELEMENTS] = { 0 };
+
+	assert_true(kernel(x, y, MAX_ELEMENTS, TOLERANCE),
+				"equal arrays are within the tolerance");
+	y[MAX_ELEMENTS - 1] = NAN;
+	assert_true(!kernel(x, y, MAX_ELEMENTS, TOLERANCE),
+				"a NaN is never within the tolerance");
+	assert_true(kernel(x, y, MAX_ELEMENTS - 1, TOLERANCE),
+				"elements after `n` are not compared");
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	scalar_kernel_matches_reference();
+	simd_kernels_match_reference();
+	selected_kernel_stops_at_the_difference();
+}
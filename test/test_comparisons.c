@@ -23,6 +23,7 @@
 #include "../src/adf.h"
 #include "test.h"
 #include "mock.h"
+#include <math.h>
 
 void compare_series_with_zero_tolerance(void)
 {
@@ -77,8 +78,60 @@ void compare_series_with_tolerance(void)
 				"\u0394 \u2265 tol: the two series should *not* be equal");
 }
 
+void compare_arrays_with_default_tolerance(void)
+{
+	adf_t adf = get_default_object();
+	series_t *series = get_default_series();
+	uint32_t n_light = adf.header.n_chunks.val
+		* adf.header.wave_info.n_wavelength.val;
+
+	/* a precision of 0 falls back to EPSILON, in the last element too */
+	series->light_exposure[n_light - 1].val += EPSILON / 2;
+	assert_true(are_series_equal(adf.series, series, &adf),
+				"\u0394 < EPSILON: the two series should be equal");
+
+	series->light_exposure[n_light - 1].val += EPSILON;
+	assert_true(!are_series_equal(adf.series, series, &adf),
+				"\u0394 > EPSILON: the two series should *not* be equal");
+
+	series->light_exposure[n_light - 1].val -= 3 * EPSILON / 2;
+	series->soil_temp_c[0].val = NAN;
+	assert_true(!are_series_equal(adf.series, series, &adf),
+				"NaN: the two series should *not* be equal");
+}
+
+void fingerprint_respects_the_precision(void)
+{
+	adf_t adf = get_object_with_precision_set();
+	series_t *series = get_default_series();
+	uint64_t fingerprint = series_fingerprint(adf.series, &adf);
+
+	assert_true(fingerprint == series_fingerprint(series, &adf),
+				"series with the same content have the same fingerprint");
+	assert_true(fingerprint != series_fingerprint(adf.series + 1, &adf),
+				"different series have different fingerprints");
+
+	/* the light exposure has a precision of 1 */
+	series->light_exposure[0].val += 0.1;
+	assert_true(fingerprint == series_fingerprint(series, &adf),
+				"values rounded to the same multiple of the precision "
+				"give the same fingerprint");
+
+	series->light_exposure[0].val += 2;
+	assert_true(fingerprint != series_fingerprint(series, &adf),
+				"values rounded to different multiples of the precision "
+				"give different fingerprints");
+
+	series->light_exposure[0].val -= 2.1;
+	series->repeated.val = 42;
+	assert_true(fingerprint == series_fingerprint(series, &adf),
+				"the repetitions are not part of the fingerprint");
+}
+
 int main(void)
 {
 	compare_series_with_zero_tolerance();
 	compare_series_with_tolerance();
+	compare_arrays_with_default_tolerance();
+	fingerprint_respects_the_precision();
 }
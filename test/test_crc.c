@@ -0,0 +1,134 @@
+/* test_crc.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/crc.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_SIZE 600
+#define MAX_OFFSET 16
+
+static uint8_t *get_random_bytes(size_t size)
+{
+	uint8_t *bytes = malloc(size);
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = rand() % 0xFF;
+	return bytes;
+}
+
+/* every length up to MAX_SIZE, from every misalignment up to MAX_OFFSET */
+static bool crc16_kernel_matches_table(crc16_fn kernel)
+{
+	uint8_t *bytes = get_random_bytes(MAX_SIZE + MAX_OFFSET);
+	bool equal = true;
+
+	for (size_t off = 0; off < MAX_OFFSET && equal; off++) {
+		for (size_t n = 0; n <= MAX_SIZE && equal; n++) {
+			equal = kernel(CRC16_INIT, bytes + off, n)
+					== crc16_update_table(CRC16_INIT, bytes + off, n);
+		}
+	}
+	free(bytes);
+	return equal;
+}
+
+static bool crc32_kernel_matches_table(crc32_fn kernel)
+{
+	uint8_t *bytes = get_random_bytes(MAX_SIZE + MAX_OFFSET);
+	bool equal = true;
+
+	for (size_t off = 0; off < MAX_OFFSET && equal; off++) {
+		for (size_t n = 0; n <= MAX_SIZE && equal; n++) {
+			equal = kernel(CRC32_INIT, bytes + off, n)
+					== crc32_update_table(CRC32_INIT, bytes + off, n);
+		}
+	}
+	free(bytes);
+	return equal;
+}
+
+void crc_of_check_string(void)
+{
+	const uint8_t check[] = "123456789";
+
+	/* CRC-16/MODBUS and CRC-32 without the final inversion */
+	assert_true(crc16(check, 9) == 0x4b37, "crc16 of the check string");
+	assert_true(crc32(check, 9) == 0x340bc6d9, "crc32 of the check string");
+}
+
+void kernels_match_table(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	(void)cpu;
+
+	/* the tables the kernels rely on are built along with the selection */
+	get_crc16_fn();
+	assert_true(crc16_kernel_matches_table(&crc16_update_slice8),
+				"crc16 slicing-by-8 matches the table");
+	assert_true(crc32_kernel_matches_table(&crc32_update_slice8),
+				"crc32 slicing-by-8 matches the table");
+#ifdef __ADF_X86__
+	if (cpu->pclmul) {
+		assert_true(crc16_kernel_matches_table(&crc16_update_pclmul),
+					"crc16 PCLMULQDQ kernel matches the table");
+		assert_true(crc32_kernel_matches_table(&crc32_update_pclmul),
+					"crc32 PCLMULQDQ kernel matches the table");
+	}
+#endif
+#ifdef __ADF_PMULL__
+	if (cpu->pmull) {
+		assert_true(crc16_kernel_matches_table(&crc16_update_pmull),
+					"crc16 PMULL kernel matches the table");
+		assert_true(crc32_kernel_matches_table(&crc32_update_pmull),
+					"crc32 PMULL kernel matches the table");
+	}
+#endif
+}
+
+void update_in_pieces(void)
+{
+	uint8_t *bytes = get_random_bytes(MAX_SIZE);
+	uint16_t crc_16 = CRC16_INIT;
+	uint32_t crc_32 = CRC32_INIT;
+
+	/* pieces of growing size, to go through every kernel path */
+	for (size_t i = 0, n = 1; i < MAX_SIZE; i += n, n *= 2) {
+		n = MAX_SIZE - i < n ? MAX_SIZE - i : n;
+		crc_16 = crc16_update(crc_16, bytes + i, n);
+		crc_32 = crc32_update(crc_32, bytes + i, n);
+	}
+	assert_true(crc_16 == crc16(bytes, MAX_SIZE),
+				"crc16 can be computed in pieces");
+	assert_true(crc_32 == crc32(bytes, MAX_SIZE),
+				"crc32 can be computed in pieces");
+	free(bytes);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	crc_of_check_string();
+	kernels_match_table();
+	update_in_pieces();
+}
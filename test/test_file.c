@@ -0,0 +1,143 @@
+/* test_file.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/adf.h"
+#include "mock.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FILE_PATH "test_file.adf"
+#define MISSING_FILE_PATH "missing_file.adf"
+
+void saved_file_equal_to_marshalled_bytes(void)
+{
+	adf_t adf = get_default_object();
+	size_t size = size_adf_t(&adf);
+	uint8_t *expected = adf_bytes_alloc(&adf), *saved = malloc(size + 1);
+	FILE *file;
+	size_t n_read;
+
+	marshal(expected, &adf);
+	assert_true(adf_save_file(&adf, FILE_PATH) == ADF_OK,
+				"adf_save_file succeeds");
+
+	file = fopen(FILE_PATH, "rb");
+	n_read = fread(saved, 1, size + 1, file);
+	fclose(file);
+	assert_true(n_read == size, "saved file has the size of the object");
+	assert_uint8_arrays_equal(expected, saved, size,
+							  "saved file contains the marshalled bytes");
+
+	free(saved);
+	adf_bytes_free(expected);
+	adf_free(&adf);
+}
+
+void opened_file_equal_to_saved_object(void)
+{
+	adf_t expected = get_default_object(), opened;
+
+	adf_save_file(&expected, FILE_PATH);
+	assert_true(adf_open_file(&opened, FILE_PATH,
+							  ADF_FILE_SEQUENTIAL | ADF_FILE_WILLNEED)
+				== ADF_OK, "adf_open_file succeeds");
+	assert_header_equal(opened.header, expected.header,
+						"opened header is correct");
+	assert_metadata_equal(opened.metadata, expected.metadata,
+						  "opened metadata is correct");
+	for (uint32_t i = 0; i < expected.metadata.size_series.val; i++)
+		assert_series_equal(opened, opened.series[i], expected.series[i],
+							"opened series is correct");
+
+	adf_free(&opened);
+	adf_free(&expected);
+}
+
+void truncated_file_is_rejected(void)
+{
+	adf_t adf = get_default_object(), opened;
+	size_t size = size_adf_t(&adf);
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+	FILE *file;
+
+	marshal(bytes, &adf);
+	file = fopen(FILE_PATH, "wb");
+	fwrite(bytes, 1, size - 3, file);
+	fclose(file);
+
+	assert_true(adf_open_file(&opened, FILE_PATH, ADF_FILE_DEFAULT)
+				== ADF_SERIES_CORRUPTED, "truncated file is rejected");
+	assert_true(adf_open_file(&opened, MISSING_FILE_PATH, ADF_FILE_DEFAULT)
+				== ADF_RUNTIME_ERROR, "missing file is rejected");
+
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
+void failed_save_keeps_the_previous_file(void)
+{
+	adf_t adf = get_default_object(), opened;
+	real_t *light_exposure = adf.series[0].light_exposure;
+
+	adf_save_file(&adf, FILE_PATH);
+	adf.series[0].light_exposure = NULL;
+	assert_true(adf_save_file(&adf, FILE_PATH) == ADF_RUNTIME_ERROR,
+				"series without arrays can't be saved");
+	adf.series[0].light_exposure = light_exposure;
+
+	assert_true(adf_open_file(&opened, FILE_PATH, ADF_FILE_DEFAULT) == ADF_OK,
+				"previous file survives a failed save");
+	assert_metadata_equal(opened.metadata, adf.metadata,
+						  "previous file is unchanged");
+
+	adf_free(&opened);
+	adf_free(&adf);
+}
+
+void additive_out_of_range_is_rejected(void)
+{
+	adf_t opened;
+	size_t size;
+	uint8_t *bytes = get_bytes_with_additive_out_of_range(&size);
+	FILE *file;
+
+	file = fopen(FILE_PATH, "wb");
+	fwrite(bytes, 1, size, file);
+	fclose(file);
+
+	assert_true(adf_open_file(&opened, FILE_PATH, ADF_FILE_DEFAULT)
+				== ADF_SERIES_CORRUPTED,
+				"file with an additive index out of the codes is rejected");
+
+	free(bytes);
+}
+
+int main(void)
+{
+	saved_file_equal_to_marshalled_bytes();
+	opened_file_equal_to_saved_object();
+	truncated_file_is_rejected();
+	failed_save_keeps_the_previous_file();
+	additive_out_of_range_is_rejected();
+	remove(FILE_PATH);
+}
@@ -22,6 +22,7 @@
 
 #include "../src/lookup_table.h"
 #include "test.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -192,7 +193,7 @@ void test_free_lookup_table(void)
 	nums = malloc(size * sizeof(uint32_t));
 	for (uint8_t i = 0; i < size; i++) {
 		nums[i] = rand();
-		res = table_put(&t, 13, nums[i]);
+		res = table_put(&t, i, nums[i]);
 		if (res != LM_OK) {
 			printf("[%x] %s", res, "An error occurred\n");
 			exit(1);
@@ -207,6 +208,89 @@ void test_free_lookup_table(void)
 	assert_true(t.pairs == NULL, "table has pairs equal to NULL");
 }
 
+void put_replaces_the_value_of_an_existing_key(void)
+{
+	uint32_t value = 0;
+	table_t t;
+
+	table_init(&t, 16, 16, &fn);
+	table_put(&t, 13, 1234);
+	table_put(&t, 13, 0);
+
+	assert_true(t.size == 1, "a key is stored just once");
+	assert_true(table_find(&t, 13, &value) == LM_OK && value == 0,
+				"a value equal to 0 is found");
+	assert_true(table_find(&t, 14, &value) == LM_VALUE_NOT_FOUND,
+				"a missing key is not found");
+
+	table_free(&t);
+}
+
+void map_matches_reference_array(void)
+{
+	const uint32_t n_keys = 4096, n_ops = 200'000;
+	uint32_t *reference = calloc(n_keys, sizeof(uint32_t)), key, value;
+	size_t expected_size = 0;
+	bool correct = true;
+	table_t t;
+
+	table_init(&t, 16, 16, &fn);
+
+	/* keys far apart in the low bits, values never 0 in the reference */
+	for (uint32_t i = 0; i < n_ops; i++) {
+		key = rand() % n_keys;
+		if (rand() % 3 == 0) {
+			if (reference[key]) { expected_size--; }
+			correct = correct
+					  && (table_remove(&t, key << 16) == LM_OK)
+						 == (reference[key] != 0);
+			reference[key] = 0;
+		}
+		else {
+			if (!reference[key]) { expected_size++; }
+			reference[key] = i + 1;
+			correct = correct && table_put(&t, key << 16, i + 1) == LM_OK;
+		}
+	}
+	for (key = 0; key < n_keys; key++) {
+		if (reference[key])
+			correct = correct && table_find(&t, key << 16, &value) == LM_OK
+					  && value == reference[key];
+		else
+			correct = correct && table_find(&t, key << 16, &value)
+								 == LM_VALUE_NOT_FOUND;
+	}
+
+	assert_true(correct, "random puts and removes match a plain array");
+	assert_true(t.size == expected_size, "the size follows puts and removes");
+	assert_true(t.size + t.n_deleted <= t.max_size / 2,
+				"the map is never more than half full");
+
+	free(reference);
+	table_free(&t);
+}
+
+void pairs_stay_in_insertion_order_across_rehashes(void)
+{
+	const uint32_t n_keys = 1000;
+	pair_t *pairs = malloc(n_keys * sizeof(pair_t));
+	bool in_order = true;
+	table_t t;
+
+	table_init(&t, 16, 16, &fn);
+	for (uint32_t i = 0; i < n_keys; i++)
+		table_put(&t, n_keys - i, i);
+	table_get_pairs(&t, pairs);
+
+	for (uint32_t i = 0; i < n_keys; i++)
+		in_order = in_order && pairs[i].key == n_keys - i
+				   && pairs[i].value == i;
+	assert_true(in_order, "pairs are returned in insertion order");
+	assert_true(t.max_size == 2048, "the map grows geometrically");
+
+	free(pairs);
+	table_free(&t);
+}
 
 int main(void)
 {
@@ -217,4 +301,7 @@ int main(void)
 	map_should_resize_when_half_full();
 	table_keys_should_return_the_list_of_the_inserted_keys();
 	test_free_lookup_table();
+	put_replaces_the_value_of_an_existing_key();
+	map_matches_reference_array();
+	pairs_stay_in_insertion_order_across_rehashes();
 }
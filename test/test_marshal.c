@@ -24,8 +24,10 @@
 #include "test.h"
 #include "../src/adf.h"
 #include <stdio.h>
+#include <string.h>
 
 #define FILE_PATH "sample.adf"
+#define N_BIG_SERIES 257
 
 void test_marshal_null_bytes(void)
 {
@@ -88,9 +90,48 @@ void marshaled_default_object_equal_to_sample_file(void)
 	adf_free(&adf);
 }
 
+void marshaled_parallel_equal_to_serial(void)
+{
+	adf_t adf = get_default_object();
+	series_t *series = malloc(N_BIG_SERIES * sizeof(series_t));
+	uint8_t *expected, *bytes;
+	uint32_t n_threads[] = { 1, 4, 0 };
+	size_t size;
+
+	/* the default series, alternated, so that none of them is merged */
+	for (uint32_t i = 0; i < N_BIG_SERIES; i++)
+		series[i] = adf.series[i % 2];
+	adf.series = series;
+	adf.metadata.size_series.val = N_BIG_SERIES;
+
+	size = size_adf_t(&adf);
+	expected = adf_bytes_alloc(&adf);
+	bytes = adf_bytes_alloc(&adf);
+	marshal(expected, &adf);
+	for (size_t t = 0; t < sizeof(n_threads) / sizeof(uint32_t); t++) {
+		memset(bytes, 0, size);
+		assert_true(marshal_parallel(bytes, &adf, n_threads[t]) == ADF_OK,
+					"marshal_parallel succeeds");
+		assert_uint8_arrays_equal(expected, bytes, size,
+								  "parallel bytes are equal to the serial ones");
+	}
+
+	adf.series[N_BIG_SERIES - 1].water_use_ml = NULL;
+	assert_true(marshal_parallel(bytes, &adf, 4) == ADF_RUNTIME_ERROR,
+				"marshal_parallel fails on a series without data");
+	adf.header.flags = ADF_FLAG_LZ_ARRAYS;
+	assert_true(marshal_parallel(bytes, &adf, 4) == ADF_RUNTIME_ERROR,
+				"marshal_parallel fails on a series without data to encode");
+
+	adf_bytes_free(expected);
+	adf_bytes_free(bytes);
+	free(series);
+}
+
 int main(void)
 {
 	test_marshal_null_bytes();
 	test_marshal_null_data();
 	marshaled_default_object_equal_to_sample_file();
+	marshaled_parallel_equal_to_serial();
 }
@@ -23,13 +23,505 @@
 #include "mock.h"
 #include "test.h"
 #include "../src/adf.h"
+#include "../src/codec.h"
+#include "../src/compare.h"
+#include "../src/crc.h"
+#include "../src/lookup_table.h"
+#include "../src/shuffle.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
+/* Every measure goes through this many bytes, whatever the buffer size */
+#define BYTES_PER_MEASURE (256u * 1024u * 1024u)
+
+static size_t sizes[] = { 64, 256, 4096, 16u * 1024u * 1024u };
+
+static uint8_t *get_random_bytes(size_t size)
+{
+	uint8_t *bytes = malloc(size);
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = rand() % 0xFF;
+	return bytes;
+}
+
+/* Throughput in MB/s */
+static double crc16_throughput(crc16_fn kernel, const uint8_t *bytes,
+							   size_t size)
+{
+	size_t n_iter = BYTES_PER_MEASURE / size;
+	volatile uint16_t sink;
+	uint16_t crc = 0;
+	uint64_t start = get_nanos();
+
+	for (size_t i = 0; i < n_iter; i++)
+		crc ^= kernel(CRC16_INIT, bytes, size);
+	sink = crc;
+	(void)sink;
+	return (double)(n_iter * size) / get_time_diff(start) * 1e-6;
+}
+
+static double crc32_throughput(crc32_fn kernel, const uint8_t *bytes,
+							   size_t size)
+{
+	size_t n_iter = BYTES_PER_MEASURE / size;
+	volatile uint32_t sink;
+	uint32_t crc = 0;
+	uint64_t start = get_nanos();
+
+	for (size_t i = 0; i < n_iter; i++)
+		crc ^= kernel(CRC32_INIT, bytes, size);
+	sink = crc;
+	(void)sink;
+	return (double)(n_iter * size) / get_time_diff(start) * 1e-6;
+}
+
+static void bench_crc16(const char *name, crc16_fn kernel,
+						const uint8_t *bytes)
+{
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(size_t); i++)
+		printf("crc16 %-8s %10zu B: %10.1f MB/s\n", name, sizes[i],
+			   crc16_throughput(kernel, bytes, sizes[i]));
+}
+
+static void bench_crc32(const char *name, crc32_fn kernel,
+						const uint8_t *bytes)
+{
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(size_t); i++)
+		printf("crc32 %-8s %10zu B: %10.1f MB/s\n", name, sizes[i],
+			   crc32_throughput(kernel, bytes, sizes[i]));
+}
+
+void bench_crc(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	uint8_t *bytes = get_random_bytes(sizes[3]);
+	(void)cpu;
+
+	get_crc16_fn();
+	bench_crc16("table", &crc16_update_table, bytes);
+	bench_crc16("slice8", &crc16_update_slice8, bytes);
+#ifdef __ADF_X86__
+	if (cpu->pclmul) { bench_crc16("pclmul", &crc16_update_pclmul, bytes); }
+#endif
+#ifdef __ADF_PMULL__
+	if (cpu->pmull) { bench_crc16("pmull", &crc16_update_pmull, bytes); }
+#endif
+	bench_crc32("table", &crc32_update_table, bytes);
+	bench_crc32("slice8", &crc32_update_slice8, bytes);
+#ifdef __ADF_X86__
+	if (cpu->pclmul) { bench_crc32("pclmul", &crc32_update_pclmul, bytes); }
+#endif
+#ifdef __ADF_PMULL__
+	if (cpu->pmull) { bench_crc32("pmull", &crc32_update_pmull, bytes); }
+#endif
+	free(bytes);
+}
+
+static uint32_t identity(void *key) { return *((uint32_t *)key); }
+
+/* Nanoseconds per operation */
+static double ns_per_op(uint64_t start, size_t n_ops)
+{
+	return get_time_diff(start) * 1e9 / n_ops;
+}
+
+static void bench_table_size(size_t n_keys)
+{
+	uint32_t *keys = malloc(n_keys * sizeof(uint32_t));
+	volatile uint32_t sink;
+	uint32_t sum = 0;
+	uint64_t start;
+	table_t t;
+
+	/* the odd keys are inserted, the even ones are misses */
+	for (size_t i = 0; i < n_keys; i++)
+		keys[i] = ((uint32_t)rand() << 1) | 1;
+
+	table_init(&t, 16, 16, &identity);
+	start = get_nanos();
+	for (size_t i = 0; i < n_keys; i++)
+		table_put(&t, keys[i], i);
+	printf("table %10zu keys: put  %6.1f ns/op\n", n_keys,
+		   ns_per_op(start, n_keys));
+
+	start = get_nanos();
+	for (size_t i = 0; i < n_keys; i++)
+		sum += table_get(&t, keys[i]);
+	printf("table %10zu keys: hit  %6.1f ns/op\n", n_keys,
+		   ns_per_op(start, n_keys));
+
+	start = get_nanos();
+	for (size_t i = 0; i < n_keys; i++)
+		sum += table_get(&t, keys[i] ^ 1);
+	printf("table %10zu keys: miss %6.1f ns/op\n", n_keys,
+		   ns_per_op(start, n_keys));
+
+	start = get_nanos();
+	for (size_t i = 0; i < n_keys; i++)
+		table_remove(&t, keys[i]);
+	printf("table %10zu keys: del  %6.1f ns/op\n", n_keys,
+		   ns_per_op(start, n_keys));
+
+	sink = sum;
+	(void)sink;
+	table_free(&t);
+	free(keys);
+}
+
+void bench_lookup_table(void)
+{
+	bench_table_size(1024);
+	bench_table_size(64u * 1024u);
+	bench_table_size(1024u * 1024u);
+}
+
+/* The series have just additives: reindexing doesn't look at the rest */
+static adf_t get_object_with_many_additives(uint32_t n_series,
+											uint32_t n_codes)
+{
+	adf_t adf = get_object_with_zero_series();
+
+	adf.series = calloc(n_series, sizeof(series_t));
+	for (uint32_t i = 0; i < n_series; i++) {
+		adf.series[i].n_soil_adds.val = 3;
+		adf.series[i].soil_additives = malloc(3 * sizeof(additive_t));
+		for (uint32_t j = 0; j < 3; j++)
+			adf.series[i].soil_additives[j] = create_additive(rand() % n_codes,
+															  1.0);
+		adf.series[i].repeated.val = 1;
+	}
+	adf.metadata.size_series.val = n_series;
+	adf.metadata.n_series = n_series;
+	return adf;
+}
+
+void bench_reindex(void)
+{
+	adf_t adf = get_object_with_many_additives(1024u * 1024u, 20'000);
+	uint64_t start;
+
+	start = get_nanos();
+	reindex_additives(&adf);
+	printf("reindex 1M series, serial:   %8.1f ms\n",
+		   get_time_diff(start) * 1e3);
+
+	start = get_nanos();
+	reindex_additives_parallel(&adf, 0);
+	printf("reindex 1M series, parallel: %8.1f ms\n",
+		   get_time_diff(start) * 1e3);
+
+	adf_free(&adf);
+}
+
+/* Throughput in MB/s of both arrays, which are equal to the last element */
+static double reals_within_throughput(reals_within_fn kernel, const float *x,
+									  const float *y, size_t n)
+{
+	size_t n_iter = BYTES_PER_MEASURE / (n * sizeof(float));
+	volatile bool sink;
+	bool within = true;
+	uint64_t start = get_nanos();
+
+	for (size_t i = 0; i < n_iter; i++)
+		within &= kernel(x, y, n, 1e-3f);
+	sink = within;
+	(void)sink;
+	return (double)(n_iter * n * sizeof(float) * 2) / get_time_diff(start)
+		* 1e-6;
+}
+
+static void bench_reals_within(const char *name, reals_within_fn kernel,
+							   const float *x, const float *y)
+{
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(size_t) - 1; i++)
+		printf("compare %-6s %10zu B: %10.1f MB/s\n", name, sizes[i],
+			   reals_within_throughput(kernel, x, y, sizes[i] / 4));
+}
+
+void bench_compare(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	size_t n = sizes[2] / 4;
+	float *x = malloc(n * sizeof(float)), *y = malloc(n * sizeof(float));
+	(void)cpu;
+
+	for (size_t i = 0; i < n; i++) {
+		x[i] = (float)rand() / RAND_MAX;
+		y[i] = x[i] + 1e-4f;
+	}
+	bench_reals_within("scalar", &reals_within_scalar, x, y);
+#ifdef __ADF_X86__
+	if (cpu->sse2) { bench_reals_within("sse2", &reals_within_sse2, x, y); }
+	if (cpu->avx2) { bench_reals_within("avx2", &reals_within_avx2, x, y); }
+#endif
+#ifdef __ADF_NEON__
+	bench_reals_within("neon", &reals_within_neon, x, y);
+#endif
+	free(x);
+	free(y);
+}
+
+/* Columns of sensor readings that change by a quarter of a degree */
+static float *get_smooth_columns(size_t n_rows, size_t n_columns)
+{
+	float *values = malloc(n_rows * n_columns * sizeof(float)), value;
+
+	for (size_t j = 0; j < n_columns; j++) {
+		value = (rand() % 400) / 4.0f;
+		for (size_t i = 0; i < n_rows; i++) {
+			if (rand() % 4 == 0) { value += 0.25f * (rand() % 3 - 1); }
+			values[i * n_columns + j] = value;
+		}
+	}
+	return values;
+}
+
+void bench_xor_codec(void)
+{
+	const size_t n_rows = 4096, n_columns = 32, n = n_rows * n_columns;
+	const size_t n_iter = BYTES_PER_MEASURE / (n * sizeof(float));
+	float *values = get_smooth_columns(n_rows, n_columns);
+	uint8_t *bytes = malloc(xor_encoded_bound(n));
+	xor_encoder_t encoder;
+	xor_decoder_t decoder;
+	size_t size = 0;
+	uint64_t start;
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) {
+		xor_encoder_init(&encoder, bytes);
+		for (size_t j = 0; j < n_columns; j++)
+			xor_encode_column(&encoder, (const uint8_t *)(values + j),
+							  n_rows, n_columns);
+		size = xor_encoder_finish(&encoder);
+	}
+	printf("xor encode %8zu B: %10.1f MB/s (ratio %.2f)\n",
+		   n * sizeof(float),
+		   (double)(n_iter * n * sizeof(float)) / get_time_diff(start) * 1e-6,
+		   (double)(n * sizeof(float)) / size);
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) {
+		xor_decoder_init(&decoder, bytes, size);
+		for (size_t j = 0; j < n_columns; j++)
+			xor_decode_column(&decoder, (uint8_t *)(values + j), n_rows,
+							  n_columns);
+	}
+	printf("xor decode %8zu B: %10.1f MB/s\n", n * sizeof(float),
+		   (double)(n_iter * n * sizeof(float)) / get_time_diff(start) * 1e-6);
+
+	free(values);
+	free(bytes);
+}
+
+void bench_quantized_codec(void)
+{
+	const size_t n_rows = 4096, n_columns = 32, n = n_rows * n_columns;
+	const size_t n_iter = BYTES_PER_MEASURE / (n * sizeof(float));
+	const float step = 0.25f;
+	float *values = get_smooth_columns(n_rows, n_columns);
+	uint8_t *bytes = malloc(quantized_encoded_bound(n));
+	quantized_encoder_t encoder;
+	quantized_decoder_t decoder;
+	size_t size = 0;
+	uint64_t start;
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) {
+		quantized_encoder_init(&encoder, bytes);
+		for (size_t j = 0; j < n_columns; j++)
+			quantized_encode_column(&encoder, (const uint8_t *)(values + j),
+									n_rows, n_columns, step);
+		size = quantized_encoder_finish(&encoder);
+	}
+	printf("quantized encode %8zu B: %10.1f MB/s (ratio %.2f)\n",
+		   n * sizeof(float),
+		   (double)(n_iter * n * sizeof(float)) / get_time_diff(start) * 1e-6,
+		   (double)(n * sizeof(float)) / size);
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) {
+		quantized_decoder_init(&decoder, bytes, size);
+		for (size_t j = 0; j < n_columns; j++)
+			quantized_decode_column(&decoder, (uint8_t *)(values + j), n_rows,
+									n_columns, step);
+	}
+	printf("quantized decode %8zu B: %10.1f MB/s\n", n * sizeof(float),
+		   (double)(n_iter * n * sizeof(float)) / get_time_diff(start) * 1e-6);
+
+	free(values);
+	free(bytes);
+}
+
+void bench_lz_codec(void)
+{
+	const size_t n_rows = 128, n_columns = 32, n = n_rows * n_columns;
+	const size_t size = n * sizeof(float);
+	const size_t n_iter = BYTES_PER_MEASURE / size;
+	float *values = get_smooth_columns(n_rows, n_columns);
+	uint8_t *compressed = malloc(lz_compress_bound(size));
+	uint32_t *table = malloc(LZ_HASH_SIZE * sizeof(uint32_t));
+	size_t compressed_size = 0;
+	uint64_t start;
+
+	/* light bands that are dark but for a few of them */
+	for (size_t i = 0; i < n; i++) {
+		if (i % n_columns >= 4) { values[i] = 0.0f; }
+	}
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++)
+		compressed_size = lz_compress(compressed, (const uint8_t *)values,
+									  size, table);
+	printf("lz compress %8zu B: %10.1f MB/s (ratio %.2f)\n", size,
+		   (double)(n_iter * size) / get_time_diff(start) * 1e-6,
+		   (double)size / compressed_size);
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++)
+		lz_decompress((uint8_t *)values, size, compressed, compressed_size);
+	printf("lz decompress %8zu B: %10.1f MB/s\n", size,
+		   (double)(n_iter * size) / get_time_diff(start) * 1e-6);
+
+	free(values);
+	free(compressed);
+	free(table);
+}
+
+static void bench_shuffle_kernels(const char *name, array_shuffle shuffle,
+								  array_shuffle unshuffle)
+{
+	const size_t size = ADF_ARRAYS_BLOCK_SIZE;
+	const size_t n_iter = BYTES_PER_MEASURE / size;
+	uint8_t *bytes = get_random_bytes(size), *shuffled = malloc(size);
+	uint64_t start;
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) { shuffle(shuffled, bytes, size / 4); }
+	printf("shuffle %-6s %10zu B: %10.1f MB/s\n", name, size,
+		   (double)(n_iter * size) / get_time_diff(start) * 1e-6);
+
+	start = get_nanos();
+	for (size_t k = 0; k < n_iter; k++) { unshuffle(bytes, shuffled, size / 4); }
+	printf("unshuffle %-6s %8zu B: %10.1f MB/s\n", name, size,
+		   (double)(n_iter * size) / get_time_diff(start) * 1e-6);
+
+	free(bytes);
+	free(shuffled);
+}
+
+void bench_shuffle(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	(void)cpu;
+
+	bench_shuffle_kernels("scalar", &shuffle_4_bytes_array_scalar,
+						  &unshuffle_4_bytes_array_scalar);
+#ifdef __ADF_X86__
+	if (cpu->ssse3)
+		bench_shuffle_kernels("ssse3", &shuffle_4_bytes_array_ssse3,
+							  &unshuffle_4_bytes_array_ssse3);
+	if (cpu->avx2)
+		bench_shuffle_kernels("avx2", &shuffle_4_bytes_array_avx2,
+							  &unshuffle_4_bytes_array_avx2);
+#endif
+#ifdef __ADF_NEON__
+	bench_shuffle_kernels("neon", &shuffle_4_bytes_array_neon,
+						  &unshuffle_4_bytes_array_neon);
+#endif
+}
+
+static bool discard_bytes(void *ctx, const uint8_t *bytes, size_t size)
+{
+	(void)ctx;
+	(void)bytes;
+	(void)size;
+	return true;
+}
+
+/* Smooth arrays, like those of a sensor, that the codecs can compress */
+static adf_t get_object_with_smooth_series(uint32_t n_series,
+										   uint32_t n_chunks)
+{
+	adf_t adf = get_object_with_zero_series();
+	uint16_t n_wave = adf.header.wave_info.n_wavelength.val,
+			 n_depth = adf.header.soil_info.n_depth.val;
+	series_t *series;
+
+	adf.header.n_chunks.val = n_chunks;
+	adf.series = calloc(n_series, sizeof(series_t));
+	for (uint32_t i = 0; i < n_series; i++) {
+		series = adf.series + i;
+		series->light_exposure = (real_t *)get_smooth_columns(n_chunks,
+															  n_wave);
+		series->soil_temp_c = (real_t *)get_smooth_columns(n_chunks, n_depth);
+		series->env_temp_c = (real_t *)get_smooth_columns(n_chunks, 1);
+		series->water_use_ml = (real_t *)get_smooth_columns(n_chunks, 1);
+		series->repeated.val = 1;
+	}
+	adf.metadata.size_series.val = n_series;
+	adf.metadata.n_series = n_series;
+	return adf;
+}
+
+static void bench_marshal_with_flags(const char *name, uint8_t flags)
+{
+	adf_t adf = get_object_with_smooth_series(4096, 96);
+	adf_writer_t writer;
+	uint8_t *bytes;
+	uint64_t start;
+	size_t size;
+
+	adf.header.flags = flags;
+	start = get_nanos();
+	size = size_adf_t(&adf);
+	printf("%-12s size_adf_t:       %8.1f ms\n", name,
+		   get_time_diff(start) * 1e3);
+	bytes = malloc(size);
+
+	start = get_nanos();
+	marshal(bytes, &adf);
+	printf("%-12s marshal:          %8.1f ms\n", name,
+		   get_time_diff(start) * 1e3);
+
+	start = get_nanos();
+	marshal_parallel(bytes, &adf, 0);
+	printf("%-12s marshal_parallel: %8.1f ms\n", name,
+		   get_time_diff(start) * 1e3);
+
+	adf_writer_init(&writer, &discard_bytes, NULL, 0);
+	start = get_nanos();
+	marshal_stream(&adf, &writer);
+	printf("%-12s marshal_stream:   %8.1f ms\n", name,
+		   get_time_diff(start) * 1e3);
+	adf_writer_free(&writer);
+
+	free(bytes);
+	adf_free(&adf);
+}
+
+void bench_marshal_encoded(void)
+{
+	bench_marshal_with_flags("plain", ADF_FLAG_SERIES_INDEX);
+	bench_marshal_with_flags("xor", ADF_FLAG_XOR_ARRAYS
+									| ADF_FLAG_SERIES_INDEX);
+	bench_marshal_with_flags("lz+shuffle", ADF_FLAG_LZ_ARRAYS
+										   | ADF_FLAG_SHUFFLE_ARRAYS
+										   | ADF_FLAG_SERIES_INDEX);
+}
+
 int main(void)
 {
-	uint64_t t = get_nanos();
-	printf("%llu\n", t);
+	srand(time(NULL));
+	bench_crc();
+	bench_lookup_table();
+	bench_reindex();
+	bench_compare();
+	bench_xor_codec();
+	bench_quantized_codec();
+	bench_lz_codec();
+	bench_shuffle();
+	bench_marshal_encoded();
 }
@@ -58,11 +58,118 @@ void series_have_more_additives_than_metadata(void)
 	assert_true(format.metadata.n_additives.val == 2,
 				"there are two additives in the metadata section");
 
-	free(codes);
 	adf_free(&format);
 }
 
+void additive_index_is_rebuilt_by_reindex(void)
+{
+	adf_t adf = get_default_object();
+	series_t series = adf.series[1];
+	additive_t additive;
+	uint16_t n_additives;
+
+	reindex_additives(&adf);
+	n_additives = adf.metadata.n_additives.val;
+	assert_true(adf.metadata.additive_index_size == n_additives,
+				"the additive index is rebuilt");
+
+	/* a series with one of the reindexed codes adds no code */
+	additive = create_additive(adf.metadata.additive_codes[0].val, 1.0);
+	series.soil_additives = &additive;
+	series.pH = 3;
+	add_series(&adf, &series);
+	assert_true(adf.metadata.n_additives.val == n_additives
+				&& adf.series[2].soil_additives[0].code_idx.val == 0,
+				"the reindexed codes are found in the index");
+
+	adf_free(&adf);
+}
+
+/* An object whose series have just additives, with random codes */
+static adf_t get_object_with_random_codes(uint32_t n_series, uint32_t n_codes)
+{
+	adf_t adf = get_object_with_zero_series();
+
+	adf.series = calloc(n_series, sizeof(series_t));
+	for (uint32_t i = 0; i < n_series; i++) {
+		adf.series[i].n_soil_adds.val = 2;
+		adf.series[i].n_atm_adds.val = 1;
+		adf.series[i].soil_additives = malloc(2 * sizeof(additive_t));
+		adf.series[i].atm_additives = malloc(sizeof(additive_t));
+		adf.series[i].soil_additives[0] = create_additive(rand() % n_codes, 1);
+		adf.series[i].soil_additives[1] = create_additive(rand() % n_codes, 1);
+		adf.series[i].atm_additives[0] = create_additive(rand() % n_codes, 1);
+		adf.series[i].repeated.val = 1;
+	}
+	adf.metadata.size_series.val = n_series;
+	adf.metadata.n_series = n_series;
+	return adf;
+}
+
+static bool are_codes_in_order_of_appearance(const adf_t *adf)
+{
+	const uint_t *codes = adf->metadata.additive_codes;
+	uint32_t next = 0;
+	additive_t additives[3];
+
+	for (uint32_t i = 0; i < adf->metadata.size_series.val; i++) {
+		additives[0] = adf->series[i].soil_additives[0];
+		additives[1] = adf->series[i].soil_additives[1];
+		additives[2] = adf->series[i].atm_additives[0];
+		for (uint32_t j = 0; j < 3; j++) {
+			if (codes[additives[j].code_idx.val].val != additives[j].code.val)
+				return false;
+			/* a code seen for the first time is the next one */
+			if (additives[j].code_idx.val > next) { return false; }
+			if (additives[j].code_idx.val == next) { next++; }
+		}
+	}
+	return next == adf->metadata.n_additives.val;
+}
+
+void reindex_keeps_codes_in_order_of_appearance(void)
+{
+	adf_t adf = get_object_with_random_codes(1000, 300);
+
+	assert_true(reindex_additives(&adf) == ADF_OK, "reindex succeeds");
+	assert_true(are_codes_in_order_of_appearance(&adf),
+				"codes are in order of first appearance");
+
+	adf_free(&adf);
+}
+
+void parallel_reindex_equal_to_serial(void)
+{
+	adf_t adf = get_object_with_random_codes(20'000, 5000);
+	uint_t *codes;
+	uint16_t n_additives;
+	bool same_codes = true;
+
+	reindex_additives(&adf);
+	n_additives = adf.metadata.n_additives.val;
+	codes = malloc(n_additives * sizeof(uint_t));
+	for (uint16_t i = 0; i < n_additives; i++)
+		codes[i] = adf.metadata.additive_codes[i];
+
+	assert_true(reindex_additives_parallel(&adf, 4) == ADF_OK,
+				"parallel reindex succeeds");
+	assert_true(adf.metadata.n_additives.val == n_additives,
+				"parallel reindex finds the same codes");
+	for (uint16_t i = 0; i < n_additives; i++)
+		same_codes = same_codes
+					 && adf.metadata.additive_codes[i].val == codes[i].val;
+	assert_true(same_codes, "parallel reindex keeps the same order");
+	assert_true(are_codes_in_order_of_appearance(&adf),
+				"parallel reindex updates every additive");
+
+	free(codes);
+	adf_free(&adf);
+}
+
 int main(void)
 {
 	series_have_more_additives_than_metadata();
+	additive_index_is_rebuilt_by_reindex();
+	reindex_keeps_codes_in_order_of_appearance();
+	parallel_reindex_equal_to_serial();
 }
@@ -282,6 +282,409 @@ void test_additive_overflow(void)
 	series_free(&series2);
 }
 
+void series_at_follows_added_and_removed_series(void)
+{
+	adf_t adf = get_object_with_zero_series();
+	series_t first = get_series(), second = get_repeated_series(), found;
+	const uint64_t day = ADF_DAY;
+
+	/* a period that doesn't fit in 16 bits */
+	adf.metadata.period_sec.val = ADF_DAY;
+	first.repeated.val = 3;
+	add_series(&adf, &first);
+	assert_true(get_series_at(&adf, &found, 3 * day) == ADF_OK
+				&& found.light_exposure == adf.series[0].light_exposure,
+				"the end of a series belongs to it");
+
+	/* merged into the last series */
+	add_series(&adf, &first);
+	add_series(&adf, &second);
+
+	assert_true(get_series_at(&adf, &found, 0) == ADF_OK
+				&& found.light_exposure == adf.series[0].light_exposure,
+				"time 0 is in the first series");
+	assert_true(get_series_at(&adf, &found, 6 * day) == ADF_OK
+				&& found.light_exposure == adf.series[0].light_exposure,
+				"the time index follows a repeated series");
+	assert_true(get_series_at(&adf, &found, 6 * day + 1) == ADF_OK
+				&& found.light_exposure == adf.series[1].light_exposure,
+				"right after its end, the next series begins");
+	assert_true(get_series_at(&adf, &found, 8 * day) == ADF_OK
+				&& found.light_exposure == adf.series[1].light_exposure,
+				"the end of the last series is in bound");
+	assert_true(get_series_at(&adf, &found, 8 * day + 1)
+				== ADF_TIME_OUT_OF_BOUND,
+				"after the last series is out of bound");
+
+	remove_series(&adf);
+	remove_series(&adf);
+	assert_true(get_series_at(&adf, &found, 6 * day) == ADF_OK
+				&& found.light_exposure == adf.series[0].light_exposure,
+				"the time index follows the removed series");
+	assert_true(get_series_at(&adf, &found, 6 * day + 1)
+				== ADF_TIME_OUT_OF_BOUND,
+				"removed series are out of bound");
+
+	series_free(&first);
+	series_free(&second);
+	adf_free(&adf);
+}
+
+/* The position of the series that covers `time`, scanning them all */
+static int64_t scan_series_at(const adf_t *adf, uint64_t time)
+{
+	uint64_t end = 0;
+
+	for (uint32_t i = 0; i < adf->metadata.size_series.val; i++) {
+		end += (uint64_t)adf->series[i].repeated.val
+			   * adf->metadata.period_sec.val;
+		if (time <= end) { return i; }
+	}
+	return -1;
+}
+
+static bool are_lookups_correct(const adf_t *adf, const uint64_t *times,
+								series_t **found, size_t n)
+{
+	int64_t pos;
+
+	for (size_t i = 0; i < n; i++) {
+		pos = scan_series_at(adf, times[i]);
+		if (pos < 0 && found[i]) { return false; }
+		if (pos >= 0 && found[i] != adf->series + pos) { return false; }
+	}
+	return true;
+}
+
+void series_at_many_equal_to_series_at(void)
+{
+	adf_t adf = get_default_object();
+	series_t *default_series = adf.series, **found;
+	uint32_t n_series = 1000, default_size = adf.metadata.size_series.val;
+	uint64_t *times, total, tmp;
+	size_t n_times = 5000, j;
+
+	/* shallow copies of the default series, alternated */
+	adf.series = malloc(n_series * sizeof(series_t));
+	adf.metadata.n_series = 0;
+	for (uint32_t i = 0; i < n_series; i++) {
+		adf.series[i] = default_series[i % default_size];
+		adf.metadata.n_series += adf.series[i].repeated.val;
+	}
+	adf.metadata.size_series.val = n_series;
+	total = adf.metadata.n_series * adf.metadata.period_sec.val;
+
+	/* increasing times, the last ones out of bound */
+	times = malloc(n_times * sizeof(uint64_t));
+	found = malloc(n_times * sizeof(series_t *));
+	for (size_t i = 0; i < n_times; i++)
+		times[i] = i * (total + 100) / (n_times - 1);
+
+	assert_true(get_series_at_many(&adf, times, n_times, found)
+				== ADF_TIME_OUT_OF_BOUND,
+				"times out of bound are reported");
+	assert_true(are_lookups_correct(&adf, times, found, n_times),
+				"sorted times are looked up correctly");
+
+	for (size_t i = n_times - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		tmp = times[i];
+		times[i] = times[j];
+		times[j] = tmp;
+	}
+	get_series_at_many(&adf, times, n_times, found);
+	assert_true(are_lookups_correct(&adf, times, found, n_times),
+				"unsorted times are looked up correctly");
+
+	/* only a few times, far apart */
+	times[0] = 0;
+	times[1] = total / 2;
+	times[2] = total;
+	assert_true(get_series_at_many(&adf, times, 3, found) == ADF_OK,
+				"times in bound are found");
+	assert_true(are_lookups_correct(&adf, times, found, 3),
+				"far apart times are looked up correctly");
+
+	free(adf.series);
+	adf.series = default_series;
+	adf.metadata.size_series.val = default_size;
+	adf_free(&adf);
+	free(times);
+	free(found);
+}
+
+void add_series_many_equal_to_add_series(void)
+{
+	adf_t expected = get_default_object(), one_by_one, many;
+	uint32_t n_series = 300, default_size = expected.metadata.size_series.val;
+	series_t *series = malloc(n_series * sizeof(series_t));
+
+	/* shallow copies of the default series, some of them in a row */
+	for (uint32_t i = 0; i < n_series; i++)
+		series[i] = expected.series[(i / 3 + i % 2) % default_size];
+
+	adf_init(&one_by_one, expected.header, expected.metadata.period_sec.val);
+	adf_init(&many, expected.header, expected.metadata.period_sec.val);
+	for (uint32_t i = 0; i < n_series; i++)
+		add_series(&one_by_one, series + i);
+
+	assert_true(add_series_many(&many, series, n_series) == ADF_OK,
+				"add_series_many succeeds");
+	assert_metadata_equal(many.metadata, one_by_one.metadata,
+						  "add_series_many merges like add_series");
+	for (uint32_t i = 0; i < many.metadata.size_series.val; i++)
+		assert_series_equal(many, many.series[i], one_by_one.series[i],
+							"series added at once is correct");
+
+	series[n_series / 2].repeated.val = 0;
+	assert_true(add_series_many(&many, series, n_series)
+				== ADF_ZERO_REPEATED_SERIES,
+				"add_series_many rejects zero-repeated series");
+	assert_true(many.metadata.n_series == one_by_one.metadata.n_series,
+				"nothing is added if a series is zero-repeated");
+
+	free(series);
+	adf_free(&expected);
+	adf_free(&one_by_one);
+	adf_free(&many);
+}
+
+void series_capacity_grows_geometrically(void)
+{
+	adf_t adf = get_default_object(), new;
+	uint32_t n_series = 1000, n_reallocs = 0;
+	series_t *previous = NULL;
+
+	adf_init(&new, adf.header, adf.metadata.period_sec.val);
+	for (uint32_t i = 0; i < n_series; i++) {
+		add_series(&new, adf.series + i % 2);
+		if (new.series != previous) { n_reallocs++; }
+		previous = new.series;
+	}
+	assert_true(n_reallocs <= 11, "the series array grows geometrically");
+	assert_true(new.series_capacity >= n_series
+				&& new.series_capacity < 2 * n_series,
+				"the capacity is at most twice the series");
+
+	assert_true(reserve_series(&new, 3 * n_series) == ADF_OK,
+				"reserve_series succeeds");
+	previous = new.series;
+	for (uint32_t i = n_series; i < 3 * n_series; i++)
+		add_series(&new, adf.series + i % 2);
+	assert_true(new.series == previous,
+				"reserved series are added without reallocs");
+
+	while (new.metadata.size_series.val > 10)
+		remove_series(&new);
+	assert_true(new.series_capacity <= 40,
+				"the series array shrinks as series are removed");
+	assert_true(new.metadata.n_series == 10 * 2,
+				"the remaining series are still there");
+
+	adf_free(&adf);
+	adf_free(&new);
+}
+
+void set_series_replaces_reserved_series(void)
+{
+	adf_t adf = get_default_object(), new;
+
+	adf_init(&new, adf.header, adf.metadata.period_sec.val);
+	reserve_series(&new, 100);
+	assert_true(set_series(&new, adf.series, adf.metadata.size_series.val)
+				== ADF_OK, "set_series succeeds after reserve_series");
+	assert_true(new.metadata.size_series.val == adf.metadata.size_series.val,
+				"set_series replaces the reserved series");
+
+	adf_free(&adf);
+	adf_free(&new);
+}
+
+void add_series_indexes_old_and_new_additives(void)
+{
+	adf_t adf = get_default_object();
+	series_t series = adf.series[0];
+	additive_t soil[2] = {
+		{ .code = { 777 }, .concentration = { 1.0 } },
+		{ .code = { 2345 }, .concentration = { 2.0 } }
+	};
+	additive_t atm[2] = {
+		{ .code = { 888 }, .concentration = { 3.0 } },
+		{ .code = { 777 }, .concentration = { 4.0 } }
+	};
+	series_t *last;
+
+	series.n_soil_adds.val = 2;
+	series.soil_additives = soil;
+	series.n_atm_adds.val = 2;
+	series.atm_additives = atm;
+	assert_true(add_series(&adf, &series) == ADF_OK, "series is added");
+
+	last = adf.series + adf.metadata.size_series.val - 1;
+	assert_true(adf.metadata.n_additives.val == 3,
+				"each new code is added once");
+	assert_true(last->soil_additives[0].code_idx.val == 1
+				&& last->soil_additives[1].code_idx.val == 0
+				&& last->atm_additives[0].code_idx.val == 2
+				&& last->atm_additives[1].code_idx.val == 1,
+				"known and new codes are indexed");
+	assert_true(adf.metadata.additive_codes[1].val == 777
+				&& adf.metadata.additive_codes[2].val == 888,
+				"new codes are appended in order");
+	assert_true(last->soil_additives[1].concentration.val == 2.0f
+				&& last->atm_additives[0].concentration.val == 3.0f,
+				"the concentrations are kept");
+
+	adf_free(&adf);
+}
+
+/* A series allocated as the ingest code does, with one soil additive */
+static series_t get_ingested_series(const adf_header_t *header, float value)
+{
+	const uint32_t n_chunks = header->n_chunks.val;
+	series_t series;
+
+	init_empty_series(&series, n_chunks, header->wave_info.n_wavelength.val,
+					  header->soil_info.n_depth.val, 1, 0);
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		series.env_temp_c[i].val = value;
+		series.water_use_ml[i].val = value * 2;
+	}
+	series.soil_additives[0] = create_additive(1234, value);
+	series.pH = 7;
+	series.p_bar.val = 1.0;
+	series.soil_density_kg_m3.val = 2.0;
+	series.repeated.val = 1;
+	return series;
+}
+
+void add_series_take_moves_the_arrays(void)
+{
+	adf_header_t header = get_default_header();
+	adf_t adf, copied;
+	series_t first = get_ingested_series(&header, 1.5),
+			 second = get_ingested_series(&header, 1.5),
+			 third = get_ingested_series(&header, 2.5);
+	real_t *light_exposure = first.light_exposure;
+
+	adf_init(&adf, header, 3600);
+	adf_init(&copied, header, 3600);
+	add_series(&copied, &first);
+	add_series(&copied, &second);
+	add_series(&copied, &third);
+
+	assert_true(add_series_take(&adf, &first) == ADF_OK,
+				"add_series_take succeeds");
+	assert_true(adf.series[0].light_exposure == light_exposure,
+				"the arrays of the series are adopted");
+	assert_true(!first.light_exposure && !first.soil_additives
+				&& first.repeated.val == 0,
+				"the taken series is zeroed");
+
+	assert_true(add_series_take(&adf, &second) == ADF_OK
+				&& adf.metadata.size_series.val == 1
+				&& adf.series[0].repeated.val == 2,
+				"an equal series is merged into the last one");
+	assert_true(!second.light_exposure, "the merged series is zeroed");
+
+	add_series_take(&adf, &third);
+	assert_metadata_equal(adf.metadata, copied.metadata,
+						  "taking series is like copying them");
+	for (uint32_t i = 0; i < adf.metadata.size_series.val; i++)
+		assert_series_equal(adf, adf.series[i], copied.series[i],
+							"taken series is correct");
+
+	adf_free(&adf);
+	adf_free(&copied);
+}
+
+void many_additive_codes_are_indexed(void)
+{
+	adf_t adf = get_object_with_zero_series();
+	uint32_t n_series = 2000, n_codes = 5000, n_distinct = 0, code;
+	series_t series = get_series();
+	additive_t additives[3], *stored, *own_additives = series.soil_additives;
+	bool *seen = calloc(n_codes, sizeof(bool)), correct = true;
+
+	series.soil_additives = additives;
+	series.n_soil_adds.val = 3;
+	for (uint32_t i = 0; i < n_series; i++) {
+		for (uint32_t j = 0; j < 3; j++) {
+			code = (i * 7 + j * 1013) % n_codes;
+			additives[j] = create_additive(code, 1.0);
+			if (!seen[code]) { n_distinct++; }
+			seen[code] = true;
+		}
+		add_series(&adf, &series);
+	}
+
+	assert_true(adf.metadata.n_additives.val == n_distinct,
+				"each distinct code is registered once");
+	for (uint32_t i = 0; i < adf.metadata.size_series.val; i++) {
+		stored = adf.series[i].soil_additives;
+		for (uint32_t j = 0; j < 3; j++)
+			correct = correct
+					  && adf.metadata.additive_codes[stored[j].code_idx.val].val
+						 == stored[j].code.val;
+	}
+	assert_true(correct, "every additive points to its own code");
+
+	series.soil_additives = own_additives;
+	series.n_soil_adds.val = 1;
+	series_free(&series);
+	free(seen);
+	adf_free(&adf);
+}
+
+/* adds `delta` to each element of the arrays of the series */
+static void shift_arrays(series_t *series, const adf_t *adf, float delta)
+{
+	uint32_t n_chunks = adf->header.n_chunks.val;
+	uint32_t n_light = n_chunks * adf->header.wave_info.n_wavelength.val;
+	uint32_t n_soil = n_chunks * adf->header.soil_info.n_depth.val;
+
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		series->env_temp_c[i].val += delta;
+		series->water_use_ml[i].val += delta;
+	}
+	for (uint32_t i = 0; i < n_light; i++)
+		series->light_exposure[i].val += delta;
+	for (uint32_t i = 0; i < n_soil; i++)
+		series->soil_temp_c[i].val += delta;
+}
+
+void series_within_tolerance_are_merged(void)
+{
+	adf_t adf = get_object_with_precision_set();
+	uint32_t size = adf.metadata.size_series.val;
+	uint32_t repeated = adf.series[size - 1].repeated.val;
+	series_t series;
+
+	/* every element is moved, but less than the smallest precision (0.5) */
+	cpy_adf_series(&series, adf.series + size - 1, &adf);
+	series.digest = (series_digest_t) { 0 };
+	shift_arrays(&series, &adf, 0.45);
+	series.repeated.val = 1;
+
+	add_series(&adf, &series);
+	assert_true(adf.metadata.size_series.val == size
+				&& adf.series[size - 1].repeated.val == repeated + 1,
+				"a series within the tolerance is merged into the last one");
+
+	series.light_exposure[0].val += 2;
+	add_series(&adf, &series);
+	assert_true(adf.metadata.size_series.val == size + 1,
+				"a series beyond the tolerance is appended");
+	assert_true(adf_series_fingerprint(&adf, size)
+				== series_fingerprint(&series, &adf),
+				"the appended series carries its fingerprint");
+	assert_true(adf_series_fingerprint(&adf, size + 1) == 0,
+				"there's no fingerprint out of bounds");
+
+	series_free(&series);
+	adf_free(&adf);
+}
+
 int main(void)
 {
 	test_add_series();
@@ -291,4 +694,13 @@ int main(void)
 	test_add_series_should_merge_additives();
 	test_additive_overflow();
 	test_add_series_with_two_repeated_additives();
+	series_at_follows_added_and_removed_series();
+	series_at_many_equal_to_series_at();
+	add_series_many_equal_to_add_series();
+	series_capacity_grows_geometrically();
+	set_series_replaces_reserved_series();
+	add_series_indexes_old_and_new_additives();
+	add_series_take_moves_the_arrays();
+	many_additive_codes_are_indexed();
+	series_within_tolerance_are_merged();
 }
@@ -209,6 +209,124 @@ void test_update_series_within_repeated_series_between_others(void)
 				"adf.series[2] == to_update");
 }
 
+void update_series_with_a_day_long_period(void)
+{
+	adf_t adf = get_object_with_zero_series();
+	series_t series1 = get_series(), to_update = get_repeated_series(), found;
+	uint16_t res;
+
+	adf.metadata.period_sec.val = ADF_DAY;
+	series1.repeated.val = 3;
+	add_series(&adf, &series1);
+
+	/* lookup the time index before the update, so that it's built */
+	get_series_at(&adf, &found, 0);
+	res = update_series(&adf, &to_update, ADF_DAY + 1);
+
+	assert_true(res == ADF_OK, "Series updated");
+	assert_true(adf.metadata.size_series.val == 3,
+				"The second day is split from the others");
+	assert_true(are_series_equal(adf.series + 1, &to_update, &adf),
+				"adf.series[1] == to_update");
+	assert_true(get_series_at(&adf, &found, ADF_DAY + 1) == ADF_OK
+				&& found.light_exposure == adf.series[1].light_exposure,
+				"The time index follows the update");
+
+	series_free(&to_update);
+	series_free(&series1);
+	adf_free(&adf);
+}
+
+void update_first_repetition_keeps_other_arrays(void)
+{
+	adf_t adf = get_object_with_zero_series();
+	series_t series1 = get_series(), series2 = get_repeated_series(),
+			 to_update = get_series_with_two_soil_additives();
+	real_t *series1_array, *series2_array;
+	uint16_t res;
+
+	series1.repeated.val = 3;
+	to_update.repeated.val = 1;
+	add_series(&adf, &series1);
+	add_series(&adf, &series2);
+	series1_array = adf.series[0].light_exposure;
+	series2_array = adf.series[1].light_exposure;
+
+	res = update_series(&adf, &to_update, 1);
+
+	assert_true(res == ADF_OK, "Series updated");
+	assert_true(adf.metadata.size_series.val == 3,
+				"The first repetition is split from the others");
+	assert_true(are_series_equal(adf.series, &to_update, &adf),
+				"adf.series[0] == to_update");
+	assert_true(adf.series[0].repeated.val == 1
+				&& adf.series[1].repeated.val == 2
+				&& adf.series[2].repeated.val == 2,
+				"The repetitions are split correctly");
+	assert_true(adf.series[1].light_exposure == series1_array
+				&& adf.series[2].light_exposure == series2_array,
+				"The arrays of the other series are not copied");
+	assert_true(adf.metadata.n_series == 5,
+				"The number of series doesn't change");
+
+	series_free(&to_update);
+	series_free(&series1);
+	series_free(&series2);
+	adf_free(&adf);
+}
+
+void update_series_at_the_end_of_a_repeated_series(void)
+{
+	adf_t adf = get_object_with_zero_series();
+	series_t series1 = get_series_with_two_soil_additives(),
+			 series2 = get_series(), to_update = get_repeated_series();
+	uint64_t end = 3 * adf.metadata.period_sec.val;
+
+	series1.repeated.val = 3;
+	series2.repeated.val = 3;
+	add_series(&adf, &series1);
+	add_series(&adf, &series2);
+	to_update.repeated.val = 1;
+
+	assert_true(update_series(&adf, &to_update, end) == ADF_OK,
+				"Series updated at the end of a repeated series");
+	assert_true(adf.metadata.size_series.val == 3
+				&& adf.series[0].repeated.val == 3,
+				"The repeated series is left as it was");
+	assert_true(are_series_equal(adf.series + 1, &to_update, &adf)
+				&& are_series_equal(adf.series + 2, &series2, &adf)
+				&& adf.series[2].repeated.val == 2,
+				"The first repetition of the following series is updated");
+	assert_true(update_series(&adf, &to_update, 2 * end)
+				== ADF_TIME_OUT_OF_BOUND,
+				"The end of the last repeated series is out of bound");
+
+	series_free(&to_update);
+	series_free(&series1);
+	series_free(&series2);
+	adf_free(&adf);
+}
+
+void update_series_registers_new_additives(void)
+{
+	adf_t adf = get_default_object();
+	series_t to_update = get_repeated_series();
+	additive_t *additive;
+
+	to_update.soil_additives[0].code.val = 777;
+	assert_true(update_series(&adf, &to_update, 1) == ADF_OK,
+				"Series updated");
+
+	additive = adf.series[0].soil_additives;
+	assert_true(adf.metadata.n_additives.val == 2,
+				"The new additive code is registered");
+	assert_true(adf.metadata.additive_codes[additive->code_idx.val].val == 777,
+				"The updated series points to the new code");
+
+	series_free(&to_update);
+	adf_free(&adf);
+}
+
 int main(void)
 {
 	test_update_series_time_out_of_bound();
@@ -217,4 +335,8 @@ int main(void)
 	update_one_series_with_an_equal_one_with_different_repetition();
 	test_update_series_within_repeated_series();
 	test_update_series_within_repeated_series_between_others();
+	update_series_with_a_day_long_period();
+	update_first_repetition_keeps_other_arrays();
+	update_series_registers_new_additives();
+	update_series_at_the_end_of_a_repeated_series();
 }
@@ -0,0 +1,137 @@
+/* test_shuffle.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/shuffle.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_ELEMENTS 131
+
+static uint8_t *get_random_bytes(size_t size)
+{
+	uint8_t *bytes = malloc(size);
+	for (size_t i = 0; i < size; i++)
+		bytes[i] = rand() % 0xFF;
+	return bytes;
+}
+
+static bool is_shuffled(const uint8_t *x, const uint8_t *y, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		for (size_t k = 0; k < 4; k++) {
+			if (x[i * 4 + k] != y[k * n + i]) { return false; }
+		}
+	}
+	return true;
+}
+
+static bool kernels_match_scalar(array_shuffle shuffle,
+								 array_shuffle unshuffle)
+{
+	uint8_t *source, *expected, *result;
+	bool equal = true;
+
+	/* every length up to MAX_ELEMENTS, so that all the tails are covered */
+	for (size_t n = 0; n <= MAX_ELEMENTS && equal; n++) {
+		source = get_random_bytes(MAX_ELEMENTS * 4);
+		expected = malloc(MAX_ELEMENTS * 4);
+		result = malloc(MAX_ELEMENTS * 4);
+		shuffle_4_bytes_array_scalar(expected, source, n);
+		shuffle(result, source, n);
+		equal = are_uint8_arrays_equal(expected, result, n * 4);
+		unshuffle_4_bytes_array_scalar(expected, source, n);
+		unshuffle(result, source, n);
+		equal = equal && are_uint8_arrays_equal(expected, result, n * 4);
+		free(source);
+		free(expected);
+		free(result);
+	}
+	return equal;
+}
+
+void scalar_kernel_splits_the_planes(void)
+{
+	uint8_t *source = get_random_bytes(MAX_ELEMENTS * 4),
+			*shuffled = malloc(MAX_ELEMENTS * 4),
+			*result = malloc(MAX_ELEMENTS * 4);
+
+	shuffle_4_bytes_array_scalar(shuffled, source, MAX_ELEMENTS);
+	assert_true(is_shuffled(source, shuffled, MAX_ELEMENTS),
+				"scalar kernel puts byte k of each element in plane k");
+	unshuffle_4_bytes_array_scalar(result, shuffled, MAX_ELEMENTS);
+	assert_uint8_arrays_equal(source, result, MAX_ELEMENTS * 4,
+							  "scalar kernels are the inverse of each other");
+
+	free(source);
+	free(shuffled);
+	free(result);
+}
+
+void simd_kernels_match_scalar_kernels(void)
+{
+	const cpu_features_t *cpu = get_cpu_features();
+	(void)cpu;
+
+#ifdef __ADF_X86__
+	if (cpu->ssse3)
+		assert_true(kernels_match_scalar(&shuffle_4_bytes_array_ssse3,
+										 &unshuffle_4_bytes_array_ssse3),
+					"SSSE3 kernels match the scalar ones");
+	if (cpu->avx2)
+		assert_true(kernels_match_scalar(&shuffle_4_bytes_array_avx2,
+										 &unshuffle_4_bytes_array_avx2),
+					"AVX2 kernels match the scalar ones");
+#endif
+#ifdef __ADF_NEON__
+	assert_true(kernels_match_scalar(&shuffle_4_bytes_array_neon,
+									 &unshuffle_4_bytes_array_neon),
+				"NEON kernels match the scalar ones");
+#endif
+}
+
+void selected_kernels_round_trip(void)
+{
+	uint8_t *source = get_random_bytes(MAX_ELEMENTS * 4),
+			*shuffled = malloc(MAX_ELEMENTS * 4),
+			*result = malloc(MAX_ELEMENTS * 4);
+
+	get_shuffle_4_bytes_fn()(shuffled, source, MAX_ELEMENTS);
+	assert_true(is_shuffled(source, shuffled, MAX_ELEMENTS),
+				"selected kernel puts byte k of each element in plane k");
+	get_unshuffle_4_bytes_fn()(result, shuffled, MAX_ELEMENTS);
+	assert_uint8_arrays_equal(source, result, MAX_ELEMENTS * 4,
+							  "selected kernels are the inverse of each other");
+
+	free(source);
+	free(shuffled);
+	free(result);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	scalar_kernel_splits_the_planes();
+	simd_kernels_match_scalar_kernels();
+	selected_kernels_round_trip();
+}
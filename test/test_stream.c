@@ -0,0 +1,402 @@
+/* test_stream.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* fileno is not part of ISO C */
+#define _DEFAULT_SOURCE
+
+#include "../src/adf.h"
+#include "mock.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_BIG_SERIES 257
+
+typedef struct {
+	uint8_t *bytes;
+	size_t size;
+	size_t n_writes;
+	size_t max_write;
+	bool fail;
+} sink_t;
+
+static bool write_to_sink(void *ctx, const uint8_t *bytes, size_t size)
+{
+	sink_t *sink = ctx;
+
+	if (sink->fail) { return false; }
+	memcpy(sink->bytes + sink->size, bytes, size);
+	sink->size += size;
+	sink->n_writes++;
+	if (size > sink->max_write) { sink->max_write = size; }
+	return true;
+}
+
+/* The default series, alternated, so that no two consecutive are equal */
+static adf_t get_big_object(void)
+{
+	adf_t adf = get_default_object();
+	series_t *series = malloc(N_BIG_SERIES * sizeof(series_t));
+
+	for (uint32_t i = 0; i < N_BIG_SERIES; i++)
+		series[i] = adf.series[i % 2];
+	adf.series = series;
+	adf.metadata.size_series.val = N_BIG_SERIES;
+	return adf;
+}
+
+void streamed_bytes_equal_to_marshal(void)
+{
+	adf_t adf = get_big_object();
+	size_t size = size_adf_t(&adf), buffer_sizes[] = { 0, 64, 1000 };
+	uint8_t *expected = adf_bytes_alloc(&adf);
+	sink_t sink = { .bytes = malloc(size) };
+	adf_writer_t writer;
+
+	marshal(expected, &adf);
+	for (size_t i = 0; i < sizeof(buffer_sizes) / sizeof(size_t); i++) {
+		sink.size = 0;
+		sink.max_write = 0;
+		adf_writer_init(&writer, &write_to_sink, &sink, buffer_sizes[i]);
+		assert_true(marshal_stream(&adf, &writer) == ADF_OK,
+					"marshal_stream succeeds");
+		assert_true(sink.size == size, "all the bytes are streamed");
+		assert_uint8_arrays_equal(expected, sink.bytes, size,
+								  "streamed bytes are equal to marshal ones");
+		assert_true(sink.max_write <= writer.buffer_size,
+					"memory is bounded by the buffer size");
+		adf_writer_free(&writer);
+	}
+
+	adf_bytes_free(expected);
+	free(sink.bytes);
+	free(adf.series);
+}
+
+void failing_writer_is_reported(void)
+{
+	adf_t adf = get_big_object();
+	sink_t sink = { .bytes = malloc(size_adf_t(&adf)), .fail = true };
+	adf_writer_t writer;
+
+	adf_writer_init(&writer, &write_to_sink, &sink, 64);
+	assert_true(marshal_stream(&adf, &writer) == ADF_RUNTIME_ERROR,
+				"a failing writer is reported");
+	adf_writer_free(&writer);
+
+	free(sink.bytes);
+	free(adf.series);
+}
+
+void conflicting_codecs_are_not_streamed(void)
+{
+	adf_t adf = get_default_object();
+	sink_t sink = { .bytes = malloc(size_adf_t(&adf)) };
+	adf_writer_t writer;
+
+	adf.header.flags = ADF_FLAG_LZ_ARRAYS | ADF_FLAG_QUANTIZED_ARRAYS;
+	adf_writer_init(&writer, &write_to_sink, &sink, 64);
+	assert_true(marshal_stream(&adf, &writer) == ADF_RUNTIME_ERROR
+				&& sink.size == 0,
+				"conflicting codecs are rejected before streaming");
+	adf_writer_free(&writer);
+
+	free(sink.bytes);
+	adf_free(&adf);
+}
+
+void streamed_to_file_and_fd(void)
+{
+	adf_t adf = get_big_object();
+	size_t size = size_adf_t(&adf);
+	uint8_t *expected = adf_bytes_alloc(&adf), *read_bytes = malloc(size);
+	adf_writer_t writer;
+	FILE *file;
+
+	marshal(expected, &adf);
+
+	file = tmpfile();
+	adf_writer_init_file(&writer, file, 100);
+	assert_true(marshal_stream(&adf, &writer) == ADF_OK,
+				"marshal_stream to a FILE succeeds");
+	adf_writer_free(&writer);
+	rewind(file);
+	assert_true(fread(read_bytes, 1, size, file) == size,
+				"all the bytes are written to the FILE");
+	assert_uint8_arrays_equal(expected, read_bytes, size,
+							  "bytes written to the FILE are correct");
+	fclose(file);
+
+	file = tmpfile();
+	assert_true(adf_writer_init_fd(&writer, fileno(file), 100) == ADF_OK,
+				"writer to a file descriptor is created");
+	assert_true(marshal_stream(&adf, &writer) == ADF_OK,
+				"marshal_stream to a file descriptor succeeds");
+	adf_writer_free(&writer);
+	rewind(file);
+	assert_true(fread(read_bytes, 1, size, file) == size,
+				"all the bytes are written to the file descriptor");
+	assert_uint8_arrays_equal(expected, read_bytes, size,
+							  "bytes written to the descriptor are correct");
+	fclose(file);
+
+	adf_bytes_free(expected);
+	free(read_bytes);
+	free(adf.series);
+}
+
+static uint16_t decode_in_chunks(adf_t *adf, const uint8_t *bytes,
+								 size_t size, size_t chunk_size,
+								 adf_series_fn on_series, void *ctx)
+{
+	adf_decoder_t decoder;
+	uint16_t res = adf_decoder_init(&decoder, adf, on_series, ctx);
+
+	for (size_t i = 0; i < size && res == ADF_OK; i += chunk_size) {
+		res = adf_decoder_feed(&decoder, bytes + i,
+							   size - i < chunk_size ? size - i : chunk_size);
+	}
+	/* after an error, finish reports it again */
+	return adf_decoder_finish(&decoder);
+}
+
+typedef struct {
+	const adf_t *expected;
+	uint32_t n_seen;
+	bool in_order;
+} seen_t;
+
+static uint16_t check_series(void *ctx, const adf_t *adf,
+							 const series_t *series, uint32_t index)
+{
+	seen_t *seen = ctx;
+	const series_t *expected = seen->expected->series + index;
+
+	if (index != seen->n_seen++) { seen->in_order = false; }
+	if (!are_series_equal(series, expected, adf)) { seen->in_order = false; }
+	return ADF_OK;
+}
+
+void decoded_chunks_equal_to_unmarshal(void)
+{
+	adf_t adf = get_big_object(), decoded, expected;
+	size_t size = size_adf_t(&adf), chunk_sizes[] = { 1, 7, 4096, size };
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+
+	marshal(bytes, &adf);
+	unmarshal(&expected, bytes);
+	for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(size_t); i++) {
+		assert_true(decode_in_chunks(&decoded, bytes, size, chunk_sizes[i],
+									 NULL, NULL) == ADF_OK,
+					"decoding in chunks succeeds");
+		assert_header_equal(decoded.header, adf.header,
+							"decoded header is correct");
+		assert_metadata_equal(decoded.metadata, expected.metadata,
+							  "decoded metadata is correct");
+		for (uint32_t j = 0; j < decoded.metadata.size_series.val; j++)
+			assert_series_equal(decoded, decoded.series[j],
+								expected.series[j],
+								"decoded series is correct");
+		adf_free(&decoded);
+	}
+
+	adf_free(&expected);
+	adf_bytes_free(bytes);
+	free(adf.series);
+}
+
+void decoder_hands_series_to_callback(void)
+{
+	adf_t adf = get_big_object(), decoded, expected;
+	size_t size = size_adf_t(&adf);
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+	seen_t seen = { .expected = &adf, .in_order = true };
+
+	marshal(bytes, &adf);
+	unmarshal(&expected, bytes);
+	assert_true(decode_in_chunks(&decoded, bytes, size, 100, &check_series,
+								 &seen) == ADF_OK,
+				"decoding with a callback succeeds");
+	assert_true(seen.n_seen == N_BIG_SERIES && seen.in_order,
+				"every series is handed to the callback, in order");
+	assert_true(decoded.series == NULL
+				&& decoded.metadata.size_series.val == 0,
+				"series handed to the callback are not stored");
+	assert_true(decoded.metadata.n_series == expected.metadata.n_series,
+				"n_series counts all the series");
+	adf_free(&decoded);
+	adf_free(&expected);
+
+	adf_bytes_free(bytes);
+	free(adf.series);
+}
+
+void decoder_reports_truncation_and_corruption(void)
+{
+	adf_t adf = get_big_object(), decoded;
+	size_t size = size_adf_t(&adf);
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+
+	marshal(bytes, &adf);
+	assert_true(decode_in_chunks(&decoded, bytes, size_header() - 1, 7,
+								 NULL, NULL) == ADF_HEADER_CORRUPTED,
+				"truncated header is reported");
+	adf_free(&decoded);
+	assert_true(decode_in_chunks(&decoded, bytes, size_header() + 10, 7,
+								 NULL, NULL) == ADF_METADATA_CORRUPTED,
+				"truncated metadata is reported");
+	adf_free(&decoded);
+	assert_true(decode_in_chunks(&decoded, bytes, size - 1, 7,
+								 NULL, NULL) == ADF_SERIES_CORRUPTED,
+				"truncated series is reported");
+	adf_free(&decoded);
+
+	bytes[size - 10] ^= 0xFF;
+	assert_true(decode_in_chunks(&decoded, bytes, size, 7,
+								 NULL, NULL) == ADF_SERIES_CORRUPTED,
+				"corrupted series is reported");
+	adf_free(&decoded);
+
+	adf_bytes_free(bytes);
+	free(adf.series);
+
+	bytes = get_bytes_with_additive_out_of_range(&size);
+	assert_true(decode_in_chunks(&decoded, bytes, size, 7,
+								 NULL, NULL) == ADF_SERIES_CORRUPTED,
+				"additive index out of the codes is reported");
+	adf_free(&decoded);
+	free(bytes);
+}
+
+void streamed_index_equal_to_marshal(void)
+{
+	adf_t adf = get_big_object(), decoded;
+	size_t size;
+	uint8_t *expected, *parallel;
+	sink_t sink;
+	adf_writer_t writer;
+
+	adf.header.flags = ADF_FLAG_SERIES_INDEX;
+	size = size_adf_t(&adf);
+	expected = adf_bytes_alloc(&adf);
+	parallel = adf_bytes_alloc(&adf);
+	sink = (sink_t){ .bytes = malloc(size) };
+
+	marshal(expected, &adf);
+	assert_true(marshal_parallel(parallel, &adf, 4) == ADF_OK,
+				"marshal_parallel succeeds with the series index");
+	assert_uint8_arrays_equal(expected, parallel, size,
+							  "parallel series index is equal to marshal one");
+	adf_writer_init(&writer, &write_to_sink, &sink, 64);
+	assert_true(marshal_stream(&adf, &writer) == ADF_OK
+				&& sink.size == size,
+				"marshal_stream writes the series index");
+	assert_uint8_arrays_equal(expected, sink.bytes, size,
+							  "streamed series index is equal to marshal one");
+	adf_writer_free(&writer);
+
+	/* readers that don't need the index skip it */
+	assert_true(decode_in_chunks(&decoded, expected, size, 7, NULL, NULL)
+				== ADF_OK, "an indexed object is decoded");
+	assert_header_equal(decoded.header, adf.header,
+						"decoded header keeps the flags");
+	adf_free(&decoded);
+
+	adf_bytes_free(expected);
+	adf_bytes_free(parallel);
+	free(sink.bytes);
+	free(adf.series);
+}
+
+static void check_streamed_encoded_arrays(uint8_t flags)
+{
+	adf_t adf = get_big_object(), decoded;
+	size_t size;
+	uint8_t *expected, *parallel;
+	sink_t sink;
+	adf_writer_t writer;
+	seen_t seen = { .expected = &adf, .in_order = true };
+
+	adf.header.flags = flags | ADF_FLAG_SERIES_INDEX;
+	size = size_adf_t(&adf);
+	expected = adf_bytes_alloc(&adf);
+	parallel = adf_bytes_alloc(&adf);
+	sink = (sink_t){ .bytes = malloc(size) };
+
+	marshal(expected, &adf);
+	assert_true(marshal_parallel(parallel, &adf, 4) == ADF_OK,
+				"marshal_parallel succeeds with encoded arrays");
+	assert_uint8_arrays_equal(expected, parallel, size,
+							  "parallel encoded arrays are equal to marshal ones");
+	adf_writer_init(&writer, &write_to_sink, &sink, 64);
+	assert_true(marshal_stream(&adf, &writer) == ADF_OK
+				&& sink.size == size,
+				"marshal_stream writes encoded arrays");
+	assert_uint8_arrays_equal(expected, sink.bytes, size,
+							  "streamed encoded arrays are equal to marshal ones");
+	adf_writer_free(&writer);
+
+	assert_true(decode_in_chunks(&decoded, expected, size, 7, &check_series,
+								 &seen) == ADF_OK,
+				"encoded arrays are decoded in chunks");
+	assert_true(seen.in_order && seen.n_seen == N_BIG_SERIES,
+				"series with encoded arrays are decoded correctly");
+	adf_free(&decoded);
+
+	adf_bytes_free(expected);
+	adf_bytes_free(parallel);
+	free(sink.bytes);
+	free(adf.series);
+}
+
+void streamed_xor_arrays_equal_to_marshal(void)
+{
+	check_streamed_encoded_arrays(ADF_FLAG_XOR_ARRAYS);
+}
+
+void streamed_lz_arrays_equal_to_marshal(void)
+{
+	check_streamed_encoded_arrays(ADF_FLAG_LZ_ARRAYS);
+}
+
+void streamed_shuffled_arrays_equal_to_marshal(void)
+{
+	check_streamed_encoded_arrays(ADF_FLAG_SHUFFLE_ARRAYS);
+	check_streamed_encoded_arrays(ADF_FLAG_SHUFFLE_ARRAYS
+								  | ADF_FLAG_LZ_ARRAYS);
+}
+
+int main(void)
+{
+	streamed_bytes_equal_to_marshal();
+	failing_writer_is_reported();
+	conflicting_codecs_are_not_streamed();
+	streamed_to_file_and_fd();
+	decoded_chunks_equal_to_unmarshal();
+	decoder_hands_series_to_callback();
+	decoder_reports_truncation_and_corruption();
+	streamed_index_equal_to_marshal();
+	streamed_xor_arrays_equal_to_marshal();
+	streamed_lz_arrays_equal_to_marshal();
+	streamed_shuffled_arrays_equal_to_marshal();
+}
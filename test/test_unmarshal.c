@@ -22,12 +22,15 @@
  */
 
 #include "../src/adf.h"
+#include "../src/crc.h"
 #include "mock.h"
 #include "test.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define FILE_PATH "sample.adf"
+#define N_BIG_SERIES 257
 
 void test_unmarshal_null_bytes(void)
 {
@@ -112,9 +115,657 @@ void unmarshaled_sample_file_equal_to_default_object(void)
 	adf_free(&new);
 }
 
+static bool is_in_slab(const adf_t *adf, const void *ptr)
+{
+	const uint8_t *slab = adf->slab, *address = ptr;
+	return address >= slab && address < slab + adf->slab_size;
+}
+
+void unmarshaled_slab_equal_to_default_object(void)
+{
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+	bool in_slab = true;
+	series_t *current;
+
+	marshal(bytes, &expected);
+	assert_true(unmarshal_slab(&new, bytes) == ADF_OK,
+				"unmarshal_slab succeeds");
+	assert_true(new.slab != NULL, "slab is allocated");
+	assert_metadata_equal(new.metadata, expected.metadata,
+						  "slab metadata is correct");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++) {
+		current = new.series + i;
+		in_slab = in_slab
+				  && is_in_slab(&new, current->light_exposure)
+				  && is_in_slab(&new, current->soil_temp_c)
+				  && is_in_slab(&new, current->env_temp_c)
+				  && is_in_slab(&new, current->water_use_ml)
+				  && is_in_slab(&new, current->soil_additives)
+				  && (uintptr_t)current->light_exposure % 64 == 0;
+		assert_series_equal(new, *current, expected.series[i],
+							"slab series is correct");
+	}
+	assert_true(in_slab, "all the series arrays are placed in the slab");
+
+	/* series removed, then added again, go back to the heap */
+	remove_series(&new);
+	remove_series(&new);
+	remove_series(&new);
+	add_series(&new, expected.series + 1);
+	assert_true(!is_in_slab(&new, new.series[1].light_exposure),
+				"series added after unmarshal_slab are not in the slab");
+
+	adf_free(&new);
+	assert_true(new.slab == NULL && new.slab_size == 0,
+				"slab is released by adf_free");
+
+	free(bytes);
+	adf_free(&expected);
+}
+
+/* The default series, alternated, so that no two consecutive are equal */
+static adf_t get_big_object(void)
+{
+	adf_t adf = get_default_object();
+	series_t *series = malloc(N_BIG_SERIES * sizeof(series_t));
+
+	for (uint32_t i = 0; i < N_BIG_SERIES; i++)
+		series[i] = adf.series[i % 2];
+	adf.series = series;
+	adf.metadata.size_series.val = N_BIG_SERIES;
+	return adf;
+}
+
+void unmarshaled_parallel_equal_to_serial(void)
+{
+	adf_t big = get_big_object(), serial, parallel;
+	uint8_t *bytes = adf_bytes_alloc(&big);
+	size_t size = size_adf_t(&big);
+	uint32_t n_threads[] = { 1, 4, 0 };
+	bool equal;
+
+	marshal(bytes, &big);
+	unmarshal(&serial, bytes);
+	for (size_t t = 0; t < sizeof(n_threads) / sizeof(uint32_t); t++) {
+		assert_true(unmarshal_parallel(&parallel, bytes, size, n_threads[t])
+					== ADF_OK, "unmarshal_parallel succeeds");
+		assert_header_equal(parallel.header, serial.header,
+							"parallel header is correct");
+		assert_metadata_equal(parallel.metadata, serial.metadata,
+							  "parallel metadata is correct");
+		equal = true;
+		for (uint32_t i = 0; i < N_BIG_SERIES; i++) {
+			equal = equal
+					&& are_series_equal(parallel.series + i, serial.series + i,
+										&serial)
+					&& parallel.series[i].repeated.val
+					   == serial.series[i].repeated.val;
+		}
+		assert_true(equal, "parallel series are equal to the serial ones");
+		adf_free(&parallel);
+	}
+
+	adf_free(&serial);
+	adf_bytes_free(bytes);
+	free(big.series);
+}
+
+void parallel_errors_match_serial(void)
+{
+	adf_t big = get_big_object(), serial, parallel;
+	size_t size = size_adf_t(&big), *offsets;
+	uint8_t *bytes = adf_bytes_alloc(&big), *corrupted = malloc(size);
+	adf_view_t view;
+	uint16_t res;
+
+	marshal(bytes, &big);
+	adf_view_init(&view, bytes, size);
+	offsets = view.series_offsets;
+
+	/* a series whose crc doesn't match */
+	memcpy(corrupted, bytes, size);
+	corrupted[offsets[200]] ^= 0xFF;
+	res = unmarshal(&serial, corrupted);
+	assert_true(res == ADF_SERIES_CORRUPTED
+				&& unmarshal_parallel(&parallel, corrupted, size, 4) == res,
+				"parallel reports a corrupted series like the serial one");
+	adf_free(&parallel);
+
+	/* a zero-repeated series before it is reported first */
+	memset(corrupted + offsets[101] - UINT_SMALL_T_SIZE - UINT_T_SIZE, 0,
+		   UINT_T_SIZE);
+	res = unmarshal(&serial, corrupted);
+	assert_true(res == ADF_ZERO_REPEATED_SERIES
+				&& unmarshal_parallel(&parallel, corrupted, size, 4) == res,
+				"parallel reports the first error like the serial one");
+	adf_free(&parallel);
+
+	/* a truncated byte array is reported after the series errors */
+	assert_true(unmarshal_parallel(&parallel, corrupted, offsets[150] + 10, 4)
+				== ADF_ZERO_REPEATED_SERIES,
+				"series errors come before the truncation");
+	adf_free(&parallel);
+	assert_true(unmarshal_parallel(&parallel, bytes, offsets[150] + 10, 4)
+				== ADF_SERIES_CORRUPTED,
+				"truncated byte array is corrupted");
+	adf_free(&parallel);
+
+	adf_view_free(&view);
+	adf_bytes_free(bytes);
+	free(corrupted);
+	free(big.series);
+}
+
+void series_at_after_unmarshal(void)
+{
+	adf_t big = get_big_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&big);
+	uint64_t period, total;
+	series_t found;
+
+	marshal(bytes, &big);
+	unmarshal(&new, bytes);
+	period = new.metadata.period_sec.val;
+	total = new.metadata.n_series * period;
+
+	assert_true(get_series_at(&new, &found, 0) == ADF_OK
+				&& found.light_exposure == new.series[0].light_exposure,
+				"time index is built after unmarshal");
+	assert_true(get_series_at(&new, &found, total) == ADF_OK
+				&& found.light_exposure
+				   == new.series[N_BIG_SERIES - 1].light_exposure,
+				"the end of the last unmarshalled series is found");
+	assert_true(get_series_at(&new, &found, total + 1)
+				== ADF_TIME_OUT_OF_BOUND,
+				"after the end of the unmarshalled series is out of bound");
+
+	adf_free(&new);
+	adf_bytes_free(bytes);
+	free(big.series);
+}
+
+void additive_index_after_unmarshal(void)
+{
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+	series_t series = expected.series[0];
+
+	marshal(bytes, &expected);
+	unmarshal(&new, bytes);
+	assert_true(new.metadata.additive_index_size
+				== new.metadata.n_additives.val,
+				"additive index is built after unmarshal");
+
+	series.pH = 3;
+	add_series(&new, &series);
+	assert_true(new.metadata.n_additives.val == 1,
+				"unmarshalled codes are found in the index");
+
+	adf_free(&new);
+	adf_free(&expected);
+	adf_bytes_free(bytes);
+}
+
+void unmarshalled_series_carry_their_fingerprint(void)
+{
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+	bool correct = true;
+
+	marshal(bytes, &expected);
+	unmarshal(&new, bytes);
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++)
+		correct = correct && new.series[i].digest.fingerprint
+							 == series_fingerprint(expected.series + i,
+												   &expected);
+	assert_true(correct, "the fingerprints are computed by unmarshal");
+
+	adf_free(&new);
+	adf_free(&expected);
+	adf_bytes_free(bytes);
+}
+
+void indexed_object_equal_to_default_object(void)
+{
+	adf_t expected = get_default_object(), new;
+	uint8_t *bytes;
+	size_t size;
+
+	expected.header.flags = ADF_FLAG_SERIES_INDEX;
+	bytes = adf_bytes_alloc(&expected);
+	size = size_adf_t(&expected);
+	marshal(bytes, &expected);
+
+	assert_true(unmarshal(&new, bytes) == ADF_OK,
+				"an object with the series index is unmarshalled");
+	assert_header_equal(new.header, expected.header,
+						"the flags of the header are read");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++)
+		assert_series_equal(new, new.series[i], expected.series[i],
+							"series before the index are correct");
+	adf_free(&new);
+
+	assert_true(unmarshal_parallel(&new, bytes, size, 2) == ADF_OK,
+				"an object with the series index is unmarshalled in parallel");
+	adf_free(&new);
+
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+}
+
+/*
+ * Rewrites the header as the versions without the flags did: the same
+ * fields, one byte shorter.
+ */
+static uint8_t *get_bytes_without_flags(adf_t *adf, size_t *size)
+{
+	const size_t old_header_size = size_header() - 1;
+	uint8_t *bytes = adf_bytes_alloc(adf), *old;
+	uint16_t crc;
+
+	marshal(bytes, adf);
+	*size = size_adf_t(adf) - 1;
+	old = malloc(*size);
+	memcpy(old, bytes, old_header_size - UINT_SMALL_T_SIZE);
+	memcpy(old + old_header_size, bytes + size_header(),
+		   *size - old_header_size);
+	/* version 0.9.2, big-endian */
+	old[4] = 0x00;
+	old[5] = 0x92;
+	crc = crc16(old, old_header_size - UINT_SMALL_T_SIZE);
+	old[old_header_size - 2] = crc >> 8;
+	old[old_header_size - 1] = crc & 0xFF;
+
+	adf_bytes_free(bytes);
+	return old;
+}
+
+void older_version_without_flags_is_read(void)
+{
+	adf_t expected = get_default_object(), new;
+	size_t size;
+	uint8_t *bytes = get_bytes_without_flags(&expected, &size);
+	series_t series;
+
+	assert_true(unmarshal(&new, bytes) == ADF_OK,
+				"an object without flags is unmarshalled");
+	assert_true(new.header.version.val == 0x0092u && new.header.flags == 0,
+				"the older version has no flags");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++)
+		assert_series_equal(new, new.series[i], expected.series[i],
+							"series of an older version are correct");
+	adf_free(&new);
+
+	assert_true(unmarshal_parallel(&new, bytes, size, 2) == ADF_OK,
+				"an object without flags is unmarshalled in parallel");
+	adf_free(&new);
+	assert_true(adf_read_series_at(bytes, size, 1, &series, NULL) == ADF_OK,
+				"a series of an older version is read at its index");
+	assert_series_equal(expected, series, expected.series[1],
+						"series read from an older version is correct");
+	series_free(&series);
+
+	free(bytes);
+	adf_free(&expected);
+}
+
+static bool are_arrays_identical(const adf_t *adf, const series_t *x,
+								 const series_t *y)
+{
+	size_t n_chunks = adf->header.n_chunks.val;
+	size_t n_wave = adf->header.wave_info.n_wavelength.val;
+	size_t n_depth = adf->header.soil_info.n_depth.val;
+
+	return memcmp(x->light_exposure, y->light_exposure,
+				  n_chunks * n_wave * sizeof(real_t)) == 0
+		   && memcmp(x->soil_temp_c, y->soil_temp_c,
+					 n_chunks * n_depth * sizeof(real_t)) == 0
+		   && memcmp(x->env_temp_c, y->env_temp_c,
+					 n_chunks * sizeof(real_t)) == 0
+		   && memcmp(x->water_use_ml, y->water_use_ml,
+					 n_chunks * sizeof(real_t)) == 0;
+}
+
+void xor_arrays_equal_to_default_object(void)
+{
+	adf_t expected = get_default_object(), new;
+	size_t raw_size = size_adf_t(&expected), size;
+	uint8_t *bytes;
+	bool identical = true;
+
+	expected.header.flags = ADF_FLAG_XOR_ARRAYS;
+	size = size_adf_t(&expected);
+	bytes = adf_bytes_alloc(&expected);
+	assert_true(marshal(bytes, &expected) == ADF_OK,
+				"an object with encoded arrays is marshalled");
+	assert_true(size < raw_size, "encoded arrays take less space");
+
+	assert_true(unmarshal(&new, bytes) == ADF_OK,
+				"an object with encoded arrays is unmarshalled");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++) {
+		assert_series_equal(new, new.series[i], expected.series[i],
+							"series with encoded arrays is correct");
+		identical = identical
+					&& are_arrays_identical(&new, new.series + i,
+											expected.series + i);
+	}
+	assert_true(identical, "encoded arrays are decoded bit by bit");
+	adf_free(&new);
+
+	assert_true(unmarshal_parallel(&new, bytes, size, 2) == ADF_OK
+				&& are_arrays_identical(&new, new.series + 1,
+										expected.series + 1),
+				"encoded arrays are decoded in parallel");
+	adf_free(&new);
+
+	/* the last byte of the encoded arrays of the last series */
+	bytes[size - UINT_SMALL_T_SIZE - UINT_T_SIZE - 1] ^= 0xFF;
+	assert_true(unmarshal(&new, bytes) == ADF_SERIES_CORRUPTED,
+				"corrupted encoded arrays are detected");
+	assert_true(unmarshal_parallel(&new, bytes, size, 2)
+				== ADF_SERIES_CORRUPTED,
+				"corrupted encoded arrays are detected in parallel");
+	adf_free(&new);
+
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+}
+
+static bool are_all_series_within_precision(const adf_t *x, const adf_t *y)
+{
+	for (uint32_t i = 0; i < x->metadata.size_series.val; i++) {
+		if (!are_series_equal(x->series + i, y->series + i, y))
+			return false;
+	}
+	return true;
+}
+
+void quantized_arrays_within_precision(void)
+{
+	adf_t expected = get_object_with_precision_set(), new;
+	size_t raw_size = size_adf_t(&expected), size;
+	uint8_t *bytes;
+
+	/* quantization takes precedence over the XOR codec */
+	expected.header.flags = ADF_FLAG_QUANTIZED_ARRAYS | ADF_FLAG_XOR_ARRAYS;
+	size = size_adf_t(&expected);
+	bytes = adf_bytes_alloc(&expected);
+	assert_true(marshal(bytes, &expected) == ADF_OK,
+				"an object with quantized arrays is marshalled");
+	assert_true(size < raw_size, "quantized arrays take less space");
+
+	assert_true(unmarshal(&new, bytes) == ADF_OK,
+				"an object with quantized arrays is unmarshalled");
+	assert_true(are_all_series_within_precision(&new, &expected),
+				"quantized arrays are decoded within their precision");
+	adf_free(&new);
+
+	assert_true(unmarshal_parallel(&new, bytes, size, 2) == ADF_OK
+				&& are_all_series_within_precision(&new, &expected),
+				"quantized arrays are decoded in parallel");
+	adf_free(&new);
+
+	bytes[size - UINT_SMALL_T_SIZE - UINT_T_SIZE - 1] ^= 0xFF;
+	assert_true(unmarshal(&new, bytes) == ADF_SERIES_CORRUPTED,
+				"corrupted quantized arrays are detected");
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+
+	/* without a precision, the values are within EPSILON */
+	expected = get_default_object();
+	expected.header.flags = ADF_FLAG_QUANTIZED_ARRAYS;
+	bytes = adf_bytes_alloc(&expected);
+	marshal(bytes, &expected);
+	assert_true(unmarshal(&new, bytes) == ADF_OK
+				&& are_all_series_within_precision(&new, &expected),
+				"arrays without a precision are decoded within EPSILON");
+	adf_free(&new);
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+}
+
+/* The value `i` of an array with `n_columns` columns */
+typedef float (*array_value)(size_t i, size_t n_columns);
+
+static void fill_array(real_t *array, size_t n_chunks, size_t n_columns,
+					   array_value get_value)
+{
+	for (size_t i = 0; i < n_chunks * n_columns; i++)
+		array[i].val = get_value(i, n_columns);
+}
+
+/* An object whose arrays span several blocks of the LZ codec */
+static adf_t get_big_object_filled_by(array_value get_value)
+{
+	adf_header_t header = get_default_header();
+	uint32_t n_chunks = 1024;
+	uint16_t n_wave = header.wave_info.n_wavelength.val,
+			 n_depth = header.soil_info.n_depth.val;
+	series_t series;
+	adf_t adf;
+
+	header.n_chunks.val = n_chunks;
+	adf_init(&adf, header, 3600);
+	for (int k = 0; k < 3; k++) {
+		series = get_random_series(n_chunks, n_wave, n_depth);
+		fill_array(series.light_exposure, n_chunks, n_wave, get_value);
+		fill_array(series.soil_temp_c, n_chunks, n_depth, get_value);
+		fill_array(series.env_temp_c, n_chunks, 1, get_value);
+		fill_array(series.water_use_ml, n_chunks, 1, get_value);
+		add_series(&adf, &series);
+		series_free(&series);
+	}
+	return adf;
+}
+
+/* Only the first column changes, e.g. the light bands but one are dark */
+static float dark_columns(size_t i, size_t n_columns)
+{
+	return i % n_columns ? 0.0f : (float)(rand() % 400) / 4.0f;
+}
+
+/* Readings whose lowest bits are noise, as the ones of a sensor */
+static float noisy_readings(size_t i, size_t n_columns)
+{
+	(void)n_columns;
+	return 15.0f + (float)(i % 7) + (float)rand() / (float)RAND_MAX;
+}
+
+void lz_arrays_equal_to_object(void)
+{
+	adf_t expected = get_big_object_filled_by(&dark_columns), new;
+	size_t raw_size = size_adf_t(&expected), size;
+	uint8_t *bytes;
+	bool identical = true;
+
+	expected.header.flags = ADF_FLAG_LZ_ARRAYS;
+	size = size_adf_t(&expected);
+	bytes = adf_bytes_alloc(&expected);
+	assert_true(marshal(bytes, &expected) == ADF_OK,
+				"an object with compressed arrays is marshalled");
+	assert_true(size * 2 < raw_size,
+				"dark light bands take less than half of the space");
+
+	assert_true(unmarshal(&new, bytes) == ADF_OK,
+				"an object with compressed arrays is unmarshalled");
+	for (uint32_t i = 0; i < new.metadata.size_series.val; i++) {
+		identical = identical
+					&& are_arrays_identical(&new, new.series + i,
+											expected.series + i);
+	}
+	assert_true(identical, "compressed arrays are decompressed bit by bit");
+	adf_free(&new);
+
+	assert_true(unmarshal_parallel(&new, bytes, size, 2) == ADF_OK
+				&& are_arrays_identical(&new, new.series + 2,
+										expected.series + 2),
+				"compressed arrays are decompressed in parallel");
+	adf_free(&new);
+
+	/* the last byte of the compressed arrays of the last series */
+	bytes[size - UINT_SMALL_T_SIZE - UINT_T_SIZE - 1] ^= 0xFF;
+	assert_true(unmarshal(&new, bytes) == ADF_SERIES_CORRUPTED,
+				"corrupted compressed arrays are detected");
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+}
+
+void conflicting_codec_flags_are_rejected(void)
+{
+	adf_t adf = get_default_object(), new;
+	uint8_t conflicts[] = { ADF_FLAG_XOR_ARRAYS, ADF_FLAG_QUANTIZED_ARRAYS };
+	size_t size = size_adf_t(&adf), flags_at = size_header() - 3;
+	uint8_t *bytes = malloc(size);
+	adf_view_t view;
+	uint16_t crc;
+	bool rejected = true;
+
+	for (size_t k = 0; k < sizeof(conflicts); k++) {
+		adf.header.flags = ADF_FLAG_LZ_ARRAYS | conflicts[k];
+		rejected = rejected
+				   && marshal(bytes, &adf) == ADF_RUNTIME_ERROR
+				   && marshal_parallel(bytes, &adf, 2) == ADF_RUNTIME_ERROR;
+	}
+	assert_true(rejected, "the LZ codec can't be combined with the others");
+
+	/* a valid crc over flags that no marshal would write */
+	adf.header.flags = ADF_FLAG_LZ_ARRAYS;
+	marshal(bytes, &adf);
+	bytes[flags_at] |= ADF_FLAG_XOR_ARRAYS;
+	crc = crc16(bytes, size_header() - UINT_SMALL_T_SIZE);
+	bytes[size_header() - 2] = crc >> 8;
+	bytes[size_header() - 1] = crc & 0xFF;
+	assert_true(unmarshal(&new, bytes) == ADF_HEADER_CORRUPTED
+				&& adf_view_init(&view, bytes, size) == ADF_HEADER_CORRUPTED,
+				"a header with conflicting codecs is corrupted");
+
+	adf.header.flags = 0x20;
+	assert_true(marshal(bytes, &adf) == ADF_RUNTIME_ERROR,
+				"unknown flags are not marshalled");
+	adf.header.flags = 0;
+	marshal(bytes, &adf);
+	bytes[flags_at] = 0x80;
+	crc = crc16(bytes, size_header() - UINT_SMALL_T_SIZE);
+	bytes[size_header() - 2] = crc >> 8;
+	bytes[size_header() - 1] = crc & 0xFF;
+	assert_true(unmarshal(&new, bytes) == ADF_HEADER_CORRUPTED
+				&& adf_view_init(&view, bytes, size) == ADF_HEADER_CORRUPTED,
+				"a header with unknown flags is corrupted");
+
+	free(bytes);
+	adf_free(&adf);
+}
+
+static size_t marshalled_size(adf_t *adf, uint8_t flags)
+{
+	adf->header.flags = flags;
+	return size_adf_t(adf);
+}
+
+void shuffled_arrays_equal_to_object(void)
+{
+	adf_t expected = get_big_object_filled_by(&noisy_readings), new;
+	size_t raw_size = marshalled_size(&expected, 0),
+		   lz_size = marshalled_size(&expected, ADF_FLAG_LZ_ARRAYS),
+		   size = marshalled_size(&expected, ADF_FLAG_SHUFFLE_ARRAYS);
+	uint32_t n_series = expected.metadata.size_series.val;
+	uint8_t *bytes = adf_bytes_alloc(&expected);
+	bool identical = true;
+
+	assert_true(size == raw_size + n_series * UINT_T_SIZE,
+				"shuffled arrays keep their size");
+	assert_true(marshal(bytes, &expected) == ADF_OK
+				&& unmarshal(&new, bytes) == ADF_OK,
+				"an object with shuffled arrays is unmarshalled");
+	for (uint32_t i = 0; i < n_series; i++) {
+		identical = identical
+					&& are_arrays_identical(&new, new.series + i,
+											expected.series + i);
+	}
+	assert_true(identical, "shuffled arrays are unshuffled bit by bit");
+	adf_free(&new);
+	adf_bytes_free(bytes);
+
+	size = marshalled_size(&expected, ADF_FLAG_SHUFFLE_ARRAYS
+									  | ADF_FLAG_LZ_ARRAYS);
+	assert_true(size < lz_size,
+				"shuffled arrays compress better than the plain ones");
+	bytes = adf_bytes_alloc(&expected);
+	identical = true;
+	assert_true(marshal(bytes, &expected) == ADF_OK
+				&& unmarshal_parallel(&new, bytes, size, 2) == ADF_OK,
+				"an object with shuffled compressed arrays is unmarshalled");
+	for (uint32_t i = 0; i < n_series; i++) {
+		identical = identical
+					&& are_arrays_identical(&new, new.series + i,
+											expected.series + i);
+	}
+	assert_true(identical,
+				"shuffled compressed arrays are decompressed bit by bit");
+	adf_free(&new);
+	adf_bytes_free(bytes);
+	adf_free(&expected);
+}
+
+void additive_index_out_of_range_is_corrupted(void)
+{
+	adf_t serial, parallel;
+	size_t size;
+	uint8_t *bytes = get_bytes_with_additive_out_of_range(&size);
+
+	assert_true(unmarshal(&serial, bytes) == ADF_SERIES_CORRUPTED,
+				"additive index out of the codes is corrupted");
+	assert_true(unmarshal_parallel(&parallel, bytes, size, 2)
+				== ADF_SERIES_CORRUPTED,
+				"parallel reports the additive index out of the codes");
+	adf_free(&parallel);
+	free(bytes);
+}
+
+void oversized_series_count_is_corrupted(void)
+{
+	adf_t adf = get_default_object(), parallel;
+	size_t size = size_adf_t(&adf), meta_size;
+	uint8_t *bytes = adf_bytes_alloc(&adf), *meta;
+	uint16_t crc;
+
+	marshal(bytes, &adf);
+	/* size_series is the first field of the metadata */
+	meta = bytes + size_header();
+	meta_size = size_medatata_t(&adf.metadata) - UINT_SMALL_T_SIZE;
+	memset(meta, 0xFF, UINT_T_SIZE);
+	crc = crc16(meta, meta_size);
+	meta[meta_size] = crc >> 8;
+	meta[meta_size + 1] = crc & 0xFF;
+
+	assert_true(unmarshal_parallel(&parallel, bytes, size, 2)
+				== ADF_SERIES_CORRUPTED,
+				"series count beyond the byte array is corrupted");
+	adf_free(&parallel);
+
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
 int main(void)
 {
 	test_unmarshal_null_bytes();
 	test_unmarshal_null_adf();
 	unmarshaled_sample_file_equal_to_default_object();
+	unmarshaled_slab_equal_to_default_object();
+	unmarshaled_parallel_equal_to_serial();
+	parallel_errors_match_serial();
+	series_at_after_unmarshal();
+	additive_index_after_unmarshal();
+	unmarshalled_series_carry_their_fingerprint();
+	indexed_object_equal_to_default_object();
+	older_version_without_flags_is_read();
+	xor_arrays_equal_to_default_object();
+	quantized_arrays_within_precision();
+	lz_arrays_equal_to_object();
+	conflicting_codec_flags_are_rejected();
+	shuffled_arrays_equal_to_object();
+	additive_index_out_of_range_is_corrupted();
+	oversized_series_count_is_corrupted();
 }
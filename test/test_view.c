@@ -0,0 +1,316 @@
+/* test_view.c
+ * ------------------------------------------------------------------------
+ * ADF - Agriculture Data Format
+ * Copyright (C) 2024 Matteo Nicoli
+ *
+ * This file is part of Terius
+ *
+ * ADF is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ADF is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../src/adf.h"
+#include "mock.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool is_series_view_equal(const series_view_t *view,
+								 const series_t *series,
+								 const adf_header_t *header)
+{
+	uint32_t n_chunks = header->n_chunks.val;
+	uint16_t n_wave = header->wave_info.n_wavelength.val;
+	uint16_t n_depth = header->soil_info.n_depth.val;
+	additive_t additive;
+
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		for (uint16_t j = 0; j < n_wave; j++) {
+			if (series_view_light_exposure(view, i, j)
+				!= series->light_exposure[i * n_wave + j].val)
+				return false;
+		}
+		for (uint16_t j = 0; j < n_depth; j++) {
+			if (series_view_soil_temp_c(view, i, j)
+				!= series->soil_temp_c[i * n_depth + j].val)
+				return false;
+		}
+		if (series_view_env_temp_c(view, i) != series->env_temp_c[i].val
+			|| series_view_water_use_ml(view, i)
+			   != series->water_use_ml[i].val)
+			return false;
+	}
+	if (view->n_soil_adds.val != series->n_soil_adds.val
+		|| view->n_atm_adds.val != series->n_atm_adds.val)
+		return false;
+	for (uint16_t j = 0; j < view->n_soil_adds.val; j++) {
+		additive = series_view_soil_additive(view, j);
+		if (additive.code.val != series->soil_additives[j].code.val
+			|| additive.concentration.val
+			   != series->soil_additives[j].concentration.val)
+			return false;
+	}
+	return view->pH == series->pH
+		   && view->p_bar.val == series->p_bar.val
+		   && view->soil_density_kg_m3.val == series->soil_density_kg_m3.val
+		   && view->repeated.val == series->repeated.val;
+}
+
+void view_null_arguments(void)
+{
+	adf_view_t view;
+	uint8_t buffer[16] = { 0 };
+
+	assert_true(adf_view_init(NULL, buffer, 16) == ADF_RUNTIME_ERROR,
+				"adf_view_init returns error for NULL view");
+	assert_true(adf_view_init(&view, NULL, 16) == ADF_RUNTIME_ERROR,
+				"adf_view_init returns error for NULL bytes");
+}
+
+void view_equal_to_marshalled_object(void)
+{
+	adf_t adf = get_default_object();
+	adf_view_t view;
+	series_view_t series;
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+	size_t size = size_adf_t(&adf);
+	bool all_equal = true;
+
+	marshal(bytes, &adf);
+	assert_true(adf_view_init(&view, bytes, size) == ADF_OK,
+				"view over a marshalled object is valid");
+	assert_header_equal(view.header, adf.header, "view header is correct");
+	assert_true(view.metadata.size_series.val == adf.metadata.size_series.val
+				&& view.metadata.n_series == adf.metadata.n_series
+				&& view.metadata.period_sec.val == adf.metadata.period_sec.val,
+				"view metadata is correct");
+	assert_true(adf_view_additive_code(&view, 0)
+				== adf.metadata.additive_codes[0].val,
+				"view additive codes are correct");
+
+	for (uint32_t i = 0; i < adf.metadata.size_series.val; i++) {
+		all_equal = all_equal
+					&& adf_view_get_series(&view, &series, i) == ADF_OK
+					&& is_series_view_equal(&series, adf.series + i,
+											&adf.header);
+	}
+	assert_true(all_equal, "series read through the view are correct");
+	assert_true(adf_view_get_series(&view, &series,
+									adf.metadata.size_series.val)
+				== ADF_RUNTIME_ERROR,
+				"series index out of bound is rejected");
+
+	adf_view_free(&view);
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
+void view_detects_corruption(void)
+{
+	adf_t adf = get_default_object();
+	adf_view_t view;
+	series_view_t series;
+	uint8_t *bytes = adf_bytes_alloc(&adf);
+	size_t size = size_adf_t(&adf);
+
+	marshal(bytes, &adf);
+
+	bytes[5] ^= 0xFF;
+	assert_true(adf_view_init(&view, bytes, size) == ADF_HEADER_CORRUPTED,
+				"corrupted header is detected");
+	bytes[5] ^= 0xFF;
+
+	bytes[size_header() + 1] ^= 0xFF;
+	assert_true(adf_view_init(&view, bytes, size) == ADF_METADATA_CORRUPTED,
+				"corrupted metadata is detected");
+	bytes[size_header() + 1] ^= 0xFF;
+
+	assert_true(adf_view_init(&view, bytes, size - 1) == ADF_SERIES_CORRUPTED,
+				"truncated series are detected");
+
+	assert_true(adf_view_init(&view, bytes, size) == ADF_OK,
+				"restored bytes are valid");
+	bytes[view.series_offsets[1]] ^= 0xFF;
+	assert_true(adf_view_get_series(&view, &series, 1) == ADF_SERIES_CORRUPTED,
+				"corrupted series is detected on access");
+	assert_true(adf_view_get_series(&view, &series, 0) == ADF_OK,
+				"other series are still readable");
+	put_additive_out_of_range(bytes, size);
+	assert_true(adf_view_get_series(&view, &series, 0) == ADF_SERIES_CORRUPTED,
+				"additive index out of the codes is detected on access");
+
+	adf_view_free(&view);
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
+void read_series_at_with_and_without_index(void)
+{
+	adf_t adf = get_default_object();
+	uint8_t flags[] = { 0, ADF_FLAG_SERIES_INDEX };
+	uint64_t start, expected_start;
+	series_t series;
+	uint8_t *bytes;
+	size_t size;
+
+	for (size_t k = 0; k < sizeof(flags); k++) {
+		adf.header.flags = flags[k];
+		bytes = adf_bytes_alloc(&adf);
+		size = size_adf_t(&adf);
+		marshal(bytes, &adf);
+
+		expected_start = 0;
+		for (uint32_t i = 0; i < adf.metadata.size_series.val; i++) {
+			assert_true(adf_read_series_at(bytes, size, i, &series, &start)
+						== ADF_OK, "adf_read_series_at succeeds");
+			assert_series_equal(adf, series, adf.series[i],
+								"series read at its index is correct");
+			assert_true(start == expected_start,
+						"the start of the series is correct");
+			expected_start += adf.series[i].repeated.val;
+			series_free(&series);
+		}
+		assert_true(adf_read_series_at(bytes, size,
+									   adf.metadata.size_series.val,
+									   &series, NULL) == ADF_RUNTIME_ERROR,
+					"series index out of bound is rejected");
+		adf_bytes_free(bytes);
+	}
+	adf_free(&adf);
+}
+
+void read_series_at_time_equal_to_get_series_at(void)
+{
+	adf_t adf = get_default_object();
+	uint8_t flags[] = { 0, ADF_FLAG_SERIES_INDEX };
+	uint64_t period = adf.metadata.period_sec.val, last;
+	series_t series, expected;
+	bool all_equal = true;
+	uint8_t *bytes;
+	size_t size;
+
+	last = adf.metadata.n_series * period;
+	for (size_t k = 0; k < sizeof(flags); k++) {
+		adf.header.flags = flags[k];
+		bytes = adf_bytes_alloc(&adf);
+		size = size_adf_t(&adf);
+		marshal(bytes, &adf);
+
+		for (uint64_t time = 0; time <= last; time += period / 2) {
+			get_series_at(&adf, &expected, time);
+			all_equal = all_equal
+						&& adf_read_series_at_time(bytes, size, time,
+												   &series, NULL) == ADF_OK
+						&& are_series_equal(&series, &expected, &adf);
+			series_free(&series);
+		}
+		assert_true(all_equal, "series read at a time are correct");
+		assert_true(adf_read_series_at_time(bytes, size, last + 1, &series,
+											NULL) == ADF_TIME_OUT_OF_BOUND,
+					"time out of bound is rejected");
+		adf_bytes_free(bytes);
+	}
+	adf_free(&adf);
+}
+
+void additive_out_of_range_is_rejected(void)
+{
+	series_t series;
+	adf_view_t view;
+	size_t size;
+	uint8_t *bytes = get_bytes_with_additive_out_of_range(&size);
+
+	assert_true(adf_view_init(&view, bytes, size) == ADF_SERIES_CORRUPTED,
+				"view checks the additive indexes");
+	assert_true(adf_read_series_at(bytes, size, 0, &series, NULL)
+				== ADF_SERIES_CORRUPTED,
+				"series read at its index checks the additive indexes");
+	assert_true(adf_read_series_at_time(bytes, size, 0, &series, NULL)
+				== ADF_SERIES_CORRUPTED,
+				"series read at a time checks the additive indexes");
+	free(bytes);
+}
+
+void view_detects_corrupted_series_index(void)
+{
+	adf_t adf = get_default_object();
+	adf_view_t view;
+	uint8_t *bytes;
+	size_t size;
+
+	adf.header.flags = ADF_FLAG_SERIES_INDEX;
+	bytes = adf_bytes_alloc(&adf);
+	size = size_adf_t(&adf);
+	marshal(bytes, &adf);
+
+	assert_true(adf_view_init(&view, bytes, size) == ADF_OK,
+				"view over an indexed object is valid");
+	adf_view_free(&view);
+
+	/* the low byte of the offset of the last entry */
+	bytes[size - UINT_SMALL_T_SIZE - UINT_BIG_T_SIZE - 1] ^= 0xFF;
+	assert_true(adf_view_init(&view, bytes, size) == ADF_SERIES_CORRUPTED,
+				"corrupted series index is detected");
+	assert_true(adf_view_init(&view, bytes, size - 1) == ADF_SERIES_CORRUPTED,
+				"truncated series index is detected");
+
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
+void view_over_xor_arrays(void)
+{
+	adf_t adf = get_default_object();
+	adf_view_t view;
+	series_view_t series_view;
+	series_t series;
+	uint8_t *bytes;
+	size_t size;
+
+	adf.header.flags = ADF_FLAG_XOR_ARRAYS | ADF_FLAG_SERIES_INDEX;
+	bytes = adf_bytes_alloc(&adf);
+	size = size_adf_t(&adf);
+	marshal(bytes, &adf);
+
+	assert_true(adf_view_init(&view, bytes, size) == ADF_OK,
+				"view over encoded arrays is valid");
+	assert_true(adf_view_get_series(&view, &series_view, 1) == ADF_OK
+				&& !series_view.light_exposure
+				&& series_view.repeated.val == adf.series[1].repeated.val
+				&& series_view_soil_additive(&series_view, 0).code.val
+				   == adf.series[1].soil_additives[0].code.val,
+				"encoded arrays are not viewed, the other fields are");
+	adf_view_free(&view);
+
+	assert_true(adf_read_series_at(bytes, size, 1, &series, NULL) == ADF_OK,
+				"a series with encoded arrays is read at its index");
+	assert_series_equal(adf, series, adf.series[1],
+						"series with encoded arrays read at its index is correct");
+	series_free(&series);
+
+	adf_bytes_free(bytes);
+	adf_free(&adf);
+}
+
+int main(void)
+{
+	view_null_arguments();
+	view_equal_to_marshalled_object();
+	view_detects_corruption();
+	read_series_at_with_and_without_index();
+	read_series_at_time_equal_to_get_series_at();
+	additive_out_of_range_is_rejected();
+	view_detects_corrupted_series_index();
+	view_over_xor_arrays();
+}